@@ -41,9 +41,64 @@ base::Result<void> DnsBpfHelper::init() {
   RETURN_IF_RESULT_NOT_OK(mConfigurationMap.init(CONFIGURATION_MAP_PATH));
   RETURN_IF_RESULT_NOT_OK(mUidOwnerMap.init(UID_OWNER_MAP_PATH));
   RETURN_IF_RESULT_NOT_OK(mDataSaverEnabledMap.init(DATA_SAVER_ENABLED_MAP_PATH));
+
+  auto generationMap = bpf::BpfMmapArray<uint64_t>::Create(RULES_GENERATION_MAP_PATH);
+  if (generationMap.ok()) {
+    mRulesGenerationMap = std::move(generationMap.value());
+  } else {
+    LOG(INFO) << __func__ << ": Not caching, no rules generation map: "
+              << generationMap.error().message();
+  }
   return {};
 }
 
+void DnsBpfHelper::invalidateStaleCacheLocked() {
+  std::optional<uint64_t> generation;
+  if (mRulesGenerationMap) {
+    auto value = mRulesGenerationMap->readValue(RULES_GENERATION_KEY);
+    if (value.ok()) generation = value.value();
+  }
+  if (mCacheValid && generation == mCachedGeneration) return;
+
+  // The generation is read before the maps, and the writers change it after writing them, so
+  // anything read from the maps from now on is at least as recent as this generation.
+  mCacheValid = generation.has_value();
+  mCachedGeneration = generation.value_or(0);
+  mCachedEnabledRules.reset();
+  mCachedDataSaverEnabled.reset();
+  mCachedUidRules.clear();
+}
+
+base::Result<uint32_t> DnsBpfHelper::getEnabledRulesLocked() {
+  if (mCachedEnabledRules) return *mCachedEnabledRules;
+
+  auto enabledRules = mConfigurationMap.readValue(UID_RULES_CONFIGURATION_KEY);
+  RETURN_IF_RESULT_NOT_OK(enabledRules);
+  if (mCacheValid) mCachedEnabledRules = enabledRules.value();
+  return enabledRules.value();
+}
+
+uint32_t DnsBpfHelper::getUidRulesLocked(uid_t uid) {
+  if (auto it = mCachedUidRules.find(uid); it != mCachedUidRules.end()) return it->second;
+
+  auto value = mUidOwnerMap.readValue(uid);
+  uint32_t uidRules = value.ok() ? value.value().rule : 0;
+  if (mCacheValid) {
+    if (mCachedUidRules.size() >= kMaxCachedUids) mCachedUidRules.clear();
+    mCachedUidRules[uid] = uidRules;
+  }
+  return uidRules;
+}
+
+base::Result<bool> DnsBpfHelper::getDataSaverEnabledLocked() {
+  if (mCachedDataSaverEnabled) return *mCachedDataSaverEnabled;
+
+  auto dataSaverSetting = mDataSaverEnabledMap.readValue(DATA_SAVER_ENABLED_KEY);
+  RETURN_IF_RESULT_NOT_OK(dataSaverSetting);
+  if (mCacheValid) mCachedDataSaverEnabled = dataSaverSetting.value();
+  return dataSaverSetting.value();
+}
+
 base::Result<bool> DnsBpfHelper::isUidNetworkingBlocked(uid_t uid, bool metered) {
   if (is_system_uid(uid)) return false;
   if (!mConfigurationMap.isValid() || !mUidOwnerMap.isValid()) {
@@ -52,11 +107,39 @@ base::Result<bool> DnsBpfHelper::isUidNetworkingBlocked(uid_t uid, bool metered)
     return base::Error(EUNATCH);
   }
 
-  auto enabledRules = mConfigurationMap.readValue(UID_RULES_CONFIGURATION_KEY);
+  std::lock_guard guard(mCacheLock);
+  invalidateStaleCacheLocked();
+  return isUidNetworkingBlockedLocked(uid, metered);
+}
+
+base::Result<void> DnsBpfHelper::areUidsNetworkingBlocked(const uid_t* uids, size_t count,
+                                                          bool metered, bool* blocked) {
+  if (!mConfigurationMap.isValid() || !mUidOwnerMap.isValid()) {
+    LOG(ERROR) << __func__
+               << ": BPF maps are not ready. Forgot to call ADnsHelper_init?";
+    return base::Error(EUNATCH);
+  }
+
+  // One generation check for the whole batch.
+  std::lock_guard guard(mCacheLock);
+  invalidateStaleCacheLocked();
+  for (size_t i = 0; i < count; i++) {
+    if (is_system_uid(uids[i])) {
+      blocked[i] = false;
+      continue;
+    }
+    auto result = isUidNetworkingBlockedLocked(uids[i], metered);
+    if (!result.ok()) return result.error();
+    blocked[i] = result.value();
+  }
+  return {};
+}
+
+base::Result<bool> DnsBpfHelper::isUidNetworkingBlockedLocked(uid_t uid, bool metered) {
+  auto enabledRules = getEnabledRulesLocked();
   RETURN_IF_RESULT_NOT_OK(enabledRules);
 
-  auto value = mUidOwnerMap.readValue(uid);
-  uint32_t uidRules = value.ok() ? value.value().rule : 0;
+  uint32_t uidRules = getUidRulesLocked(uid);
 
   // For doze mode, battery saver, low power standby.
   if (isBlockedByUidRules(enabledRules.value(), uidRules)) return true;
@@ -74,7 +157,7 @@ base::Result<bool> DnsBpfHelper::isUidNetworkingBlocked(uid_t uid, bool metered)
     if (uidRules & PENALTY_BOX_MATCH) return true;
     if (uidRules & HAPPY_BOX_MATCH) return false;
 
-    auto dataSaverSetting = mDataSaverEnabledMap.readValue(DATA_SAVER_ENABLED_KEY);
+    auto dataSaverSetting = getDataSaverEnabledLocked();
     RETURN_IF_RESULT_NOT_OK(dataSaverSetting);
     return dataSaverSetting.value();
   }
@@ -17,8 +17,15 @@
 #pragma once
 
 #include <android-base/result.h>
+#include <android-base/thread_annotations.h>
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 
 #include "bpf/BpfMap.h"
+#include "bpf/BpfMmapArray.h"
 #include "netd.h"
 
 namespace android {
@@ -32,11 +39,34 @@ class DnsBpfHelper {
 
   base::Result<void> init();
   base::Result<bool> isUidNetworkingBlocked(uid_t uid, bool metered);
+  // Same as isUidNetworkingBlocked for each of count uids, storing the results in blocked.
+  base::Result<void> areUidsNetworkingBlocked(const uid_t* uids, size_t count, bool metered,
+                                              bool* blocked);
 
  private:
+  // Beyond this, the per-uid cache is emptied rather than grown.
+  static constexpr size_t kMaxCachedUids = 1024;
+
+  // Drops whatever was read from the maps if the rules generation changed since.
+  void invalidateStaleCacheLocked() REQUIRES(mCacheLock);
+  base::Result<bool> isUidNetworkingBlockedLocked(uid_t uid, bool metered) REQUIRES(mCacheLock);
+  base::Result<uint32_t> getEnabledRulesLocked() REQUIRES(mCacheLock);
+  uint32_t getUidRulesLocked(uid_t uid) REQUIRES(mCacheLock);
+  base::Result<bool> getDataSaverEnabledLocked() REQUIRES(mCacheLock);
+
   android::bpf::BpfMapRO<uint32_t, uint32_t> mConfigurationMap;
   android::bpf::BpfMapRO<uint32_t, UidOwnerValue> mUidOwnerMap;
   android::bpf::BpfMapRO<uint32_t, bool> mDataSaverEnabledMap;
+  // Missing on kernels before 5.5, in which case nothing is cached.
+  std::unique_ptr<android::bpf::BpfMmapArray<uint64_t>> mRulesGenerationMap;
+
+  // What was read from the maps while the rules generation was mCachedGeneration.
+  std::mutex mCacheLock;
+  bool mCacheValid GUARDED_BY(mCacheLock) = false;
+  uint64_t mCachedGeneration GUARDED_BY(mCacheLock) = 0;
+  std::optional<uint32_t> mCachedEnabledRules GUARDED_BY(mCacheLock);
+  std::optional<bool> mCachedDataSaverEnabled GUARDED_BY(mCacheLock);
+  std::unordered_map<uid_t, uint32_t> mCachedUidRules GUARDED_BY(mCacheLock);
 
   // For testing
   friend class DnsBpfHelperTest;
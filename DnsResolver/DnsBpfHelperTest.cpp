@@ -19,6 +19,7 @@
 
 #define BPF_MAP_MAKE_VISIBLE_FOR_TESTING
 #include "DnsBpfHelper.h"
+#include "bpf/KernelUtils.h"
 
 using namespace android::bpf;  // NOLINT(google-build-using-namespace): exempted
 
@@ -196,5 +197,67 @@ TEST_F(DnsBpfHelperTest, IsUidNetworkingBlocked_metered) {
   }
 }
 
+TEST_F(DnsBpfHelperTest, IsUidNetworkingBlocked_cached) {
+  if (!isAtLeastKernelVersion(5, 5, 0)) GTEST_SKIP() << "BPF_F_MMAPABLE not supported below 5.5";
+
+  auto generationMap = BpfMmapArray<uint64_t>::CreateFromFd(
+      base::unique_fd(createMap(BPF_MAP_TYPE_ARRAY, sizeof(uint32_t), sizeof(uint64_t),
+                                RULES_GENERATION_MAP_SIZE, BPF_F_MMAPABLE)),
+      /*writable=*/true);
+  ASSERT_RESULT_OK(generationMap);
+  BpfMmapArray<uint64_t>& generation = *generationMap.value();
+  mDnsBpfHelper.mRulesGenerationMap = std::move(generationMap.value());
+
+  EXPECT_RESULT_OK(mFakeConfigurationMap.writeValue(UID_RULES_CONFIGURATION_KEY, STANDBY_MATCH,
+                                                    BPF_EXIST));
+  EXPECT_RESULT_OK(mFakeUidOwnerMap.writeValue(AID_APP_START, {.iif = 0, .rule = STANDBY_MATCH},
+                                               BPF_ANY));
+  auto result = mDnsBpfHelper.isUidNetworkingBlocked(AID_APP_START, /*metered=*/false);
+  ASSERT_RESULT_OK(result);
+  EXPECT_TRUE(result.value());
+
+  // The verdict is cached until the generation changes.
+  EXPECT_RESULT_OK(mFakeUidOwnerMap.deleteValue(AID_APP_START));
+  result = mDnsBpfHelper.isUidNetworkingBlocked(AID_APP_START, /*metered=*/false);
+  ASSERT_RESULT_OK(result);
+  EXPECT_TRUE(result.value());
+
+  EXPECT_RESULT_OK(generation.writeValue(RULES_GENERATION_KEY, 1));
+  result = mDnsBpfHelper.isUidNetworkingBlocked(AID_APP_START, /*metered=*/false);
+  ASSERT_RESULT_OK(result);
+  EXPECT_FALSE(result.value());
+
+  // So are the global settings.
+  EXPECT_RESULT_OK(mFakeUidOwnerMap.writeValue(AID_APP_START, {.iif = 0, .rule = STANDBY_MATCH},
+                                               BPF_ANY));
+  EXPECT_RESULT_OK(mFakeConfigurationMap.writeValue(UID_RULES_CONFIGURATION_KEY, NO_MATCH,
+                                                    BPF_EXIST));
+  EXPECT_RESULT_OK(generation.writeValue(RULES_GENERATION_KEY, 2));
+  result = mDnsBpfHelper.isUidNetworkingBlocked(AID_APP_START, /*metered=*/false);
+  ASSERT_RESULT_OK(result);
+  EXPECT_FALSE(result.value());
+}
+
+TEST_F(DnsBpfHelperTest, AreUidsNetworkingBlocked) {
+  const uid_t uids[] = {AID_SYSTEM, AID_APP_START, AID_APP_START + 1};
+  bool blocked[] = {true, false, true};
+
+  EXPECT_RESULT_OK(mFakeConfigurationMap.writeValue(UID_RULES_CONFIGURATION_KEY, STANDBY_MATCH,
+                                                    BPF_EXIST));
+  EXPECT_RESULT_OK(mFakeUidOwnerMap.writeValue(AID_APP_START, {.iif = 0, .rule = STANDBY_MATCH},
+                                               BPF_ANY));
+  ASSERT_RESULT_OK(mDnsBpfHelper.areUidsNetworkingBlocked(uids, std::size(uids),
+                                                          /*metered=*/false, blocked));
+  EXPECT_FALSE(blocked[0]);
+  EXPECT_TRUE(blocked[1]);
+  EXPECT_FALSE(blocked[2]);
+
+  ResetAllMaps();
+  auto result = mDnsBpfHelper.areUidsNetworkingBlocked(uids, std::size(uids), /*metered=*/false,
+                                                       blocked);
+  EXPECT_FALSE(result.ok());
+  EXPECT_EQ(EUNATCH, result.error().code());
+}
+
 }  // namespace net
 }  // namespace android
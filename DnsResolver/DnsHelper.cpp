@@ -35,3 +35,11 @@ int ADnsHelper_isUidNetworkingBlocked(uid_t uid, bool metered) {
   // bool -> int conversion.
   return result.value();
 }
+
+int ADnsHelper_areUidsNetworkingBlocked(const uid_t* uids, size_t count, bool metered,
+                                        bool* blocked) {
+  auto result = sDnsBpfHelper.areUidsNetworkingBlocked(uids, count, metered, blocked);
+  if (!result.ok()) return -result.error().code();
+
+  return 0;
+}
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <sys/cdefs.h>
 #include <sys/types.h>
 
@@ -43,4 +45,19 @@ int ADnsHelper_init();
  */
 int ADnsHelper_isUidNetworkingBlocked(uid_t uid, bool metered);
 
+/*
+ * Same as ADnsHelper_isUidNetworkingBlocked, for |count| uids at once. Cheaper than calling it for
+ * each uid, e.g. to filter the waiters of a cached DNS answer.
+ *
+ * |uids| is an array of |count| Linux/Android UIDs to be queried.
+ * |metered| indicates whether the uids are currently using a billing network.
+ * |blocked| is an array of |count| results, set to whether each uid has blocked networking.
+ *
+ * Returns 0 on success, -EUNATCH when the ADnsHelper_init is not called before calling this
+ * function. Returns a negative POSIX error code (see errno.h) on other failures that return from
+ * bpf syscall, in which case the contents of |blocked| are unspecified.
+ */
+int ADnsHelper_areUidsNetworkingBlocked(const uid_t* uids, size_t count, bool metered,
+                                        bool* blocked);
+
 __END_DECLS
@@ -18,6 +18,7 @@ package com.android.networkstack.tethering;
 
 import static com.android.networkstack.tethering.util.TetheringUtils.getTetheringJniLibraryName;
 
+import static org.junit.Assert.assertArrayEquals;
 import static org.junit.Assert.assertEquals;
 import static org.junit.Assert.assertFalse;
 import static org.junit.Assert.assertNotNull;
@@ -100,4 +101,42 @@ public final class BpfBitmapTest {
         mTestBitmap.clear();
         assertTrue(mTestBitmap.isEmpty());
     }
+
+    @Test
+    public void testSetRange() throws Exception {
+        // The test bitmap is two words long.
+        mTestBitmap.setRange(10, 120, true);
+        mTestBitmap.setRange(20, 100, false);
+        assertFalse(mTestBitmap.get(9));
+        for (int i = 10; i < 20; ++i) assertTrue(mTestBitmap.get(i));
+        for (int i = 20; i <= 100; ++i) assertFalse(mTestBitmap.get(i));
+        for (int i = 101; i <= 120; ++i) assertTrue(mTestBitmap.get(i));
+        assertFalse(mTestBitmap.get(121));
+
+        // Whole words.
+        mTestBitmap.setRange(0, 127, false);
+        assertTrue(mTestBitmap.isEmpty());
+        mTestBitmap.setRange(64, 127, true);
+        assertFalse(mTestBitmap.get(63));
+        assertEquals(64, mTestBitmap.getAllSet().length);
+    }
+
+    @Test
+    public void testSetIndices() throws Exception {
+        mTestBitmap.set(new int[] {72, 0, 63, 6, 64, 1, 2, 63}, true);
+        assertArrayEquals(mTestData, mTestBitmap.getAllSet());
+
+        mTestBitmap.set(new int[] {63, 0}, false);
+        assertArrayEquals(new int[] {1, 2, 6, 64, 72}, mTestBitmap.getAllSet());
+
+        mTestBitmap.set(new int[] {}, true);
+        assertArrayEquals(new int[] {1, 2, 6, 64, 72}, mTestBitmap.getAllSet());
+    }
+
+    @Test
+    public void testGetAllSet() throws Exception {
+        assertArrayEquals(new int[0], mTestBitmap.getAllSet());
+        for (int i : mTestData) mTestBitmap.set(i);
+        assertArrayEquals(mTestData, mTestBitmap.getAllSet());
+    }
 }
@@ -45,6 +45,7 @@ import org.junit.runner.RunWith;
 
 import java.io.File;
 import java.net.InetAddress;
+import java.util.List;
 import java.util.NoSuchElementException;
 import java.util.concurrent.atomic.AtomicInteger;
 
@@ -356,6 +357,69 @@ public final class BpfMapTest {
         assertTrue(mTestMap.isEmpty());
     }
 
+    @Test
+    public void testUpdateEntries() throws Exception {
+        // Updating no entries is a no-op.
+        mTestMap.updateEntries(new ArrayMap<>());
+        assertTrue(mTestMap.isEmpty());
+
+        mTestMap.updateEntries(mTestData);
+        for (int i = 0; i < mTestData.size(); i++) {
+            assertEquals(mTestData.valueAt(i), mTestMap.getValue(mTestData.keyAt(i)));
+        }
+
+        // Existing entries are replaced.
+        final ArrayMap<TetherDownstream6Key, Tether6Value> newData = new ArrayMap<>();
+        final Tether6Value newValue = createTether6Value(44, "00:00:00:00:00:1a",
+                "44:44:44:00:00:1b", ETH_P_IPV6, 1280);
+        newData.put(mTestData.keyAt(0), newValue);
+        mTestMap.updateEntries(newData);
+        assertEquals(newValue, mTestMap.getValue(mTestData.keyAt(0)));
+        assertEquals(mTestData.valueAt(1), mTestMap.getValue(mTestData.keyAt(1)));
+    }
+
+    @Test
+    public void testDeleteEntries() throws Exception {
+        for (int i = 0; i < mTestData.size(); i++) {
+            mTestMap.insertEntry(mTestData.keyAt(i), mTestData.valueAt(i));
+        }
+
+        // Delete a missing key between two existing ones: it is skipped.
+        final TetherDownstream6Key missingKey =
+                createTetherDownstream6Key(104, "00:00:00:00:00:dd", "2001:db8::4");
+        assertEquals(2, mTestMap.deleteEntries(
+                List.of(mTestData.keyAt(0), missingKey, mTestData.keyAt(1))));
+        assertFalse(mTestMap.containsKey(mTestData.keyAt(0)));
+        assertFalse(mTestMap.containsKey(mTestData.keyAt(1)));
+        assertTrue(mTestMap.containsKey(mTestData.keyAt(2)));
+
+        assertEquals(0, mTestMap.deleteEntries(List.of(mTestData.keyAt(0))));
+        assertEquals(1, mTestMap.deleteEntries(List.of(mTestData.keyAt(2))));
+        assertTrue(mTestMap.isEmpty());
+    }
+
+    @Test
+    public void testIterateFullMap() throws Exception {
+        final ArrayMap<TetherDownstream6Key, Tether6Value> resultMap = new ArrayMap<>();
+        for (int i = 1; i <= TEST_MAP_SIZE; i++) {
+            resultMap.put(
+                    createTetherDownstream6Key(i, "00:00:00:00:00:01", "2001:db8::1"),
+                    createTether6Value(100, "de:ad:be:ef:00:01", "de:ad:be:ef:00:02",
+                    ETH_P_IPV6, 1500));
+        }
+        mTestMap.updateEntries(resultMap);
+
+        mTestMap.forEach((key, value) -> {
+            if (!value.equals(resultMap.remove(key))) {
+                fail("Unexpected result: " + key + ", value: " + value);
+            }
+        });
+        assertTrue(resultMap.isEmpty());
+
+        mTestMap.clear();
+        assertTrue(mTestMap.isEmpty());
+    }
+
     @Test
     public void testInsertOverflow() throws Exception {
         final ArrayMap<TetherDownstream6Key, Tether6Value> testData =
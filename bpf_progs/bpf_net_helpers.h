@@ -63,6 +63,7 @@ static int (*bpf_l4_csum_replace)(struct __sk_buff* skb, __u32 offset, __u64 fro
 static int (*bpf_redirect)(__u32 ifindex, __u64 flags) = (void*)BPF_FUNC_redirect;
 static int (*bpf_redirect_map)(const struct bpf_map_def* map, __u32 key,
                                __u64 flags) = (void*)BPF_FUNC_redirect_map;
+static int (*bpf_xdp_adjust_head)(struct xdp_md* ctx, int delta) = (void*)BPF_FUNC_xdp_adjust_head;
 
 static int (*bpf_skb_change_head)(struct __sk_buff* skb, __u32 head_room,
                                   __u64 flags) = (void*)BPF_FUNC_skb_change_head;
@@ -17,6 +17,8 @@
 #include <linux/bpf.h>
 #include <linux/if.h>
 #include <linux/if_ether.h>
+#include <linux/icmp.h>
+#include <linux/icmpv6.h>
 #include <linux/in.h>
 #include <linux/in6.h>
 #include <linux/ip.h>
@@ -54,6 +56,83 @@ struct frag_hdr {
 
 DEFINE_BPF_MAP_GRW(clat_ingress6_map, HASH, ClatIngress6Key, ClatIngress6Value, 16, AID_SYSTEM)
 
+// ----- Clat Error Counters -----
+
+// Only written by bpf code and only read by userspace, see the tether_error_map comment
+// in offload.c regarding pre-T kernel bugs with non-zero offset writes to bpf map ARRAYs.
+DEFINE_BPF_MAP_RO(clat_error_map, ARRAY, uint32_t, uint32_t, BPF_CLAT_ERR__MAX, AID_SYSTEM)
+
+#define COUNT_AND_RETURN(counter, ret) do {                   \
+    uint32_t code = BPF_CLAT_ERR_ ## counter;                 \
+    uint32_t *count = bpf_clat_error_map_lookup_elem(&code);  \
+    if (count) __sync_fetch_and_add(count, 1);                \
+    return ret;                                               \
+} while(0)
+
+#define TC_DROP(counter) COUNT_AND_RETURN(counter, TC_ACT_SHOT)
+#define TC_PUNT(counter) COUNT_AND_RETURN(counter, TC_ACT_PIPE)
+
+// Mark ingress non-offloaded clat packet for dropping in ip6tables bw_raw_PREROUTING.
+// Non-offloaded clat packet is going to be handled by clat daemon and ip6tables. The
+// duplicate one in ip6tables is not necessary.
+#define TC_PUNT_MARKED(counter) do { \
+    skb->mark = CLAT_MARK;           \
+    TC_PUNT(counter);                \
+} while(0)
+
+// Returns the ICMP type/code an ICMPv6 message translates to (type in the high byte),
+// or 0 if it should be left to clatd.  Matches icmp6_to_icmp_type/code() in clatd.
+static inline __always_inline __u16 icmp6_to_icmp_type_code(const struct icmp6hdr* icmp6) {
+    switch (icmp6->icmp6_type) {
+        case ICMPV6_ECHO_REQUEST:
+            return (ICMP_ECHO << 8) | icmp6->icmp6_code;
+        case ICMPV6_ECHO_REPLY:
+            return (ICMP_ECHOREPLY << 8) | icmp6->icmp6_code;
+        case ICMPV6_TIME_EXCEED:
+            return (ICMP_TIME_EXCEEDED << 8) | icmp6->icmp6_code;
+        case ICMPV6_DEST_UNREACH:
+            switch (icmp6->icmp6_code) {
+                case ICMPV6_NOROUTE:
+                case ICMPV6_NOT_NEIGHBOUR:
+                case ICMPV6_ADDR_UNREACH:
+                    return (ICMP_DEST_UNREACH << 8) | ICMP_HOST_UNREACH;
+                case ICMPV6_ADM_PROHIBITED:
+                    return (ICMP_DEST_UNREACH << 8) | ICMP_HOST_ANO;
+                case ICMPV6_PORT_UNREACH:
+                    return (ICMP_DEST_UNREACH << 8) | ICMP_PORT_UNREACH;
+            }
+    }
+    return 0;
+}
+
+static inline __always_inline __sum16 ipv4_hdr_csum(const struct iphdr* ip) {
+    __wsum sum4 = 0;
+    for (int i = 0; i < sizeof(*ip) / sizeof(__u16); ++i) {
+        sum4 += ((__u16*)ip)[i];
+    }
+    // Note that sum4 is guaranteed to be non-zero by virtue of ip->version == 4
+    sum4 = (sum4 & 0xFFFF) + (sum4 >> 16);  // collapse u32 into range 1 .. 0x1FFFE
+    sum4 = (sum4 & 0xFFFF) + (sum4 >> 16);  // collapse any potential carry into u16
+    return (__u16)~sum4;                    // sum4 cannot be zero, so this is never 0xFFFF
+}
+
+// The parts of an ICMPv6 message which get rewritten during translation, preceded by
+// the IPv6 pseudo-header (which, unlike for TCP/UDP, is not neutralized by the choice
+// of clat address, since ICMP has no pseudo-header at all).  Laid out for bpf_csum_diff().
+struct icmp6_csum_old {
+    struct in6_addr saddr;
+    struct in6_addr daddr;
+    __be32 len;
+    __be32 nexthdr;
+    struct icmp6hdr icmp6;   // with zero checksum
+    struct ipv6hdr inner6;   // iff ICMPv6 error
+};
+
+struct icmp4_csum_new {
+    struct icmphdr icmp;     // with zero checksum
+    struct iphdr inner4;     // iff ICMP error
+};
+
 static inline __always_inline int nat64(struct __sk_buff* skb,
                                         const struct rawip_bool rawip,
                                         const struct kver_uint kver) {
@@ -117,11 +196,11 @@ static inline __always_inline int nat64(struct __sk_buff* skb,
 
     if (proto == IPPROTO_FRAGMENT) {
         // Fragment handling requires bpf_skb_adjust_room which is 4.14+
-        if (!KVER_IS_AT_LEAST(kver, 4, 14, 0)) return TC_ACT_PIPE;
+        if (!KVER_IS_AT_LEAST(kver, 4, 14, 0)) TC_PUNT(FRAG_UNSUPPORTED_KVER);
 
         // Must have (ethernet and) ipv6 header and ipv6 fragment extension header
         if (data + l2_header_size + sizeof(*ip6) + sizeof(struct frag_hdr) > data_end)
-            return TC_ACT_PIPE;
+            TC_PUNT(SHORT_FRAG_HEADER);
         const struct frag_hdr *frag = (const struct frag_hdr *)(ip6 + 1);
         proto = frag->nexthdr;
         // RFC6145: use bottom 16-bits of network endian 32-bit IPv6 ID field for 16-bit IPv4 field.
@@ -136,9 +215,14 @@ static inline __always_inline int nat64(struct __sk_buff* skb,
         // Note that by construction tot_len is guaranteed to not underflow here
         tot_len -= sizeof(struct frag_hdr);
         // This is a badly formed IPv6 packet with less payload than the size of an IPv6 Frag EH
-        if (tot_len < sizeof(struct iphdr)) return TC_ACT_PIPE;
+        if (tot_len < sizeof(struct iphdr)) TC_PUNT(TRUNCATED_FRAG);
     }
 
+    // The (new) ICMP header, and for ICMP errors the IPv4 header of the embedded packet,
+    // which will overwrite the start of the ICMPv6 message once the outer header is translated.
+    struct icmp4_csum_new icmp4 = {};  // used iff proto == IPPROTO_ICMPV6
+    bool is_icmp_error = false;
+
     switch (proto) {
         case IPPROTO_TCP:      // For TCP, UDP & UDPLITE the checksum neutrality of the chosen
         case IPPROTO_UDP:      // IPv6 address means there is no need to update their checksums.
@@ -147,12 +231,100 @@ static inline __always_inline int nat64(struct __sk_buff* skb,
         case IPPROTO_ESP:      // since there is never a checksum to update.
             break;
 
+        case IPPROTO_ICMPV6: {
+            // The ICMPv6 checksum covers the IPv6 pseudo-header, so it has to be recomputed,
+            // which we can only do incrementally if we have the entire ICMPv6 message.
+            if (frag_off != htons(IP_DF)) TC_PUNT_MARKED(ICMP_FRAGMENT);
+
+            if (data + l2_header_size + sizeof(*ip6) + sizeof(struct icmp6hdr) > data_end)
+                TC_PUNT_MARKED(SHORT_ICMP_HEADER);
+            const struct icmp6hdr* icmp6 = (const struct icmp6hdr*)(ip6 + 1);
+
+            const __u16 type_code = icmp6_to_icmp_type_code(icmp6);
+            if (!type_code) {
+                if (icmp6->icmp6_type == ICMPV6_DEST_UNREACH) TC_PUNT_MARKED(ICMP_UNSUPPORTED_CODE);
+                TC_PUNT_MARKED(ICMP_UNSUPPORTED_TYPE);
+            }
+            is_icmp_error = icmp6->icmp6_type < 128;  // RFC 4443 section 2.1
+
+            struct icmp6_csum_old old = {
+                    .saddr = ip6->saddr,
+                    .daddr = ip6->daddr,
+                    .len = htonl(ntohs(ip6->payload_len)),
+                    .nexthdr = htonl(IPPROTO_ICMPV6),
+                    .icmp6 = *icmp6,
+            };
+            old.icmp6.icmp6_cksum = 0;
+
+            icmp4.icmp.type = type_code >> 8;
+            icmp4.icmp.code = type_code & 0xFF;
+            // Echo identifier and sequence number, everything else has no (used) 32-bit field.
+            if (!is_icmp_error) icmp4.icmp.un.gateway = icmp6->icmp6_dataun.un_data32[0];
+
+            // Seed with the ICMPv6 checksum, then subtract out the pseudo-header & old header
+            // sums, and add in the new header sums: what remains is the unchanged payload.
+            __wsum csum = (__u16)~icmp6->icmp6_cksum;
+
+            if (is_icmp_error) {
+                // Shrinking the embedded IPv6 header requires bpf_skb_adjust_room which is 4.14+
+                if (!KVER_IS_AT_LEAST(kver, 4, 14, 0)) TC_PUNT_MARKED(ICMP_ERROR_UNSUPPORTED_KVER);
+
+                if (data + l2_header_size + sizeof(*ip6) + sizeof(struct icmp6hdr) +
+                        sizeof(struct ipv6hdr) > data_end)
+                    TC_PUNT_MARKED(SHORT_ICMP_ERROR);
+                const struct ipv6hdr* inner6 = (const struct ipv6hdr*)(icmp6 + 1);
+
+                // The offending packet must be one we translated, ie. sent from our clat
+                // address to the nat64 prefix, and its transport checksum must (thanks to the
+                // checksum neutral address) not need any update.
+                if (inner6->version != 6 ||
+                    inner6->saddr.in6_u.u6_addr32[0] != k.local6.in6_u.u6_addr32[0] ||
+                    inner6->saddr.in6_u.u6_addr32[1] != k.local6.in6_u.u6_addr32[1] ||
+                    inner6->saddr.in6_u.u6_addr32[2] != k.local6.in6_u.u6_addr32[2] ||
+                    inner6->saddr.in6_u.u6_addr32[3] != k.local6.in6_u.u6_addr32[3] ||
+                    inner6->daddr.in6_u.u6_addr32[0] != k.pfx96.in6_u.u6_addr32[0] ||
+                    inner6->daddr.in6_u.u6_addr32[1] != k.pfx96.in6_u.u6_addr32[1] ||
+                    inner6->daddr.in6_u.u6_addr32[2] != k.pfx96.in6_u.u6_addr32[2])
+                    TC_PUNT_MARKED(ICMP_ERROR_INNER_MISMATCH);
+                if (inner6->nexthdr != IPPROTO_TCP && inner6->nexthdr != IPPROTO_UDP)
+                    TC_PUNT_MARKED(ICMP_ERROR_INNER_PROTO);
+                if (ntohs(inner6->payload_len) > 0xFFFF - sizeof(struct iphdr))
+                    TC_PUNT_MARKED(ICMP_ERROR_INNER_TOO_BIG);
+
+                old.inner6 = *inner6;
+                icmp4.inner4 = (struct iphdr){
+                        .version = 4,
+                        .ihl = sizeof(struct iphdr) / sizeof(__u32),
+                        .tos = (inner6->priority << 4) + (inner6->flow_lbl[0] >> 4),
+                        .tot_len = htons(ntohs(inner6->payload_len) + sizeof(struct iphdr)),
+                        .id = 0,
+                        .frag_off = htons(IP_DF),
+                        .ttl = inner6->hop_limit,
+                        .protocol = inner6->nexthdr,
+                        .check = 0,
+                        .saddr = v->local4.s_addr,
+                        .daddr = inner6->daddr.in6_u.u6_addr32[3],
+                };
+                icmp4.inner4.check = ipv4_hdr_csum(&icmp4.inner4);
+
+                csum = bpf_csum_diff((__be32*)&old, sizeof(old),
+                                     (__be32*)&icmp4, sizeof(icmp4), csum);
+
+                // The outer IPv4 packet shrinks along with the embedded header.
+                tot_len -= sizeof(struct ipv6hdr) - sizeof(struct iphdr);
+            } else {
+                csum = bpf_csum_diff((__be32*)&old, offsetof(struct icmp6_csum_old, inner6),
+                                     (__be32*)&icmp4.icmp, sizeof(icmp4.icmp), csum);
+            }
+            csum = (csum & 0xFFFF) + (csum >> 16);
+            csum = (csum & 0xFFFF) + (csum >> 16);
+            icmp4.icmp.checksum = (__u16)~csum;
+            proto = IPPROTO_ICMP;
+            break;
+        }
+
         default:  // do not know how to handle anything else
-            // Mark ingress non-offloaded clat packet for dropping in ip6tables bw_raw_PREROUTING.
-            // Non-offloaded clat packet is going to be handled by clat daemon and ip6tables. The
-            // duplicate one in ip6tables is not necessary.
-            skb->mark = CLAT_MARK;
-            return TC_ACT_PIPE;
+            TC_PUNT_MARKED(UNSUPPORTED_PROTO);
     }
 
     struct ethhdr eth2;  // used iff is_ethernet
@@ -197,13 +369,7 @@ static inline __always_inline int nat64(struct __sk_buff* skb,
 
     // Packet mutations begin - point of no return, but if this first modification fails
     // the packet is probably still pristine, so let clatd handle it.
-    if (bpf_skb_change_proto(skb, htons(ETH_P_IP), 0)) {
-        // Mark ingress non-offloaded clat packet for dropping in ip6tables bw_raw_PREROUTING.
-        // Non-offloaded clat packet is going to be handled by clat daemon and ip6tables. The
-        // duplicate one in ip6tables is not necessary.
-        skb->mark = CLAT_MARK;
-        return TC_ACT_PIPE;
-    }
+    if (bpf_skb_change_proto(skb, htons(ETH_P_IP), 0)) TC_PUNT_MARKED(CHANGE_PROTO_FAILED);
 
     // This takes care of updating the skb->csum field for a CHECKSUM_COMPLETE packet.
     //
@@ -239,7 +405,19 @@ static inline __always_inline int nat64(struct __sk_buff* skb,
         // If we're converting an IPv6 Fragment, we need to trim off 8 more bytes
         // We're beyond recovery on error here... but hard to imagine how this could fail.
         if (bpf_skb_adjust_room(skb, -(__s32)sizeof(struct frag_hdr), BPF_ADJ_ROOM_NET, /*flags*/0))
-            return TC_ACT_SHOT;
+            TC_DROP(ADJUST_ROOM_FAILED);
+    }
+
+    // Same reasoning as above: the kver check makes sure bpf_skb_adjust_room() is not emitted
+    // for 4.9, even though is_icmp_error already implies 4.14+.
+    //
+    // This removes the first 20 bytes of the ICMPv6 message, after which the remaining
+    // 8 + 40 - 20 = 28 bytes of ICMPv6 and embedded IPv6 headers are exactly the space
+    // which the ICMP and embedded IPv4 headers will be written to below.
+    if (KVER_IS_AT_LEAST(kver, 4, 14, 0) && is_icmp_error) {
+        if (bpf_skb_adjust_room(skb, -(__s32)(sizeof(struct ipv6hdr) - sizeof(struct iphdr)),
+                                BPF_ADJ_ROOM_NET, /*flags*/0))
+            TC_DROP(ADJUST_ROOM_FAILED);
     }
 
     try_make_writable(skb, l2_header_size + sizeof(struct iphdr));
@@ -265,6 +443,18 @@ static inline __always_inline int nat64(struct __sk_buff* skb,
         *(struct iphdr*)data = ip;
     }
 
+    // Overwrite the ICMPv6 header (and embedded IPv6 header) with their translated versions.
+    // BPF_F_RECOMPUTE_CSUM keeps skb->csum up to date for a CHECKSUM_COMPLETE packet.
+    if (ip.protocol == IPPROTO_ICMP) {
+        const __u32 l4_offset = l2_header_size + sizeof(struct iphdr);
+        const int ret = is_icmp_error
+                ? bpf_skb_store_bytes(skb, l4_offset, &icmp4, sizeof(icmp4),
+                                      BPF_F_RECOMPUTE_CSUM)
+                : bpf_skb_store_bytes(skb, l4_offset, &icmp4.icmp, sizeof(icmp4.icmp),
+                                      BPF_F_RECOMPUTE_CSUM);
+        if (ret) TC_DROP(STORE_BYTES_FAILED);
+    }
+
     // Redirect, possibly back to same interface, so tcpdump sees packet twice.
     if (v->oif) return bpf_redirect(v->oif, BPF_F_INGRESS);
 
@@ -22,6 +22,39 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+// Reasons for which the ingress6 clat program punts a packet, which matched a clat
+// ingress rule, to the clatd daemon (or drops it), rather than translating it in bpf.
+#define BPF_CLAT_ERRORS                  \
+    ERR(FRAG_UNSUPPORTED_KVER)           \
+    ERR(SHORT_FRAG_HEADER)               \
+    ERR(TRUNCATED_FRAG)                  \
+    ERR(UNSUPPORTED_PROTO)               \
+    ERR(ICMP_FRAGMENT)                   \
+    ERR(SHORT_ICMP_HEADER)               \
+    ERR(ICMP_UNSUPPORTED_TYPE)           \
+    ERR(ICMP_UNSUPPORTED_CODE)           \
+    ERR(ICMP_ERROR_UNSUPPORTED_KVER)     \
+    ERR(SHORT_ICMP_ERROR)                \
+    ERR(ICMP_ERROR_INNER_MISMATCH)       \
+    ERR(ICMP_ERROR_INNER_PROTO)          \
+    ERR(ICMP_ERROR_INNER_TOO_BIG)        \
+    ERR(CHANGE_PROTO_FAILED)             \
+    ERR(ADJUST_ROOM_FAILED)              \
+    ERR(STORE_BYTES_FAILED)              \
+    ERR(_MAX)
+
+#define ERR(x) BPF_CLAT_ERR_ ##x,
+enum {
+    BPF_CLAT_ERRORS
+};
+#undef ERR
+
+#define ERR(x) #x,
+static const char *bpf_clat_errors[] = {
+    BPF_CLAT_ERRORS
+};
+#undef ERR
+
 // This header file is shared by eBPF kernel programs (C) and netd (C++) and
 // some of the maps are also accessed directly from Java mainline module code.
 //
@@ -57,4 +90,23 @@ typedef struct {
 } ClatEgress4Value;
 STRUCT_SIZE(ClatEgress4Value, 4 + 2 * 16 + 1 + 3);  // 40
 
+typedef struct {
+    uint32_t iif;            // The input interface index
+    struct in6_addr local6;  // The full 128-bits of the destination IPv6 address
+} ClatXsk6Key;
+STRUCT_SIZE(ClatXsk6Key, 4 + 16);  // 20
+
+typedef struct {
+    uint32_t xskIndex;  // The index of clatd's AF_XDP socket in clat_xsk_map
+} ClatXsk6Value;
+STRUCT_SIZE(ClatXsk6Value, 4);  // 4
+
+// The AF_XDP sockets clatd receives on, see clatd_xsk.c.
+#define CLAT_XSK_MAP_SIZE 16
+
+// clatd's UMEM frame size. Packets which do not fit in a frame (after the kernel's
+// XDP_PACKET_HEADROOM) are left to the packet socket.
+#define CLAT_XSK_FRAME_SIZE 4096
+#define CLAT_XSK_MAX_PACKET (CLAT_XSK_FRAME_SIZE - 256)
+
 #undef STRUCT_SIZE
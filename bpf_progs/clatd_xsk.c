@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/in.h>
+#include <linux/in6.h>
+#include <linux/ipv6.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// The resulting .o needs to load on the Android T bpfloader
+#define BPFLOADER_MIN_VER BPFLOADER_T_VERSION
+
+#include "bpf_helpers.h"
+#include "bpf_net_helpers.h"
+#include "clatd.h"
+
+// Steers the IPv6 packets for clatd's address on the native interface into clatd's AF_XDP
+// socket, so that they are translated straight out of its UMEM rather than copied through
+// the packet socket. This is a separate object from clatd.o, which must load on any kernel,
+// while XSKMAPs (and XDP generally) are only usable on newer ones. It is not critical:
+// clatd keeps reading from its packet socket whether or not this is in use.
+
+// Keyed by input interface and clatd's IPv6 address, just like the packet socket's filter.
+DEFINE_BPF_MAP_GRW(clat_xsk6_map, HASH, ClatXsk6Key, ClatXsk6Value, CLAT_XSK_MAP_SIZE,
+                   AID_SYSTEM)
+
+// Written by clatd itself, with the map fd it is given. Unlike the above this is not created on
+// older kernels, which do not know the map type. No BTF, since the kernel refuses it on XSKMAPs.
+DEFINE_BPF_MAP_BASE(clat_xsk_map, XSKMAP, sizeof(uint32_t), sizeof(uint32_t), CLAT_XSK_MAP_SIZE,
+                    AID_ROOT, AID_SYSTEM, 0660, DEFAULT_BPF_MAP_SELINUX_CONTEXT,
+                    DEFAULT_BPF_MAP_PIN_SUBDIR, PRIVATE, KVER_5_9, KVER_INF, BPFLOADER_MIN_VER,
+                    BPFLOADER_MAX_VER, LOAD_ON_ENG, LOAD_ON_USER, LOAD_ON_USERDEBUG)
+
+static inline __always_inline int do_xdp_clat_xsk(struct xdp_md *ctx,
+                                                  const struct rawip_bool rawip) {
+    const void* data = (void*)(long)ctx->data;
+    const void* data_end = (void*)(long)ctx->data_end;
+    const int l2_header_size = rawip.rawip ? 0 : sizeof(struct ethhdr);
+
+    if (!rawip.rawip) {
+        const struct ethhdr* eth = data;
+
+        // Make sure we actually have an ethernet header
+        if ((void*)(eth + 1) > data_end) return XDP_PASS;
+
+        if (eth->h_proto != htons(ETH_P_IPV6)) return XDP_PASS;
+    }
+
+    const struct ipv6hdr* ip6 = data + l2_header_size;
+
+    // Must have (ethernet and) ipv6 header
+    if ((void*)(ip6 + 1) > data_end) return XDP_PASS;
+
+    // IP version must be 6
+    if (ip6->version != 6) return XDP_PASS;
+
+    // clatd only binds its socket to the first rx queue, packets on any other queue go to
+    // the packet socket instead.
+    if (ctx->rx_queue_index) return XDP_PASS;
+
+    // A packet which does not fit in a UMEM frame would be dropped by the socket. This also
+    // catches GRO packets in generic XDP mode, which can only be handled by the packet socket.
+    if (data_end - data > CLAT_XSK_MAX_PACKET) return XDP_PASS;
+
+    ClatXsk6Key k = {
+            .iif = ctx->ingress_ifindex,
+            .local6 = ip6->daddr,
+    };
+
+    ClatXsk6Value* v = bpf_clat_xsk6_map_lookup_elem(&k);
+
+    if (!v) return XDP_PASS;
+
+    // Once the ethernet header is gone the packet can no longer be passed up the stack, so make
+    // sure clatd's socket is there first.
+    const uint32_t xsk_index = v->xskIndex;
+    if (!bpf_map_lookup_elem_unsafe(&clat_xsk_map, &xsk_index)) return XDP_PASS;
+
+    // clatd always gets the bare IPv6 packet, whatever the interface type.
+    if (l2_header_size && bpf_xdp_adjust_head(ctx, l2_header_size)) return XDP_PASS;
+
+    return bpf_redirect_map(&clat_xsk_map, xsk_index, 0);
+}
+
+DEFINE_BPF_PROG_KVER("xdp/clat_xsk_ether", AID_ROOT, AID_SYSTEM, xdp_clat_xsk_ether, KVER_5_9)
+(struct xdp_md *ctx) {
+    return do_xdp_clat_xsk(ctx, ETHER);
+}
+
+DEFINE_BPF_PROG_KVER("xdp/clat_xsk_rawip", AID_ROOT, AID_SYSTEM, xdp_clat_xsk_rawip, KVER_5_9)
+(struct xdp_md *ctx) {
+    return do_xdp_clat_xsk(ctx, RAWIP);
+}
+
+LICENSE("Apache 2.0");
+DISABLE_BTF_ON_USER_BUILDS();
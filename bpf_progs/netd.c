@@ -94,6 +94,15 @@ DEFINE_BPF_MAP_RO_NETD(stats_map_B, HASH, StatsKey, StatsValue, STATS_MAP_SIZE)
 DEFINE_BPF_MAP_NO_NETD(iface_stats_map, HASH, uint32_t, StatsValue, IFACE_STATS_MAP_SIZE)
 DEFINE_BPF_MAP_RO_NETD(uid_owner_map, HASH, uint32_t, UidOwnerValue, UID_OWNER_MAP_SIZE)
 DEFINE_BPF_MAP_RO_NETD(uid_permission_map, HASH, uint32_t, uint8_t, UID_OWNER_MAP_SIZE)
+
+// Direct-indexed copies of the above for keys below UID_ARRAY_MAP_SIZE, ie. the system uids and
+// the apps of user 0 (app ids for the permission map), which is where nearly all packets come from.
+// An ARRAY lookup is a bounds check and an add (inlined by the JIT), where a HASH lookup hashes the
+// key and walks a bucket. The writers keep every such entry in both maps: the HASH maps stay
+// complete for userspace readers, and remain the overflow for uids of other users and isolated
+// processes. Deleted (or never written) entries are all zeroes.
+DEFINE_BPF_MAP_RO_NETD(uid_owner_array_map, ARRAY, uint32_t, UidOwnerValue, UID_ARRAY_MAP_SIZE)
+DEFINE_BPF_MAP_RO_NETD(uid_permission_array_map, ARRAY, uint32_t, uint8_t, UID_ARRAY_MAP_SIZE)
 DEFINE_BPF_MAP_NO_NETD(ingress_discard_map, HASH, IngressDiscardKey, IngressDiscardValue,
                        INGRESS_DISCARD_MAP_SIZE)
 
@@ -115,6 +124,15 @@ DEFINE_BPF_RINGBUF_EXT(packet_trace_ringbuf, PacketTrace, PACKET_TRACE_BUF_SIZE,
 DEFINE_BPF_MAP_RO_NETD(data_saver_enabled_map, ARRAY, uint32_t, bool,
                        DATA_SAVER_ENABLED_MAP_SIZE)
 
+// Never used from ebpf. ConnectivityService stores the current time in it after each write to the
+// maps above that DnsBpfHelper reads, so that DnsBpfHelper can cache what it read until it changes.
+// Mmapable, so that checking it is a memory load rather than a syscall, hence 5.5+ only.
+DEFINE_BPF_MAP_BASE_FLAGS(rules_generation_map, ARRAY, sizeof(uint32_t), sizeof(uint64_t),
+                          RULES_GENERATION_MAP_SIZE, BPF_F_MMAPABLE, AID_ROOT, AID_NET_BW_ACCT,
+                          0460, "fs_bpf_netd_readonly", "", PRIVATE, KVER_5_5, KVER_INF,
+                          BPFLOADER_MIN_VER, BPFLOADER_MAX_VER, LOAD_ON_ENG, LOAD_ON_USER,
+                          LOAD_ON_USERDEBUG)
+
 // iptables xt_bpf programs need to be usable by both netd and netutils_wrappers
 // selinux contexts, because even non-xt_bpf iptables mutations are implemented as
 // a full table dump, followed by an update in userspace, and then a reload into the kernel,
@@ -398,11 +416,18 @@ static __always_inline inline bool ingress_should_discard(struct __sk_buff* skb,
     return true;  // disallowed interface
 }
 
+// An all zero entry of uid_owner_array_map matches nothing, just like a missing one, so callers
+// do not need to tell them apart.
+static __always_inline inline UidOwnerValue* lookup_uid_owner(uint32_t uid) {
+    if (uid < UID_ARRAY_MAP_SIZE) return bpf_uid_owner_array_map_lookup_elem(&uid);
+    return bpf_uid_owner_map_lookup_elem(&uid);
+}
+
 static __always_inline inline int bpf_owner_firewall_match(uint32_t uid) {
     if (is_system_uid(uid)) return PASS;
 
     const BpfConfig enabledRules = getConfig(UID_RULES_CONFIGURATION_KEY);
-    const UidOwnerValue* uidEntry = bpf_uid_owner_map_lookup_elem(&uid);
+    const UidOwnerValue* uidEntry = lookup_uid_owner(uid);
     const uint32_t uidRules = uidEntry ? uidEntry->rule : 0;
 
     if (enabledRules & (FIREWALL_DROP_IF_SET | FIREWALL_DROP_IF_UNSET)
@@ -422,7 +447,7 @@ static __always_inline inline int bpf_owner_match(struct __sk_buff* skb, uint32_
 
     BpfConfig enabledRules = getConfig(UID_RULES_CONFIGURATION_KEY);
 
-    UidOwnerValue* uidEntry = bpf_uid_owner_map_lookup_elem(&uid);
+    UidOwnerValue* uidEntry = lookup_uid_owner(uid);
     uint32_t uidRules = uidEntry ? uidEntry->rule : 0;
     uint32_t allowed_iif = uidEntry ? uidEntry->iif : 0;
 
@@ -649,7 +674,7 @@ DEFINE_XTBPF_PROG("skfilter/allowlist/xtbpf", AID_ROOT, AID_NET_ADMIN, xt_bpf_al
     // Let's treat such cases as 'root' which is_system_uid()
     if (sock_uid == 65534) return BPF_MATCH;
 
-    UidOwnerValue* allowlistMatch = bpf_uid_owner_map_lookup_elem(&sock_uid);
+    UidOwnerValue* allowlistMatch = lookup_uid_owner(sock_uid);
     if (allowlistMatch) return allowlistMatch->rule & HAPPY_BOX_MATCH ? BPF_MATCH : BPF_NOMATCH;
     return BPF_NOMATCH;
 }
@@ -658,7 +683,7 @@ DEFINE_XTBPF_PROG("skfilter/allowlist/xtbpf", AID_ROOT, AID_NET_ADMIN, xt_bpf_al
 DEFINE_XTBPF_PROG("skfilter/denylist/xtbpf", AID_ROOT, AID_NET_ADMIN, xt_bpf_denylist_prog)
 (struct __sk_buff* skb) {
     uint32_t sock_uid = bpf_get_socket_uid(skb);
-    UidOwnerValue* denylistMatch = bpf_uid_owner_map_lookup_elem(&sock_uid);
+    UidOwnerValue* denylistMatch = lookup_uid_owner(sock_uid);
     if (denylistMatch) return denylistMatch->rule & PENALTY_BOX_MATCH ? BPF_MATCH : BPF_NOMATCH;
     return BPF_NOMATCH;
 }
@@ -671,6 +696,11 @@ static __always_inline inline uint8_t get_app_permissions(uint32_t uid) {
      * run time. See UserHandle#isSameApp for detail.
      */
     uint32_t appId = uid % AID_USER_OFFSET;  // == PER_USER_RANGE == 100000
+    if (appId < UID_ARRAY_MAP_SIZE) {
+        const uint8_t* entry = bpf_uid_permission_array_map_lookup_elem(&appId);
+        if (entry && (*entry & BPF_PERMISSION_ARRAY_ENTRY)) return *entry;
+        return BPF_PERMISSION_INTERNET;
+    }
     uint8_t* permissions = bpf_uid_permission_map_lookup_elem(&appId);
     // if UID not in map, then default to just INTERNET permission.
     return permissions ? *permissions : BPF_PERMISSION_INTERNET;
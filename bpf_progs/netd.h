@@ -109,9 +109,11 @@ STRUCT_SIZE(PacketTrace, 8+4+4 + 4+4 + 2+2 + 1+1+1+1);
 // standby_uid_map:     key:  4 bytes, value:  1 bytes, cost:  145216 bytes    =   145Kbytes
 // powersave_uid_map:   key:  4 bytes, value:  1 bytes, cost:  145216 bytes    =   145Kbytes
 // packet_trace_ringbuf:key:  0 bytes, value: 24 bytes, cost:   32768 bytes    =    32Kbytes
-// total:                                                                         4962Kbytes
-// It takes maximum 4.9MB kernel memory space if all maps are full, which requires any devices
-// running this module to have a memlock rlimit to be larger then 5MB. In the old qtaguid module,
+// uid_owner_array_map: key:  4 bytes, value:  8 bytes, cost:  160000 bytes    =   160Kbytes
+// uid_perm_array_map:  key:  4 bytes, value:  1 bytes, cost:  160000 bytes    =   160Kbytes
+// total:                                                                         5282Kbytes
+// It takes maximum 5.2MB kernel memory space if all maps are full, which requires any devices
+// running this module to have a memlock rlimit to be larger then 5.3MB. In the old qtaguid module,
 // we don't have a total limit for data entries but only have limitation of tags each uid can have.
 // (default is 1024 in kernel);
 
@@ -127,6 +129,12 @@ static const int UID_OWNER_MAP_SIZE = 4000;
 static const int INGRESS_DISCARD_MAP_SIZE = 100;
 static const int PACKET_TRACE_BUF_SIZE = 32 * 1024;
 static const int DATA_SAVER_ENABLED_MAP_SIZE = 1;
+static const int RULES_GENERATION_MAP_SIZE = 1;
+// Covers the system uids and the apps of user 0, ie. AID_APP_END + 1. ARRAY maps are not hashed
+// and not prealloc'ed per element, so the cost above is just max_entries * roundup(value_size, 8).
+// LINT.IfChange(uid_array_map_size)
+static const int UID_ARRAY_MAP_SIZE = 20000;
+// LINT.ThenChange(../framework/src/android/net/BpfNetMapsConstants.java)
 
 #ifdef __cplusplus
 
@@ -170,10 +178,13 @@ ASSERT_STRING_EQUAL(XT_BPF_DENYLIST_PROG_PATH,  BPF_NETD_PATH "prog_netd_skfilte
 #define CONFIGURATION_MAP_PATH BPF_NETD_PATH "map_netd_configuration_map"
 #define UID_OWNER_MAP_PATH BPF_NETD_PATH "map_netd_uid_owner_map"
 #define UID_PERMISSION_MAP_PATH BPF_NETD_PATH "map_netd_uid_permission_map"
+#define UID_OWNER_ARRAY_MAP_PATH BPF_NETD_PATH "map_netd_uid_owner_array_map"
+#define UID_PERMISSION_ARRAY_MAP_PATH BPF_NETD_PATH "map_netd_uid_permission_array_map"
 #define INGRESS_DISCARD_MAP_PATH BPF_NETD_PATH "map_netd_ingress_discard_map"
 #define PACKET_TRACE_RINGBUF_PATH BPF_NETD_PATH "map_netd_packet_trace_ringbuf"
 #define PACKET_TRACE_ENABLED_MAP_PATH BPF_NETD_PATH "map_netd_packet_trace_enabled_map"
 #define DATA_SAVER_ENABLED_MAP_PATH BPF_NETD_PATH "map_netd_data_saver_enabled_map"
+#define RULES_GENERATION_MAP_PATH BPF_NETD_PATH "map_netd_rules_generation_map"
 
 #endif // __cplusplus
 
@@ -199,6 +210,9 @@ enum UidOwnerMatchType : uint32_t {
 enum BpfPermissionMatch : uint8_t {
     BPF_PERMISSION_INTERNET = 1 << 2,
     BPF_PERMISSION_UPDATE_DEVICE_STATS = 1 << 3,
+    // Only used in uid_permission_array_map, to tell a written entry (which may grant nothing)
+    // from an unwritten all zero one, which means the app id is not in uid_permission_map.
+    BPF_PERMISSION_ARRAY_ENTRY = 1 << 7,
 };
 // In production we use two identical stats maps to record per uid stats and
 // do swap and clean based on the configuration specified here. The statsMapType
@@ -239,6 +253,9 @@ STRUCT_SIZE(IngressDiscardValue, 2 * 4);  // 8
 #define CURRENT_STATS_MAP_CONFIGURATION_KEY 1
 // Entry in the data saver enabled map that stores whether data saver is enabled or not.
 #define DATA_SAVER_ENABLED_KEY 0
+// Entry in the rules generation map. Its value changes whenever the configuration map, the uid
+// owner map or the data saver enabled map is written, see DnsBpfHelper.
+#define RULES_GENERATION_KEY 0
 
 #undef STRUCT_SIZE
 
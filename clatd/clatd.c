@@ -45,7 +45,9 @@
 #include "config.h"
 #include "dump.h"
 #include "logging.h"
+#include "stats.h"
 #include "translate.h"
+#include "xsk.h"
 
 struct clat_config Global_Clatd_Config;
 
@@ -77,6 +79,7 @@ void process_packet_6_to_4(struct tun_data *tunnel) {
   if (readlen < 0) {
     if (errno != EAGAIN) {
       logmsg(ANDROID_LOG_WARN, "%s: read error: %s", __func__, strerror(errno));
+      stats_inc(CLATD_STAT_READ_ERROR);
     }
     return;
   } else if (readlen == 0) {
@@ -85,6 +88,7 @@ void process_packet_6_to_4(struct tun_data *tunnel) {
     return;
   } else if (readlen >= sizeof(buf)) {
     logmsg(ANDROID_LOG_WARN, "%s: read truncation - ignoring pkt", __func__);
+    stats_inc(CLATD_STAT_READ_TRUNCATED);
     return;
   }
 
@@ -115,11 +119,27 @@ void process_packet_6_to_4(struct tun_data *tunnel) {
   if (readlen < payload_offset + tp_net) {
     logmsg(ANDROID_LOG_WARN, "%s: ignoring %zd byte pkt shorter than %d+%u L2 header",
            __func__, readlen, payload_offset, tp_net);
+    stats_inc(CLATD_STAT_SHORT_READ);
     return;
   }
 
   const int pkt_len = readlen - payload_offset;
 
+  if (tunnel->vnet_hdr) {
+    // The tun takes partial checksums and GSO superpackets, so leave the checksum to whoever
+    // ends up needing it. csum_start is relative to the L2 header.
+    if ((buf.vnet.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) && buf.vnet.csum_start < tp_net) {
+      logmsg(ANDROID_LOG_ERROR, "%s: out of range - checksum start %d < %u",
+             __func__, buf.vnet.csum_start, tp_net);
+      stats_inc(CLATD_STAT_CHECKSUM_OUT_OF_RANGE);
+      return;
+    }
+    if (buf.vnet.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) buf.vnet.csum_start -= tp_net;
+    translate_vnet_packet(tunnel->fd4, 0 /* to_ipv6 */, buf.payload + tp_net, pkt_len - tp_net,
+                          &buf.vnet);
+    return;
+  }
+
   // This will detect a skb->ip_summed == CHECKSUM_PARTIAL packet with non-final L4 checksum
   if (tp_status & TP_STATUS_CSUMNOTREADY) {
     static bool logged = false;
@@ -128,20 +148,10 @@ void process_packet_6_to_4(struct tun_data *tunnel) {
       logged = true;
     }
 
-    // These are non-negative by virtue of csum_start/offset being u16
-    const int cs_start = buf.vnet.csum_start;
-    const int cs_offset = cs_start + buf.vnet.csum_offset;
-    if (cs_start > pkt_len) {
-      logmsg(ANDROID_LOG_ERROR, "%s: out of range - checksum start %d > %d",
-             __func__, cs_start, pkt_len);
-    } else if (cs_offset + 1 >= pkt_len) {
-      logmsg(ANDROID_LOG_ERROR, "%s: out of range - checksum offset %d + 1 >= %d",
-             __func__, cs_offset, pkt_len);
-    } else {
-      uint16_t csum = ip_checksum(buf.payload + cs_start, pkt_len - cs_start);
-      if (!csum) csum = 0xFFFF;  // required fixup for UDP, TCP must live with it
-      buf.payload[cs_offset] = csum & 0xFF;
-      buf.payload[cs_offset + 1] = csum >> 8;
+    if (finish_partial_checksum(buf.payload, pkt_len, buf.vnet.csum_start,
+                                buf.vnet.csum_offset)) {
+      logmsg(ANDROID_LOG_ERROR, "%s: out of range - checksum %d + %d > %d",
+             __func__, buf.vnet.csum_start, buf.vnet.csum_offset, pkt_len);
     }
   }
 
@@ -152,29 +162,37 @@ void process_packet_6_to_4(struct tun_data *tunnel) {
 void process_packet_4_to_6(struct tun_data *tunnel) {
   struct {
     struct tun_pi pi;
+    struct virtio_net_hdr vnet;  // Only present if the tun was created with IFF_VNET_HDR.
     uint8_t payload[MAXMTU];
     char pad; // +1 byte to make packet truncation obvious
   } buf;
-  ssize_t readlen = read(tunnel->fd4, &buf, sizeof(buf));
+  struct iovec iov[] = {
+    { &buf.pi, sizeof(buf.pi) },
+    { &buf.vnet, tunnel->vnet_hdr ? sizeof(buf.vnet) : 0 },
+    { buf.payload, sizeof(buf.payload) + sizeof(buf.pad) },
+  };
+  ssize_t readlen = readv(tunnel->fd4, iov, ARRAY_SIZE(iov));
+  const int payload_offset = iov[0].iov_len + iov[1].iov_len;
 
   if (readlen < 0) {
     if (errno != EAGAIN) {
       logmsg(ANDROID_LOG_WARN, "%s: read error: %s", __func__, strerror(errno));
+      stats_inc(CLATD_STAT_READ_ERROR);
     }
     return;
   } else if (readlen == 0) {
     logmsg(ANDROID_LOG_WARN, "%s: tun interface removed", __func__);
     running = 0;
     return;
-  } else if (readlen >= sizeof(buf)) {
+  } else if (readlen > payload_offset + sizeof(buf.payload)) {
     logmsg(ANDROID_LOG_WARN, "%s: read truncation - ignoring pkt", __func__);
+    stats_inc(CLATD_STAT_READ_TRUNCATED);
     return;
   }
 
-  const int payload_offset = offsetof(typeof(buf), payload);
-
   if (readlen < payload_offset) {
     logmsg(ANDROID_LOG_WARN, "%s: short read: got %ld bytes", __func__, readlen);
+    stats_inc(CLATD_STAT_SHORT_READ);
     return;
   }
 
@@ -183,6 +201,7 @@ void process_packet_4_to_6(struct tun_data *tunnel) {
   uint16_t proto = ntohs(buf.pi.proto);
   if (proto != ETH_P_IP) {
     logmsg(ANDROID_LOG_WARN, "%s: unknown packet type = 0x%x", __func__, proto);
+    stats_inc(CLATD_STAT_TUN_UNKNOWN_PROTO);
     return;
   }
 
@@ -190,6 +209,11 @@ void process_packet_4_to_6(struct tun_data *tunnel) {
     logmsg(ANDROID_LOG_WARN, "%s: unexpected flags = %d", __func__, buf.pi.flags);
   }
 
+  if (tunnel->vnet_hdr) {
+    translate_vnet_packet(tunnel->write_fd6, 1 /* to_ipv6 */, buf.payload, pkt_len, &buf.vnet);
+    return;
+  }
+
   translate_packet(tunnel->write_fd6, 1 /* to_ipv6 */, buf.payload, pkt_len);
 }
 
@@ -287,6 +311,7 @@ void event_loop(struct tun_data *tunnel) {
   struct pollfd wait_fd[] = {
     { tunnel->read_fd6, POLLIN, 0 },
     { tunnel->fd4, POLLIN, 0 },
+    { tunnel->xsk_fd ? tunnel->xsk_fd : -1, POLLIN, 0 },  // poll() ignores negative fds.
   };
 
   while (running) {
@@ -302,6 +327,7 @@ void event_loop(struct tun_data *tunnel) {
       // socket error flag instead.
       if (wait_fd[0].revents) process_packet_6_to_4(tunnel);
       if (wait_fd[1].revents) process_packet_4_to_6(tunnel);
+      if (wait_fd[2].revents) process_packet_xsk(tunnel);
     }
   }
 }
@@ -0,0 +1,375 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * clatd_benchmark.cpp - throughput of the clatd translation engine
+ *
+ * Drives ipv4_packet()/ipv6_packet() (translation only) and translate_packet() (translation plus
+ * the writev() of the result) with synthetic TCP, UDP, ICMP and fragmented packets of several
+ * sizes, and with a mix of them. Translated packets are written to /dev/null, so that the
+ * numbers do not depend on a tun interface or on the network stack.
+ *
+ * Besides the usual time per packet, every benchmark reports packets/s and bytes/s, and, where
+ * perf_event_open() allows counting CPU cycles (e.g. as root), cycles/byte.
+ */
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+extern "C" {
+#include "checksum.h"
+#include "clatd.h"
+#include "config.h"
+#include "translate.h"
+}
+
+// The real send_rawv6() does a sendmsg() on a raw socket, which would need root, a route to the
+// destination and would measure the kernel's IPv6 output path. Like clatd_test, just writev().
+extern "C" void send_rawv6(int fd, clat_packet out, int iov_len) { writev(fd, out, iov_len); }
+
+namespace {
+
+// Same translation parameters as clatd_test.
+const char kIPv4LocalAddr[]  = "192.0.0.4";
+const char kIPv6LocalAddr[]  = "2001:db8:0:b11::464";
+const char kIPv6PlatSubnet[] = "64:ff9b::";
+const char kIPv4RemoteAddr[] = "8.8.8.8";
+
+// Packet sizes (including the IP header) to run each protocol with: minimal, the IPv4 and IPv6
+// minimum MTUs and a typical Ethernet MTU.
+const int kSizes[] = { 64, 576, 1280, 1500 };
+
+enum Proto { TCP, UDP, ICMP, FRAG_FIRST, FRAG_LATER };
+
+uint8_t ipProto(Proto proto, bool v6) {
+  switch (proto) {
+    case TCP:
+      return IPPROTO_TCP;
+    case ICMP:
+      return v6 ? (uint8_t)IPPROTO_ICMPV6 : (uint8_t)IPPROTO_ICMP;
+    default:
+      return IPPROTO_UDP;
+  }
+}
+
+size_t transportHeaderLen(Proto proto) {
+  switch (proto) {
+    case TCP:
+      return sizeof(struct tcphdr);
+    case ICMP:
+      return sizeof(struct icmphdr);
+    case FRAG_LATER:
+      return 0;
+    default:
+      return sizeof(struct udphdr);
+  }
+}
+
+// Fills in the transport header at 'l4' (of 'len' bytes including payload), checksummed against
+// the given pseudo-header sum. Non-first fragments have no transport header to fill in.
+void fillTransport(Proto proto, bool v6, uint8_t *l4, size_t len, uint32_t pseudo_sum) {
+  uint16_t *check;
+  switch (proto) {
+    case TCP: {
+      struct tcphdr *tcp = (struct tcphdr *)l4;
+      tcp->source        = htons(51339);
+      tcp->dest          = htons(443);
+      tcp->seq           = htonl(1);
+      tcp->ack_seq       = htonl(1);
+      tcp->doff          = 5;
+      tcp->ack           = 1;
+      tcp->window        = htons(65535);
+      check              = &tcp->check;
+      break;
+    }
+    case ICMP: {
+      struct icmphdr *icmp   = (struct icmphdr *)l4;
+      icmp->type             = v6 ? (uint8_t)ICMP6_ECHO_REPLY : (uint8_t)ICMP_ECHO;
+      icmp->un.echo.id       = htons(1);
+      icmp->un.echo.sequence = htons(1);
+      check                  = &icmp->checksum;
+      // ICMP has no pseudo-header, ICMPv6 does.
+      if (!v6) pseudo_sum = 0;
+      break;
+    }
+    case FRAG_LATER:
+      return;
+    default: {
+      struct udphdr *udp = (struct udphdr *)l4;
+      udp->source        = htons(51339);
+      udp->dest          = htons(53);
+      udp->len           = htons(len);
+      check              = &udp->check;
+      break;
+    }
+  }
+  *check = 0;
+  *check = ip_checksum_finish(ip_checksum_add(pseudo_sum, l4, len));
+}
+
+// Builds an IPv4 packet from the clat address to a remote host, as the tun interface delivers it.
+std::vector<uint8_t> makeIPv4Packet(Proto proto, size_t size, std::mt19937 &rng) {
+  std::vector<uint8_t> packet(size);
+  for (uint8_t &b : packet) b = rng();
+
+  struct iphdr *ip = (struct iphdr *)packet.data();
+  memset(ip, 0, sizeof(*ip) + transportHeaderLen(proto));
+  ip->version  = 4;
+  ip->ihl      = 5;
+  ip->tot_len  = htons(size);
+  ip->id       = htons(rng());
+  ip->ttl      = 64;
+  ip->protocol = ipProto(proto, false);
+  inet_pton(AF_INET, kIPv4LocalAddr, &ip->saddr);
+  inet_pton(AF_INET, kIPv4RemoteAddr, &ip->daddr);
+  if (proto == FRAG_FIRST) {
+    ip->frag_off = htons(IP_MF);
+  } else if (proto == FRAG_LATER) {
+    ip->frag_off = htons(1480 / 8);
+  } else {
+    ip->frag_off = htons(IP_DF);
+  }
+  ip->check = ip_checksum(ip, sizeof(*ip));
+
+  const size_t len = size - sizeof(*ip);
+  fillTransport(proto, false, (uint8_t *)(ip + 1), len, ipv4_pseudo_header_checksum(ip, len));
+  return packet;
+}
+
+// Builds the IPv6 packet that the same remote host would send back through the PLAT.
+std::vector<uint8_t> makeIPv6Packet(Proto proto, size_t size, std::mt19937 &rng) {
+  std::vector<uint8_t> packet(size);
+  for (uint8_t &b : packet) b = rng();
+
+  const bool fragmented = (proto == FRAG_FIRST || proto == FRAG_LATER);
+  const size_t hdrs_len = sizeof(struct ip6_hdr) + (fragmented ? sizeof(struct ip6_frag) : 0);
+  struct ip6_hdr *ip6 = (struct ip6_hdr *)packet.data();
+  memset(ip6, 0, hdrs_len + transportHeaderLen(proto));
+  ip6->ip6_vfc  = 0x60;
+  ip6->ip6_plen = htons(size - sizeof(*ip6));
+  ip6->ip6_nxt  = fragmented ? (uint8_t)IPPROTO_FRAGMENT : ipProto(proto, true);
+  ip6->ip6_hlim = 64;
+  inet_pton(AF_INET6, kIPv6PlatSubnet, &ip6->ip6_src);
+  inet_pton(AF_INET, kIPv4RemoteAddr, &ip6->ip6_src.s6_addr32[3]);
+  inet_pton(AF_INET6, kIPv6LocalAddr, &ip6->ip6_dst);
+
+  if (fragmented) {
+    struct ip6_frag *frag = (struct ip6_frag *)(ip6 + 1);
+    frag->ip6f_nxt        = ipProto(proto, true);
+    frag->ip6f_ident      = htonl(rng());
+    frag->ip6f_offlg      = (proto == FRAG_FIRST) ? (uint16_t)IP6F_MORE_FRAG : htons(1448);
+  }
+
+  const size_t len = size - hdrs_len;
+  fillTransport(proto, true, packet.data() + hdrs_len, len,
+                ipv6_pseudo_header_checksum(ip6, len, ipProto(proto, true)));
+  return packet;
+}
+
+struct Workload {
+  std::vector<std::vector<uint8_t>> packets;
+  size_t bytes = 0;
+};
+
+// Enough distinct packets that the payloads do not all sit in L1, but the headers do.
+constexpr int kPacketsPerWorkload = 64;
+
+Workload makeWorkload(bool v6, Proto proto, size_t size) {
+  std::mt19937 rng(size);
+  Workload w;
+  for (int i = 0; i < kPacketsPerWorkload; i++) {
+    w.packets.push_back(v6 ? makeIPv6Packet(proto, size, rng) : makeIPv4Packet(proto, size, rng));
+    w.bytes += size;
+  }
+  return w;
+}
+
+// Roughly what a phone's uplink and downlink through clat look like: mostly full-sized TCP,
+// acks and DNS, a little ICMP and the occasional fragmented datagram.
+Workload makeMixWorkload(bool v6) {
+  static const struct {
+    Proto proto;
+    size_t size;
+    int count;
+  } kMix[] = {
+    { TCP, 1500, 36 },  { TCP, 64, 16 },       { UDP, 64, 4 },       { UDP, 1280, 4 },
+    { ICMP, 64, 2 },    { FRAG_FIRST, 1280, 1 }, { FRAG_LATER, 576, 1 },
+  };
+  std::mt19937 rng(v6);
+  Workload w;
+  for (const auto &m : kMix) {
+    for (int i = 0; i < m.count; i++) {
+      w.packets.push_back(v6 ? makeIPv6Packet(m.proto, m.size, rng)
+                             : makeIPv4Packet(m.proto, m.size, rng));
+      w.bytes += m.size;
+    }
+  }
+  std::shuffle(w.packets.begin(), w.packets.end(), rng);
+  return w;
+}
+
+// Counts CPU cycles spent by this thread, if perf events are available.
+class CycleCounter {
+ public:
+  CycleCounter() {
+    struct perf_event_attr attr = {};
+    attr.type                   = PERF_TYPE_HARDWARE;
+    attr.size                   = sizeof(attr);
+    attr.config                 = PERF_COUNT_HW_CPU_CYCLES;
+    attr.disabled               = 1;
+    attr.exclude_hv             = 1;
+    mFd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if (mFd < 0) {
+      // Unprivileged processes may still be allowed to count user space only.
+      attr.exclude_kernel = 1;
+      mFd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    }
+  }
+  ~CycleCounter() {
+    if (mFd >= 0) close(mFd);
+  }
+
+  bool valid() const { return mFd >= 0; }
+  void start() {
+    ioctl(mFd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(mFd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  uint64_t stop() {
+    uint64_t cycles = 0;
+    ioctl(mFd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(mFd, &cycles, sizeof(cycles)) != sizeof(cycles)) return 0;
+    return cycles;
+  }
+
+ private:
+  int mFd;
+};
+
+void setUpConfig() {
+  inet_pton(AF_INET, kIPv4LocalAddr, &Global_Clatd_Config.ipv4_local_subnet);
+  inet_pton(AF_INET6, kIPv6PlatSubnet, &Global_Clatd_Config.plat_subnet);
+  inet_pton(AF_INET6, kIPv6LocalAddr, &Global_Clatd_Config.ipv6_local_subnet);
+  Global_Clatd_Config.native_ipv6_interface = "wlan0";
+  init_header_templates();
+}
+
+// Translates only, into a clat_packet on the stack, without writing anything.
+int translateOnly(bool to_ipv6, const std::vector<uint8_t> &packet) {
+  uint8_t hdrs[CLAT_POS_PAYLOAD][MAX_TCP_HDR];
+  clat_packet out;
+  for (int i = 0; i < CLAT_POS_PAYLOAD; i++) out[i] = { hdrs[i], 0 };
+  out[CLAT_POS_PAYLOAD] = { nullptr, 0 };
+
+  const int iov_len = to_ipv6 ? ipv4_packet(out, CLAT_POS_IPHDR, packet.data(), packet.size())
+                              : ipv6_packet(out, CLAT_POS_IPHDR, packet.data(), packet.size());
+  benchmark::ClobberMemory();
+  return iov_len;
+}
+
+void run(benchmark::State &state, bool to_ipv6, bool write, const Workload &w) {
+  setUpConfig();
+  // Packets that get dropped would make the numbers meaningless.
+  for (const std::vector<uint8_t> &packet : w.packets) {
+    if (translateOnly(to_ipv6, packet) <= 0) {
+      state.SkipWithError("packet was not translated");
+      return;
+    }
+  }
+
+  const int fd = write ? open("/dev/null", O_WRONLY | O_CLOEXEC) : -1;
+  if (write && fd < 0) {
+    state.SkipWithError("cannot open /dev/null");
+    return;
+  }
+
+  CycleCounter cycles;
+  uint64_t totalCycles = 0;
+  for (auto _ : state) {
+    if (cycles.valid()) cycles.start();
+    for (const std::vector<uint8_t> &packet : w.packets) {
+      if (write) {
+        translate_packet(fd, to_ipv6, packet.data(), packet.size());
+      } else {
+        benchmark::DoNotOptimize(translateOnly(to_ipv6, packet));
+      }
+    }
+    if (cycles.valid()) totalCycles += cycles.stop();
+  }
+  if (fd >= 0) close(fd);
+
+  // One iteration translates the whole workload, so report per-packet figures as well.
+  const int64_t packets = state.iterations() * w.packets.size();
+  const int64_t bytes   = state.iterations() * w.bytes;
+  state.SetItemsProcessed(packets);
+  state.SetBytesProcessed(bytes);
+  state.counters["sec_per_packet"] =
+    benchmark::Counter(packets, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+  if (cycles.valid() && bytes) {
+    state.counters["cycles_per_byte"]   = (double)totalCycles / bytes;
+    state.counters["cycles_per_packet"] = (double)totalCycles / packets;
+  }
+}
+
+// Arguments: packet size.
+void BM_Translate(benchmark::State &state, bool to_ipv6, bool write, Proto proto) {
+  run(state, to_ipv6, write, makeWorkload(!to_ipv6, proto, state.range(0)));
+}
+
+void BM_TranslateMix(benchmark::State &state, bool to_ipv6, bool write) {
+  run(state, to_ipv6, write, makeMixWorkload(!to_ipv6));
+}
+
+void sizes(benchmark::internal::Benchmark *b) {
+  b->ArgName("size");
+  for (int size : kSizes) b->Arg(size);
+}
+
+// ipv4_packet() / ipv6_packet() only.
+BENCHMARK_CAPTURE(BM_Translate, ipv4_packet/tcp, true, false, TCP)->Apply(sizes);
+BENCHMARK_CAPTURE(BM_Translate, ipv4_packet/udp, true, false, UDP)->Apply(sizes);
+BENCHMARK_CAPTURE(BM_Translate, ipv4_packet/icmp, true, false, ICMP)->Apply(sizes);
+BENCHMARK_CAPTURE(BM_Translate, ipv4_packet/frag_first, true, false, FRAG_FIRST)->Apply(sizes);
+BENCHMARK_CAPTURE(BM_Translate, ipv4_packet/frag_later, true, false, FRAG_LATER)->Apply(sizes);
+BENCHMARK_CAPTURE(BM_Translate, ipv6_packet/tcp, false, false, TCP)->Apply(sizes);
+BENCHMARK_CAPTURE(BM_Translate, ipv6_packet/udp, false, false, UDP)->Apply(sizes);
+BENCHMARK_CAPTURE(BM_Translate, ipv6_packet/icmp, false, false, ICMP)->Apply(sizes);
+BENCHMARK_CAPTURE(BM_Translate, ipv6_packet/frag_first, false, false, FRAG_FIRST)->Apply(sizes);
+BENCHMARK_CAPTURE(BM_Translate, ipv6_packet/frag_later, false, false, FRAG_LATER)->Apply(sizes);
+
+// translate_packet(), including the write.
+BENCHMARK_CAPTURE(BM_Translate, translate_4to6/tcp, true, true, TCP)->Apply(sizes);
+BENCHMARK_CAPTURE(BM_Translate, translate_4to6/udp, true, true, UDP)->Apply(sizes);
+BENCHMARK_CAPTURE(BM_Translate, translate_6to4/tcp, false, true, TCP)->Apply(sizes);
+BENCHMARK_CAPTURE(BM_Translate, translate_6to4/udp, false, true, UDP)->Apply(sizes);
+
+BENCHMARK_CAPTURE(BM_TranslateMix, ipv4_packet, true, false);
+BENCHMARK_CAPTURE(BM_TranslateMix, ipv6_packet, false, false);
+BENCHMARK_CAPTURE(BM_TranslateMix, translate_4to6, true, true);
+BENCHMARK_CAPTURE(BM_TranslateMix, translate_6to4, false, true);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -19,10 +19,20 @@
 #include <iostream>
 
 #include <arpa/inet.h>
+#include <poll.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
 #include <linux/if_packet.h>
+// linux/virtio_net.h is not C++ clean: it has a struct member called 'class'.
+#define class class_
+#include <linux/virtio_net.h>
+#undef class
 #include <netinet/in6.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/uio.h>
+#include <unistd.h>
 
 #include <gtest/gtest.h>
 
@@ -33,7 +43,9 @@ extern "C" {
 #include "checksum.h"
 #include "clatd.h"
 #include "config.h"
+#include "stats.h"
 #include "translate.h"
+#include "xsk.h"
 }
 
 // For convenience.
@@ -568,6 +580,7 @@ class ClatdTest : public ::testing::Test {
     inet_pton(AF_INET6, kIPv6PlatSubnet, &Global_Clatd_Config.plat_subnet);
     memset(&Global_Clatd_Config.ipv6_local_subnet, 0, sizeof(in6_addr));
     Global_Clatd_Config.native_ipv6_interface = const_cast<char *>(sTun.name().c_str());
+    init_header_templates();
   }
 
   // Static because setting up the tun interface takes about 40ms.
@@ -740,6 +753,7 @@ TEST_F(ClatdTest, AdjustChecksum) {
 TEST_F(ClatdTest, Translate) {
   // This test uses hardcoded packets so the clatd address must be fixed.
   inet_pton(AF_INET6, kIPv6LocalAddr, &Global_Clatd_Config.ipv6_local_subnet);
+  init_header_templates();
 
   uint8_t udp_ipv4[] = { IPV4_UDP_HEADER UDP_HEADER PAYLOAD };
   uint8_t udp_ipv6[] = { IPV6_UDP_HEADER UDP_HEADER PAYLOAD };
@@ -761,6 +775,7 @@ TEST_F(ClatdTest, Translate) {
 TEST_F(ClatdTest, Fragmentation) {
   // This test uses hardcoded packets so the clatd address must be fixed.
   inet_pton(AF_INET6, kIPv6LocalAddr, &Global_Clatd_Config.ipv6_local_subnet);
+  init_header_templates();
 
   check_fragment_translation(kIPv4Fragments, kIPv4FragLengths, kIPv6Fragments, kIPv6FragLengths,
                              ARRAYSIZE(kIPv4Fragments), "IPv4->IPv6 fragment translation");
@@ -769,6 +784,64 @@ TEST_F(ClatdTest, Fragmentation) {
                              ARRAYSIZE(kIPv6Fragments), "IPv6->IPv4 fragment translation");
 }
 
+TEST_F(ClatdTest, Counters) {
+  // This test uses hardcoded packets so the clatd address must be fixed.
+  inet_pton(AF_INET6, kIPv6LocalAddr, &Global_Clatd_Config.ipv6_local_subnet);
+  init_header_templates();
+
+  // What the system server does: create the memory, let clatd map it, and read it separately.
+  int fd = memfd_create("clatd_stats", MFD_CLOEXEC);
+  ASSERT_LE(0, fd);
+  ASSERT_EQ(0, ftruncate(fd, sizeof(struct clatd_stats)));
+  struct clatd_stats *const old_stats = Clatd_Stats;
+  ASSERT_EQ(0, stats_map(fd));
+  const struct clatd_stats *stats = (const struct clatd_stats *)mmap(
+      NULL, sizeof(struct clatd_stats), PROT_READ, MAP_SHARED, fd, 0);
+  ASSERT_NE(MAP_FAILED, stats);
+  close(fd);
+  struct clatd_stats *const shared_stats = Clatd_Stats;
+  memset(shared_stats, 0, sizeof(*shared_stats));
+
+  uint8_t udp_ipv4[] = { IPV4_UDP_HEADER UDP_HEADER PAYLOAD };
+  uint8_t udp_ipv6[] = { IPV6_UDP_HEADER UDP_HEADER PAYLOAD };
+  fix_udp_checksum(udp_ipv4);
+  fix_udp_checksum(udp_ipv6);
+  check_translated_packet(udp_ipv4, sizeof(udp_ipv4), udp_ipv6, sizeof(udp_ipv6),
+                          "UDP/IPv4 -> UDP/IPv6 translation");
+  check_translated_packet(udp_ipv6, sizeof(udp_ipv6), udp_ipv4, sizeof(udp_ipv4),
+                          "UDP/IPv6 -> UDP/IPv4 translation");
+  for (size_t i = 0; i < ARRAYSIZE(kIPv6Fragments); i++) {
+    check_translated_packet(kIPv6Fragments[i], kIPv6FragLengths[i], kIPv4Fragments[i],
+                            kIPv4FragLengths[i], "IPv6->IPv4 fragment translation");
+  }
+
+  // None of these get as far as sending anything, so the fd is never used.
+  translate_packet(-1, 1 /* to_ipv6 */, udp_ipv4, sizeof(struct iphdr) - 1);
+  udp_ipv4[9] = IPPROTO_SCTP;
+  translate_packet(-1, 1 /* to_ipv6 */, udp_ipv4, sizeof(udp_ipv4));
+  translate_packet(-1, 0 /* to_ipv6 */, udp_ipv6, sizeof(struct ip6_hdr) + 4);
+  udp_ipv6[24] = 0xff;  // Multicast destination.
+  translate_packet(-1, 0 /* to_ipv6 */, udp_ipv6, sizeof(udp_ipv6));
+
+  EXPECT_EQ(1U, stats->counters[CLATD_STAT_PACKETS_4_TO_6]);
+  EXPECT_EQ(sizeof(udp_ipv6), stats->counters[CLATD_STAT_BYTES_4_TO_6]);
+  EXPECT_EQ(1U + ARRAYSIZE(kIPv6Fragments), stats->counters[CLATD_STAT_PACKETS_6_TO_4]);
+  uint64_t bytes_6_to_4 = sizeof(udp_ipv4);
+  for (size_t i = 0; i < ARRAYSIZE(kIPv4FragLengths); i++) bytes_6_to_4 += kIPv4FragLengths[i];
+  EXPECT_EQ(bytes_6_to_4, stats->counters[CLATD_STAT_BYTES_6_TO_4]);
+  EXPECT_EQ(ARRAYSIZE(kIPv6Fragments), stats->counters[CLATD_STAT_FRAGMENTS_6_TO_4]);
+  EXPECT_EQ(0U, stats->counters[CLATD_STAT_FRAGMENTS_4_TO_6]);
+  EXPECT_EQ(1U, stats->counters[CLATD_STAT_SHORT_IP_HEADER]);
+  EXPECT_EQ(1U, stats->counters[CLATD_STAT_UNKNOWN_PROTO]);
+  EXPECT_EQ(1U, stats->counters[CLATD_STAT_SHORT_TRANSPORT_HEADER]);
+  EXPECT_EQ(1U, stats->counters[CLATD_STAT_IPV6_MULTICAST]);
+  EXPECT_STREQ("IPV6_MULTICAST", clatd_stat_names[CLATD_STAT_IPV6_MULTICAST]);
+
+  Clatd_Stats = old_stats;
+  munmap(shared_stats, sizeof(*shared_stats));
+  munmap((void *)stats, sizeof(*stats));
+}
+
 // picks a random interface ID that is checksum neutral with the IPv4 address and the NAT64 prefix
 void gen_random_iid(struct in6_addr *myaddr, struct in_addr *ipv4_local_subnet,
                     struct in6_addr *plat_subnet) {
@@ -817,10 +890,19 @@ TEST_F(ClatdTest, TranslateChecksumNeutral) {
 
   ASSERT_NE(htonl((uint32_t)0x00000464), Global_Clatd_Config.ipv6_local_subnet.s6_addr32[3]);
   ASSERT_NE((uint32_t)0, Global_Clatd_Config.ipv6_local_subnet.s6_addr32[3]);
+  init_header_templates();
 
   // Check that translating UDP packets is checksum-neutral. First, IPv4.
   uint8_t udp_ipv4[] = { IPV4_UDP_HEADER UDP_HEADER PAYLOAD };
   fix_udp_checksum(udp_ipv4);
+
+  // With a checksum-neutral address, the precomputed pseudo-header sums are identical, so that
+  // the transport checksum is not even adjusted.
+  const struct iphdr *ip = (struct iphdr *)udp_ipv4;
+  ASSERT_TRUE(is_local_ipv4_flow(ip));
+  EXPECT_EQ(ipv4_pseudo_header_checksum(ip, UDP_LEN),
+            local_ipv6_pseudo_header_checksum(ip->daddr, UDP_LEN, IPPROTO_UDP));
+
   check_translate_checksum_neutral(udp_ipv4, sizeof(udp_ipv4), sizeof(udp_ipv4) + 20,
                                    "UDP/IPv4 -> UDP/IPv6 checksum neutral");
 
@@ -833,3 +915,205 @@ TEST_F(ClatdTest, TranslateChecksumNeutral) {
   check_translate_checksum_neutral(udp_ipv4, sizeof(udp_ipv4), sizeof(udp_ipv4) + 20,
                                    "UDP/IPv4 -> UDP/IPv6 checksum neutral");
 }
+
+// Builds a TCP packet from the clat address to 8.8.8.8 (or from 8.8.8.8 to it, for IPv6), with a
+// partial checksum as the kernel would send it with VIRTIO_NET_HDR_F_NEEDS_CSUM.
+size_t make_partial_tcp_packet(uint8_t *packet, int version, size_t payload_len) {
+  const size_t ip_len = (version == 4) ? sizeof(struct iphdr) : sizeof(struct ip6_hdr);
+  const size_t l4_len = sizeof(struct tcphdr) + payload_len;
+  struct tcphdr *tcp  = (struct tcphdr *)(packet + ip_len);
+  uint32_t pseudo_checksum;
+
+  memset(packet, 0, ip_len + sizeof(*tcp));
+  if (version == 4) {
+    struct iphdr *ip = (struct iphdr *)packet;
+    ip->version      = 4;
+    ip->ihl          = 5;
+    ip->tot_len      = htons(ip_len + l4_len);
+    ip->frag_off     = htons(IP_DF);
+    ip->ttl          = 55;
+    ip->protocol     = IPPROTO_TCP;
+    ip->saddr        = Global_Clatd_Config.ipv4_local_subnet.s_addr;
+    inet_pton(AF_INET, "8.8.8.8", &ip->daddr);
+    ip->check       = ip_checksum(ip, sizeof(*ip));
+    pseudo_checksum = ipv4_pseudo_header_checksum(ip, l4_len);
+  } else {
+    struct ip6_hdr *ip6 = (struct ip6_hdr *)packet;
+    ip6->ip6_vfc        = 0x60;
+    ip6->ip6_plen       = htons(l4_len);
+    ip6->ip6_nxt        = IPPROTO_TCP;
+    ip6->ip6_hlim       = 55;
+    inet_pton(AF_INET6, "64:ff9b::8.8.8.8", &ip6->ip6_src);
+    ip6->ip6_dst    = Global_Clatd_Config.ipv6_local_subnet;
+    pseudo_checksum = ipv6_pseudo_header_checksum(ip6, l4_len, IPPROTO_TCP);
+  }
+  tcp->source  = htons(443);
+  tcp->dest    = htons(40000);
+  tcp->seq     = htonl(1000);
+  tcp->doff    = 5;
+  tcp->ack     = 1;
+  tcp->psh     = 1;
+  tcp->check   = ~ip_checksum_finish(pseudo_checksum);
+  for (size_t i = 0; i < payload_len; i++) packet[ip_len + sizeof(*tcp) + i] = i;
+  return ip_len + l4_len;
+}
+
+TEST_F(ClatdTest, TranslateGsoSuperpacket) {
+  inet_pton(AF_INET6, kIPv6LocalAddr, &Global_Clatd_Config.ipv6_local_subnet);
+  init_header_templates();
+
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, fds));
+
+  // A TSO superpacket from the tun is sent as separate, fully checksummed IPv6 segments.
+  uint8_t packet[sizeof(struct iphdr) + sizeof(struct tcphdr) + 3000];
+  size_t len = make_partial_tcp_packet(packet, 4, 3000);
+  struct virtio_net_hdr vnet = {
+    .flags       = VIRTIO_NET_HDR_F_NEEDS_CSUM,
+    .gso_type    = VIRTIO_NET_HDR_GSO_TCPV4,
+    .hdr_len     = sizeof(struct iphdr) + sizeof(struct tcphdr),
+    .gso_size    = 1200,
+    .csum_start  = sizeof(struct iphdr),
+    .csum_offset = offsetof(struct tcphdr, check),
+  };
+  translate_vnet_packet(fds[0], 1 /* to_ipv6 */, packet, len, &vnet);
+
+  const uint8_t *payload = packet + sizeof(struct iphdr) + sizeof(struct tcphdr);
+  uint8_t out[MAXMTU];
+  for (size_t offset = 0; offset < 3000; offset += 1200) {
+    const size_t seg_len = std::min<size_t>(1200, 3000 - offset);
+    ssize_t outlen       = read(fds[1], out, sizeof(out));
+    ASSERT_EQ((ssize_t)(sizeof(struct ip6_hdr) + sizeof(struct tcphdr) + seg_len), outlen);
+    check_packet(out, outlen, "TCP/IPv4 superpacket -> TCP/IPv6 segment");
+
+    struct tcphdr *tcp = (struct tcphdr *)(out + sizeof(struct ip6_hdr));
+    EXPECT_EQ(1000 + offset, ntohl(tcp->seq));
+    EXPECT_EQ(offset + seg_len == 3000, tcp->psh);
+    EXPECT_EQ(0, memcmp(payload + offset, tcp + 1, seg_len));
+  }
+  EXPECT_EQ(-1, read(fds[1], out, sizeof(out))) << "Unexpected extra segment";
+
+  // A GRO superpacket from the packet socket goes to the tun as a whole, with a partial checksum.
+  uint8_t packet6[sizeof(struct ip6_hdr) + sizeof(struct tcphdr) + 3000];
+  len = make_partial_tcp_packet(packet6, 6, 3000);
+  vnet.gso_type   = VIRTIO_NET_HDR_GSO_TCPV6;
+  vnet.hdr_len    = sizeof(struct ip6_hdr) + sizeof(struct tcphdr);
+  vnet.csum_start = sizeof(struct ip6_hdr);
+  translate_vnet_packet(fds[1], 0 /* to_ipv6 */, packet6, len, &vnet);
+
+  struct tun_pi tun_header;
+  struct virtio_net_hdr vnet_out;
+  struct iovec iov[] = {
+    { &tun_header, sizeof(tun_header) },
+    { &vnet_out, sizeof(vnet_out) },
+    { out, sizeof(out) },
+  };
+  ssize_t outlen = readv(fds[0], iov, ARRAYSIZE(iov)) - sizeof(tun_header) - sizeof(vnet_out);
+  ASSERT_EQ((ssize_t)(sizeof(struct iphdr) + sizeof(struct tcphdr) + 3000), outlen);
+  EXPECT_EQ(htons(ETH_P_IP), tun_header.proto);
+  EXPECT_EQ(VIRTIO_NET_HDR_F_NEEDS_CSUM, vnet_out.flags);
+  EXPECT_EQ(VIRTIO_NET_HDR_GSO_TCPV4, vnet_out.gso_type);
+  EXPECT_EQ(sizeof(struct iphdr) + sizeof(struct tcphdr), vnet_out.hdr_len);
+  EXPECT_EQ(1200, vnet_out.gso_size);
+  EXPECT_EQ(sizeof(struct iphdr), vnet_out.csum_start);
+  EXPECT_EQ(offsetof(struct tcphdr, check), vnet_out.csum_offset);
+  ASSERT_EQ(0, finish_partial_checksum(out, outlen, vnet_out.csum_start, vnet_out.csum_offset));
+  check_packet(out, outlen, "TCP/IPv6 superpacket -> TCP/IPv4 superpacket");
+  EXPECT_EQ(0, memcmp(payload, out + sizeof(struct iphdr) + sizeof(struct tcphdr), 3000));
+
+  // Packets without offloads get an empty virtio_net_hdr.
+  uint8_t udp_ipv6[] = { IPV6_UDP_HEADER UDP_HEADER PAYLOAD };
+  fix_udp_checksum(udp_ipv6);
+  memset(&vnet, 0, sizeof(vnet));
+  translate_vnet_packet(fds[1], 0 /* to_ipv6 */, udp_ipv6, sizeof(udp_ipv6), &vnet);
+  outlen = readv(fds[0], iov, ARRAYSIZE(iov)) - sizeof(tun_header) - sizeof(vnet_out);
+  ASSERT_EQ((ssize_t)sizeof(udp_ipv6) - 20, outlen);
+  EXPECT_EQ(0, vnet_out.flags);
+  EXPECT_EQ(VIRTIO_NET_HDR_GSO_NONE, vnet_out.gso_type);
+  check_packet(out, outlen, "UDP/IPv6 -> UDP/IPv4 with virtio_net_hdr");
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// Stands in for xdp/clat_xsk_rawip, so that this does not depend on clatd_xsk.o being loaded: a
+// program which redirects every packet to the socket at index 0 of the XSKMAP.
+static int load_xsk_redirect_program(int map_fd) {
+  const struct bpf_insn insns[] = {
+    { .code = BPF_LD | BPF_DW | BPF_IMM, .dst_reg = BPF_REG_1, .src_reg = BPF_PSEUDO_MAP_FD,
+      .imm = map_fd },
+    { .imm = 0 },
+    { .code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_2, .imm = 0 },
+    { .code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_3, .imm = XDP_PASS },
+    { .code = BPF_JMP | BPF_CALL, .imm = BPF_FUNC_redirect_map },
+    { .code = BPF_JMP | BPF_EXIT },
+  };
+  union bpf_attr attr = {};
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insns     = (uintptr_t)insns;
+  attr.insn_cnt  = ARRAYSIZE(insns);
+  attr.license   = (uintptr_t)"Apache 2.0";
+  return syscall(__NR_bpf, BPF_PROG_LOAD, &attr, sizeof(attr));
+}
+
+TEST_F(ClatdTest, XskReceive) {
+  inet_pton(AF_INET6, kIPv6LocalAddr, &Global_Clatd_Config.ipv6_local_subnet);
+  init_header_templates();
+
+  union bpf_attr attr = {};
+  attr.map_type    = BPF_MAP_TYPE_XSKMAP;
+  attr.key_size    = sizeof(uint32_t);
+  attr.value_size  = sizeof(uint32_t);
+  attr.max_entries = 1;
+  const int map_fd = syscall(__NR_bpf, BPF_MAP_CREATE, &attr, sizeof(attr));
+  if (map_fd == -1) {
+    GTEST_SKIP() << "XSKMAP not supported: " << strerror(errno);
+  }
+  const int prog_fd = load_xsk_redirect_program(map_fd);
+  ASSERT_LE(0, prog_fd) << strerror(errno);
+
+  // A socketpair stands in for the tun.
+  int tun_fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_DGRAM, 0, tun_fds));
+  struct tun_data tunnel = {};
+  tunnel.fd4             = tun_fds[1];
+
+  const int xsk_fd = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+  ASSERT_LE(0, xsk_fd) << strerror(errno);
+  ASSERT_EQ(0, xsk_configure(&tunnel, xsk_fd, sTun.ifindex(), map_fd, 0));
+  EXPECT_EQ(xsk_fd, tunnel.xsk_fd);
+
+  // Generic XDP works on any interface, like the packet socket does.
+  memset(&attr, 0, sizeof(attr));
+  attr.link_create.prog_fd        = prog_fd;
+  attr.link_create.target_ifindex = sTun.ifindex();
+  attr.link_create.attach_type    = BPF_XDP;
+  attr.link_create.flags          = XDP_FLAGS_SKB_MODE;
+  const int link_fd = syscall(__NR_bpf, BPF_LINK_CREATE, &attr, sizeof(attr));
+  ASSERT_LE(0, link_fd) << strerror(errno);
+
+  uint8_t udp_ipv6[] = { IPV6_UDP_HEADER UDP_HEADER PAYLOAD };
+  uint8_t udp_ipv4[] = { IPV4_UDP_HEADER UDP_HEADER PAYLOAD };
+  fix_udp_checksum(udp_ipv6);
+  fix_udp_checksum(udp_ipv4);
+
+  // More packets than there are UMEM frames, so that this only passes if frames are recycled.
+  for (int i = 0; i < 300; i++) {
+    ASSERT_EQ((ssize_t)sizeof(udp_ipv6), write(sTun.fd(), udp_ipv6, sizeof(udp_ipv6)));
+    struct pollfd pfd = { xsk_fd, POLLIN, 0 };
+    ASSERT_EQ(1, poll(&pfd, 1, 1000)) << "Packet " << i << " was not redirected";
+    process_packet_xsk(&tunnel);
+
+    struct tun_pi tun_header;
+    uint8_t out[sizeof(udp_ipv4) + 1];
+    struct iovec iov[] = {
+      { &tun_header, sizeof(tun_header) },
+      { out, sizeof(out) },
+    };
+    ASSERT_EQ((ssize_t)(sizeof(tun_header) + sizeof(udp_ipv4)), readv(tun_fds[0], iov, 2));
+    EXPECT_EQ(htons(ETH_P_IP), tun_header.proto);
+    check_data_matches(udp_ipv4, out, sizeof(udp_ipv4), "UDP/IPv6 -> UDP/IPv4 through AF_XDP");
+  }
+
+  for (int fd : { link_fd, xsk_fd, prog_fd, map_fd, tun_fds[0], tun_fds[1] }) close(fd);
+}
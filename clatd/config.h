@@ -24,6 +24,8 @@
 struct tun_data {
   char device4[IFNAMSIZ];
   int read_fd6, write_fd6, fd4;
+  int vnet_hdr;  // fd4 has IFF_VNET_HDR: packets carry a virtio_net_hdr, and may be GSO.
+  int xsk_fd;    // AF_XDP socket that IPv6 packets are also received on, or 0 if none.
 };
 
 struct clat_config {
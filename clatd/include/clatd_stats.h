@@ -0,0 +1,72 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * clatd_stats.h - counters that clatd keeps in memory shared with the system server
+ *
+ * The system server creates a memfd of sizeof(struct clatd_stats) and passes it to clatd with -s.
+ * clatd is the only writer, and stores each counter with a single (relaxed) atomic store, so the
+ * system server can read them at any time without locking. Both are built from the same tree, so
+ * there is no versioning.
+ */
+#ifndef __CLATD_STATS_H__
+#define __CLATD_STATS_H__
+
+#include <stdint.h>
+
+// Drop reasons may be counted for the inner packet of an ICMP error, which drops the error too.
+#define CLATD_STATS                 \
+  STAT(PACKETS_4_TO_6)              \
+  STAT(BYTES_4_TO_6)                \
+  STAT(PACKETS_6_TO_4)              \
+  STAT(BYTES_6_TO_4)                \
+  STAT(GSO_SEGMENTS)                \
+  STAT(FRAGMENTS_4_TO_6)            \
+  STAT(FRAGMENTS_6_TO_4)            \
+  STAT(CHECKSUM_COMPLETED)          \
+  STAT(CHECKSUM_UDP_ZERO)           \
+  STAT(READ_ERROR)                  \
+  STAT(READ_TRUNCATED)              \
+  STAT(SHORT_READ)                  \
+  STAT(TUN_UNKNOWN_PROTO)           \
+  STAT(CHECKSUM_OUT_OF_RANGE)       \
+  STAT(SHORT_IP_HEADER)             \
+  STAT(BAD_IP_HEADER)               \
+  STAT(IPV6_MULTICAST)              \
+  STAT(IPV6_WRONG_ADDRESS)          \
+  STAT(SHORT_FRAG_HEADER)           \
+  STAT(UNKNOWN_PROTO)               \
+  STAT(SHORT_TRANSPORT_HEADER)      \
+  STAT(BAD_TCP_HEADER)              \
+  STAT(TCP_HEADER_TRUNCATED)        \
+  STAT(ICMP_UNSUPPORTED)            \
+  STAT(_MAX)
+
+#define STAT(x) CLATD_STAT_##x,
+enum clatd_stat {
+  CLATD_STATS
+};
+#undef STAT
+
+#define STAT(x) #x,
+static const char *const clatd_stat_names[] = {
+  CLATD_STATS
+};
+#undef STAT
+
+struct clatd_stats {
+  uint64_t counters[CLATD_STAT__MAX];
+};
+
+#endif /* __CLATD_STATS_H__ */
@@ -21,6 +21,7 @@
 #include "debug.h"
 #include "dump.h"
 #include "logging.h"
+#include "stats.h"
 #include "translate.h"
 
 /* function: icmp_packet
@@ -38,6 +39,7 @@ int icmp_packet(clat_packet out, clat_packet_index pos, const struct icmphdr *ic
 
   if (len < sizeof(struct icmphdr)) {
     logmsg_dbg(ANDROID_LOG_ERROR, "icmp_packet/(too small)");
+    stats_inc(CLATD_STAT_SHORT_TRANSPORT_HEADER);
     return 0;
   }
 
@@ -67,21 +69,25 @@ int ipv4_packet(clat_packet out, clat_packet_index pos, const uint8_t *packet, s
 
   if (len < sizeof(struct iphdr)) {
     logmsg_dbg(ANDROID_LOG_ERROR, "ip_packet/too short for an ip header");
+    stats_inc(CLATD_STAT_SHORT_IP_HEADER);
     return 0;
   }
 
   if (header->ihl < 5) {
     logmsg_dbg(ANDROID_LOG_ERROR, "ip_packet/ip header length set to less than 5: %x", header->ihl);
+    stats_inc(CLATD_STAT_BAD_IP_HEADER);
     return 0;
   }
 
   if ((size_t)header->ihl * 4 > len) {  // ip header length larger than entire packet
     logmsg_dbg(ANDROID_LOG_ERROR, "ip_packet/ip header length set too large: %x", header->ihl);
+    stats_inc(CLATD_STAT_BAD_IP_HEADER);
     return 0;
   }
 
   if (header->version != 4) {
     logmsg_dbg(ANDROID_LOG_ERROR, "ip_packet/ip header version not 4: %x", header->version);
+    stats_inc(CLATD_STAT_BAD_IP_HEADER);
     return 0;
   }
 
@@ -112,12 +118,17 @@ int ipv4_packet(clat_packet out, clat_packet_index pos, const uint8_t *packet, s
    * translation does not change the transport layer length, the checksum is unaffected.
    */
   old_sum = ipv4_pseudo_header_checksum(header, len_left);
-  new_sum = ipv6_pseudo_header_checksum(ip6_targ, len_left, nxthdr);
+  if (is_local_ipv4_flow(header)) {
+    new_sum = local_ipv6_pseudo_header_checksum(header->daddr, len_left, nxthdr);
+  } else {
+    new_sum = ipv6_pseudo_header_checksum(ip6_targ, len_left, nxthdr);
+  }
 
   // If the IPv4 packet is fragmented, add a Fragment header.
   frag_hdr             = (struct ip6_frag *)out[pos + 1].iov_base;
   frag_hdr_len         = maybe_fill_frag_header(frag_hdr, ip6_targ, header);
   out[pos + 1].iov_len = frag_hdr_len;
+  if (frag_hdr_len) stats_inc(CLATD_STAT_FRAGMENTS_4_TO_6);
 
   if (frag_hdr_len && frag_hdr->ip6f_offlg & IP6F_OFF_MASK) {
     // Non-first fragment. Copy the rest of the packet as is.
@@ -137,6 +148,7 @@ int ipv4_packet(clat_packet out, clat_packet_index pos, const uint8_t *packet, s
     logmsg_dbg(ANDROID_LOG_ERROR, "ip_packet/unknown protocol: %x", header->protocol);
     logcat_hexdump("ipv4/protocol", packet, len);
 #endif
+    stats_inc(CLATD_STAT_UNKNOWN_PROTO);
     return 0;
   }
 
@@ -23,6 +23,7 @@
 #include "debug.h"
 #include "dump.h"
 #include "logging.h"
+#include "stats.h"
 #include "translate.h"
 
 /* function: icmp6_packet
@@ -40,6 +41,7 @@ int icmp6_packet(clat_packet out, clat_packet_index pos, const struct icmp6_hdr
 
   if (len < sizeof(struct icmp6_hdr)) {
     logmsg_dbg(ANDROID_LOG_ERROR, "icmp6_packet/(too small)");
+    stats_inc(CLATD_STAT_SHORT_TRANSPORT_HEADER);
     return 0;
   }
 
@@ -82,15 +84,18 @@ int ipv6_packet(clat_packet out, clat_packet_index pos, const uint8_t *packet, s
   const uint8_t *next_header;
   size_t len_left;
   uint32_t old_sum, new_sum;
+  int local_flow;
   int iov_len;
 
   if (len < sizeof(struct ip6_hdr)) {
     logmsg_dbg(ANDROID_LOG_ERROR, "ipv6_packet/too short for an ip6 header: %d", len);
+    stats_inc(CLATD_STAT_SHORT_IP_HEADER);
     return 0;
   }
 
   if (IN6_IS_ADDR_MULTICAST(&ip6->ip6_dst)) {
     log_bad_address("ipv6_packet/multicast %s->%s", &ip6->ip6_src, &ip6->ip6_dst);
+    stats_inc(CLATD_STAT_IPV6_MULTICAST);
     return 0;  // silently ignore
   }
 
@@ -100,12 +105,15 @@ int ipv6_packet(clat_packet out, clat_packet_index pos, const uint8_t *packet, s
   // to translate them. We accept third-party ICMPv6 errors, even though their source addresses
   // cannot be translated, so that things like unreachables and traceroute will work. fill_ip_header
   // takes care of faking a source address for them.
-  if (!(is_in_plat_subnet(&ip6->ip6_src) &&
+  local_flow = is_local_ipv6_flow(ip6);
+  if (!local_flow &&
+      !(is_in_plat_subnet(&ip6->ip6_src) &&
         IN6_ARE_ADDR_EQUAL(&ip6->ip6_dst, &Global_Clatd_Config.ipv6_local_subnet)) &&
       !(is_in_plat_subnet(&ip6->ip6_dst) &&
         IN6_ARE_ADDR_EQUAL(&ip6->ip6_src, &Global_Clatd_Config.ipv6_local_subnet)) &&
       ip6->ip6_nxt != IPPROTO_ICMPV6) {
     log_bad_address("ipv6_packet/wrong source address: %s->%s", &ip6->ip6_src, &ip6->ip6_dst);
+    stats_inc(CLATD_STAT_IPV6_WRONG_ADDRESS);
     return 0;
   }
 
@@ -127,6 +135,7 @@ int ipv6_packet(clat_packet out, clat_packet_index pos, const uint8_t *packet, s
     frag_hdr = (struct ip6_frag *)next_header;
     if (len_left < sizeof(*frag_hdr)) {
       logmsg_dbg(ANDROID_LOG_ERROR, "ipv6_packet/too short for fragment header: %d", len);
+      stats_inc(CLATD_STAT_SHORT_FRAG_HEADER);
       return 0;
     }
 
@@ -134,6 +143,7 @@ int ipv6_packet(clat_packet out, clat_packet_index pos, const uint8_t *packet, s
     len_left -= sizeof(*frag_hdr);
 
     protocol = parse_frag_header(frag_hdr, ip_targ);
+    stats_inc(CLATD_STAT_FRAGMENTS_6_TO_4);
   }
 
   // ICMP and ICMPv6 have different protocol numbers.
@@ -147,7 +157,11 @@ int ipv6_packet(clat_packet out, clat_packet_index pos, const uint8_t *packet, s
    * length, which is not the same as len_left in the case of fragmented packets. But since
    * translation does not change the transport layer length, the checksum is unaffected.
    */
-  old_sum = ipv6_pseudo_header_checksum(ip6, len_left, protocol);
+  if (local_flow) {
+    old_sum = local_ipv6_pseudo_header_checksum(ip6->ip6_src.s6_addr32[3], len_left, protocol);
+  } else {
+    old_sum = ipv6_pseudo_header_checksum(ip6, len_left, protocol);
+  }
   new_sum = ipv4_pseudo_header_checksum(ip_targ, len_left);
 
   // Does not support IPv6 extension headers except Fragment.
@@ -168,6 +182,7 @@ int ipv6_packet(clat_packet out, clat_packet_index pos, const uint8_t *packet, s
     logmsg(ANDROID_LOG_ERROR, "ipv6_packet/unknown next header type: %x", ip6->ip6_nxt);
     logcat_hexdump("ipv6/nxthdr", packet, len);
 #endif
+    stats_inc(CLATD_STAT_UNKNOWN_PROTO);
     return 0;
   }
 
@@ -18,19 +18,26 @@
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <net/if.h>
 #include <netinet/in.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/personality.h>
 #include <sys/utsname.h>
 #include <unistd.h>
 
+#include <linux/if_tun.h>
+
 #include "clatd.h"
 #include "common.h"
 #include "config.h"
 #include "logging.h"
+#include "stats.h"
+#include "translate.h"
+#include "xsk.h"
 
 #define DEVICEPREFIX "v4-"
 
@@ -51,6 +58,10 @@ void print_help() {
   printf("-t [tun file descriptor number]\n");
   printf("-r [read socket descriptor number]\n");
   printf("-w [write socket descriptor number]\n");
+  printf("-x [AF_XDP socket descriptor number]\n");
+  printf("-m [XSKMAP descriptor number, for -x]\n");
+  printf("-k [index of the AF_XDP socket in the XSKMAP, for -x]\n");
+  printf("-s [counter shared memory descriptor number]\n");
 }
 
 /* function: main
@@ -61,10 +72,11 @@ int main(int argc, char **argv) {
   int opt;
   char *uplink_interface = NULL, *plat_prefix = NULL;
   char *v4_addr = NULL, *v6_addr = NULL, *tunfd_str = NULL, *read_sock_str = NULL,
-       *write_sock_str = NULL;
+       *write_sock_str = NULL, *xsk_str = NULL, *xsk_map_str = NULL, *xsk_index_str = NULL,
+       *stats_str = NULL;
   unsigned len;
 
-  while ((opt = getopt(argc, argv, "i:p:4:6:t:r:w:h")) != -1) {
+  while ((opt = getopt(argc, argv, "i:p:4:6:t:r:w:x:m:k:s:h")) != -1) {
     switch (opt) {
       case 'i':
         uplink_interface = optarg;
@@ -87,6 +99,18 @@ int main(int argc, char **argv) {
       case 'w':
         write_sock_str = optarg;
         break;
+      case 'x':
+        xsk_str = optarg;
+        break;
+      case 'm':
+        xsk_map_str = optarg;
+        break;
+      case 'k':
+        xsk_index_str = optarg;
+        break;
+      case 's':
+        stats_str = optarg;
+        break;
       case 'h':
         print_help();
         exit(0);
@@ -150,9 +174,49 @@ int main(int argc, char **argv) {
     exit(1);
   }
 
-  logmsg(ANDROID_LOG_INFO, "Starting clat version %s on %s plat=%s v4=%s v6=%s", CLATD_VERSION,
+  // The parent reads our counters from this, see clatd_stats.h. If it cannot be mapped we keep
+  // counting in private memory, which nobody will see, but is better than not running at all.
+  if (stats_str != NULL) {
+    int stats_fd, ret;
+    if (!parse_int(stats_str, &stats_fd)) {
+      logmsg(ANDROID_LOG_FATAL, "invalid counter fd %s", stats_str);
+      exit(1);
+    }
+    if ((ret = stats_map(stats_fd))) {
+      logmsg(ANDROID_LOG_WARN, "could not map counters: %s", strerror(-ret));
+    }
+    close(stats_fd);
+  }
+
+  init_header_templates();
+
+  // The tun was created by our parent, which decides whether it does GSO and checksum offload.
+  struct ifreq ifr = {};
+  tunnel.vnet_hdr = !ioctl(tunnel.fd4, TUNGETIFF, &ifr) && (ifr.ifr_flags & IFF_VNET_HDR);
+
+  logmsg(ANDROID_LOG_INFO, "Starting clat version %s on %s plat=%s v4=%s v6=%s%s", CLATD_VERSION,
          uplink_interface, plat_prefix ? plat_prefix : "(none)", v4_addr ? v4_addr : "(none)",
-         v6_addr ? v6_addr : "(none)");
+         v6_addr ? v6_addr : "(none)", tunnel.vnet_hdr ? " vnet_hdr" : "");
+
+  // The parent attached xdp/clat_xsk_* to the uplink, and pointed its clat_xsk6_map entry for our
+  // address at the index. Failing to set the socket up is not fatal, since the packet socket
+  // receives whatever is not redirected.
+  tunnel.xsk_fd = 0;
+  if (xsk_str != NULL) {
+    int xsk_fd, xsk_map_fd, xsk_index;
+    if (!parse_int(xsk_str, &xsk_fd) || xsk_map_str == NULL ||
+        !parse_int(xsk_map_str, &xsk_map_fd) || xsk_index_str == NULL ||
+        !parse_int(xsk_index_str, &xsk_index) || xsk_index < 0) {
+      logmsg(ANDROID_LOG_FATAL, "invalid AF_XDP socket %s, XSKMAP %s or index %s", xsk_str,
+             xsk_map_str ? xsk_map_str : "(none)", xsk_index_str ? xsk_index_str : "(none)");
+      exit(1);
+    }
+    if (xsk_configure(&tunnel, xsk_fd, if_nametoindex(uplink_interface), xsk_map_fd,
+                      xsk_index)) {
+      close(xsk_fd);
+    }
+    close(xsk_map_fd);
+  }
 
   {
     // Compile time detection of 32 vs 64-bit build. (note: C does not have 'constexpr')
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * stats.c - drop/punt and traffic counters
+ */
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stats.h"
+
+static struct clatd_stats private_stats;
+
+struct clatd_stats *Clatd_Stats = &private_stats;
+
+int stats_map(int fd) {
+  struct stat st;
+  if (fstat(fd, &st)) return -errno;
+  if (st.st_size < (off_t)sizeof(struct clatd_stats)) return -EINVAL;
+
+  struct clatd_stats *shared =
+    mmap(NULL, sizeof(struct clatd_stats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (shared == MAP_FAILED) return -errno;
+
+  // Keep whatever was counted before, normally nothing.
+  memcpy(shared, Clatd_Stats, sizeof(struct clatd_stats));
+  Clatd_Stats = shared;
+  return 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * stats.h - drop/punt and traffic counters
+ */
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include "clatd_stats.h"
+
+// Where the counters are kept. Private memory until stats_map() is called.
+extern struct clatd_stats *Clatd_Stats;
+
+// Moves the counters into the shared memory fd, see clatd_stats.h. Returns 0 or -errno.
+int stats_map(int fd);
+
+/* function: stats_add
+ * adds to a counter. We are the only writer, so this needs no atomic read-modify-write, only a
+ * store that a concurrent reader cannot see half of.
+ *   stat - the counter
+ *   n    - what to add to it
+ */
+static inline void stats_add(enum clatd_stat stat, uint64_t n) {
+  uint64_t *counter = &Clatd_Stats->counters[stat];
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static inline void stats_inc(enum clatd_stat stat) { stats_add(stat, 1); }
+
+#endif /* __STATS_H__ */
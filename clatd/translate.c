@@ -19,6 +19,8 @@
 
 #include <string.h>
 
+#include <linux/virtio_net.h>
+
 #include "checksum.h"
 #include "clatd.h"
 #include "common.h"
@@ -26,6 +28,59 @@
 #include "debug.h"
 #include "icmp.h"
 #include "logging.h"
+#include "stats.h"
+
+struct clat_header_templates Global_Clatd_Templates;
+
+/* function: init_header_templates
+ * precomputes the translated headers and pseudo-header sums for our own address pair, so that
+ * translating the common case is a struct copy plus a few field stores
+ */
+void init_header_templates(void) {
+  struct clat_header_templates *t = &Global_Clatd_Templates;
+  uint32_t ipv4_local_sum;
+
+  memset(t, 0, sizeof(*t));
+
+  t->ip6.ip6_vfc              = 6 << 4;
+  t->ip6.ip6_src              = Global_Clatd_Config.ipv6_local_subnet;
+  t->ip6.ip6_dst              = Global_Clatd_Config.plat_subnet;
+  t->ip6.ip6_dst.s6_addr32[3] = 0;
+
+  t->ip.ihl      = 5;
+  t->ip.version  = 4;
+  t->ip.frag_off = htons(IP_DF);
+  t->ip.daddr    = Global_Clatd_Config.ipv4_local_subnet.s_addr;
+
+  // Assumes a /96 plat subnet.
+  t->ipv6_pair_sum = ip_checksum_add(0, &t->ip6.ip6_src, sizeof(struct in6_addr));
+  t->ipv6_pair_sum = ip_checksum_add(t->ipv6_pair_sum, &t->ip6.ip6_dst, 12);
+
+  // If our IPv6 address was made checksum-neutral (see makeChecksumNeutral() in libclat), the pair
+  // sums to the same as our IPv4 address. Use the IPv4 sum then, so that the IPv4 and IPv6
+  // pseudo-header sums come out identical and tcp_translate() and udp_translate() can leave the
+  // transport checksum alone.
+  ipv4_local_sum = ip_checksum_add(0, &t->ip.daddr, sizeof(t->ip.daddr));
+  // (0x0000 and 0xffff are both zero in one's complement.)
+  if (ip_checksum_finish(ipv4_local_sum) % 0xffff ==
+      ip_checksum_finish(t->ipv6_pair_sum) % 0xffff) {
+    t->ipv6_pair_sum = ipv4_local_sum;
+  }
+}
+
+/* function: local_ipv6_pseudo_header_checksum
+ * calculates the ipv6 pseudo-header checksum of a packet between our IPv6 address and the plat
+ * address of a remote IPv4 host, using the precomputed sum for the address pair
+ * remote_addr4 - the remote IPv4 address
+ * len          - the transport length (transport header + payload)
+ * protocol     - the transport layer protocol
+ */
+uint32_t local_ipv6_pseudo_header_checksum(uint32_t remote_addr4, uint32_t len, uint8_t protocol) {
+  // Same sum as ipv6_pseudo_header_checksum(), which adds htonl(len) and htonl(protocol). The
+  // high 16 bits of both are zero, as len fits in an IP(v4) length field.
+  return Global_Clatd_Templates.ipv6_pair_sum + (remote_addr4 & 0xffff) + (remote_addr4 >> 16) +
+         htons(len) + htons(protocol);
+}
 
 /* function: packet_checksum
  * calculates the checksum over all the packet components starting from pos
@@ -124,28 +179,33 @@ void fill_tun_header(struct tun_pi *tun_header, uint16_t proto) {
 void fill_ip_header(struct iphdr *ip, uint16_t payload_len, uint8_t protocol,
                     const struct ip6_hdr *old_header) {
   int ttl_guess;
-  memset(ip, 0, sizeof(struct iphdr));
 
-  ip->ihl      = 5;
-  ip->version  = 4;
-  ip->tos      = 0;
-  ip->tot_len  = htons(sizeof(struct iphdr) + payload_len);
-  ip->id       = 0;
-  ip->frag_off = htons(IP_DF);
-  ip->ttl      = old_header->ip6_hlim;
-  ip->protocol = protocol;
-  ip->check    = 0;
+  if (is_local_ipv6_flow(old_header)) {
+    // The common case: from a remote host to our IPv4 address.
+    *ip       = Global_Clatd_Templates.ip;
+    ip->saddr = old_header->ip6_src.s6_addr32[3];
+  } else {
+    memset(ip, 0, sizeof(struct iphdr));
+
+    ip->ihl      = 5;
+    ip->version  = 4;
+    ip->frag_off = htons(IP_DF);
 
-  ip->saddr = ipv6_addr_to_ipv4_addr(&old_header->ip6_src);
-  ip->daddr = ipv6_addr_to_ipv4_addr(&old_header->ip6_dst);
+    ip->saddr = ipv6_addr_to_ipv4_addr(&old_header->ip6_src);
+    ip->daddr = ipv6_addr_to_ipv4_addr(&old_header->ip6_dst);
 
-  // Third-party ICMPv6 message. This may have been originated by an native IPv6 address.
-  // In that case, the source IPv6 address can't be translated and we need to make up an IPv4
-  // source address. For now, use 255.0.0.<ttl>, which at least looks useful in traceroute.
-  if ((uint32_t)ip->saddr == INADDR_NONE) {
-    ttl_guess = icmp_guess_ttl(old_header->ip6_hlim);
-    ip->saddr = htonl((0xff << 24) + ttl_guess);
+    // Third-party ICMPv6 message. This may have been originated by an native IPv6 address.
+    // In that case, the source IPv6 address can't be translated and we need to make up an IPv4
+    // source address. For now, use 255.0.0.<ttl>, which at least looks useful in traceroute.
+    if ((uint32_t)ip->saddr == INADDR_NONE) {
+      ttl_guess = icmp_guess_ttl(old_header->ip6_hlim);
+      ip->saddr = htonl((0xff << 24) + ttl_guess);
+    }
   }
+
+  ip->tot_len  = htons(sizeof(struct iphdr) + payload_len);
+  ip->ttl      = old_header->ip6_hlim;
+  ip->protocol = protocol;
 }
 
 /* function: fill_ip6_header
@@ -157,15 +217,21 @@ void fill_ip_header(struct iphdr *ip, uint16_t payload_len, uint8_t protocol,
  */
 void fill_ip6_header(struct ip6_hdr *ip6, uint16_t payload_len, uint8_t protocol,
                      const struct iphdr *old_header) {
-  memset(ip6, 0, sizeof(struct ip6_hdr));
+  if (is_local_ipv4_flow(old_header)) {
+    // The common case: from our IPv4 address to a remote host.
+    *ip6                      = Global_Clatd_Templates.ip6;
+    ip6->ip6_dst.s6_addr32[3] = old_header->daddr;
+  } else {
+    memset(ip6, 0, sizeof(struct ip6_hdr));
+
+    ip6->ip6_vfc = 6 << 4;
+    ip6->ip6_src = ipv4_addr_to_ipv6_addr(old_header->saddr);
+    ip6->ip6_dst = ipv4_addr_to_ipv6_addr(old_header->daddr);
+  }
 
-  ip6->ip6_vfc  = 6 << 4;
   ip6->ip6_plen = htons(payload_len);
   ip6->ip6_nxt  = protocol;
   ip6->ip6_hlim = old_header->ttl;
-
-  ip6->ip6_src = ipv4_addr_to_ipv6_addr(old_header->saddr);
-  ip6->ip6_dst = ipv4_addr_to_ipv6_addr(old_header->daddr);
 }
 
 /* function: maybe_fill_frag_header
@@ -260,6 +326,7 @@ int icmp_to_icmp6(clat_packet out, clat_packet_index pos, const struct icmphdr *
     clat_packet_len                = CLAT_POS_PAYLOAD + 1;
   } else {
     // Unknown type/code. The type/code conversion functions have already logged an error.
+    stats_inc(CLATD_STAT_ICMP_UNSUPPORTED);
     return 0;
   }
 
@@ -305,6 +372,7 @@ int icmp6_to_icmp(clat_packet out, clat_packet_index pos, const struct icmp6_hdr
     clat_packet_len                = CLAT_POS_PAYLOAD + 1;
   } else {
     // Unknown type/code. The type/code conversion functions have already logged an error.
+    stats_inc(CLATD_STAT_ICMP_UNSUPPORTED);
     return 0;
   }
 
@@ -345,6 +413,7 @@ int udp_packet(clat_packet out, clat_packet_index pos, const struct udphdr *udp,
 
   if (len < sizeof(struct udphdr)) {
     logmsg_dbg(ANDROID_LOG_ERROR, "udp_packet/(too small)");
+    stats_inc(CLATD_STAT_SHORT_TRANSPORT_HEADER);
     return 0;
   }
 
@@ -369,16 +438,19 @@ int tcp_packet(clat_packet out, clat_packet_index pos, const struct tcphdr *tcp,
 
   if (len < sizeof(struct tcphdr)) {
     logmsg_dbg(ANDROID_LOG_ERROR, "tcp_packet/(too small)");
+    stats_inc(CLATD_STAT_SHORT_TRANSPORT_HEADER);
     return 0;
   }
 
   if (tcp->doff < 5) {
     logmsg_dbg(ANDROID_LOG_ERROR, "tcp_packet/tcp header length set to less than 5: %x", tcp->doff);
+    stats_inc(CLATD_STAT_BAD_TCP_HEADER);
     return 0;
   }
 
   if ((size_t)tcp->doff * 4 > len) {
     logmsg_dbg(ANDROID_LOG_ERROR, "tcp_packet/tcp header length set too large: %x", tcp->doff);
+    stats_inc(CLATD_STAT_BAD_TCP_HEADER);
     return 0;
   }
 
@@ -410,7 +482,10 @@ int udp_translate(clat_packet out, clat_packet_index pos, const struct udphdr *u
   out[CLAT_POS_PAYLOAD].iov_len  = payload_size;
 
   if (udp_targ->check) {
-    udp_targ->check = ip_checksum_adjust(udp->check, old_sum, new_sum);
+    // Identical sums (see init_header_templates) mean the checksum is still correct.
+    if (old_sum != new_sum) {
+      udp_targ->check = ip_checksum_adjust(udp->check, old_sum, new_sum);
+    }
   } else {
     // Zero checksums are special. RFC 768 says, "An all zero transmitted checksum value means that
     // the transmitter generated no checksum (for debugging or for higher level protocols that
@@ -418,6 +493,7 @@ int udp_translate(clat_packet out, clat_packet_index pos, const struct udphdr *u
     // for safety we recompute it.
     udp_targ->check = 0;  // Checksum field must be 0 when calculating checksum.
     udp_targ->check = packet_checksum(new_sum, out, pos);
+    stats_inc(CLATD_STAT_CHECKSUM_UDP_ZERO);
   }
 
   // RFC 768: "If the computed checksum is zero, it is transmitted as all ones (the equivalent
@@ -450,6 +526,7 @@ int tcp_translate(clat_packet out, clat_packet_index pos, const struct tcphdr *t
     // counts in 4-byte words. So this can never happen unless there is a bug in the caller.
     logmsg(ANDROID_LOG_ERROR, "tcp_translate: header too long %d > %d, truncating", header_size,
            MAX_TCP_HDR);
+    stats_inc(CLATD_STAT_TCP_HEADER_TRUNCATED);
     header_size = MAX_TCP_HDR;
   }
 
@@ -458,7 +535,9 @@ int tcp_translate(clat_packet out, clat_packet_index pos, const struct tcphdr *t
   out[CLAT_POS_PAYLOAD].iov_base = (uint8_t *)payload;
   out[CLAT_POS_PAYLOAD].iov_len  = payload_size;
 
-  tcp_targ->check = ip_checksum_adjust(tcp->check, old_sum, new_sum);
+  if (old_sum != new_sum) {
+    tcp_targ->check = ip_checksum_adjust(tcp->check, old_sum, new_sum);
+  }
 
   return CLAT_POS_PAYLOAD + 1;
 }
@@ -482,6 +561,58 @@ void send_rawv6(int fd, clat_packet out, int iov_len) {
   sendmsg(fd, &msg, 0);
 }
 
+/* function: send_packet
+ * counts a translated packet, and sends it: IPv6 ones with send_rawv6(), IPv4 ones with a writev()
+ * to the tun
+ * fd      - raw socket if to_ipv6, tun otherwise
+ * to_ipv6 - true if the packet is IPv6
+ * out     - the packet
+ * iov_len - number of iovecs in out
+ */
+static void send_packet(int fd, int to_ipv6, clat_packet out, int iov_len) {
+  size_t bytes = 0;
+  for (int i = CLAT_POS_IPHDR; i < iov_len; i++) bytes += out[i].iov_len;
+  stats_inc(to_ipv6 ? CLATD_STAT_PACKETS_4_TO_6 : CLATD_STAT_PACKETS_6_TO_4);
+  stats_add(to_ipv6 ? CLATD_STAT_BYTES_4_TO_6 : CLATD_STAT_BYTES_6_TO_4, bytes);
+
+  if (to_ipv6) {
+    send_rawv6(fd, out, iov_len);
+  } else {
+    writev(fd, out, iov_len);
+  }
+}
+
+// Buffers for all the headers of a translated packet, see init_clat_packet().
+struct clat_packet_headers {
+  struct {
+    struct tun_pi pi;
+    struct virtio_net_hdr vnet;  // Only written to tuns created with IFF_VNET_HDR.
+  } tun;
+  char iphdr[sizeof(struct ip6_hdr)];
+  char fraghdr[sizeof(struct ip6_frag)];
+  char transporthdr[MAX_TCP_HDR];
+  char icmp_iphdr[sizeof(struct ip6_hdr)];
+  char icmp_fraghdr[sizeof(struct ip6_frag)];
+  char icmp_transporthdr[MAX_TCP_HDR];
+};
+
+/* function: init_clat_packet
+ * sets up the iovec of the packet we'll send, which gets passed down to the translation functions
+ * out     - clat_packet to set up
+ * headers - buffers for the packet headers
+ */
+static void init_clat_packet(clat_packet out, struct clat_packet_headers *headers) {
+  out[CLAT_POS_TUNHDR]              = (struct iovec){ &headers->tun, 0 };
+  out[CLAT_POS_IPHDR]               = (struct iovec){ headers->iphdr, 0 };
+  out[CLAT_POS_FRAGHDR]             = (struct iovec){ headers->fraghdr, 0 };
+  out[CLAT_POS_TRANSPORTHDR]        = (struct iovec){ headers->transporthdr, 0 };
+  out[CLAT_POS_ICMPERR_IPHDR]       = (struct iovec){ headers->icmp_iphdr, 0 };
+  out[CLAT_POS_ICMPERR_FRAGHDR]     = (struct iovec){ headers->icmp_fraghdr, 0 };
+  out[CLAT_POS_ICMPERR_TRANSPORTHDR] = (struct iovec){ headers->icmp_transporthdr, 0 };
+  // Payload. No buffer, it's a pointer to the original payload.
+  out[CLAT_POS_PAYLOAD] = (struct iovec){ NULL, 0 };
+}
+
 /* function: translate_packet
  * takes a packet, translates it, and writes it to fd
  * fd         - fd to write translated packet to
@@ -490,40 +621,257 @@ void send_rawv6(int fd, clat_packet out, int iov_len) {
  * packetsize - size of packet
  */
 void translate_packet(int fd, int to_ipv6, const uint8_t *packet, size_t packetsize) {
+  struct clat_packet_headers headers;
+  clat_packet out;
   int iov_len = 0;
 
-  // Allocate buffers for all packet headers.
-  struct tun_pi tun_targ;
-  char iphdr[sizeof(struct ip6_hdr)];
-  char fraghdr[sizeof(struct ip6_frag)];
-  char transporthdr[MAX_TCP_HDR];
-  char icmp_iphdr[sizeof(struct ip6_hdr)];
-  char icmp_fraghdr[sizeof(struct ip6_frag)];
-  char icmp_transporthdr[MAX_TCP_HDR];
-
-  // iovec of the packets we'll send. This gets passed down to the translation functions.
-  clat_packet out = {
-    { &tun_targ, 0 },          // Tunnel header.
-    { iphdr, 0 },              // IP header.
-    { fraghdr, 0 },            // Fragment header.
-    { transporthdr, 0 },       // Transport layer header.
-    { icmp_iphdr, 0 },         // ICMP error inner IP header.
-    { icmp_fraghdr, 0 },       // ICMP error fragmentation header.
-    { icmp_transporthdr, 0 },  // ICMP error transport layer header.
-    { NULL, 0 },               // Payload. No buffer, it's a pointer to the original payload.
-  };
+  init_clat_packet(out, &headers);
 
   if (to_ipv6) {
     iov_len = ipv4_packet(out, CLAT_POS_IPHDR, packet, packetsize);
     if (iov_len > 0) {
-      send_rawv6(fd, out, iov_len);
+      send_packet(fd, 1 /* to_ipv6 */, out, iov_len);
     }
   } else {
     iov_len = ipv6_packet(out, CLAT_POS_IPHDR, packet, packetsize);
     if (iov_len > 0) {
-      fill_tun_header(&tun_targ, ETH_P_IP);
-      out[CLAT_POS_TUNHDR].iov_len = sizeof(tun_targ);
-      writev(fd, out, iov_len);
+      fill_tun_header(&headers.tun.pi, ETH_P_IP);
+      out[CLAT_POS_TUNHDR].iov_len = sizeof(headers.tun.pi);
+      send_packet(fd, 0 /* to_ipv6 */, out, iov_len);
+    }
+  }
+}
+
+/* function: finish_partial_checksum
+ * computes the transport checksum of a packet that the kernel left for us to checksum
+ * (VIRTIO_NET_HDR_F_NEEDS_CSUM). The checksum field then holds the pseudo-header sum, and the
+ * checksum covers everything from csum_start to the end of the packet.
+ * packet      - packet, the checksum is written into it
+ * len         - size of packet
+ * csum_start  - offset of the checksummed data in packet
+ * csum_offset - offset of the checksum field, relative to csum_start
+ * returns: 0 on success, -1 if csum_start or csum_offset is out of range
+ */
+int finish_partial_checksum(uint8_t *packet, size_t len, size_t csum_start, size_t csum_offset) {
+  const size_t cs_offset = csum_start + csum_offset;
+  uint16_t csum;
+
+  if (csum_start > len || cs_offset + 1 >= len) {
+    stats_inc(CLATD_STAT_CHECKSUM_OUT_OF_RANGE);
+    return -1;
+  }
+
+  csum = ip_checksum(packet + csum_start, len - csum_start);
+  if (!csum) csum = 0xFFFF;  // required fixup for UDP, TCP must live with it
+  memcpy(packet + cs_offset, &csum, sizeof(csum));
+  stats_inc(CLATD_STAT_CHECKSUM_COMPLETED);
+  return 0;
+}
+
+/* function: gso_type_matches
+ * returns true iff a non-fragmented packet with the given transport protocol can be a GSO
+ * superpacket of the given virtio_net_hdr gso_type
+ */
+static int gso_type_matches(uint8_t gso_type, uint8_t protocol) {
+  switch (gso_type & ~VIRTIO_NET_HDR_GSO_ECN) {
+    case VIRTIO_NET_HDR_GSO_TCPV4:
+    case VIRTIO_NET_HDR_GSO_TCPV6:
+      return protocol == IPPROTO_TCP;
+    case VIRTIO_NET_HDR_GSO_UDP_L4:
+      return protocol == IPPROTO_UDP;
+    default:
+      return 0;
+  }
+}
+
+/* function: send_gso_segments
+ * sends a translated TCP or UDP GSO superpacket as IPv6 packets of at most gso_size bytes of
+ * payload each, which is what the kernel would otherwise have split it into before we saw it.
+ * A raw socket cannot take GSO metadata, so this is done right before the sends, and the
+ * translation itself only happens once per superpacket.
+ * fd       - raw socket to send the segments on
+ * out      - translated superpacket, as filled in by ipv4_packet()
+ * iov_len  - number of iovecs in out
+ * gso_size - maximum payload size of each segment
+ */
+static void send_gso_segments(int fd, clat_packet out, int iov_len, uint16_t gso_size) {
+  const struct ip6_hdr *ip6 = out[CLAT_POS_IPHDR].iov_base;
+  const uint8_t *payload    = out[CLAT_POS_PAYLOAD].iov_base;
+  const size_t payload_len  = out[CLAT_POS_PAYLOAD].iov_len;
+  const size_t th_len       = out[CLAT_POS_TRANSPORTHDR].iov_len;
+  const uint32_t pseudo_sum = ipv6_pseudo_header_checksum(ip6, 0, ip6->ip6_nxt);
+  struct ip6_hdr seg_ip6    = *ip6;
+  uint8_t seg_th[MAX_TCP_HDR];
+  clat_packet seg;
+  size_t offset = 0, len;
+  uint16_t *check;
+  uint32_t sum;
+
+  memcpy(seg, out, sizeof(clat_packet));
+  seg[CLAT_POS_IPHDR].iov_base        = &seg_ip6;
+  seg[CLAT_POS_TRANSPORTHDR].iov_base = seg_th;
+
+  do {
+    len = payload_len - offset < gso_size ? payload_len - offset : gso_size;
+    memcpy(seg_th, out[CLAT_POS_TRANSPORTHDR].iov_base, th_len);
+
+    // Same header fixups as the kernel's tcp_gso_segment() and __udp_gso_segment().
+    if (ip6->ip6_nxt == IPPROTO_TCP) {
+      struct tcphdr *tcp = (struct tcphdr *)seg_th;
+      uint8_t *flags     = seg_th + 13;  // Not all libcs name the CWR bit.
+      tcp->seq           = htonl(ntohl(tcp->seq) + offset);
+      if (offset) *flags &= ~0x80;  // CWR
+      if (offset + len < payload_len) *flags &= ~(TH_FIN | TH_PUSH);
+      check = &tcp->check;
+    } else {
+      struct udphdr *udp = (struct udphdr *)seg_th;
+      udp->len           = htons(th_len + len);
+      check              = &udp->check;
+    }
+
+    seg_ip6.ip6_plen                = htons(th_len + len);
+    seg[CLAT_POS_PAYLOAD].iov_base  = (uint8_t *)payload + offset;
+    seg[CLAT_POS_PAYLOAD].iov_len   = len;
+
+    *check = 0;
+    sum    = pseudo_sum + htons(th_len + len);
+    sum    = ip_checksum_add(sum, seg_th, th_len);
+    sum    = ip_checksum_add(sum, payload + offset, len);
+    *check = ip_checksum_finish(sum);
+    if (!*check && ip6->ip6_nxt == IPPROTO_UDP) *check = 0xffff;
+
+    stats_inc(CLATD_STAT_GSO_SEGMENTS);
+    send_packet(fd, 1 /* to_ipv6 */, seg, iov_len);
+    offset += len;
+  } while (offset < payload_len);
+}
+
+/* function: translate_vnet_packet_4_to_6
+ * translates an IPv4 packet read from a tun with IFF_VNET_HDR, and sends it
+ */
+static void translate_vnet_packet_4_to_6(int fd, uint8_t *packet, size_t packetsize,
+                                         const struct virtio_net_hdr *vnet) {
+  const struct iphdr *ip = (const struct iphdr *)packet;
+  struct clat_packet_headers headers;
+  clat_packet out;
+  int iov_len;
+
+  if (vnet->gso_type != VIRTIO_NET_HDR_GSO_NONE && vnet->gso_size &&
+      packetsize >= sizeof(struct iphdr) && gso_type_matches(vnet->gso_type, ip->protocol) &&
+      !(ip->frag_off & htons(IP_MF | IP_OFFMASK))) {
+    // The transport checksum gets computed for each segment, so it doesn't matter that the
+    // translation adjusts a partial one.
+    init_clat_packet(out, &headers);
+    iov_len = ipv4_packet(out, CLAT_POS_IPHDR, packet, packetsize);
+    if (iov_len > 0) {
+      send_gso_segments(fd, out, iov_len, vnet->gso_size);
     }
+    return;
+  }
+
+  // The raw socket needs a complete checksum.
+  if ((vnet->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) &&
+      finish_partial_checksum(packet, packetsize, vnet->csum_start, vnet->csum_offset)) {
+    logmsg_dbg(ANDROID_LOG_ERROR, "translate_vnet_packet/checksum out of range: %d+%d > %zu",
+               vnet->csum_start, vnet->csum_offset, packetsize);
+    return;
+  }
+  translate_packet(fd, 1 /* to_ipv6 */, packet, packetsize);
+}
+
+/* function: translate_vnet_packet_6_to_4
+ * translates an IPv6 packet, and writes it to a tun with IFF_VNET_HDR. TCP and UDP packets,
+ * including GRO superpackets, are passed on with a partial checksum (and their GSO metadata), so
+ * that nobody needs to checksum the payload; the kernel has either validated or not yet computed
+ * the transport checksum anyway.
+ */
+static void translate_vnet_packet_6_to_4(int fd, uint8_t *packet, size_t packetsize,
+                                         const struct virtio_net_hdr *vnet) {
+  const struct ip6_hdr *ip6 = (const struct ip6_hdr *)packet;
+  struct clat_packet_headers headers;
+  struct virtio_net_hdr *vnet_out = &headers.tun.vnet;
+  struct iphdr *ip_targ;
+  size_t th_len;
+  uint16_t *check;
+  clat_packet out;
+  int partial, iov_len;
+
+  if (packetsize < sizeof(struct ip6_hdr)) return;
+
+  if (ip6->ip6_nxt != IPPROTO_TCP && ip6->ip6_nxt != IPPROTO_UDP) {
+    partial = 0;
+  } else if (vnet->gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+    partial = gso_type_matches(vnet->gso_type, ip6->ip6_nxt);
+  } else {
+    // Only bother with a partial checksum if it saves checksumming the payload in software.
+    partial = vnet->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM;
+  }
+  if ((vnet->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) && vnet->csum_start != sizeof(struct ip6_hdr)) {
+    partial = 0;
+  }
+
+  if (!partial && (vnet->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) &&
+      finish_partial_checksum(packet, packetsize, vnet->csum_start, vnet->csum_offset)) {
+    logmsg_dbg(ANDROID_LOG_ERROR, "translate_vnet_packet/checksum out of range: %d+%d > %zu",
+               vnet->csum_start, vnet->csum_offset, packetsize);
+    return;
+  }
+
+  if (partial && ip6->ip6_nxt == IPPROTO_UDP &&
+      packetsize >= sizeof(struct ip6_hdr) + sizeof(struct udphdr)) {
+    // Keep udp_translate() from computing a checksum we're about to replace anyway.
+    struct udphdr *udp = (struct udphdr *)(packet + sizeof(struct ip6_hdr));
+    if (!udp->check) udp->check = 0xffff;
+  }
+
+  init_clat_packet(out, &headers);
+  iov_len = ipv6_packet(out, CLAT_POS_IPHDR, packet, packetsize);
+  if (iov_len <= 0) return;
+
+  memset(vnet_out, 0, sizeof(*vnet_out));
+  if (partial) {
+    ip_targ = out[CLAT_POS_IPHDR].iov_base;
+    th_len  = out[CLAT_POS_TRANSPORTHDR].iov_len;
+    check   = (ip6->ip6_nxt == IPPROTO_TCP)
+                ? &((struct tcphdr *)out[CLAT_POS_TRANSPORTHDR].iov_base)->check
+                : &((struct udphdr *)out[CLAT_POS_TRANSPORTHDR].iov_base)->check;
+    // A partial checksum is the (not inverted) pseudo-header sum.
+    *check = ~ip_checksum_finish(
+      ipv4_pseudo_header_checksum(ip_targ, ntohs(ip_targ->tot_len) - sizeof(struct iphdr)));
+
+    vnet_out->flags       = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    vnet_out->csum_start  = sizeof(struct iphdr);
+    vnet_out->csum_offset = (uint8_t *)check - (uint8_t *)out[CLAT_POS_TRANSPORTHDR].iov_base;
+    if (vnet->gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+      vnet_out->gso_type = vnet->gso_type;
+      if ((vnet->gso_type & ~VIRTIO_NET_HDR_GSO_ECN) == VIRTIO_NET_HDR_GSO_TCPV6) {
+        vnet_out->gso_type = (vnet->gso_type & VIRTIO_NET_HDR_GSO_ECN) | VIRTIO_NET_HDR_GSO_TCPV4;
+      }
+      vnet_out->gso_size = vnet->gso_size;
+      vnet_out->hdr_len  = sizeof(struct iphdr) + th_len;
+    }
+  }
+
+  fill_tun_header(&headers.tun.pi, ETH_P_IP);
+  out[CLAT_POS_TUNHDR].iov_len = sizeof(headers.tun);
+  send_packet(fd, 0 /* to_ipv6 */, out, iov_len);
+}
+
+/* function: translate_vnet_packet
+ * like translate_packet, for a tun created with IFF_VNET_HDR: takes the virtio_net_hdr that the
+ * packet came with into account, and writes one to the tun. GSO superpackets are translated as a
+ * whole.
+ * fd         - fd to write translated packet to
+ * to_ipv6    - true if translating to ipv6, false if translating to ipv4
+ * packet     - packet, checksum fields may be modified in place
+ * packetsize - size of packet
+ * vnet       - the packet's virtio_net_hdr, with csum_start relative to the start of packet
+ */
+void translate_vnet_packet(int fd, int to_ipv6, uint8_t *packet, size_t packetsize,
+                           const struct virtio_net_hdr *vnet) {
+  if (to_ipv6) {
+    translate_vnet_packet_4_to_6(fd, packet, packetsize, vnet);
+  } else {
+    translate_vnet_packet_6_to_4(fd, packet, packetsize, vnet);
   }
 }
@@ -33,6 +33,37 @@
 
 #define MAX_TCP_HDR (15 * 4)  // Data offset field is 4 bits and counts in 32-bit words.
 
+// Headers and checksum sums for the common case of translating between our own addresses and a
+// remote host in the plat subnet, precomputed from Global_Clatd_Config by init_header_templates().
+struct clat_header_templates {
+  struct ip6_hdr ip6;      // 4->6: src is our IPv6 address, dst is the plat subnet.
+  struct iphdr ip;         // 6->4: dst is our IPv4 address.
+  uint32_t ipv6_pair_sum;  // Partial checksum of our IPv6 address plus the plat subnet.
+};
+
+extern struct clat_header_templates Global_Clatd_Templates;
+
+// Must be called whenever Global_Clatd_Config changes.
+void init_header_templates(void);
+
+// Returns true iff the IPv4 packet is from our IPv4 address to a remote host.
+static inline int is_local_ipv4_flow(const struct iphdr *ip) {
+  return ip->saddr == Global_Clatd_Templates.ip.daddr &&
+         ip->daddr != Global_Clatd_Templates.ip.daddr;
+}
+
+// Returns true iff the IPv6 packet is from the plat subnet to our IPv6 address.
+static inline int is_local_ipv6_flow(const struct ip6_hdr *ip6) {
+  const struct in6_addr *plat = &Global_Clatd_Templates.ip6.ip6_dst;
+  return IN6_ARE_ADDR_EQUAL(&ip6->ip6_dst, &Global_Clatd_Templates.ip6.ip6_src) &&
+         ip6->ip6_src.s6_addr32[0] == plat->s6_addr32[0] &&
+         ip6->ip6_src.s6_addr32[1] == plat->s6_addr32[1] &&
+         ip6->ip6_src.s6_addr32[2] == plat->s6_addr32[2];
+}
+
+// Pseudo-header checksum between our IPv6 address and the plat address of a remote host.
+uint32_t local_ipv6_pseudo_header_checksum(uint32_t remote_addr4, uint32_t len, uint8_t protocol);
+
 // Calculates the checksum over all the packet components starting from pos.
 uint16_t packet_checksum(uint32_t checksum, clat_packet packet, clat_packet_index pos);
 
@@ -49,8 +80,15 @@ void fill_ip_header(struct iphdr *ip_targ, uint16_t payload_len, uint8_t protoco
 void fill_ip6_header(struct ip6_hdr *ip6, uint16_t payload_len, uint8_t protocol,
                      const struct iphdr *old_header);
 
+struct virtio_net_hdr;
+
 // Translate and send packets.
 void translate_packet(int fd, int to_ipv6, const uint8_t *packet, size_t packetsize);
+void translate_vnet_packet(int fd, int to_ipv6, uint8_t *packet, size_t packetsize,
+                           const struct virtio_net_hdr *vnet);
+
+// Completes a VIRTIO_NET_HDR_F_NEEDS_CSUM checksum in software.
+int finish_partial_checksum(uint8_t *packet, size_t len, size_t csum_start, size_t csum_offset);
 
 // Translate IPv4 and IPv6 packets.
 int ipv4_packet(clat_packet out, clat_packet_index pos, const uint8_t *packet, size_t len);
@@ -0,0 +1,240 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * xsk.c - AF_XDP receive path
+ *
+ * The xdp/clat_xsk_* programs in clatd_xsk.o redirect the IPv6 packets for our address into an
+ * AF_XDP socket, instead of letting them go up the stack to the packet socket. The kernel puts
+ * them in frames of our UMEM and posts descriptors on the rx ring, and we translate them in place
+ * and hand the frames straight back on the fill ring: no skb, no cBPF filter, and on drivers with
+ * AF_XDP zero-copy support no copy at all. Drivers without it (and generic XDP, e.g. on veth or
+ * tun) copy the packet into the frame, which is still cheaper than the packet socket.
+ *
+ * Only receiving is done here. Translated IPv6 packets are still sent through the raw socket, so
+ * that they get routed, neighbour resolved, queued and accounted like any other packet.
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/bpf.h>
+#include <linux/if_xdp.h>
+#include <linux/virtio_net.h>
+
+#include "clatd.h"
+#include "config.h"
+#include "logging.h"
+#include "translate.h"
+#include "xsk.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+// Must match CLAT_XSK_FRAME_SIZE in bpf_progs/clatd.h, which only redirects packets that fit.
+#define XSK_FRAME_SIZE 4096
+
+// UMEM frames, and size of the fill and rx rings, so that the fill ring can always take every
+// frame back. Halved until the UMEM can be registered within RLIMIT_MEMLOCK.
+#define XSK_FRAMES 256
+#define XSK_MIN_FRAMES 16
+
+struct xsk_ring {
+  uint32_t *producer;
+  uint32_t *consumer;
+  void *descs;
+  void *map;
+  size_t map_len;
+};
+
+static struct {
+  uint8_t *umem;
+  size_t umem_len;
+  uint32_t mask;  // Number of frames - 1.
+  struct xsk_ring fill, rx;
+} xsk;
+
+static int map_ring(struct xsk_ring *ring, int fd, const struct xdp_ring_offset *off,
+                    size_t desc_size, uint32_t entries, off_t pgoff) {
+  ring->map_len = off->desc + entries * desc_size;
+  ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                   pgoff);
+  if (ring->map == MAP_FAILED) {
+    ring->map = NULL;
+    return -errno;
+  }
+  ring->producer = (uint32_t *)((uint8_t *)ring->map + off->producer);
+  ring->consumer = (uint32_t *)((uint8_t *)ring->map + off->consumer);
+  ring->descs    = (uint8_t *)ring->map + off->desc;
+  return 0;
+}
+
+static void xsk_teardown(void) {
+  if (xsk.rx.map) munmap(xsk.rx.map, xsk.rx.map_len);
+  if (xsk.fill.map) munmap(xsk.fill.map, xsk.fill.map_len);
+  if (xsk.umem) munmap(xsk.umem, xsk.umem_len);
+  memset(&xsk, 0, sizeof(xsk));
+}
+
+/* function: register_umem
+ * allocates the UMEM and registers it with the socket, with as many frames as RLIMIT_MEMLOCK allows
+ *   fd - the AF_XDP socket
+ *   returns: the number of frames, or -errno
+ */
+static int register_umem(int fd) {
+  for (uint32_t frames = XSK_FRAMES; frames >= XSK_MIN_FRAMES; frames /= 2) {
+    xsk.umem_len = (size_t)frames * XSK_FRAME_SIZE;
+    xsk.umem = mmap(NULL, xsk.umem_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                    -1, 0);
+    if (xsk.umem == MAP_FAILED) {
+      xsk.umem = NULL;
+      return -errno;
+    }
+
+    struct xdp_umem_reg reg = {
+      .addr       = (uintptr_t)xsk.umem,
+      .len        = xsk.umem_len,
+      .chunk_size = XSK_FRAME_SIZE,
+    };
+    if (!setsockopt(fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg))) return frames;
+
+    int err = errno;
+    munmap(xsk.umem, xsk.umem_len);
+    xsk.umem = NULL;
+    if (err != ENOBUFS && err != ENOMEM) return -err;
+  }
+  return -ENOBUFS;
+}
+
+int xsk_configure(struct tun_data *tunnel, int fd, int ifindex, int xsk_map_fd, uint32_t index) {
+  const int frames = register_umem(fd);
+  if (frames < 0) {
+    logmsg(ANDROID_LOG_WARN, "%s: UMEM registration failed: %s", __func__, strerror(-frames));
+    return frames;
+  }
+  xsk.mask = frames - 1;
+
+  // The completion ring is only used for transmitting, but binding requires one.
+  if (setsockopt(fd, SOL_XDP, XDP_UMEM_FILL_RING, &frames, sizeof(frames)) ||
+      setsockopt(fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &frames, sizeof(frames)) ||
+      setsockopt(fd, SOL_XDP, XDP_RX_RING, &frames, sizeof(frames))) {
+    int err = errno;
+    logmsg(ANDROID_LOG_WARN, "%s: ring setup failed: %s", __func__, strerror(err));
+    xsk_teardown();
+    return -err;
+  }
+
+  struct xdp_mmap_offsets off;
+  socklen_t optlen = sizeof(off);
+  int ret;
+  if (getsockopt(fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen)) {
+    ret = -errno;
+  } else if (!(ret = map_ring(&xsk.fill, fd, &off.fr, sizeof(uint64_t), frames,
+                              XDP_UMEM_PGOFF_FILL_RING))) {
+    ret = map_ring(&xsk.rx, fd, &off.rx, sizeof(struct xdp_desc), frames, XDP_PGOFF_RX_RING);
+  }
+  if (ret) {
+    logmsg(ANDROID_LOG_WARN, "%s: ring mmap failed: %s", __func__, strerror(-ret));
+    xsk_teardown();
+    return ret;
+  }
+
+  // Give every frame to the kernel before any packet can arrive.
+  uint64_t *fill = xsk.fill.descs;
+  for (int i = 0; i < frames; i++) fill[i] = (uint64_t)i * XSK_FRAME_SIZE;
+  __atomic_store_n(xsk.fill.producer, frames, __ATOMIC_RELEASE);
+
+  // Zero-copy if the driver can, copy mode otherwise. The event loop polls the socket anyway, so
+  // the kernel may as well wait for that rather than keep the driver busy refilling.
+  struct sockaddr_xdp sxdp = {
+    .sxdp_family   = AF_XDP,
+    .sxdp_flags    = XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP,
+    .sxdp_ifindex  = ifindex,
+    .sxdp_queue_id = 0,
+  };
+  const char *mode = "zero-copy";
+  if (bind(fd, (struct sockaddr *)&sxdp, sizeof(sxdp))) {
+    sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+    mode = "copy";
+    if (bind(fd, (struct sockaddr *)&sxdp, sizeof(sxdp))) {
+      int err = errno;
+      logmsg(ANDROID_LOG_WARN, "%s: bind failed: %s", __func__, strerror(err));
+      xsk_teardown();
+      return -err;
+    }
+  }
+
+  // Last, so that the XDP program only starts redirecting once the socket is ready.
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.map_fd = xsk_map_fd;
+  attr.key    = (uintptr_t)&index;
+  attr.value  = (uintptr_t)&fd;
+  attr.flags  = BPF_ANY;
+  if (syscall(__NR_bpf, BPF_MAP_UPDATE_ELEM, &attr, sizeof(attr))) {
+    int err = errno;
+    logmsg(ANDROID_LOG_WARN, "%s: XSKMAP update failed: %s", __func__, strerror(err));
+    xsk_teardown();
+    return -err;
+  }
+
+  logmsg(ANDROID_LOG_INFO, "AF_XDP socket bound to ifindex %d in %s mode with %d frames",
+         ifindex, mode, frames);
+  tunnel->xsk_fd = fd;
+  return 0;
+}
+
+/* function: translate_xsk_packet
+ * translates an IPv6 packet received through the AF_XDP socket and writes it to the tun
+ *   tunnel - tun device data
+ *   packet - the packet, in its UMEM frame
+ *   len    - length of the packet
+ */
+static void translate_xsk_packet(struct tun_data *tunnel, uint8_t *packet, size_t len) {
+  if (tunnel->vnet_hdr) {
+    // XDP packets have a complete checksum, and are never GSO (see CLAT_XSK_MAX_PACKET).
+    const struct virtio_net_hdr vnet = { .gso_type = VIRTIO_NET_HDR_GSO_NONE };
+    translate_vnet_packet(tunnel->fd4, 0 /* to_ipv6 */, packet, len, &vnet);
+  } else {
+    translate_packet(tunnel->fd4, 0 /* to_ipv6 */, packet, len);
+  }
+}
+
+void process_packet_xsk(struct tun_data *tunnel) {
+  const struct xdp_desc *descs = xsk.rx.descs;
+  uint64_t *fill = xsk.fill.descs;
+
+  // We are the only consumer of the rx ring and the only producer of the fill ring.
+  const uint32_t rx_prod = __atomic_load_n(xsk.rx.producer, __ATOMIC_ACQUIRE);
+  uint32_t rx_cons = *xsk.rx.consumer;
+  uint32_t fill_prod = *xsk.fill.producer;
+
+  for (; rx_cons != rx_prod; rx_cons++) {
+    const struct xdp_desc *desc = &descs[rx_cons & xsk.mask];
+    translate_xsk_packet(tunnel, xsk.umem + desc->addr, desc->len);
+    // The address is that of the packet, which starts after the kernel's headroom.
+    fill[fill_prod++ & xsk.mask] = desc->addr & ~(uint64_t)(XSK_FRAME_SIZE - 1);
+  }
+
+  __atomic_store_n(xsk.rx.consumer, rx_cons, __ATOMIC_RELEASE);
+  __atomic_store_n(xsk.fill.producer, fill_prod, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * xsk.h - AF_XDP receive path
+ */
+#ifndef __XSK_H__
+#define __XSK_H__
+
+#include <stdint.h>
+
+struct tun_data;
+
+// Sets up fd, an unbound AF_XDP socket, to receive from the first rx queue of the interface, and
+// adds it to the XSKMAP xsk_map_fd at index. On success sets tunnel->xsk_fd and returns 0,
+// otherwise returns -errno and leaves fd for the caller to close.
+int xsk_configure(struct tun_data *tunnel, int fd, int ifindex, int xsk_map_fd, uint32_t index);
+
+// Translates the packets received on tunnel->xsk_fd, and gives their frames back to the kernel.
+void process_packet_xsk(struct tun_data *tunnel);
+
+#endif /* __XSK_H__ */
@@ -51,15 +51,29 @@ public class BpfNetMapsConstants {
             "/sys/fs/bpf/netd_shared/map_netd_uid_owner_map";
     public static final String UID_PERMISSION_MAP_PATH =
             "/sys/fs/bpf/netd_shared/map_netd_uid_permission_map";
+    public static final String UID_OWNER_ARRAY_MAP_PATH =
+            "/sys/fs/bpf/netd_shared/map_netd_uid_owner_array_map";
+    public static final String UID_PERMISSION_ARRAY_MAP_PATH =
+            "/sys/fs/bpf/netd_shared/map_netd_uid_permission_array_map";
     public static final String COOKIE_TAG_MAP_PATH =
             "/sys/fs/bpf/netd_shared/map_netd_cookie_tag_map";
     public static final String DATA_SAVER_ENABLED_MAP_PATH =
             "/sys/fs/bpf/netd_shared/map_netd_data_saver_enabled_map";
     public static final String INGRESS_DISCARD_MAP_PATH =
             "/sys/fs/bpf/netd_shared/map_netd_ingress_discard_map";
+    public static final String RULES_GENERATION_MAP_PATH =
+            "/sys/fs/bpf/netd_shared/map_netd_rules_generation_map";
     public static final Struct.S32 UID_RULES_CONFIGURATION_KEY = new Struct.S32(0);
     public static final Struct.S32 CURRENT_STATS_MAP_CONFIGURATION_KEY = new Struct.S32(1);
     public static final Struct.S32 DATA_SAVER_ENABLED_KEY = new Struct.S32(0);
+    public static final Struct.S32 RULES_GENERATION_KEY = new Struct.S32(0);
+
+    // LINT.IfChange(uid_array_map_size)
+    // Uids (app ids for the permission map) below this are also stored in the array maps.
+    public static final int UID_ARRAY_MAP_SIZE = 20000;
+    // LINT.ThenChange(../../../../bpf_progs/netd.h)
+    // Set in every value written to the uid permission array map.
+    public static final short PERMISSION_ARRAY_ENTRY = (1 << 7);
 
     public static final short DATA_SAVER_DISABLED = 0;
     public static final short DATA_SAVER_ENABLED = 1;
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+// Shared by the netbpfload benchmarks, which load the tethering apex bpf .o's into a private
+// bpffs instance (hence they require root, but leave the real /sys/fs/bpf untouched).
+//
+// The benchmarks are device only: they link against bionic, libbase and liblog, so they need an
+// Android userspace (eg. a device or cuttlefish); there is no host build. By default the objects
+// are read from the tethering apex, and the bpffs is mounted under /data/local/tmp. To benchmark
+// other objects, eg. pushed from a local build, set NETBPFLOAD_BENCHMARK_BPF_DIR to a directory
+// laid out like the apex's etc/bpf/, and TMPDIR to move the bpffs mount point.
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <android-base/strings.h>
+
+#include "loader.h"
+
+namespace android {
+namespace bpf {
+
+// Same source directories (relative to objectDir()), and order, as netbpfload's own 'locations'.
+inline constexpr const char* kLocations[][2] = {
+        {"", "tethering/"},
+        {"netd_shared/", "netd_shared/"},
+        {"netd_readonly/", "netd_readonly/"},
+        {"net_shared/", "net_shared/"},
+        {"net_private/", "net_private/"},
+};
+
+inline constexpr const char* kSubDirs[] = {
+        "tethering", "netd_shared", "netd_readonly", "net_shared", "net_private", "loader",
+};
+
+// Returns $name with a trailing '/', or defaultDir if it is not set.
+inline std::string dirFromEnv(const char* name, const char* defaultDir) {
+    const char* dir = getenv(name);
+    std::string path = (dir && *dir) ? dir : defaultDir;
+    if (path.back() != '/') path += '/';
+    return path;
+}
+
+inline std::string objectDir() {
+    return dirFromEnv("NETBPFLOAD_BENCHMARK_BPF_DIR", "/apex/com.android.tethering/etc/bpf/");
+}
+
+inline std::string scratchDir() {
+    return dirFromEnv("TMPDIR", "/data/local/tmp/");
+}
+
+inline std::vector<std::string> listObjects(const std::string& dirPath) {
+    std::vector<std::string> paths;
+    DIR* dir = opendir(dirPath.c_str());
+    if (!dir) return paths;
+    while (struct dirent* ent = readdir(dir)) {
+        std::string s = ent->d_name;
+        if (base::EndsWith(s, ".o")) paths.push_back(dirPath + s);
+    }
+    closedir(dir);
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// The objects in each of kLocations, in the same order.
+inline std::vector<std::vector<std::string>> listAllObjects() {
+    std::vector<std::vector<std::string>> objects;
+    const std::string root = objectDir();
+    for (const auto& loc : kLocations) objects.push_back(listObjects(root + loc[0]));
+    return objects;
+}
+
+class TestBpfFs {
+  public:
+    TestBpfFs() {
+        std::string tmpl = scratchDir() + "netbpfload_benchmark.XXXXXX";
+        if (mkdtemp(tmpl.data())) mRoot = tmpl + "/";
+    }
+
+    ~TestBpfFs() {
+        if (mRoot.empty()) return;
+        if (mMounted) umount2(mRoot.c_str(), MNT_DETACH);
+        rmdir(mRoot.c_str());
+    }
+
+    TestBpfFs(const TestBpfFs&) = delete;
+    TestBpfFs& operator=(const TestBpfFs&) = delete;
+
+    // Replaces any previous instance with an empty bpffs, with all pin subdirectories created.
+    bool remount() {
+        if (mRoot.empty()) return false;
+        if (mMounted && umount2(mRoot.c_str(), MNT_DETACH)) return false;
+        mMounted = !mount("bpf", mRoot.c_str(), "bpf", 0, nullptr);
+        if (!mMounted) return false;
+        for (const char* subDir : kSubDirs) {
+            if (mkdir((mRoot + subDir).c_str(), S_ISVTX | S_IRWXU | S_IRWXG | S_IRWXO)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const std::string& root() const { return mRoot; }
+
+    // Translates a pin path under the real /sys/fs/bpf/ (eg. from netd.h) to this instance.
+    std::string path(std::string_view realPath) const {
+        constexpr std::string_view kRealRoot = "/sys/fs/bpf/";
+        if (realPath.substr(0, kRealRoot.size()) == kRealRoot) {
+            realPath.remove_prefix(kRealRoot.size());
+        }
+        return mRoot + std::string(realPath);
+    }
+
+  private:
+    std::string mRoot;
+    bool mMounted = false;
+};
+
+inline bool loadAll(const std::vector<std::vector<std::string>>& objects, const TestBpfFs& fs,
+                    unsigned threads) {
+    const std::string root = objectDir();
+    for (size_t i = 0; i < std::size(kLocations); i++) {
+        const std::string dir = root + kLocations[i][0];
+        const Location location = {
+                .dir = dir.c_str(),
+                .prefix = kLocations[i][1],
+                .fsRoot = fs.root().c_str(),
+        };
+        const std::vector<LoadResult> results = loadProgs(objects[i], location, threads);
+        for (const LoadResult& result : results) {
+            if (result.ret && result.isCritical) return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace bpf
+}  // namespace android
@@ -0,0 +1,697 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BpfProgsBenchmark"
+
+// Measures how long the tethering apex bpf programs take per packet, separately for each of
+// the code paths that matter (offload hit vs. miss vs. punt, dscp cache hit vs. policy scan...),
+// by running them on synthetic packets with BPF_PROG_TEST_RUN. The reported time is the
+// kernel's own measurement of the mean run time, in nanoseconds per packet.
+//
+// Everything gets loaded (once) by netbpfload's loader into a private bpffs instance, and the
+// maps are filled in with just enough state for each path, so no device state is needed or
+// touched, but this requires root. Every run checks the program's return code (and for the
+// offload punts, the error counter), so that a change which makes a packet take another path
+// fails the benchmark rather than silently measuring something else.
+//
+// Not everything can be run this way:
+//   - tc programs always see an ethernet frame received on 'lo', so the rawip variants
+//     (and the clat egress4 program, which only has one) are not run.
+//   - packets belong to a dummy socket of uid 0, which is a system uid, so only the system
+//     uid paths through netd's firewall are run, not the per app ones. Instead, the uid owner
+//     and permission lookups of app uids are timed with a small stand-in program, once in the
+//     HASH map and once in the direct-indexed ARRAY map which replaced it for most uids.
+//   - cgroup sock and sock_addr programs (inet_create, bind4/6 block_port) cannot be run.
+
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/pkt_cls.h>
+#include <linux/tcp.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <array>
+#include <functional>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+
+#include "BenchmarkUtils.h"
+#include "BpfSyscallWrappers.h"
+#include "bpf/BpfMap.h"
+#include "clatd.h"
+#include "netd.h"
+#include "offload.h"
+
+using android::base::Result;
+using android::base::StringPrintf;
+using android::base::unique_fd;
+using android::bpf::BpfMap;
+using android::bpf::BpfMapRO;
+using android::bpf::listAllObjects;
+using android::bpf::loadAll;
+using android::bpf::retrieveProgram;
+using android::bpf::runProgramRepeatedly;
+using android::bpf::TestBpfFs;
+using std::string;
+using std::vector;
+
+namespace {
+
+#define TETHERING_PATH "/sys/fs/bpf/tethering/"
+#define NET_SHARED_PATH "/sys/fs/bpf/net_shared/"
+
+// dscpPolicy.h cannot be included from C++ (it declares bpf helpers), so this mirrors its
+// DscpPolicy, just like DscpPolicyValue.java does.
+struct DscpPolicy {
+    struct in6_addr src_ip;
+    struct in6_addr dst_ip;
+    uint32_t ifindex;
+    __be16 src_port;
+    uint16_t dst_port_start;
+    uint16_t dst_port_end;
+    uint8_t proto;
+    int8_t dscp_val;
+    uint8_t present_fields;
+    uint8_t pad[3];
+};
+static_assert(sizeof(DscpPolicy) == 48);
+
+constexpr int MAX_POLICIES = 16;          // from dscpPolicy.h
+constexpr uint8_t DST_IP_MASK_FLAG = 2;   // from dscpPolicy.h
+constexpr uint8_t PROTO_MASK_FLAG = 8;    // from dscpPolicy.h
+
+// BPF_PROG_TEST_RUN receives every packet on 'lo', whose mac address is all zeroes.
+constexpr uint32_t kLoopbackIfindex = 1;
+
+// The upstream, which doesn't need to exist, of a rule whose data limit has been reached.
+constexpr uint32_t kLimitedIfindex = 2;
+
+// App uids given firewall rules and permissions, and the one which is then looked up.
+constexpr uint32_t kFirstAppUid = 10000;
+constexpr uint32_t kAppUidCount = 1000;
+constexpr uint32_t kLookupUid = 10123;
+
+// Map lookups per run of the uid lookup program, so that they outweigh the cost of the run.
+constexpr uint32_t kLookups = 16;
+
+// Runs per BPF_PROG_TEST_RUN call. Offloaded packets get their hop limit (or ttl) decremented
+// on every run, so this must stay well below the 255 they start with.
+constexpr uint32_t kRepeat = 200;
+
+constexpr size_t kPayloadSize = 64;
+constexpr uint16_t kMtu = 1500;
+
+constexpr uint16_t kClientPort = 50000;
+constexpr uint16_t kServerPort = 443;
+
+struct in6_addr addr6(const char* str) {
+    struct in6_addr addr;
+    if (inet_pton(AF_INET6, str, &addr) != 1) abort();
+    return addr;
+}
+
+struct in_addr addr4(const char* str) {
+    struct in_addr addr;
+    if (inet_pton(AF_INET, str, &addr) != 1) abort();
+    return addr;
+}
+
+struct in6_addr v4mapped(const struct in_addr& addr) {
+    struct in6_addr mapped = {};
+    mapped.s6_addr32[2] = htonl(0xFFFF);
+    mapped.s6_addr32[3] = addr.s_addr;
+    return mapped;
+}
+
+const struct in6_addr kClient6 = addr6("2001:db8:1::2");
+const struct in6_addr kUnknownClient6 = addr6("2001:db8:1::3");
+const struct in6_addr kUnknownSubnet6 = addr6("2001:db8:4::2");
+const struct in6_addr kLimitedClient6 = addr6("2001:db8:3::2");
+const struct in6_addr kServer6 = addr6("2001:db8:2::1");
+const struct in6_addr kNat64Prefix = addr6("64:ff9b::");
+const struct in6_addr kNat64Server = addr6("64:ff9b::cb00:7101");
+const struct in6_addr kClat6 = addr6("2001:db8:1::c1a7");
+
+const struct in_addr kClient4 = addr4("192.168.42.2");
+const struct in_addr kUnknownClient4 = addr4("192.168.42.3");
+const struct in_addr kServer4 = addr4("203.0.113.1");
+const struct in_addr kClat4 = addr4("192.0.0.4");
+
+uint64_t top64(const struct in6_addr& addr) {
+    uint64_t top;
+    memcpy(&top, &addr, sizeof(top));
+    return top;
+}
+
+// ----- Packets -----
+
+template <typename Header>
+void append(vector<uint8_t>* frame, const Header& header) {
+    const uint8_t* const bytes = reinterpret_cast<const uint8_t*>(&header);
+    frame->insert(frame->end(), bytes, bytes + sizeof(header));
+}
+
+// Ethernet header to (and from) 'lo', which all offload rules copy back unchanged, so that
+// every repetition of a forwarded frame still matches the same rule.
+struct ethhdr ethHeader(uint16_t ethertype) {
+    struct ethhdr eth = {};
+    eth.h_proto = htons(ethertype);
+    return eth;
+}
+
+struct tcphdr tcpHeader(uint16_t sport, uint16_t dport, bool syn) {
+    struct tcphdr tcp = {};
+    tcp.source = htons(sport);
+    tcp.dest = htons(dport);
+    tcp.doff = sizeof(tcp) / 4;
+    tcp.ack = !syn;
+    tcp.syn = syn;
+    tcp.window = htons(65535);
+    return tcp;
+}
+
+vector<uint8_t> tcp6Frame(const struct in6_addr& src, const struct in6_addr& dst,
+                          uint16_t sport, uint16_t dport, uint8_t hopLimit, bool syn = false) {
+    struct ipv6hdr ip6 = {};
+    ip6.version = 6;
+    ip6.payload_len = htons(sizeof(struct tcphdr) + kPayloadSize);
+    ip6.nexthdr = IPPROTO_TCP;
+    ip6.hop_limit = hopLimit;
+    ip6.saddr = src;
+    ip6.daddr = dst;
+
+    vector<uint8_t> frame;
+    append(&frame, ethHeader(ETH_P_IPV6));
+    append(&frame, ip6);
+    append(&frame, tcpHeader(sport, dport, syn));
+    frame.resize(frame.size() + kPayloadSize);
+    return frame;
+}
+
+vector<uint8_t> tcp4Frame(const struct in_addr& src, const struct in_addr& dst,
+                          uint16_t sport, uint16_t dport, uint8_t ttl, bool syn = false) {
+    struct iphdr ip = {};
+    ip.version = 4;
+    ip.ihl = sizeof(ip) / 4;
+    ip.tot_len = htons(sizeof(ip) + sizeof(struct tcphdr) + kPayloadSize);
+    ip.frag_off = htons(0x4000);  // IP_DF
+    ip.ttl = ttl;
+    ip.protocol = IPPROTO_TCP;
+    ip.saddr = src.s_addr;
+    ip.daddr = dst.s_addr;
+    const uint16_t* const words = reinterpret_cast<const uint16_t*>(&ip);
+    uint32_t sum = 0;
+    for (size_t i = 0; i < sizeof(ip) / sizeof(uint16_t); i++) sum += words[i];
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    ip.check = static_cast<uint16_t>(~sum);
+
+    vector<uint8_t> frame;
+    append(&frame, ethHeader(ETH_P_IP));
+    append(&frame, ip);
+    append(&frame, tcpHeader(sport, dport, syn));
+    frame.resize(frame.size() + kPayloadSize);
+    return frame;
+}
+
+// ----- Map contents -----
+
+template <typename Key, typename Value>
+Result<void> writeEntry(const TestBpfFs& fs, const char* path, const Key& key,
+                        const Value& value) {
+    BpfMap<Key, Value> map;
+    if (auto res = map.init(fs.path(path).c_str()); !res.ok()) return res;
+    return map.writeValue(key, value, BPF_ANY);
+}
+
+template <typename Key, typename Value>
+Result<void> clearMap(const TestBpfFs& fs, const char* path) {
+    BpfMap<Key, Value> map;
+    if (auto res = map.init(fs.path(path).c_str()); !res.ok()) return res;
+    return map.clear();
+}
+
+bool isPinned(const TestBpfFs& fs, const char* path) {
+    return !access(fs.path(path).c_str(), F_OK);
+}
+
+// Forwards both ways between a client on a downstream and a server on the internet, but with
+// the upstream and downstream both being 'lo', and with NAT rules mapping addresses and ports
+// onto themselves, so that a forwarded frame is still forwarded when the next run sees it.
+Result<void> populateOffloadMaps(const TestBpfFs& fs) {
+    const char* const statsPath = TETHERING_PATH "map_offload_tether_stats_map";
+    const char* const limitPath = TETHERING_PATH "map_offload_tether_limit_map";
+    for (const TetherStatsKey upstream : {kLoopbackIfindex, kLimitedIfindex}) {
+        if (auto res = writeEntry(fs, statsPath, upstream, TetherStatsValue{}); !res.ok()) {
+            return res;
+        }
+        const TetherLimitValue limit =
+                upstream == kLimitedIfindex ? 0 : std::numeric_limits<TetherLimitValue>::max();
+        if (auto res = writeEntry(fs, limitPath, upstream, limit); !res.ok()) return res;
+    }
+
+    const Tether6Value forward6 = {
+            .oif = kLoopbackIfindex,
+            .macHeader = ethHeader(ETH_P_IPV6),
+            .pmtu = kMtu,
+    };
+    const TetherDownstream6Key down6 = {.iif = kLoopbackIfindex, .neigh6 = kClient6};
+    if (auto res = writeEntry(fs, TETHERING_PATH "map_offload_tether_downstream6_map", down6,
+                              forward6); !res.ok()) {
+        return res;
+    }
+    Tether6Value limited6 = forward6;
+    limited6.oif = kLimitedIfindex;
+    for (const auto& [client, value] : {std::pair{kClient6, forward6},
+                                        std::pair{kLimitedClient6, limited6}}) {
+        const TetherUpstream6Key up6 = {.iif = kLoopbackIfindex, .src64 = top64(client)};
+        if (auto res = writeEntry(fs, TETHERING_PATH "map_offload_tether_upstream6_map", up6,
+                                  value); !res.ok()) {
+            return res;
+        }
+    }
+
+    const Tether4Key down4 = {
+            .iif = kLoopbackIfindex,
+            .l4Proto = IPPROTO_TCP,
+            .src4 = kServer4,
+            .dst4 = kClient4,
+            .srcPort = htons(kServerPort),
+            .dstPort = htons(kClientPort),
+    };
+    const Tether4Value forward4Down = {
+            .oif = kLoopbackIfindex,
+            .macHeader = ethHeader(ETH_P_IP),
+            .pmtu = kMtu,
+            .src46 = v4mapped(kServer4),
+            .dst46 = v4mapped(kClient4),
+            .srcPort = htons(kServerPort),
+            .dstPort = htons(kClientPort),
+    };
+    if (auto res = writeEntry(fs, TETHERING_PATH "map_offload_tether_downstream4_map", down4,
+                              forward4Down); !res.ok()) {
+        return res;
+    }
+    const Tether4Key up4 = {
+            .iif = kLoopbackIfindex,
+            .l4Proto = IPPROTO_TCP,
+            .src4 = kClient4,
+            .dst4 = kServer4,
+            .srcPort = htons(kClientPort),
+            .dstPort = htons(kServerPort),
+    };
+    const Tether4Value forward4Up = {
+            .oif = kLoopbackIfindex,
+            .macHeader = ethHeader(ETH_P_IP),
+            .pmtu = kMtu,
+            .src46 = v4mapped(kClient4),
+            .dst46 = v4mapped(kServer4),
+            .srcPort = htons(kClientPort),
+            .dstPort = htons(kServerPort),
+    };
+    return writeEntry(fs, TETHERING_PATH "map_offload_tether_upstream4_map", up4, forward4Up);
+}
+
+// Clat translates packets from the server (behind the nat64 prefix) to the clat address.
+Result<void> populateClatMaps(const TestBpfFs& fs) {
+    const ClatIngress6Key key = {
+            .iif = kLoopbackIfindex,
+            .pfx96 = kNat64Prefix,
+            .local6 = kClat6,
+    };
+    const ClatIngress6Value value = {.oif = kLoopbackIfindex, .local4 = kClat4};
+    if (auto res = writeEntry(fs, NET_SHARED_PATH "map_clatd_clat_ingress6_map", key, value);
+        !res.ok()) {
+        return res;
+    }
+
+    // The xsk program (5.9+) is optional, and is always left without a socket to redirect to.
+    const char* const xsk6Path = NET_SHARED_PATH "map_clatd_xsk_clat_xsk6_map";
+    if (!isPinned(fs, xsk6Path)) return {};
+    const ClatXsk6Key xskKey = {.iif = kLoopbackIfindex, .local6 = kClat6};
+    return writeEntry(fs, xsk6Path, xskKey, ClatXsk6Value{.xskIndex = 0});
+}
+
+// A full table of IPv6 policies for 'lo', of which only the last one matches the server's
+// port, so that a cache miss has to look at all of them.
+Result<void> populateDscpMaps(const TestBpfFs& fs) {
+    const char* const policiesPath = NET_SHARED_PATH "map_dscpPolicy_ipv6_dscp_policies_map";
+    if (!isPinned(fs, policiesPath)) return {};  // 5.15+
+    for (uint32_t i = 0; i < MAX_POLICIES; i++) {
+        const uint16_t port = i == MAX_POLICIES - 1 ? kServerPort : 1000 + i;
+        const DscpPolicy policy = {
+                .dst_ip = kServer6,
+                .ifindex = kLoopbackIfindex,
+                .dst_port_start = port,
+                .dst_port_end = port,
+                .proto = IPPROTO_TCP,
+                .dscp_val = 46,  // EF
+                .present_fields = DST_IP_MASK_FLAG | PROTO_MASK_FLAG,
+        };
+        if (auto res = writeEntry(fs, policiesPath, i, policy); !res.ok()) return res;
+    }
+    return {};
+}
+
+// The dummy socket of every BPF_PROG_TEST_RUN call has a new cookie, so without this the
+// cache would fill up, after which nothing can be cached anymore. Its values are RuleEntry's.
+Result<void> clearDscpCache(const TestBpfFs& fs) {
+    return clearMap<uint64_t, std::array<uint8_t, 44>>(
+            fs, NET_SHARED_PATH "map_dscpPolicy_socket_policy_cache_map");
+}
+
+Result<uint32_t> readTetherError(const TestBpfFs& fs, int error) {
+    BpfMapRO<uint32_t, uint32_t> map;
+    auto res = map.init(fs.path(TETHERING_PATH "map_offload_tether_error_map").c_str());
+    if (!res.ok()) return res.error();
+    return map.readValue(error);
+}
+
+Result<void> setUidZeroRule(const TestBpfFs& fs, uint32_t rule) {
+    const UidOwnerValue value = {.iif = 0, .rule = rule};
+    return writeEntry(fs, UID_OWNER_ARRAY_MAP_PATH, uint32_t{0}, value);
+}
+
+template <typename Value>
+Result<void> writeAppUids(const TestBpfFs& fs, const char* path, const Value& value) {
+    BpfMap<uint32_t, Value> map;
+    if (auto res = map.init(fs.path(path).c_str()); !res.ok()) return res;
+    for (uint32_t uid = kFirstAppUid; uid < kFirstAppUid + kAppUidCount; uid++) {
+        if (auto res = map.writeValue(uid, value, BPF_ANY); !res.ok()) return res;
+    }
+    return {};
+}
+
+// Same contents in the HASH and ARRAY maps, as BpfNetMaps writes them for uids which fit both.
+Result<void> populateUidMaps(const TestBpfFs& fs) {
+    const UidOwnerValue owner = {.iif = 0, .rule = PENALTY_BOX_MATCH};
+    if (auto res = writeAppUids(fs, UID_OWNER_MAP_PATH, owner); !res.ok()) return res;
+    if (auto res = writeAppUids(fs, UID_OWNER_ARRAY_MAP_PATH, owner); !res.ok()) return res;
+    const uint8_t permissions = BPF_PERMISSION_INTERNET;
+    if (auto res = writeAppUids(fs, UID_PERMISSION_MAP_PATH, permissions); !res.ok()) return res;
+    return writeAppUids(fs, UID_PERMISSION_ARRAY_MAP_PATH,
+                        static_cast<uint8_t>(permissions | BPF_PERMISSION_ARRAY_ENTRY));
+}
+
+// Loads everything into a private bpffs instance, which is kept for the whole run.
+// Returns an error message, or an empty string on success.
+const string& setUpOnce(TestBpfFs** fs) {
+    static TestBpfFs bpfFs;
+    static const string error = []() -> string {
+        if (getuid()) return "must run as root";
+        const vector<vector<string>> objects = listAllObjects();
+        size_t objectCount = 0;
+        for (const auto& locationObjects : objects) objectCount += locationObjects.size();
+        if (!objectCount) return "no bpf objects found";
+        if (!bpfFs.remount()) return "failed to mount private bpffs";
+        if (!loadAll(objects, bpfFs, 1)) return "failed to load a critical bpf object";
+        for (const auto populate : {populateOffloadMaps, populateClatMaps, populateDscpMaps,
+                                    populateUidMaps}) {
+            if (auto res = populate(bpfFs); !res.ok()) return res.error().message();
+        }
+        return "";
+    }();
+    *fs = &bpfFs;
+    return error;
+}
+
+// ----- Benchmarks -----
+
+struct Case {
+    string name;            // object/program/path
+    const char* progPath;   // where the program would be pinned in the real /sys/fs/bpf
+    vector<uint8_t> frame;
+    uint32_t expectedRet;
+    // Programs which change the packet so that a second run would take another path can
+    // only be run once per call, which is then less precise.
+    uint32_t repeat = kRepeat;
+    // For offload punts, the error which must be counted for every run.
+    int tetherError = -1;
+    // Sets up any state only this path needs, before the first run.
+    std::function<Result<void>(const TestBpfFs&)> prepare;
+    // Undoes any state a call leaves behind, which would change the path of the next call.
+    std::function<Result<void>(const TestBpfFs&)> reset;
+};
+
+void runCase(benchmark::State& state, const Case& c) {
+    TestBpfFs* fs;
+    if (const string& error = setUpOnce(&fs); !error.empty()) {
+        state.SkipWithError(error.c_str());
+        return;
+    }
+
+    const unique_fd prog(retrieveProgram(fs->path(c.progPath).c_str()));
+    if (!prog.ok()) {
+        state.SkipWithError("program not loaded on this kernel");
+        return;
+    }
+    if (c.prepare) {
+        if (auto res = c.prepare(*fs); !res.ok()) {
+            state.SkipWithError(res.error().message().c_str());
+            return;
+        }
+    }
+
+    uint32_t errorsBefore = 0;
+    if (c.tetherError >= 0) {
+        auto errors = readTetherError(*fs, c.tetherError);
+        if (!errors.ok()) {
+            state.SkipWithError(errors.error().message().c_str());
+            return;
+        }
+        errorsBefore = errors.value();
+    }
+
+    uint64_t runs = 0;
+    for (auto _ : state) {
+        uint32_t ret, duration;
+        if (runProgramRepeatedly(prog, c.frame.data(), c.frame.size(), c.repeat, &ret,
+                                 &duration)) {
+            state.SkipWithError(StringPrintf("BPF_PROG_TEST_RUN failed: %s",
+                                             strerror(errno)).c_str());
+            return;
+        }
+        if (ret != c.expectedRet) {
+            state.SkipWithError(StringPrintf("returned %u instead of %u", ret,
+                                             c.expectedRet).c_str());
+            return;
+        }
+        state.SetIterationTime(duration * 1e-9);
+        runs += c.repeat;
+
+        if (c.reset) {
+            if (auto res = c.reset(*fs); !res.ok()) {
+                state.SkipWithError(res.error().message().c_str());
+                return;
+            }
+        }
+    }
+
+    if (c.tetherError >= 0) {
+        auto errors = readTetherError(*fs, c.tetherError);
+        if (!errors.ok() || errors.value() - errorsBefore != (uint32_t)runs) {
+            state.SkipWithError(StringPrintf("%s was not counted for every packet",
+                                             bpf_tether_errors[c.tetherError]).c_str());
+        }
+    }
+}
+
+// A tc program which looks kLookupUid up in the map kLookups times, like netd.c's
+// bpf_uid_owner_map_lookup_elem() & co, and returns how many of the lookups found an entry.
+unique_fd loadUidLookupProgram(const unique_fd& map) {
+    const bpf_insn lookup[] = {
+            {.code = BPF_LD | BPF_DW | BPF_IMM, .dst_reg = BPF_REG_1,
+             .src_reg = BPF_PSEUDO_MAP_FD, .imm = map.get()},
+            {.imm = 0},
+            {.code = BPF_ALU64 | BPF_MOV | BPF_X, .dst_reg = BPF_REG_2, .src_reg = BPF_REG_10},
+            {.code = BPF_ALU64 | BPF_ADD | BPF_K, .dst_reg = BPF_REG_2, .imm = -4},
+            {.code = BPF_JMP | BPF_CALL, .imm = BPF_FUNC_map_lookup_elem},
+            {.code = BPF_JMP | BPF_JEQ | BPF_K, .dst_reg = BPF_REG_0, .off = 1, .imm = 0},
+            {.code = BPF_ALU64 | BPF_ADD | BPF_K, .dst_reg = BPF_REG_6, .imm = 1},
+    };
+    vector<bpf_insn> insns = {
+            {.code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_6, .imm = 0},
+            {.code = BPF_ST | BPF_MEM | BPF_W, .dst_reg = BPF_REG_10, .off = -4,
+             .imm = static_cast<int32_t>(kLookupUid)},
+    };
+    for (uint32_t i = 0; i < kLookups; i++) {
+        insns.insert(insns.end(), std::begin(lookup), std::end(lookup));
+    }
+    insns.push_back({.code = BPF_ALU64 | BPF_MOV | BPF_X, .dst_reg = BPF_REG_0,
+                     .src_reg = BPF_REG_6});
+    insns.push_back({.code = BPF_JMP | BPF_EXIT});
+
+    bpf_attr attr = {};
+    attr.prog_type = BPF_PROG_TYPE_SCHED_CLS;
+    attr.insns = android::bpf::ptr_to_u64(insns.data());
+    attr.insn_cnt = insns.size();
+    attr.license = android::bpf::ptr_to_u64("Apache 2.0");
+    return unique_fd(android::bpf::bpf(BPF_PROG_LOAD, attr));
+}
+
+// Reports the time per lookup, which includes 1/kLookups of the cost of a program run.
+void runUidLookup(benchmark::State& state, const char* mapPath) {
+    TestBpfFs* fs;
+    if (const string& error = setUpOnce(&fs); !error.empty()) {
+        state.SkipWithError(error.c_str());
+        return;
+    }
+
+    const unique_fd map(android::bpf::mapRetrieveRO(fs->path(mapPath).c_str()));
+    if (!map.ok()) {
+        state.SkipWithError("map not created on this kernel");
+        return;
+    }
+    const unique_fd prog = loadUidLookupProgram(map);
+    if (!prog.ok()) {
+        state.SkipWithError(StringPrintf("BPF_PROG_LOAD failed: %s", strerror(errno)).c_str());
+        return;
+    }
+
+    const auto frame = tcp6Frame(kClient6, kServer6, kClientPort, kServerPort, 255);
+    for (auto _ : state) {
+        uint32_t ret, duration;
+        if (runProgramRepeatedly(prog, frame.data(), frame.size(), kRepeat, &ret, &duration)) {
+            state.SkipWithError(StringPrintf("BPF_PROG_TEST_RUN failed: %s",
+                                             strerror(errno)).c_str());
+            return;
+        }
+        if (ret != kLookups) {
+            state.SkipWithError(StringPrintf("found %u of %u entries", ret, kLookups).c_str());
+            return;
+        }
+        state.SetIterationTime(duration * 1e-9 / kLookups);
+    }
+}
+
+vector<Case> allCases() {
+    const uint32_t tcPipe = TC_ACT_PIPE;
+    const uint32_t tcRedirect = TC_ACT_REDIRECT;
+    const uint32_t tcUnspec = static_cast<uint32_t>(TC_ACT_UNSPEC);
+    const uint32_t xdpPass = XDP_PASS;
+    const uint32_t pass = 1;      // from netd.c
+    const uint32_t noMatch = 0;   // from netd.c
+    const uint32_t match = 1;     // from netd.c
+
+    const auto download6 = tcp6Frame(kServer6, kClient6, kServerPort, kClientPort, 255);
+    const auto upload6 = tcp6Frame(kClient6, kServer6, kClientPort, kServerPort, 255);
+    const auto download4 = tcp4Frame(kServer4, kClient4, kServerPort, kClientPort, 255);
+    const auto upload4 = tcp4Frame(kClient4, kServer4, kClientPort, kServerPort, 255);
+
+#define OFFLOAD_PROG(name) TETHERING_PATH "prog_offload_schedcls_tether_" name
+#define OFFLOAD_XDP_PROG(name) TETHERING_PATH "prog_offload_xdp_tether_" name
+    vector<Case> cases = {
+            {"offload/downstream6_ether/forward", OFFLOAD_PROG("downstream6_ether"),
+             download6, tcRedirect},
+            {"offload/downstream6_ether/no_rule", OFFLOAD_PROG("downstream6_ether"),
+             tcp6Frame(kServer6, kUnknownClient6, kServerPort, kClientPort, 255), tcPipe},
+            {"offload/downstream6_ether/punt_low_ttl", OFFLOAD_PROG("downstream6_ether"),
+             tcp6Frame(kServer6, kClient6, kServerPort, kClientPort, 1), tcPipe, kRepeat,
+             BPF_TETHER_ERR_LOW_TTL},
+            {"offload/downstream6_ether/punt_tcp_control", OFFLOAD_PROG("downstream6_ether"),
+             tcp6Frame(kServer6, kClient6, kServerPort, kClientPort, 255, /* syn */ true),
+             tcPipe, kRepeat, BPF_TETHER_ERR_TCPV6_CONTROL_PACKET},
+            {"offload/upstream6_ether/forward", OFFLOAD_PROG("upstream6_ether"), upload6,
+             tcRedirect},
+            {"offload/upstream6_ether/no_rule", OFFLOAD_PROG("upstream6_ether"),
+             tcp6Frame(kUnknownSubnet6, kServer6, kClientPort, kServerPort, 255), tcPipe},
+            {"offload/upstream6_ether/punt_limit_reached", OFFLOAD_PROG("upstream6_ether"),
+             tcp6Frame(kLimitedClient6, kServer6, kClientPort, kServerPort, 255), tcPipe,
+             kRepeat, BPF_TETHER_ERR_LIMIT_REACHED},
+            {"offload/downstream4_ether/forward", OFFLOAD_PROG("downstream4_ether"), download4,
+             tcRedirect},
+            {"offload/downstream4_ether/no_rule", OFFLOAD_PROG("downstream4_ether"),
+             tcp4Frame(kServer4, kUnknownClient4, kServerPort, kClientPort, 255), tcPipe},
+            {"offload/downstream4_ether/punt_tcp_control", OFFLOAD_PROG("downstream4_ether"),
+             tcp4Frame(kServer4, kClient4, kServerPort, kClientPort, 255, /* syn */ true),
+             tcPipe, kRepeat, BPF_TETHER_ERR_TCPV4_CONTROL_PACKET},
+            {"offload/upstream4_ether/forward", OFFLOAD_PROG("upstream4_ether"), upload4,
+             tcRedirect},
+            {"offload/upstream4_ether/no_rule", OFFLOAD_PROG("upstream4_ether"),
+             tcp4Frame(kUnknownClient4, kServer4, kClientPort, kServerPort, 255), tcPipe},
+            {"offload/xdp_downstream_ether/pass", OFFLOAD_XDP_PROG("downstream_ether"),
+             download6, xdpPass},
+            {"offload/xdp_upstream_ether/pass", OFFLOAD_XDP_PROG("upstream_ether"), upload6,
+             xdpPass},
+
+            {"netd/cgroupskb_ingress_stats/system_uid", BPF_INGRESS_PROG_PATH, download6, pass},
+            {"netd/cgroupskb_egress_stats/system_uid", BPF_EGRESS_PROG_PATH, upload6, pass},
+            {"netd/xtbpf_ingress/account", XT_BPF_INGRESS_PROG_PATH, download6, match},
+            {"netd/xtbpf_egress/account", XT_BPF_EGRESS_PROG_PATH, upload6, match},
+            {"netd/xtbpf_allowlist/system_uid", XT_BPF_ALLOWLIST_PROG_PATH, upload6, match},
+            {"netd/xtbpf_denylist/no_rule", XT_BPF_DENYLIST_PROG_PATH, upload6, noMatch, kRepeat,
+             -1, [](const TestBpfFs& fs) { return setUidZeroRule(fs, 0); }},
+            {"netd/xtbpf_denylist/penalty_box", XT_BPF_DENYLIST_PROG_PATH, upload6, match,
+             kRepeat, -1,
+             [](const TestBpfFs& fs) { return setUidZeroRule(fs, PENALTY_BOX_MATCH); }},
+            {"netd/schedact_ingress_account/account", TC_BPF_INGRESS_ACCOUNT_PROG_PATH,
+             download6, tcUnspec},
+
+            {"clatd/ingress6_clat_ether/translate",
+             NET_SHARED_PATH "prog_clatd_schedcls_ingress6_clat_ether",
+             tcp6Frame(kNat64Server, kClat6, kServerPort, kClientPort, 255), tcRedirect, 1},
+            {"clatd/ingress6_clat_ether/no_rule",
+             NET_SHARED_PATH "prog_clatd_schedcls_ingress6_clat_ether", download6, tcPipe},
+            {"clatd_xsk/clat_xsk_ether/no_rule",
+             NET_SHARED_PATH "prog_clatd_xsk_xdp_clat_xsk_ether", download6, xdpPass},
+            {"clatd_xsk/clat_xsk_ether/no_socket",
+             NET_SHARED_PATH "prog_clatd_xsk_xdp_clat_xsk_ether",
+             tcp6Frame(kNat64Server, kClat6, kServerPort, kClientPort, 255), xdpPass},
+
+            // Only the first of the runs in a call misses the cache.
+            {"dscpPolicy/set_dscp_ether/cache_hit",
+             NET_SHARED_PATH "prog_dscpPolicy_schedcls_set_dscp_ether", upload6, tcPipe,
+             kRepeat, -1, clearDscpCache, clearDscpCache},
+            {"dscpPolicy/set_dscp_ether/policy_scan",
+             NET_SHARED_PATH "prog_dscpPolicy_schedcls_set_dscp_ether", upload6, tcPipe, 1, -1,
+             clearDscpCache, clearDscpCache},
+    };
+#undef OFFLOAD_PROG
+#undef OFFLOAD_XDP_PROG
+    return cases;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    for (const Case& c : allCases()) {
+        benchmark::RegisterBenchmark(c.name.c_str(),
+                                     [c](benchmark::State& state) { runCase(state, c); })
+                ->UseManualTime()
+                ->Unit(benchmark::kNanosecond);
+    }
+    for (const auto& [name, mapPath] : {
+                 std::pair{"netd/uid_owner_lookup/hash", UID_OWNER_MAP_PATH},
+                 std::pair{"netd/uid_owner_lookup/array", UID_OWNER_ARRAY_MAP_PATH},
+                 std::pair{"netd/uid_permission_lookup/hash", UID_PERMISSION_MAP_PATH},
+                 std::pair{"netd/uid_permission_lookup/array", UID_PERMISSION_ARRAY_MAP_PATH},
+         }) {
+        benchmark::RegisterBenchmark(name, [mapPath = mapPath](benchmark::State& state) {
+            runUidLookup(state, mapPath);
+        })->UseManualTime()->Unit(benchmark::kNanosecond);
+    }
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -38,6 +38,11 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <android/api-level.h>
 #include <android-base/logging.h>
 #include <android-base/macros.h>
@@ -101,6 +106,7 @@ int loadAllElfObjects(const android::bpf::Location& location) {
     int retVal = 0;
     DIR* dir;
     struct dirent* ent;
+    std::vector<string> progPaths;
 
     if ((dir = opendir(location.dir)) != NULL) {
         while ((ent = readdir(dir)) != NULL) {
@@ -109,18 +115,27 @@ int loadAllElfObjects(const android::bpf::Location& location) {
 
             string progPath(location.dir);
             progPath += s;
-
-            bool critical;
-            int ret = android::bpf::loadProg(progPath.c_str(), &critical, location);
-            if (ret) {
-                if (critical) retVal = ret;
-                ALOGE("Failed to load object: %s, ret: %s", progPath.c_str(), std::strerror(-ret));
-            } else {
-                ALOGI("Loaded object: %s", progPath.c_str());
-            }
+            progPaths.push_back(progPath);
         }
         closedir(dir);
     }
+
+    // readdir() order is filesystem dependent, sort to make the load order deterministic.
+    std::sort(progPaths.begin(), progPaths.end());
+
+    const std::vector<android::bpf::LoadResult> results = android::bpf::loadProgs(
+            progPaths, location, std::max(std::thread::hardware_concurrency(), 1u));
+
+    for (size_t i = 0; i < progPaths.size(); i++) {
+        const int ret = results[i].ret;
+        if (ret) {
+            if (results[i].isCritical) retVal = ret;
+            ALOGE("Failed to load object: %s, ret: %s", progPaths[i].c_str(),
+                  std::strerror(-ret));
+        } else {
+            ALOGI("Loaded object: %s", progPaths[i].c_str());
+        }
+    }
     return retVal;
 }
 
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "NetBpfLoadBenchmark"
+
+// Measures how long loading all of the tethering apex bpf .o's takes, which is what
+// netbpfload does on the boot critical path, with varying amounts of parallelism.
+//
+// Everything gets loaded into a private bpffs instance (freshly mounted for every
+// iteration, so that nothing is reused), hence this requires root, but leaves the
+// real /sys/fs/bpf untouched.
+
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "BenchmarkUtils.h"
+
+using android::bpf::listAllObjects;
+using android::bpf::loadAll;
+using android::bpf::TestBpfFs;
+using std::string;
+using std::vector;
+
+namespace {
+
+void BM_LoadAllObjects(benchmark::State& state) {
+    if (getuid()) {
+        state.SkipWithError("must run as root");
+        return;
+    }
+
+    const unsigned threads = state.range(0);
+    TestBpfFs fs;
+
+    const vector<vector<string>> objects = listAllObjects();
+    size_t objectCount = 0;
+    for (const auto& locationObjects : objects) objectCount += locationObjects.size();
+    if (!objectCount) {
+        state.SkipWithError("no bpf objects found");
+        return;
+    }
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        if (!fs.remount()) {
+            state.SkipWithError("failed to mount private bpffs");
+            return;
+        }
+        state.ResumeTiming();
+
+        if (!loadAll(objects, fs, threads)) {
+            state.SkipWithError("failed to load a critical bpf object");
+            return;
+        }
+    }
+
+    state.counters["objects"] = objectCount;
+    state.counters["objects_per_second"] =
+            benchmark::Counter(objectCount, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// 1 is the old, fully serial, behaviour.
+BENCHMARK(BM_LoadAllObjects)
+        ->ArgName("threads")
+        ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
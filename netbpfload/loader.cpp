@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sysexits.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/utsname.h>
 #include <sys/wait.h>
@@ -49,11 +50,16 @@
 #error "BPFLOADER_VERSION is less than COMPILE_FOR_BPFLOADER_VERSION"
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
 #include <cstdlib>
-#include <fstream>
+#include <functional>
 #include <iostream>
 #include <optional>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -63,8 +69,6 @@
 #include <android-base/strings.h>
 #include <android-base/unique_fd.h>
 
-#define BPF_FS_PATH "/sys/fs/bpf/"
-
 // Size of the BPF log buffer for verifier logging
 #define BPF_LOAD_LOG_SZ 0xfffff
 
@@ -73,11 +77,10 @@
 
 using android::base::StartsWith;
 using android::base::unique_fd;
-using std::ifstream;
-using std::ios;
 using std::optional;
 using std::string;
 using std::vector;
+using std::chrono::steady_clock;
 
 namespace android {
 namespace bpf {
@@ -89,6 +92,11 @@ const std::string& getBuildType() {
 
 static unsigned int page_size = static_cast<unsigned int>(getpagesize());
 
+static int64_t elapsedUs(steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(steady_clock::now() - start)
+            .count();
+}
+
 constexpr const char* lookupSelinuxContext(const domain d, const char* const unspecified = "") {
     switch (d) {
         case domain::unspecified:   return unspecified;
@@ -217,110 +225,109 @@ typedef struct {
     unique_fd prog_fd; /* fd after loading */
 } codeSection;
 
-static int readElfHeader(ifstream& elfFile, Elf64_Ehdr* eh) {
-    elfFile.seekg(0);
-    if (elfFile.fail()) return -1;
-
-    if (!elfFile.read((char*)eh, sizeof(*eh))) return -1;
-
-    return 0;
+ElfObject::~ElfObject() {
+    if (mData) munmap(const_cast<char*>(mData), mSize);
 }
 
-/* Reads all section header tables into an Shdr array */
-static int readSectionHeadersAll(ifstream& elfFile, vector<Elf64_Shdr>& shTable) {
-    Elf64_Ehdr eh;
-    int ret = 0;
-
-    ret = readElfHeader(elfFile, &eh);
-    if (ret) return ret;
+int ElfObject::open(const char* elfPath) {
+    unique_fd fd(::open(elfPath, O_RDONLY | O_CLOEXEC));
+    if (!fd.ok()) return -errno;
 
-    elfFile.seekg(eh.e_shoff);
-    if (elfFile.fail()) return -1;
+    struct stat st;
+    if (fstat(fd, &st)) return -errno;
+    if (st.st_size < (off_t)sizeof(Elf64_Ehdr)) return -ENOEXEC;
 
-    /* Read shdr table entries */
-    shTable.resize(eh.e_shnum);
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) return -errno;
+    mData = static_cast<const char*>(p);
+    mSize = st.st_size;
 
-    if (!elfFile.read((char*)shTable.data(), (eh.e_shnum * eh.e_shentsize))) return -ENOMEM;
+    const Elf64_Ehdr* eh = reinterpret_cast<const Elf64_Ehdr*>(mData);
+    if (eh->e_shentsize != sizeof(Elf64_Shdr)) return -ENOEXEC;
+    if (eh->e_shoff > mSize || eh->e_shnum > (mSize - eh->e_shoff) / sizeof(Elf64_Shdr)) {
+        return -ENOEXEC;
+    }
 
-    return 0;
-}
+    const Elf64_Shdr* shTable = reinterpret_cast<const Elf64_Shdr*>(mData + eh->e_shoff);
+    for (int i = 0; i < eh->e_shnum; i++) {
+        if (shTable[i].sh_type != SHT_NOBITS &&
+            (shTable[i].sh_offset > mSize || shTable[i].sh_size > mSize - shTable[i].sh_offset)) {
+            ALOGE("%s section %d [0x%llx+0x%llx] beyond end of file", elfPath, i,
+                  (unsigned long long)shTable[i].sh_offset, (unsigned long long)shTable[i].sh_size);
+            return -ENOEXEC;
+        }
+        mSections.push_back(&shTable[i]);
+    }
 
-/* Read a section by its index - for ex to get sec hdr strtab blob */
-static int readSectionByIdx(ifstream& elfFile, int id, vector<char>& sec) {
-    vector<Elf64_Shdr> shTable;
-    int ret = readSectionHeadersAll(elfFile, shTable);
+    if (eh->e_shstrndx >= mSections.size()) return -ENOEXEC;
+    int ret = readSectionByIdx(eh->e_shstrndx, mSecStrTab);
     if (ret) return ret;
+    mSecStrTab.push_back('\0');  // guarantee termination of the final name
 
-    elfFile.seekg(shTable[id].sh_offset);
-    if (elfFile.fail()) return -1;
+    for (int i = 0; i < (int)mSections.size(); i++) {
+        const char* name = getName(mSections[i]->sh_name);
+        // First section with a given name wins, just like the previous linear searches.
+        if (name) mSectionIndex.emplace(name, i);
+    }
 
-    sec.resize(shTable[id].sh_size);
-    if (!elfFile.read(sec.data(), shTable[id].sh_size)) return -1;
+    vector<char> symData;
+    if (!readSectionByType(SHT_SYMTAB, symData)) {
+        const Elf64_Sym* buf = reinterpret_cast<const Elf64_Sym*>(symData.data());
+        mSymtab.assign(buf, buf + symData.size() / sizeof(Elf64_Sym));
+        mSortedSymtab = mSymtab;
+        std::sort(mSortedSymtab.begin(), mSortedSymtab.end(),
+                  [](const Elf64_Sym& a, const Elf64_Sym& b) { return a.st_value < b.st_value; });
+    }
 
     return 0;
 }
 
-/* Read whole section header string table */
-static int readSectionHeaderStrtab(ifstream& elfFile, vector<char>& strtab) {
-    Elf64_Ehdr eh;
-    int ret = readElfHeader(elfFile, &eh);
-    if (ret) return ret;
-
-    ret = readSectionByIdx(elfFile, eh.e_shstrndx, strtab);
-    if (ret) return ret;
-
-    return 0;
+int ElfObject::sectionIndex(const string& name) const {
+    auto it = mSectionIndex.find(name);
+    return it == mSectionIndex.end() ? -1 : it->second;
 }
 
-/* Get name from offset in strtab */
-static int getSymName(ifstream& elfFile, int nameOff, string& name) {
-    int ret;
-    vector<char> secStrTab;
-
-    ret = readSectionHeaderStrtab(elfFile, secStrTab);
-    if (ret) return ret;
-
-    if (nameOff >= (int)secStrTab.size()) return -1;
+const char* ElfObject::getName(Elf64_Word nameOff) const {
+    if (nameOff >= mSecStrTab.size()) return nullptr;
+    return mSecStrTab.data() + nameOff;
+}
 
-    name = string((char*)secStrTab.data() + nameOff);
+/* Read a section by its index - for ex to get sec hdr strtab blob */
+int ElfObject::readSectionByIdx(int id, vector<char>& data) const {
+    if (id < 0 || id >= (int)mSections.size()) return -2;
+    const Elf64_Shdr* sh = mSections[id];
+    if (sh->sh_type == SHT_NOBITS) {
+        data.assign(sh->sh_size, 0);
+    } else {
+        data.assign(mData + sh->sh_offset, mData + sh->sh_offset + sh->sh_size);
+    }
     return 0;
 }
 
 /* Reads a full section by name - example to get the GPL license */
-static int readSectionByName(const char* name, ifstream& elfFile, vector<char>& data) {
-    vector<char> secStrTab;
-    vector<Elf64_Shdr> shTable;
-    int ret;
-
-    ret = readSectionHeadersAll(elfFile, shTable);
-    if (ret) return ret;
-
-    ret = readSectionHeaderStrtab(elfFile, secStrTab);
-    if (ret) return ret;
-
-    for (int i = 0; i < (int)shTable.size(); i++) {
-        char* secname = secStrTab.data() + shTable[i].sh_name;
-        if (!secname) continue;
-
-        if (!strcmp(secname, name)) {
-            vector<char> dataTmp;
-            dataTmp.resize(shTable[i].sh_size);
-
-            elfFile.seekg(shTable[i].sh_offset);
-            if (elfFile.fail()) return -1;
-
-            if (!elfFile.read((char*)dataTmp.data(), shTable[i].sh_size)) return -1;
+int ElfObject::readSectionByName(const char* name, vector<char>& data) const {
+    return readSectionByIdx(sectionIndex(name), data);
+}
 
-            data = dataTmp;
-            return 0;
-        }
+int ElfObject::readSectionByType(int type, vector<char>& data) const {
+    for (int i = 0; i < (int)mSections.size(); i++) {
+        if ((int)mSections[i]->sh_type == type) return readSectionByIdx(i, data);
     }
     return -2;
 }
 
-unsigned int readSectionUint(const char* name, ifstream& elfFile, unsigned int defVal) {
+/* Get name from offset in strtab */
+static int getSymName(const ElfObject& elf, int nameOff, string& name) {
+    const char* s = elf.getName(nameOff);
+    if (!s) return -1;
+
+    name = s;
+    return 0;
+}
+
+unsigned int readSectionUint(const char* name, const ElfObject& elf, unsigned int defVal) {
     vector<char> theBytes;
-    int ret = readSectionByName(name, elfFile, theBytes);
+    int ret = elf.readSectionByName(name, theBytes);
     if (ret) {
         ALOGD("Couldn't find section %s (defaulting to %u [0x%x]).", name, defVal, defVal);
         return defVal;
@@ -341,50 +348,6 @@ unsigned int readSectionUint(const char* name, ifstream& elfFile, unsigned int d
     }
 }
 
-static int readSectionByType(ifstream& elfFile, int type, vector<char>& data) {
-    int ret;
-    vector<Elf64_Shdr> shTable;
-
-    ret = readSectionHeadersAll(elfFile, shTable);
-    if (ret) return ret;
-
-    for (int i = 0; i < (int)shTable.size(); i++) {
-        if ((int)shTable[i].sh_type != type) continue;
-
-        vector<char> dataTmp;
-        dataTmp.resize(shTable[i].sh_size);
-
-        elfFile.seekg(shTable[i].sh_offset);
-        if (elfFile.fail()) return -1;
-
-        if (!elfFile.read((char*)dataTmp.data(), shTable[i].sh_size)) return -1;
-
-        data = dataTmp;
-        return 0;
-    }
-    return -2;
-}
-
-static bool symCompare(Elf64_Sym a, Elf64_Sym b) {
-    return (a.st_value < b.st_value);
-}
-
-static int readSymTab(ifstream& elfFile, int sort, vector<Elf64_Sym>& data) {
-    int ret, numElems;
-    Elf64_Sym* buf;
-    vector<char> secData;
-
-    ret = readSectionByType(elfFile, SHT_SYMTAB, secData);
-    if (ret) return ret;
-
-    buf = (Elf64_Sym*)secData.data();
-    numElems = (secData.size() / sizeof(Elf64_Sym));
-    data.assign(buf, buf + numElems);
-
-    if (sort) std::sort(data.begin(), data.end(), symCompare);
-    return 0;
-}
-
 static enum bpf_prog_type getSectionType(string& name) {
     for (auto& snt : sectionNameTypes)
         if (StartsWith(name, snt.name)) return snt.type;
@@ -409,10 +372,10 @@ static string getSectionName(enum bpf_prog_type type)
 }
 */
 
-static int readProgDefs(ifstream& elfFile, vector<struct bpf_prog_def>& pd,
+static int readProgDefs(const ElfObject& elf, vector<struct bpf_prog_def>& pd,
                         size_t sizeOfBpfProgDef) {
     vector<char> pdData;
-    int ret = readSectionByName("progs", elfFile, pdData);
+    int ret = elf.readSectionByName("progs", pdData);
     // Older file formats do not require a 'progs' section at all.
     // (We should probably figure out whether this is behaviour which is safe to remove now.)
     if (ret == -2) return 0;
@@ -442,30 +405,14 @@ static int readProgDefs(ifstream& elfFile, vector<struct bpf_prog_def>& pd,
     return 0;
 }
 
-static int getSectionSymNames(ifstream& elfFile, const string& sectionName, vector<string>& names,
+static int getSectionSymNames(const ElfObject& elf, const string& sectionName,
+                              vector<string>& names,
                               optional<unsigned> symbolType = std::nullopt) {
     int ret;
-    string name;
-    vector<Elf64_Sym> symtab;
-    vector<Elf64_Shdr> shTable;
-
-    ret = readSymTab(elfFile, 1 /* sort */, symtab);
-    if (ret) return ret;
+    const vector<Elf64_Sym>& symtab = elf.sortedSymtab();
 
     /* Get index of section */
-    ret = readSectionHeadersAll(elfFile, shTable);
-    if (ret) return ret;
-
-    int sec_idx = -1;
-    for (int i = 0; i < (int)shTable.size(); i++) {
-        ret = getSymName(elfFile, shTable[i].sh_name, name);
-        if (ret) return ret;
-
-        if (!name.compare(sectionName)) {
-            sec_idx = i;
-            break;
-        }
-    }
+    int sec_idx = elf.sectionIndex(sectionName);
 
     /* No section found with matching name*/
     if (sec_idx == -1) {
@@ -478,7 +425,7 @@ static int getSectionSymNames(ifstream& elfFile, const string& sectionName, vect
 
         if (symtab[i].st_shndx == sec_idx) {
             string s;
-            ret = getSymName(elfFile, symtab[i].st_name, s);
+            ret = getSymName(elf, symtab[i].st_name, s);
             if (ret) return ret;
             names.push_back(s);
         }
@@ -488,19 +435,18 @@ static int getSectionSymNames(ifstream& elfFile, const string& sectionName, vect
 }
 
 /* Read a section by its index - for ex to get sec hdr strtab blob */
-static int readCodeSections(ifstream& elfFile, vector<codeSection>& cs, size_t sizeOfBpfProgDef) {
-    vector<Elf64_Shdr> shTable;
+static int readCodeSections(const ElfObject& elf, vector<codeSection>& cs,
+                            size_t sizeOfBpfProgDef) {
+    const vector<const Elf64_Shdr*>& shTable = elf.sections();
     int entries, ret = 0;
 
-    ret = readSectionHeadersAll(elfFile, shTable);
-    if (ret) return ret;
     entries = shTable.size();
 
     vector<struct bpf_prog_def> pd;
-    ret = readProgDefs(elfFile, pd, sizeOfBpfProgDef);
+    ret = readProgDefs(elf, pd, sizeOfBpfProgDef);
     if (ret) return ret;
     vector<string> progDefNames;
-    ret = getSectionSymNames(elfFile, "progs", progDefNames);
+    ret = getSectionSymNames(elf, "progs", progDefNames);
     if (!pd.empty() && ret) return ret;
 
     for (int i = 0; i < entries; i++) {
@@ -508,7 +454,7 @@ static int readCodeSections(ifstream& elfFile, vector<codeSection>& cs, size_t s
         codeSection cs_temp;
         cs_temp.type = BPF_PROG_TYPE_UNSPEC;
 
-        ret = getSymName(elfFile, shTable[i].sh_name, name);
+        ret = getSymName(elf, shTable[i]->sh_name, name);
         if (ret) return ret;
 
         enum bpf_prog_type ptype = getSectionType(name);
@@ -526,12 +472,12 @@ static int readCodeSections(ifstream& elfFile, vector<codeSection>& cs, size_t s
         cs_temp.type = ptype;
         cs_temp.name = name;
 
-        ret = readSectionByIdx(elfFile, i, cs_temp.data);
+        ret = elf.readSectionByIdx(i, cs_temp.data);
         if (ret) return ret;
         ALOGD("Loaded code section %d (%s)", i, name.c_str());
 
         vector<string> csSymNames;
-        ret = getSectionSymNames(elfFile, oldName, csSymNames, STT_FUNC);
+        ret = getSectionSymNames(elf, oldName, csSymNames, STT_FUNC);
         if (ret || !csSymNames.size()) return ret;
         for (size_t i = 0; i < progDefNames.size(); ++i) {
             if (!progDefNames[i].compare(csSymNames[0] + "_def")) {
@@ -541,12 +487,12 @@ static int readCodeSections(ifstream& elfFile, vector<codeSection>& cs, size_t s
         }
 
         /* Check for rel section */
-        if (cs_temp.data.size() > 0 && i < entries) {
-            ret = getSymName(elfFile, shTable[i + 1].sh_name, name);
+        if (cs_temp.data.size() > 0 && i + 1 < entries) {
+            ret = getSymName(elf, shTable[i + 1]->sh_name, name);
             if (ret) return ret;
 
             if (name == (".rel" + oldName)) {
-                ret = readSectionByIdx(elfFile, i + 1, cs_temp.rel_data);
+                ret = elf.readSectionByIdx(i + 1, cs_temp.rel_data);
                 if (ret) return ret;
                 ALOGD("Loaded relo section %d (%s)", i, name.c_str());
             }
@@ -560,16 +506,12 @@ static int readCodeSections(ifstream& elfFile, vector<codeSection>& cs, size_t s
     return 0;
 }
 
-static int getSymNameByIdx(ifstream& elfFile, int index, string& name) {
-    vector<Elf64_Sym> symtab;
-    int ret = 0;
-
-    ret = readSymTab(elfFile, 0 /* !sort */, symtab);
-    if (ret) return ret;
+static int getSymNameByIdx(const ElfObject& elf, int index, string& name) {
+    const vector<Elf64_Sym>& symtab = elf.symtab();
 
     if (index >= (int)symtab.size()) return -1;
 
-    return getSymName(elfFile, symtab[index].st_name, name);
+    return getSymName(elf, symtab[index].st_name, name);
 }
 
 static bool mapMatchesExpectations(const unique_fd& fd, const string& mapName,
@@ -628,15 +570,15 @@ static bool mapMatchesExpectations(const unique_fd& fd, const string& mapName,
     return false;
 }
 
-static int createMaps(const char* elfPath, ifstream& elfFile, vector<unique_fd>& mapFds,
-                      const char* prefix, const size_t sizeOfBpfMapDef) {
+static int createMaps(const char* elfPath, const ElfObject& elf, vector<unique_fd>& mapFds,
+                      const Location& location, const size_t sizeOfBpfMapDef) {
     int ret;
     vector<char> mdData;
     vector<struct bpf_map_def> md;
     vector<string> mapNames;
     string objName = pathToObjName(string(elfPath));
 
-    ret = readSectionByName("maps", elfFile, mdData);
+    ret = elf.readSectionByName("maps", mdData);
     if (ret == -2) return 0;  // no maps to read
     if (ret) return ret;
 
@@ -663,7 +605,7 @@ static int createMaps(const char* elfPath, ifstream& elfFile, vector<unique_fd>&
         dataPtr += sizeOfBpfMapDef;
     }
 
-    ret = getSectionSymNames(elfFile, "maps", mapNames);
+    ret = getSectionSymNames(elf, "maps", mapNames);
     if (ret) return ret;
 
     unsigned kvers = kernelVersion();
@@ -765,8 +707,8 @@ static int createMaps(const char* elfPath, ifstream& elfFile, vector<unique_fd>&
         // Format of pin location is /sys/fs/bpf/<pin_subdir|prefix>map_<objName>_<mapName>
         // except that maps shared across .o's have empty <objName>
         // Note: <objName> refers to the extension-less basename of the .o file (without @ suffix).
-        string mapPinLoc = string(BPF_FS_PATH) + lookupPinSubdir(pin_subdir, prefix) + "map_" +
-                           (md[i].shared ? "" : objName) + "_" + mapNames[i];
+        string mapPinLoc = string(location.fsRoot) + lookupPinSubdir(pin_subdir, location.prefix) +
+                           "map_" + (md[i].shared ? "" : objName) + "_" + mapNames[i];
         bool reuse = false;
         unique_fd fd;
         int saved_errno;
@@ -800,7 +742,7 @@ static int createMaps(const char* elfPath, ifstream& elfFile, vector<unique_fd>&
 
         if (!reuse) {
             if (specified(selinux_context)) {
-                string createLoc = string(BPF_FS_PATH) + lookupPinSubdir(selinux_context) +
+                string createLoc = string(location.fsRoot) + lookupPinSubdir(selinux_context) +
                                    "tmp_map_" + objName + "_" + mapNames[i];
                 ret = bpfFdPin(fd, createLoc.c_str());
                 if (ret) {
@@ -900,10 +842,11 @@ static void applyRelo(void* insnsPtr, Elf64_Addr offset, int fd) {
     insn->src_reg = BPF_PSEUDO_MAP_FD;
 }
 
-static void applyMapRelo(ifstream& elfFile, vector<unique_fd> &mapFds, vector<codeSection>& cs) {
+static void applyMapRelo(const ElfObject& elf, vector<unique_fd> &mapFds,
+                         vector<codeSection>& cs) {
     vector<string> mapNames;
 
-    int ret = getSectionSymNames(elfFile, "maps", mapNames);
+    int ret = getSectionSymNames(elf, "maps", mapNames);
     if (ret) return;
 
     for (int k = 0; k != (int)cs.size(); k++) {
@@ -914,7 +857,7 @@ static void applyMapRelo(ifstream& elfFile, vector<unique_fd> &mapFds, vector<co
             int symIndex = ELF64_R_SYM(rel[i].r_info);
             string symName;
 
-            ret = getSymNameByIdx(elfFile, symIndex, symName);
+            ret = getSymNameByIdx(elf, symIndex, symName);
             if (ret) return;
 
             /* Find the map fd and apply relo */
@@ -928,8 +871,55 @@ static void applyMapRelo(ifstream& elfFile, vector<unique_fd> &mapFds, vector<co
     }
 }
 
+// Returns whether the program is meant to be loaded with this kernel, bpfloader, build & arch.
+static bool isProgForThisDevice(const codeSection& cs, int i, unsigned kvers) {
+    const string& name = cs.name;
+
+    unsigned min_kver = cs.prog_def->min_kver;
+    unsigned max_kver = cs.prog_def->max_kver;
+    ALOGD("cs[%d].name:%s min_kver:%x .max_kver:%x (kvers:%x)", i, name.c_str(), min_kver,
+         max_kver, kvers);
+    if (kvers < min_kver) return false;
+    if (kvers >= max_kver) return false;
+
+    unsigned bpfMinVer = cs.prog_def->bpfloader_min_ver;
+    unsigned bpfMaxVer = cs.prog_def->bpfloader_max_ver;
+
+    ALOGD("cs[%d].name:%s requires bpfloader version [0x%05x,0x%05x)", i, name.c_str(),
+          bpfMinVer, bpfMaxVer);
+    if (BPFLOADER_VERSION < bpfMinVer) return false;
+    if (BPFLOADER_VERSION >= bpfMaxVer) return false;
+
+    if ((cs.prog_def->ignore_on_eng && isEng()) ||
+        (cs.prog_def->ignore_on_user && isUser()) ||
+        (cs.prog_def->ignore_on_userdebug && isUserdebug())) {
+        ALOGD("cs[%d].name:%s is ignored on %s builds", i, name.c_str(),
+              getBuildType().c_str());
+        return false;
+    }
+
+    if ((isArm() && isKernel32Bit() && cs.prog_def->ignore_on_arm32) ||
+        (isArm() && isKernel64Bit() && cs.prog_def->ignore_on_aarch64) ||
+        (isX86() && isKernel32Bit() && cs.prog_def->ignore_on_x86_32) ||
+        (isX86() && isKernel64Bit() && cs.prog_def->ignore_on_x86_64) ||
+        (isRiscV() && cs.prog_def->ignore_on_riscv64)) {
+        ALOGD("cs[%d].name:%s is ignored on %s", i, name.c_str(), describeArch());
+        return false;
+    }
+
+    return true;
+}
+
+// Format of pin location is
+// /sys/fs/bpf/<prefix>prog_<objName>_<progName>
+static string progPinLocation(const string& progName, const string& objName, domain pin_subdir,
+                              const Location& location) {
+    return string(location.fsRoot) + lookupPinSubdir(pin_subdir, location.prefix) + "prog_" +
+           objName + '_' + progName;
+}
+
 static int loadCodeSections(const char* elfPath, vector<codeSection>& cs, const string& license,
-                            const char* prefix) {
+                            const Location& location) {
     unsigned kvers = kernelVersion();
 
     if (!kvers) {
@@ -949,42 +939,12 @@ static int loadCodeSections(const char* elfPath, vector<codeSection>& cs, const
             return -EINVAL;
         }
 
-        unsigned min_kver = cs[i].prog_def->min_kver;
-        unsigned max_kver = cs[i].prog_def->max_kver;
-        ALOGD("cs[%d].name:%s min_kver:%x .max_kver:%x (kvers:%x)", i, name.c_str(), min_kver,
-             max_kver, kvers);
-        if (kvers < min_kver) continue;
-        if (kvers >= max_kver) continue;
+        if (!isProgForThisDevice(cs[i], i, kvers)) continue;
 
-        unsigned bpfMinVer = cs[i].prog_def->bpfloader_min_ver;
-        unsigned bpfMaxVer = cs[i].prog_def->bpfloader_max_ver;
         domain selinux_context = getDomainFromSelinuxContext(cs[i].prog_def->selinux_context);
         domain pin_subdir = getDomainFromPinSubdir(cs[i].prog_def->pin_subdir);
         // Note: make sure to only check for unrecognized *after* verifying bpfloader
         // version limits include this bpfloader's version.
-
-        ALOGD("cs[%d].name:%s requires bpfloader version [0x%05x,0x%05x)", i, name.c_str(),
-              bpfMinVer, bpfMaxVer);
-        if (BPFLOADER_VERSION < bpfMinVer) continue;
-        if (BPFLOADER_VERSION >= bpfMaxVer) continue;
-
-        if ((cs[i].prog_def->ignore_on_eng && isEng()) ||
-            (cs[i].prog_def->ignore_on_user && isUser()) ||
-            (cs[i].prog_def->ignore_on_userdebug && isUserdebug())) {
-            ALOGD("cs[%d].name:%s is ignored on %s builds", i, name.c_str(),
-                  getBuildType().c_str());
-            continue;
-        }
-
-        if ((isArm() && isKernel32Bit() && cs[i].prog_def->ignore_on_arm32) ||
-            (isArm() && isKernel64Bit() && cs[i].prog_def->ignore_on_aarch64) ||
-            (isX86() && isKernel32Bit() && cs[i].prog_def->ignore_on_x86_32) ||
-            (isX86() && isKernel64Bit() && cs[i].prog_def->ignore_on_x86_64) ||
-            (isRiscV() && cs[i].prog_def->ignore_on_riscv64)) {
-            ALOGD("cs[%d].name:%s is ignored on %s", i, name.c_str(), describeArch());
-            continue;
-        }
-
         if (unrecognized(pin_subdir)) return -ENOTDIR;
 
         if (specified(selinux_context)) {
@@ -1004,10 +964,7 @@ static int loadCodeSections(const char* elfPath, vector<codeSection>& cs, const
         name = name.substr(0, name.find_last_of('$'));
 
         bool reuse = false;
-        // Format of pin location is
-        // /sys/fs/bpf/<prefix>prog_<objName>_<progName>
-        string progPinLoc = string(BPF_FS_PATH) + lookupPinSubdir(pin_subdir, prefix) + "prog_" +
-                            objName + '_' + string(name);
+        string progPinLoc = progPinLocation(name, objName, pin_subdir, location);
         if (access(progPinLoc.c_str(), F_OK) == 0) {
             fd.reset(retrieveProgram(progPinLoc.c_str()));
             ALOGD("New bpf prog load reusing prog %s, ret: %d (%s)", progPinLoc.c_str(), fd.get(),
@@ -1029,10 +986,14 @@ static int loadCodeSections(const char* elfPath, vector<codeSection>& cs, const
             };
             if (isAtLeastKernelVersion(4, 14, 0))
                 strlcpy(req.prog_name, cs[i].name.c_str(), sizeof(req.prog_name));
+            const auto start = steady_clock::now();
             fd.reset(bpf(BPF_PROG_LOAD, req));
+            const int64_t loadUs = elapsedUs(start);
 
             ALOGD("BPF_PROG_LOAD call for %s (%s) returned fd: %d (%s)", elfPath,
                   cs[i].name.c_str(), fd.get(), (!fd.ok() ? std::strerror(errno) : "no error"));
+            ALOGI("prog %s (%u insns) BPF_PROG_LOAD took %" PRId64 "us", progPinLoc.c_str(),
+                  req.insn_cnt, loadUs);
 
             if (!fd.ok()) {
                 vector<string> lines = android::base::Split(log_buf.data(), "\n");
@@ -1053,7 +1014,7 @@ static int loadCodeSections(const char* elfPath, vector<codeSection>& cs, const
 
         if (!reuse) {
             if (specified(selinux_context)) {
-                string createLoc = string(BPF_FS_PATH) + lookupPinSubdir(selinux_context) +
+                string createLoc = string(location.fsRoot) + lookupPinSubdir(selinux_context) +
                                    "tmp_prog_" + objName + '_' + string(name);
                 ret = bpfFdPin(fd, createLoc.c_str());
                 if (ret) {
@@ -1102,48 +1063,68 @@ static int loadCodeSections(const char* elfPath, vector<codeSection>& cs, const
     return 0;
 }
 
-int loadProg(const char* elfPath, bool* isCritical, const Location& location) {
+// The state of a single ELF object as it progresses through the load stages.
+struct ObjectLoader {
+    string path;
+    ElfObject elf;
     vector<char> license;
     vector<char> critical;
     vector<codeSection> cs;
     vector<unique_fd> mapFds;
-    int ret;
+    size_t sizeOfBpfMapDef = 0;
+    bool skip = false;  // true iff the object is not meant for this version of the bpfloader
+    // Per stage wall clock time, in microseconds.
+    int64_t parseUs = 0;
+    int64_t mapsUs = 0;
+    int64_t progsUs = 0;
+};
 
-    if (!isCritical) return -1;
-    *isCritical = false;
+static void logObjectTimes(const ObjectLoader& obj) {
+    ALOGI("%s: parse %" PRId64 "us, maps %" PRId64 "us, progs %" PRId64 "us", obj.path.c_str(),
+          obj.parseUs, obj.mapsUs, obj.progsUs);
+}
 
-    ifstream elfFile(elfPath, ios::in | ios::binary);
-    if (!elfFile.is_open()) return -1;
+static int parseObjectSections(ObjectLoader& obj, bool* isCritical) {
+    const char* elfPath = obj.path.c_str();
+    int ret;
+
+    ret = obj.elf.open(elfPath);
+    if (ret) {
+        ALOGE("Couldn't open ELF object %s: %s", elfPath, strerror(-ret));
+        return -1;
+    }
 
-    ret = readSectionByName("critical", elfFile, critical);
+    ret = obj.elf.readSectionByName("critical", obj.critical);
     *isCritical = !ret;
 
-    ret = readSectionByName("license", elfFile, license);
+    ret = obj.elf.readSectionByName("license", obj.license);
     if (ret) {
         ALOGE("Couldn't find license in %s", elfPath);
         return ret;
     } else {
         ALOGD("Loading %s%s ELF object %s with license %s",
-              *isCritical ? "critical for " : "optional", *isCritical ? (char*)critical.data() : "",
-              elfPath, (char*)license.data());
+              *isCritical ? "critical for " : "optional",
+              *isCritical ? (char*)obj.critical.data() : "", elfPath,
+              (char*)obj.license.data());
     }
 
     // the following default values are for bpfloader V0.0 format which does not include them
     unsigned int bpfLoaderMinVer =
-            readSectionUint("bpfloader_min_ver", elfFile, DEFAULT_BPFLOADER_MIN_VER);
+            readSectionUint("bpfloader_min_ver", obj.elf, DEFAULT_BPFLOADER_MIN_VER);
     unsigned int bpfLoaderMaxVer =
-            readSectionUint("bpfloader_max_ver", elfFile, DEFAULT_BPFLOADER_MAX_VER);
+            readSectionUint("bpfloader_max_ver", obj.elf, DEFAULT_BPFLOADER_MAX_VER);
     unsigned int bpfLoaderMinRequiredVer =
-            readSectionUint("bpfloader_min_required_ver", elfFile, 0);
-    size_t sizeOfBpfMapDef =
-            readSectionUint("size_of_bpf_map_def", elfFile, DEFAULT_SIZEOF_BPF_MAP_DEF);
+            readSectionUint("bpfloader_min_required_ver", obj.elf, 0);
+    obj.sizeOfBpfMapDef =
+            readSectionUint("size_of_bpf_map_def", obj.elf, DEFAULT_SIZEOF_BPF_MAP_DEF);
     size_t sizeOfBpfProgDef =
-            readSectionUint("size_of_bpf_prog_def", elfFile, DEFAULT_SIZEOF_BPF_PROG_DEF);
+            readSectionUint("size_of_bpf_prog_def", obj.elf, DEFAULT_SIZEOF_BPF_PROG_DEF);
 
     // inclusive lower bound check
     if (BPFLOADER_VERSION < bpfLoaderMinVer) {
         ALOGI("BpfLoader version 0x%05x ignoring ELF object %s with min ver 0x%05x",
               BPFLOADER_VERSION, elfPath, bpfLoaderMinVer);
+        obj.skip = true;
         return 0;
     }
 
@@ -1151,6 +1132,7 @@ int loadProg(const char* elfPath, bool* isCritical, const Location& location) {
     if (BPFLOADER_VERSION >= bpfLoaderMaxVer) {
         ALOGI("BpfLoader version 0x%05x ignoring ELF object %s with max ver 0x%05x",
               BPFLOADER_VERSION, elfPath, bpfLoaderMaxVer);
+        obj.skip = true;
         return 0;
     }
 
@@ -1163,8 +1145,8 @@ int loadProg(const char* elfPath, bool* isCritical, const Location& location) {
     ALOGI("BpfLoader version 0x%05x processing ELF object %s with ver [0x%05x,0x%05x)",
           BPFLOADER_VERSION, elfPath, bpfLoaderMinVer, bpfLoaderMaxVer);
 
-    if (sizeOfBpfMapDef < DEFAULT_SIZEOF_BPF_MAP_DEF) {
-        ALOGE("sizeof(bpf_map_def) of %zu is too small (< %d)", sizeOfBpfMapDef,
+    if (obj.sizeOfBpfMapDef < DEFAULT_SIZEOF_BPF_MAP_DEF) {
+        ALOGE("sizeof(bpf_map_def) of %zu is too small (< %d)", obj.sizeOfBpfMapDef,
               DEFAULT_SIZEOF_BPF_MAP_DEF);
         return -1;
     }
@@ -1175,31 +1157,114 @@ int loadProg(const char* elfPath, bool* isCritical, const Location& location) {
         return -1;
     }
 
-    ret = readCodeSections(elfFile, cs, sizeOfBpfProgDef);
+    ret = readCodeSections(obj.elf, obj.cs, sizeOfBpfProgDef);
     if (ret) {
         ALOGE("Couldn't read all code sections in %s", elfPath);
         return ret;
     }
 
     /* Just for future debugging */
-    if (0) dumpAllCs(cs);
+    if (0) dumpAllCs(obj.cs);
 
-    ret = createMaps(elfPath, elfFile, mapFds, location.prefix, sizeOfBpfMapDef);
+    return 0;
+}
+
+// Stage 1: map and parse the ELF object, check it is meant for us, and read its code sections.
+static int parseObject(ObjectLoader& obj, bool* isCritical) {
+    const auto start = steady_clock::now();
+    int ret = parseObjectSections(obj, isCritical);
+    obj.parseUs = elapsedUs(start);
+    return ret;
+}
+
+// Stage 2: create (or reuse) and pin the object's maps, and relocate its code to use them.
+static int createObjectMaps(ObjectLoader& obj, const Location& location) {
+    const char* elfPath = obj.path.c_str();
+    const auto start = steady_clock::now();
+
+    int ret = createMaps(elfPath, obj.elf, obj.mapFds, location, obj.sizeOfBpfMapDef);
     if (ret) {
         ALOGE("Failed to create maps: (ret=%d) in %s", ret, elfPath);
         return ret;
     }
 
-    for (int i = 0; i < (int)mapFds.size(); i++)
-        ALOGD("map_fd found at %d is %d in %s", i, mapFds[i].get(), elfPath);
+    for (int i = 0; i < (int)obj.mapFds.size(); i++)
+        ALOGD("map_fd found at %d is %d in %s", i, obj.mapFds[i].get(), elfPath);
 
-    applyMapRelo(elfFile, mapFds, cs);
+    applyMapRelo(obj.elf, obj.mapFds, obj.cs);
+    obj.mapsUs = elapsedUs(start);
+    return 0;
+}
 
-    ret = loadCodeSections(elfPath, cs, string(license.data()), location.prefix);
+// Stage 3: load (ie. have the kernel verify) and pin the object's programs.
+static int loadObjectPrograms(ObjectLoader& obj, const Location& location) {
+    const auto start = steady_clock::now();
+    int ret = loadCodeSections(obj.path.c_str(), obj.cs, string(obj.license.data()),
+                               location);
+    obj.progsUs = elapsedUs(start);
     if (ret) ALOGE("Failed to load programs, loadCodeSections ret=%d", ret);
+    return ret;
+}
+
+int loadProg(const char* elfPath, bool* isCritical, const Location& location) {
+    ObjectLoader obj;
+    int ret;
+
+    if (!isCritical) return -1;
+    *isCritical = false;
 
+    obj.path = elfPath;
+    ret = parseObject(obj, isCritical);
+    if (ret || obj.skip) return ret;
+
+    ret = createObjectMaps(obj, location);
+    if (!ret) ret = loadObjectPrograms(obj, location);
+    logObjectTimes(obj);
     return ret;
 }
 
+// Calls fn(0) .. fn(count - 1), spread across up to maxThreads threads (including this one).
+static void runInParallel(size_t count, unsigned maxThreads, const std::function<void(size_t)>& fn) {
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) fn(i);
+    };
+
+    size_t numThreads = std::min<size_t>(std::max(maxThreads, 1u), count);
+    vector<std::thread> threads;
+    for (size_t t = 1; t < numThreads; t++) threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads) t.join();
+}
+
+vector<LoadResult> loadProgs(const vector<string>& elfPaths, const Location& location,
+                             unsigned maxThreads) {
+    vector<ObjectLoader> objs(elfPaths.size());
+    vector<LoadResult> results(elfPaths.size());
+
+    runInParallel(objs.size(), maxThreads, [&](size_t i) {
+        objs[i].path = elfPaths[i];
+        results[i].ret = parseObject(objs[i], &results[i].isCritical);
+    });
+
+    // Shared maps mean the objects are not independent of each other here,
+    // so keep this cheap stage serial (and deterministic).
+    for (size_t i = 0; i < objs.size(); i++) {
+        if (results[i].ret || objs[i].skip) continue;
+        results[i].ret = createObjectMaps(objs[i], location);
+    }
+
+    runInParallel(objs.size(), maxThreads, [&](size_t i) {
+        if (results[i].ret || objs[i].skip) return;
+        results[i].ret = loadObjectPrograms(objs[i], location);
+    });
+
+    for (size_t i = 0; i < objs.size(); i++) {
+        if (!objs[i].skip) logObjectTimes(objs[i]);
+    }
+
+    return results;
+}
+
 }  // namespace bpf
 }  // namespace android
@@ -17,8 +17,11 @@
 #pragma once
 
 #include <linux/bpf.h>
+#include <linux/elf.h>
 
-#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace android {
 namespace bpf {
@@ -67,13 +70,71 @@ static constexpr bool specified(domain d) {
 struct Location {
     const char* const dir = "";
     const char* const prefix = "";
+    // Where the bpf filesystem is mounted, overridable so that tests can use a private instance.
+    const char* const fsRoot = "/sys/fs/bpf/";
+};
+
+// An ELF object file mmap'ed read-only into memory.
+//
+// The ELF, section header table, section header string table and symbol table are
+// validated and indexed once, when the file is opened, after which all section lookups
+// are in-memory and do not touch the file again.
+class ElfObject {
+  public:
+    ElfObject() = default;
+    ~ElfObject();
+    ElfObject(const ElfObject&) = delete;
+    ElfObject& operator=(const ElfObject&) = delete;
+
+    // Maps and indexes the given file, returns 0 on success or a negative errno.
+    int open(const char* elfPath);
+
+    const std::vector<const Elf64_Shdr*>& sections() const { return mSections; }
+
+    // Returns the index of the named section, or -1 if there is no such section.
+    int sectionIndex(const std::string& name) const;
+
+    // Returns the name at the given section header string table offset (which, as in
+    // all clang built bpf objects, also holds the symbol names), or nullptr if out of bounds.
+    const char* getName(Elf64_Word nameOff) const;
+
+    // Copies out the contents of a section, returns 0 on success, -2 if not found.
+    int readSectionByIdx(int id, std::vector<char>& data) const;
+    int readSectionByName(const char* name, std::vector<char>& data) const;
+    int readSectionByType(int type, std::vector<char>& data) const;
+
+    // The symbol table, both in file order and sorted by symbol value.
+    const std::vector<Elf64_Sym>& symtab() const { return mSymtab; }
+    const std::vector<Elf64_Sym>& sortedSymtab() const { return mSortedSymtab; }
+
+  private:
+    const char* mData = nullptr;
+    size_t mSize = 0;
+    std::vector<const Elf64_Shdr*> mSections;
+    std::unordered_map<std::string, int> mSectionIndex;
+    std::vector<char> mSecStrTab;
+    std::vector<Elf64_Sym> mSymtab;
+    std::vector<Elf64_Sym> mSortedSymtab;
 };
 
 // BPF loader implementation. Loads an eBPF ELF object
 int loadProg(const char* elfPath, bool* isCritical, const Location &location = {});
 
+struct LoadResult {
+    int ret = 0;
+    bool isCritical = false;
+};
+
+// Loads several ELF objects of a single location, returning one result per object.
+//
+// Maps (which may be shared between objects) are created, and thus pinned, serially in the
+// order the objects are given in, so the outcome is deterministic.  Parsing the objects and
+// loading (ie. verifying) their programs is spread across up to 'maxThreads' threads.
+std::vector<LoadResult> loadProgs(const std::vector<std::string>& elfPaths,
+                                  const Location& location, unsigned maxThreads);
+
 // Exposed for testing
-unsigned int readSectionUint(const char* name, std::ifstream& elfFile, unsigned int defVal);
+unsigned int readSectionUint(const char* name, const ElfObject& elf, unsigned int defVal);
 
 // Returns the build type string (from ro.build.type).
 const std::string& getBuildType();
@@ -26,7 +26,10 @@
 #include <nativehelper/JNIHelp.h>
 #include <net/if.h>
 #include <spawn.h>
+#include <poll.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/xattr.h>
@@ -39,6 +42,8 @@
 #include <netjniutils/netjniutils.h>
 #include <private/android_filesystem_config.h>
 
+#include "clatd.h"
+#include "clatd_stats.h"
 #include "libclat/clatutils.h"
 #include "nativehelper/scoped_utf_chars.h"
 
@@ -127,6 +132,7 @@ static void verifyClatPerms() {
     V2("prog_clatd_schedcls_ingress6_clat_ether", S_IFREG|0440, PROG);
     V2("map_clatd_clat_egress4_map",              S_IFREG|0660, MAP_RW);
     V2("map_clatd_clat_ingress6_map",             S_IFREG|0660, MAP_RW);
+    V2("map_clatd_clat_error_map",                S_IFREG|0440, MAP_RO);
 
 #undef V2
 
@@ -225,8 +231,11 @@ static jint com_android_server_connectivity_ClatCoordinator_createTunInterface(J
         return -1;
     }
 
+    // With IFF_VNET_HDR every packet carries a virtio_net_hdr, which lets the kernel hand clatd
+    // TCP and UDP superpackets with partial checksums (and take them back), instead of having
+    // segmented and checksummed them first. clatd checks for the flag with TUNGETIFF.
     struct ifreq ifr = {
-            .ifr_flags = static_cast<short>(IFF_TUN | IFF_TUN_EXCL),
+            .ifr_flags = static_cast<short>(IFF_TUN | IFF_TUN_EXCL | IFF_VNET_HDR),
     };
     strlcpy(ifr.ifr_name, v4interface.c_str(), sizeof(ifr.ifr_name));
 
@@ -237,6 +246,16 @@ static jint com_android_server_connectivity_ClatCoordinator_createTunInterface(J
         return -1;
     }
 
+    // Without offloads the tun still works, the kernel just won't send clatd any superpackets.
+    // UDP segmentation offload needs a 6.2+ kernel.
+    unsigned long offloads = TUN_F_CSUM | TUN_F_TSO4;
+#ifdef TUN_F_USO4
+    if (ioctl(fd, TUNSETOFFLOAD, offloads | TUN_F_USO4 | TUN_F_USO6) == 0) return fd;
+#endif
+    if (ioctl(fd, TUNSETOFFLOAD, offloads)) {
+        ALOGW("ioctl(TUNSETOFFLOAD) failed (%s)", strerror(errno));
+    }
+
     return fd;
 }
 
@@ -357,7 +376,8 @@ static void com_android_server_connectivity_ClatCoordinator_configurePacketSocke
 
 static jint com_android_server_connectivity_ClatCoordinator_startClatd(
         JNIEnv* env, jclass clazz, jobject tunJavaFd, jobject readSockJavaFd,
-        jobject writeSockJavaFd, jstring iface, jstring pfx96, jstring v4, jstring v6) {
+        jobject writeSockJavaFd, jstring iface, jstring pfx96, jstring v4, jstring v6,
+        jobject statsJavaFd) {
     ScopedUtfChars ifaceStr(env, iface);
     ScopedUtfChars pfx96Str(env, pfx96);
     ScopedUtfChars v4Str(env, v4);
@@ -381,13 +401,25 @@ static jint com_android_server_connectivity_ClatCoordinator_startClatd(
         return -1;
     }
 
+    // The counters are optional.
+    int statsFd = -1;
+    if (statsJavaFd != nullptr) {
+        statsFd = netjniutils::GetNativeFileDescriptor(env, statsJavaFd);
+        if (statsFd < 0) {
+            jniThrowExceptionFmt(env, "java/io/IOException", "Invalid counter file descriptor");
+            return -1;
+        }
+    }
+
     // 1. these are the FD we'll pass to clatd on the cli, so need it as a string
     char tunFdStr[INT32_STRLEN];
     char sockReadStr[INT32_STRLEN];
     char sockWriteStr[INT32_STRLEN];
+    char statsFdStr[INT32_STRLEN];
     snprintf(tunFdStr, sizeof(tunFdStr), "%d", tunFd);
     snprintf(sockReadStr, sizeof(sockReadStr), "%d", readSock);
     snprintf(sockWriteStr, sizeof(sockWriteStr), "%d", writeSock);
+    snprintf(statsFdStr, sizeof(statsFdStr), "%d", statsFd);
 
     // 2. we're going to use this as argv[0] to clatd to make ps output more useful
     std::string progname("clatd-");
@@ -402,6 +434,8 @@ static jint com_android_server_connectivity_ClatCoordinator_startClatd(
                           "-t", tunFdStr,
                           "-r", sockReadStr,
                           "-w", sockWriteStr,
+                          // Ends the arguments here if there are no counters.
+                          statsFd >= 0 ? "-s" : nullptr, statsFdStr,
                           nullptr};
     // clang-format on
 
@@ -450,6 +484,14 @@ static jint com_android_server_connectivity_ClatCoordinator_startClatd(
         throwIOException(env, "posix_spawn_file_actions_adddup2 for write socket failed", ret);
         return -1;
     }
+    if (statsFd >= 0) {
+        if (int ret = posix_spawn_file_actions_adddup2(&fa, statsFd, statsFd)) {
+            posix_spawnattr_destroy(&attr);
+            posix_spawn_file_actions_destroy(&fa);
+            throwIOException(env, "posix_spawn_file_actions_adddup2 for counters failed", ret);
+            return -1;
+        }
+    }
 
     // 5. actually perform vfork/dup2/execve
     pid_t pid;
@@ -471,6 +513,44 @@ static jint com_android_server_connectivity_ClatCoordinator_startClatd(
 // TODO: have a function stopProcess(int pid, const char *name) in common location and call it.
 static constexpr int WAITPID_ATTEMPTS = 50;
 static constexpr int WAITPID_RETRY_INTERVAL_US = 100000;
+static constexpr int SIGTERM_TIMEOUT_MS = WAITPID_ATTEMPTS * WAITPID_RETRY_INTERVAL_US / 1000;
+
+// Polls for the child to exit every WAITPID_RETRY_INTERVAL_US, for up to SIGTERM_TIMEOUT_MS.
+// Returns the pid once it has been reaped, 0 if it is still running, or -1 with errno set.
+static pid_t pollForClatdExit(const pid_t pid, int* const status) {
+    pid_t ret = 0;
+    for (int count = 0; ret == 0 && count < WAITPID_ATTEMPTS; count++) {
+        usleep(WAITPID_RETRY_INTERVAL_US);
+        ret = waitpid(pid, status, WNOHANG);
+    }
+    return ret;
+}
+
+// Waits for the child to exit after SIGTERM, for up to SIGTERM_TIMEOUT_MS. A pidfd becomes
+// readable as soon as the process exits, so this returns within a scheduling delay of clatd
+// exiting rather than at the next 100ms polling step.
+// Returns the pid once it has been reaped, 0 if it is still running, or -1 with errno set.
+static pid_t waitForClatdExit(const pid_t pid, int* const status) {
+    const int pidfd = syscall(__NR_pidfd_open, pid, 0);
+    // Kernels before 5.3 have no pidfd_open.
+    if (pidfd == -1) return pollForClatdExit(pid, status);
+
+    struct pollfd pfd = {.fd = pidfd, .events = POLLIN};
+    int ret;
+    do {
+        ret = poll(&pfd, 1, SIGTERM_TIMEOUT_MS);
+    } while (ret == -1 && errno == EINTR);
+    close(pidfd);
+    if (ret == 0) return 0;
+    if (ret == -1) {
+        // Never block in waitpid without knowing clatd has exited: fall back to polling, so
+        // that the caller still gets to SIGKILL it if it doesn't.
+        ALOGW("poll on clatd pidfd failed: %s", strerror(errno));
+        return pollForClatdExit(pid, status);
+    }
+    // clatd has exited, so this does not block.
+    return TEMP_FAILURE_RETRY(waitpid(pid, status, 0));
+}
 
 static void com_android_server_connectivity_ClatCoordinator_stopClatd(JNIEnv* env, jclass clazz,
                                                                       jint pid) {
@@ -489,11 +569,7 @@ static void com_android_server_connectivity_ClatCoordinator_stopClatd(JNIEnv* en
         ALOGE("Error killing clatd child process %d: %s", pid, strerror(err));
     }
     int status = 0;
-    int ret = 0;
-    for (int count = 0; ret == 0 && count < WAITPID_ATTEMPTS; count++) {
-        usleep(WAITPID_RETRY_INTERVAL_US);
-        ret = waitpid(pid, &status, WNOHANG);
-    }
+    int ret = waitForClatdExit(pid, &status);
     if (ret == 0) {
         ALOGE("Failed to SIGTERM clatd pid=%d, try SIGKILL", pid);
         // TODO: fix that kill failed or waitpid doesn't return.
@@ -527,9 +603,72 @@ static jlong com_android_server_connectivity_ClatCoordinator_getSocketCookie(
     return static_cast<jlong>(sock_cookie);
 }
 
+static jint com_android_server_connectivity_ClatCoordinator_createClatdStats(JNIEnv* env,
+                                                                             jclass clazz) {
+    int fd = memfd_create("clatd_stats", MFD_CLOEXEC);
+    if (fd < 0) {
+        throwIOException(env, "memfd_create failed", errno);
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(struct clatd_stats))) {
+        const int err = errno;
+        close(fd);
+        throwIOException(env, "ftruncate failed", err);
+        return -1;
+    }
+    return fd;
+}
+
+static jlongArray com_android_server_connectivity_ClatCoordinator_getClatdCounters(
+        JNIEnv* env, jclass clazz, jobject statsJavaFd) {
+    int statsFd = netjniutils::GetNativeFileDescriptor(env, statsJavaFd);
+    if (statsFd < 0) {
+        jniThrowExceptionFmt(env, "java/io/IOException", "Invalid counter file descriptor");
+        return nullptr;
+    }
+
+    void* map = mmap(nullptr, sizeof(struct clatd_stats), PROT_READ, MAP_SHARED, statsFd, 0);
+    if (map == MAP_FAILED) {
+        throwIOException(env, "mmap failed", errno);
+        return nullptr;
+    }
+
+    // clatd writes each counter with a single atomic store, see clatd_stats.h.
+    const struct clatd_stats* stats = static_cast<const struct clatd_stats*>(map);
+    jlong counters[CLATD_STAT__MAX];
+    for (int i = 0; i < CLATD_STAT__MAX; i++) {
+        counters[i] = __atomic_load_n(&stats->counters[i], __ATOMIC_RELAXED);
+    }
+    munmap(map, sizeof(struct clatd_stats));
+
+    jlongArray ret = env->NewLongArray(CLATD_STAT__MAX);
+    if (ret != nullptr) env->SetLongArrayRegion(ret, 0, CLATD_STAT__MAX, counters);
+    return ret;
+}
+
+static jobjectArray com_android_server_connectivity_ClatCoordinator_getClatdCounterNames(
+        JNIEnv* env, jclass clazz) {
+    jobjectArray ret = env->NewObjectArray(CLATD_STAT__MAX, env->FindClass("java/lang/String"),
+                                           nullptr);
+    for (int i = 0; i < CLATD_STAT__MAX; i++) {
+        env->SetObjectArrayElement(ret, i, env->NewStringUTF(clatd_stat_names[i]));
+    }
+    return ret;
+}
+
 /*
  * JNI registration.
  */
+static jobjectArray com_android_server_connectivity_ClatCoordinator_getBpfCounterNames(
+        JNIEnv* env, jclass clazz) {
+    size_t size = BPF_CLAT_ERR__MAX;
+    jobjectArray ret = env->NewObjectArray(size, env->FindClass("java/lang/String"), nullptr);
+    for (int i = 0; i < size; i++) {
+        env->SetObjectArrayElement(ret, i, env->NewStringUTF(bpf_clat_errors[i]));
+    }
+    return ret;
+}
+
 static const JNINativeMethod gMethods[] = {
         /* name, signature, funcPtr */
         {"native_selectIpv4Address", "(Ljava/lang/String;I)Ljava/lang/String;",
@@ -551,12 +690,20 @@ static const JNINativeMethod gMethods[] = {
          (void*)com_android_server_connectivity_ClatCoordinator_configurePacketSocket},
         {"native_startClatd",
          "(Ljava/io/FileDescriptor;Ljava/io/FileDescriptor;Ljava/io/FileDescriptor;Ljava/lang/"
-         "String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)I",
+         "String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/io/FileDescriptor;)I",
          (void*)com_android_server_connectivity_ClatCoordinator_startClatd},
         {"native_stopClatd", "(I)V",
          (void*)com_android_server_connectivity_ClatCoordinator_stopClatd},
         {"native_getSocketCookie", "(Ljava/io/FileDescriptor;)J",
          (void*)com_android_server_connectivity_ClatCoordinator_getSocketCookie},
+        {"native_getBpfCounterNames", "()[Ljava/lang/String;",
+         (void*)com_android_server_connectivity_ClatCoordinator_getBpfCounterNames},
+        {"native_createClatdStats", "()I",
+         (void*)com_android_server_connectivity_ClatCoordinator_createClatdStats},
+        {"native_getClatdCounters", "(Ljava/io/FileDescriptor;)[J",
+         (void*)com_android_server_connectivity_ClatCoordinator_getClatdCounters},
+        {"native_getClatdCounterNames", "()[Ljava/lang/String;",
+         (void*)com_android_server_connectivity_ClatCoordinator_getClatdCounterNames},
 };
 
 int register_com_android_server_connectivity_ClatCoordinator(JNIEnv* env) {
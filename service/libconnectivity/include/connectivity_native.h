@@ -25,6 +25,9 @@
 #ifndef __ANDROID_API_U__
 #define __ANDROID_API_U__ 34
 #endif
+#ifndef __ANDROID_API_V__
+#define __ANDROID_API_V__ 35
+#endif
 
 __BEGIN_DECLS
 
@@ -81,6 +84,63 @@ int AConnectivityNative_unblockAllPortsForBind() __INTRODUCED_IN(__ANDROID_API_U
 int AConnectivityNative_getPortsBlockedForBind(in_port_t* _Nonnull ports, size_t* _Nonnull count)
     __INTRODUCED_IN(__ANDROID_API_U__);
 
+/**
+ * Blocks all ports from firstPort to lastPort inclusive from being assigned during bind(), in a
+ * single call and map update. As with AConnectivityNative_blockPortForBind, the caller is
+ * responsible for updating /proc/sys/net/ipv4/ip_local_port_range.
+ *
+ * Returns 0 on success, or a POSIX error code (see errno.h) on failure:
+ *  - EINVAL if lastPort < firstPort
+ *  - EPERM if the UID of the client doesn't have network stack permission
+ *  - Other errors as per https://man7.org/linux/man-pages/man2/bpf.2.html
+ *
+ * @param firstPort First port number of the range.
+ * @param lastPort Last port number of the range.
+ */
+int AConnectivityNative_blockPortRangeForBind(in_port_t firstPort, in_port_t lastPort)
+    __INTRODUCED_IN(__ANDROID_API_V__);
+
+/**
+ * Unblocks all ports from firstPort to lastPort inclusive, in a single call and map update.
+ *
+ * Returns 0 on success, or a POSIX error code (see errno.h) on failure:
+ *  - EINVAL if lastPort < firstPort
+ *  - EPERM if the UID of the client doesn't have network stack permission
+ *  - Other errors as per https://man7.org/linux/man-pages/man2/bpf.2.html
+ *
+ * @param firstPort First port number of the range.
+ * @param lastPort Last port number of the range.
+ */
+int AConnectivityNative_unblockPortRangeForBind(in_port_t firstPort, in_port_t lastPort)
+    __INTRODUCED_IN(__ANDROID_API_V__);
+
+/**
+ * Blocks all of the given ports from being assigned during bind(), in a single call and map
+ * update. See AConnectivityNative_blockPortForBind.
+ *
+ * Returns 0 on success, or a POSIX error code (see errno.h) on failure:
+ *  - EPERM if the UID of the client doesn't have network stack permission
+ *  - Other errors as per https://man7.org/linux/man-pages/man2/bpf.2.html
+ *
+ * @param ports Array of port numbers, in any order.
+ * @param count Number of ports in the array.
+ */
+int AConnectivityNative_blockPortsForBind(const in_port_t* _Nonnull ports, size_t count)
+    __INTRODUCED_IN(__ANDROID_API_V__);
+
+/**
+ * Unblocks all of the given ports, in a single call and map update.
+ *
+ * Returns 0 on success, or a POSIX error code (see errno.h) on failure:
+ *  - EPERM if the UID of the client doesn't have network stack permission
+ *  - Other errors as per https://man7.org/linux/man-pages/man2/bpf.2.html
+ *
+ * @param ports Array of port numbers, in any order.
+ * @param count Number of ports in the array.
+ */
+int AConnectivityNative_unblockPortsForBind(const in_port_t* _Nonnull ports, size_t count)
+    __INTRODUCED_IN(__ANDROID_API_V__);
+
 __END_DECLS
 
 
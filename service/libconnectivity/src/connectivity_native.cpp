@@ -89,3 +89,39 @@ int AConnectivityNative_getPortsBlockedForBind(in_port_t *ports, size_t *count)
     *count = actualBlockedPorts.size();
     return 0;
 }
+
+int AConnectivityNative_blockPortRangeForBind(in_port_t firstPort, in_port_t lastPort) {
+    if (!android::modules::sdklevel::IsAtLeastU()) return ENOSYS;
+    std::shared_ptr<IConnectivityNative> c = getBinder();
+    if (!c) {
+        return EAGAIN;
+    }
+    return getErrno(c->blockPortRangeForBind(firstPort, lastPort));
+}
+
+int AConnectivityNative_unblockPortRangeForBind(in_port_t firstPort, in_port_t lastPort) {
+    if (!android::modules::sdklevel::IsAtLeastU()) return ENOSYS;
+    std::shared_ptr<IConnectivityNative> c = getBinder();
+    if (!c) {
+        return EAGAIN;
+    }
+    return getErrno(c->unblockPortRangeForBind(firstPort, lastPort));
+}
+
+int AConnectivityNative_blockPortsForBind(const in_port_t* ports, size_t count) {
+    if (!android::modules::sdklevel::IsAtLeastU()) return ENOSYS;
+    std::shared_ptr<IConnectivityNative> c = getBinder();
+    if (!c) {
+        return EAGAIN;
+    }
+    return getErrno(c->blockPortsForBind(std::vector<int32_t>(ports, ports + count)));
+}
+
+int AConnectivityNative_unblockPortsForBind(const in_port_t* ports, size_t count) {
+    if (!android::modules::sdklevel::IsAtLeastU()) return ENOSYS;
+    std::shared_ptr<IConnectivityNative> c = getBinder();
+    if (!c) {
+        return EAGAIN;
+    }
+    return getErrno(c->unblockPortsForBind(std::vector<int32_t>(ports, ports + count)));
+}
@@ -17,7 +17,9 @@
 #include "libclat/clatutils.h"
 
 #include <errno.h>
+#include <linux/bpf.h>
 #include <linux/filter.h>
+#include <linux/if_link.h>
 #include <linux/if_packet.h>
 #include <linux/if_tun.h>
 #include <log/log.h>
@@ -27,6 +29,12 @@
 
 #include <bpf/BpfClassic.h>
 
+#define BPF_FD_JUST_USE_INT
+#include <BpfSyscallWrappers.h>
+#undef BPF_FD_JUST_USE_INT
+
+#include "clatd.h"
+
 extern "C" {
 #include "checksum.h"
 }
@@ -255,6 +263,123 @@ int configure_packet_socket(const int sock, const in6_addr* const addr, const in
     return 0;
 }
 
+static const char* kXskEtherProgPath = "/sys/fs/bpf/net_shared/prog_clatd_xsk_xdp_clat_xsk_ether";
+static const char* kXskRawipProgPath = "/sys/fs/bpf/net_shared/prog_clatd_xsk_xdp_clat_xsk_rawip";
+static const char* kXsk6MapPath = "/sys/fs/bpf/net_shared/map_clatd_xsk_clat_xsk6_map";
+static const char* kXskMapPath = "/sys/fs/bpf/net_shared/map_clatd_xsk_clat_xsk_map";
+
+static int deleteXsk6Entry(const in6_addr* const addr, const int ifindex) {
+    const int mapFd = bpf::mapRetrieveRW(kXsk6MapPath);
+    if (mapFd < 0) {
+        const int err = errno;
+        ALOGE("retrieve %s failed: %s", kXsk6MapPath, strerror(err));
+        return -err;
+    }
+    const ClatXsk6Key key = {
+            .iif = static_cast<uint32_t>(ifindex),
+            .local6 = *addr,
+    };
+    const int ret = bpf::deleteMapEntry(mapFd, &key);
+    const int err = errno;
+    close(mapFd);
+    if (ret) {
+        ALOGE("delete clat_xsk6_map entry failed: %s", strerror(err));
+        return -err;
+    }
+    return 0;
+}
+
+static int createXdpLink(const int progFd, const int ifindex, const uint32_t flags) {
+    bpf_attr attr = {};
+    attr.link_create.prog_fd = progFd;
+    attr.link_create.target_ifindex = ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = flags;
+    return bpf::bpf(BPF_LINK_CREATE, &attr);
+}
+
+/* function: attach_xsk_program
+ * Attaches the XDP program that steers packets for the address into clatd's AF_XDP socket, and
+ * points it at the socket's index in the XSKMAP. The program is detached when the returned link
+ * is closed, so the link is best handed to clatd together with the socket. Once clatd has stopped,
+ * detach_xsk_program() removes the steering entry.
+ *   addr       - the IP address to steer
+ *   ifindex    - index of interface to attach the program to
+ *   isEthernet - whether the interface has an ethernet header
+ *   xskIndex   - index of clatd's AF_XDP socket in the XSKMAP, see open_xsk_map()
+ * returns: the bpf link fd on success, -errno on failure
+ */
+int attach_xsk_program(const in6_addr* const addr, const int ifindex, const bool isEthernet,
+                       const uint32_t xskIndex) {
+    if (xskIndex >= CLAT_XSK_MAP_SIZE) return -EINVAL;
+
+    const int mapFd = bpf::mapRetrieveRW(kXsk6MapPath);
+    if (mapFd < 0) {
+        const int err = errno;
+        ALOGE("retrieve %s failed: %s", kXsk6MapPath, strerror(err));
+        return -err;
+    }
+    const ClatXsk6Key key = {
+            .iif = static_cast<uint32_t>(ifindex),
+            .local6 = *addr,
+    };
+    const ClatXsk6Value value = {.xskIndex = xskIndex};
+    const int ret = bpf::writeToMapEntry(mapFd, &key, &value, BPF_ANY);
+    const int err = errno;
+    close(mapFd);
+    if (ret) {
+        ALOGE("write clat_xsk6_map entry failed: %s", strerror(err));
+        return -err;
+    }
+
+    const char* const progPath = isEthernet ? kXskEtherProgPath : kXskRawipProgPath;
+    const int progFd = bpf::retrieveProgram(progPath);
+    if (progFd < 0) {
+        const int err = errno;
+        ALOGE("retrieve %s failed: %s", progPath, strerror(err));
+        deleteXsk6Entry(addr, ifindex);
+        return -err;
+    }
+
+    // Native XDP if the driver supports it, generic XDP otherwise.
+    int linkFd = createXdpLink(progFd, ifindex, XDP_FLAGS_DRV_MODE);
+    if (linkFd < 0) linkFd = createXdpLink(progFd, ifindex, XDP_FLAGS_SKB_MODE);
+    const int linkErr = errno;
+    close(progFd);
+    if (linkFd < 0) {
+        ALOGE("attach XDP program to ifindex %d failed: %s", ifindex, strerror(linkErr));
+        deleteXsk6Entry(addr, ifindex);
+        return -linkErr;
+    }
+
+    return linkFd;
+}
+
+/* function: detach_xsk_program
+ * Removes the steering entry written by attach_xsk_program(), once clatd has stopped and the link
+ * is closed.
+ *   addr    - the IP address that was steered
+ *   ifindex - index of interface the program was attached to
+ * returns: 0 on success, -errno on failure
+ */
+int detach_xsk_program(const in6_addr* const addr, const int ifindex) {
+    return deleteXsk6Entry(addr, ifindex);
+}
+
+/* function: open_xsk_map
+ * Opens the XSKMAP that clatd adds its AF_XDP socket to.
+ * returns: the map fd on success, -errno on failure
+ */
+int open_xsk_map() {
+    const int fd = bpf::mapRetrieveRW(kXskMapPath);
+    if (fd < 0) {
+        const int err = errno;
+        ALOGE("retrieve %s failed: %s", kXskMapPath, strerror(err));
+        return -err;
+    }
+    return fd;
+}
+
 }  // namespace clat
 }  // namespace net
 }  // namespace android
@@ -26,8 +26,13 @@ extern "C" {
 #include "checksum.h"
 }
 
+#define BPF_FD_JUST_USE_INT
+#include <BpfSyscallWrappers.h>
+#undef BPF_FD_JUST_USE_INT
+
 #include <aidl/android/net/INetd.h>
 #include "clat_mark.h"
+#include "clatd.h"
 static_assert(aidl::android::net::INetd::CLAT_MARK == CLAT_MARK, "must be 0xDEADC1A7");
 
 // Default translation parameters.
@@ -187,6 +192,56 @@ TEST_F(ClatUtils, ConfigurePacketSocket) {
     v6Iface.destroy();
 }
 
+TEST_F(ClatUtils, AttachXskProgram) {
+    const int mapFd = open_xsk_map();
+    if (mapFd == -ENOENT) GTEST_SKIP() << "clatd_xsk.o not loaded";
+    ASSERT_LE(0, mapFd);
+    close(mapFd);
+
+    TunInterface v6Iface;
+    ASSERT_EQ(0, v6Iface.init());
+
+    struct in6_addr addr6;
+    EXPECT_EQ(1, inet_pton(AF_INET6, "2001:db8::f00", &addr6));
+    EXPECT_EQ(-EINVAL, attach_xsk_program(&addr6, v6Iface.ifindex(), false, CLAT_XSK_MAP_SIZE));
+
+    const int xsk6MapFd =
+            bpf::mapRetrieveRW("/sys/fs/bpf/net_shared/map_clatd_xsk_clat_xsk6_map");
+    ASSERT_LE(0, xsk6MapFd);
+    ClatXsk6Value value = {};
+
+    // A failed attach leaves no steering entry behind.
+    constexpr int kNoSuchIfindex = INT32_MAX;
+    EXPECT_GT(0, attach_xsk_program(&addr6, kNoSuchIfindex, false, 3));
+    const ClatXsk6Key badKey = {
+            .iif = static_cast<uint32_t>(kNoSuchIfindex),
+            .local6 = addr6,
+    };
+    EXPECT_EQ(-1, bpf::findMapEntry(xsk6MapFd, &badKey, &value));
+    EXPECT_EQ(ENOENT, errno);
+
+    const int linkFd = attach_xsk_program(&addr6, v6Iface.ifindex(), false, 3);
+    ASSERT_LE(0, linkFd);
+
+    // The steering entry for the address points at the socket's index.
+    const ClatXsk6Key key = {
+            .iif = static_cast<uint32_t>(v6Iface.ifindex()),
+            .local6 = addr6,
+    };
+    EXPECT_EQ(0, bpf::findMapEntry(xsk6MapFd, &key, &value));
+    EXPECT_EQ(3U, value.xskIndex);
+
+    // Closing the link detaches the program, and detaching removes the steering entry.
+    close(linkFd);
+    EXPECT_EQ(0, detach_xsk_program(&addr6, v6Iface.ifindex()));
+    EXPECT_EQ(-1, bpf::findMapEntry(xsk6MapFd, &key, &value));
+    EXPECT_EQ(ENOENT, errno);
+    EXPECT_EQ(-ENOENT, detach_xsk_program(&addr6, v6Iface.ifindex()));
+
+    close(xsk6MapFd);
+    v6Iface.destroy();
+}
+
 // This is not a realistic test because we can't test generateIPv6Address here since it requires
 // manipulating routing, which we can't do without talking to the real netd on the system.
 // See test MakeChecksumNeutral.
@@ -28,6 +28,10 @@ int generateIpv6Address(const char* const iface, const in_addr v4, const in6_add
 int detect_mtu(const struct in6_addr* const plat_subnet, const uint32_t plat_suffix,
                const uint32_t mark);
 int configure_packet_socket(const int sock, const in6_addr* const addr, const int ifindex);
+int attach_xsk_program(const in6_addr* const addr, const int ifindex, const bool isEthernet,
+                       const uint32_t xskIndex);
+int detach_xsk_program(const in6_addr* const addr, const int ifindex);
+int open_xsk_map();
 
 // For testing
 typedef bool (*isIpv4AddrFreeFn)(const in_addr_t);
@@ -28,7 +28,13 @@ import static android.net.BpfNetMapsConstants.IIF_MATCH;
 import static android.net.BpfNetMapsConstants.INGRESS_DISCARD_MAP_PATH;
 import static android.net.BpfNetMapsConstants.LOCKDOWN_VPN_MATCH;
 import static android.net.BpfNetMapsConstants.PENALTY_BOX_MATCH;
+import static android.net.BpfNetMapsConstants.PERMISSION_ARRAY_ENTRY;
+import static android.net.BpfNetMapsConstants.RULES_GENERATION_KEY;
+import static android.net.BpfNetMapsConstants.RULES_GENERATION_MAP_PATH;
+import static android.net.BpfNetMapsConstants.UID_ARRAY_MAP_SIZE;
+import static android.net.BpfNetMapsConstants.UID_OWNER_ARRAY_MAP_PATH;
 import static android.net.BpfNetMapsConstants.UID_OWNER_MAP_PATH;
+import static android.net.BpfNetMapsConstants.UID_PERMISSION_ARRAY_MAP_PATH;
 import static android.net.BpfNetMapsConstants.UID_PERMISSION_MAP_PATH;
 import static android.net.BpfNetMapsConstants.UID_RULES_CONFIGURATION_KEY;
 import static android.net.BpfNetMapsUtils.getMatchByFirewallChain;
@@ -55,6 +61,7 @@ import android.net.UidOwnerValue;
 import android.os.Build;
 import android.os.RemoteException;
 import android.os.ServiceSpecificException;
+import android.os.SystemClock;
 import android.system.ErrnoException;
 import android.system.Os;
 import android.util.ArraySet;
@@ -73,6 +80,7 @@ import com.android.net.module.util.BpfMap;
 import com.android.net.module.util.IBpfMap;
 import com.android.net.module.util.Struct;
 import com.android.net.module.util.Struct.S32;
+import com.android.net.module.util.Struct.S64;
 import com.android.net.module.util.Struct.U32;
 import com.android.net.module.util.Struct.U8;
 import com.android.net.module.util.bpf.CookieTagMapKey;
@@ -124,10 +132,18 @@ public class BpfNetMaps {
     // BpfMap for UID_OWNER_MAP_PATH. This map is not accessed by others.
     private static IBpfMap<S32, UidOwnerValue> sUidOwnerMap = null;
     private static IBpfMap<S32, U8> sUidPermissionMap = null;
+    // Direct-indexed copies of the entries of the two maps above whose keys are below
+    // UID_ARRAY_MAP_SIZE, which is where the eBPF programs look them up. Only written through
+    // updateUidOwnerEntry and friends, so that the copies never diverge.
+    private static IBpfMap<S32, UidOwnerValue> sUidOwnerArrayMap = null;
+    private static IBpfMap<S32, U8> sUidPermissionArrayMap = null;
     private static IBpfMap<CookieTagMapKey, CookieTagMapValue> sCookieTagMap = null;
     // TODO: Add BOOL class and replace U8?
     private static IBpfMap<S32, U8> sDataSaverEnabledMap = null;
     private static IBpfMap<IngressDiscardKey, IngressDiscardValue> sIngressDiscardMap = null;
+    // Changed after every write to the maps that DnsBpfHelper reads and caches. Only exists on
+    // 5.5+ kernels, null otherwise.
+    private static IBpfMap<S32, S64> sRulesGenerationMap = null;
 
     private static final List<Pair<Integer, String>> PERMISSION_LIST = Arrays.asList(
             Pair.create(PERMISSION_INTERNET, "PERMISSION_INTERNET"),
@@ -158,6 +174,22 @@ public class BpfNetMaps {
         sUidPermissionMap = uidPermissionMap;
     }
 
+    /**
+     * Set uidOwnerArrayMap for test.
+     */
+    @VisibleForTesting
+    public static void setUidOwnerArrayMapForTest(IBpfMap<S32, UidOwnerValue> uidOwnerArrayMap) {
+        sUidOwnerArrayMap = uidOwnerArrayMap;
+    }
+
+    /**
+     * Set uidPermissionArrayMap for test.
+     */
+    @VisibleForTesting
+    public static void setUidPermissionArrayMapForTest(IBpfMap<S32, U8> uidPermissionArrayMap) {
+        sUidPermissionArrayMap = uidPermissionArrayMap;
+    }
+
     /**
      * Set cookieTagMap for test.
      */
@@ -184,6 +216,14 @@ public class BpfNetMaps {
         sIngressDiscardMap = ingressDiscardMap;
     }
 
+    /**
+     * Set rulesGenerationMap for test.
+     */
+    @VisibleForTesting
+    public static void setRulesGenerationMapForTest(IBpfMap<S32, S64> rulesGenerationMap) {
+        sRulesGenerationMap = rulesGenerationMap;
+    }
+
     @RequiresApi(Build.VERSION_CODES.TIRAMISU)
     private static IBpfMap<S32, U32> getConfigurationMap() {
         try {
@@ -214,6 +254,26 @@ public class BpfNetMaps {
         }
     }
 
+    @RequiresApi(Build.VERSION_CODES.TIRAMISU)
+    private static IBpfMap<S32, UidOwnerValue> getUidOwnerArrayMap() {
+        try {
+            return new BpfMap<>(
+                    UID_OWNER_ARRAY_MAP_PATH, S32.class, UidOwnerValue.class);
+        } catch (ErrnoException e) {
+            throw new IllegalStateException("Cannot open uid owner array map", e);
+        }
+    }
+
+    @RequiresApi(Build.VERSION_CODES.TIRAMISU)
+    private static IBpfMap<S32, U8> getUidPermissionArrayMap() {
+        try {
+            return new BpfMap<>(
+                    UID_PERMISSION_ARRAY_MAP_PATH, S32.class, U8.class);
+        } catch (ErrnoException e) {
+            throw new IllegalStateException("Cannot open uid permission array map", e);
+        }
+    }
+
     @RequiresApi(Build.VERSION_CODES.TIRAMISU)
     private static IBpfMap<CookieTagMapKey, CookieTagMapValue> getCookieTagMap() {
         try {
@@ -244,6 +304,33 @@ public class BpfNetMaps {
         }
     }
 
+    @RequiresApi(Build.VERSION_CODES.TIRAMISU)
+    private static IBpfMap<S32, S64> getRulesGenerationMap() {
+        try {
+            return new BpfMap<>(RULES_GENERATION_MAP_PATH, S32.class, S64.class);
+        } catch (ErrnoException e) {
+            if (e.errno == ENOENT) return null;  // Kernel older than 5.5.
+            throw new IllegalStateException("Cannot open rules generation map", e);
+        }
+    }
+
+    /**
+     * Tells the readers of the maps that DnsBpfHelper caches that they changed. Must be called
+     * after writing configuration, uid owner or data saver enabled map entries.
+     *
+     * This stores the current time rather than incrementing a counter, so that it needs no
+     * read-modify-write, and any two writers store different values even if they race.
+     */
+    private static void bumpRulesGeneration() {
+        if (sRulesGenerationMap == null) return;
+        try {
+            sRulesGenerationMap.updateEntry(RULES_GENERATION_KEY,
+                    new S64(SystemClock.elapsedRealtimeNanos()));
+        } catch (ErrnoException e) {
+            Log.wtf(TAG, "Failed to update rules generation: " + Os.strerror(e.errno));
+        }
+    }
+
     @RequiresApi(Build.VERSION_CODES.TIRAMISU)
     private static void initBpfMaps() {
         if (sConfigurationMap == null) {
@@ -265,7 +352,16 @@ public class BpfNetMaps {
         if (sUidOwnerMap == null) {
             sUidOwnerMap = getUidOwnerMap();
         }
+        if (sUidOwnerArrayMap == null) {
+            sUidOwnerArrayMap = getUidOwnerArrayMap();
+        }
         try {
+            // Array entries cannot be deleted, zero the ones that mirror a uid owner map entry.
+            sUidOwnerMap.forEach((uid, config) -> {
+                if (isInUidArray((int) uid.val)) {
+                    sUidOwnerArrayMap.updateEntry(uid, new UidOwnerValue(0, 0));
+                }
+            });
             sUidOwnerMap.clear();
         } catch (ErrnoException e) {
             throw new IllegalStateException("Failed to initialize uid owner map", e);
@@ -274,6 +370,9 @@ public class BpfNetMaps {
         if (sUidPermissionMap == null) {
             sUidPermissionMap = getUidPermissionMap();
         }
+        if (sUidPermissionArrayMap == null) {
+            sUidPermissionArrayMap = getUidPermissionArrayMap();
+        }
 
         if (sCookieTagMap == null) {
             sCookieTagMap = getCookieTagMap();
@@ -296,6 +395,11 @@ public class BpfNetMaps {
         } catch (ErrnoException e) {
             throw new IllegalStateException("Failed to initialize ingress discard map", e);
         }
+
+        if (sRulesGenerationMap == null) {
+            sRulesGenerationMap = getRulesGenerationMap();
+        }
+        bumpRulesGeneration();
     }
 
     /**
@@ -384,6 +488,41 @@ public class BpfNetMaps {
         }
     }
 
+    private static boolean isInUidArray(final int uid) {
+        return uid >= 0 && uid < UID_ARRAY_MAP_SIZE;
+    }
+
+    // The HASH maps are the source of truth for everything but the eBPF programs (eg.
+    // BpfNetMapsReader, DnsBpfHelper, netd), so they are written first, and the array maps only
+    // mirror them once that succeeded: a failure (eg. E2BIG when the HASH map is full) must not
+    // leave eBPF enforcing something nothing else can see.
+    private static void updateUidOwnerEntry(final int uid, final UidOwnerValue value)
+            throws ErrnoException {
+        sUidOwnerMap.updateEntry(new S32(uid), value);
+        if (isInUidArray(uid)) sUidOwnerArrayMap.updateEntry(new S32(uid), value);
+    }
+
+    private static void deleteUidOwnerEntry(final int uid) throws ErrnoException {
+        sUidOwnerMap.deleteEntry(new S32(uid));
+        if (isInUidArray(uid)) {
+            sUidOwnerArrayMap.updateEntry(new S32(uid), new UidOwnerValue(0, 0));
+        }
+    }
+
+    private static void updateUidPermissionEntry(final int uid, final short permissions)
+            throws ErrnoException {
+        sUidPermissionMap.updateEntry(new S32(uid), new U8(permissions));
+        if (isInUidArray(uid)) {
+            sUidPermissionArrayMap.updateEntry(new S32(uid),
+                    new U8((short) (permissions | PERMISSION_ARRAY_ENTRY)));
+        }
+    }
+
+    private static void deleteUidPermissionEntry(final int uid) throws ErrnoException {
+        sUidPermissionMap.deleteEntry(new S32(uid));
+        if (isInUidArray(uid)) sUidPermissionArrayMap.updateEntry(new S32(uid), new U8((short) 0));
+    }
+
     private void removeRule(final int uid, final long match, final String caller) {
         try {
             synchronized (sUidOwnerMap) {
@@ -400,10 +539,11 @@ public class BpfNetMaps {
                 );
 
                 if (newMatch.rule == 0) {
-                    sUidOwnerMap.deleteEntry(new S32(uid));
+                    deleteUidOwnerEntry(uid);
                 } else {
-                    sUidOwnerMap.updateEntry(new S32(uid), newMatch);
+                    updateUidOwnerEntry(uid, newMatch);
                 }
+                bumpRulesGeneration();
             }
         } catch (ErrnoException e) {
             throw new ServiceSpecificException(e.errno,
@@ -433,7 +573,8 @@ public class BpfNetMaps {
                             match
                     );
                 }
-                sUidOwnerMap.updateEntry(new S32(uid), newMatch);
+                updateUidOwnerEntry(uid, newMatch);
+                bumpRulesGeneration();
             }
         } catch (ErrnoException e) {
             throw new ServiceSpecificException(e.errno,
@@ -520,6 +661,7 @@ public class BpfNetMaps {
                 final U32 config = sConfigurationMap.getValue(UID_RULES_CONFIGURATION_KEY);
                 final long newConfig = enable ? (config.val | match) : (config.val & ~match);
                 sConfigurationMap.updateEntry(UID_RULES_CONFIGURATION_KEY, new U32(newConfig));
+                bumpRulesGeneration();
             }
         } catch (ErrnoException e) {
             throw new ServiceSpecificException(e.errno,
@@ -846,7 +988,7 @@ public class BpfNetMaps {
         if (permissions == PERMISSION_UNINSTALLED || permissions == PERMISSION_INTERNET) {
             for (final int uid : uids) {
                 try {
-                    sUidPermissionMap.deleteEntry(new S32(uid));
+                    deleteUidPermissionEntry(uid);
                 } catch (ErrnoException e) {
                     Log.e(TAG, "Failed to remove uid " + uid + " from permission map: " + e);
                 }
@@ -856,7 +998,7 @@ public class BpfNetMaps {
 
         for (final int uid : uids) {
             try {
-                sUidPermissionMap.updateEntry(new S32(uid), new U8((short) permissions));
+                updateUidPermissionEntry(uid, (short) permissions);
             } catch (ErrnoException e) {
                 Log.e(TAG, "Failed to set permission "
                         + permissions + " to uid " + uid + ": " + e);
@@ -879,6 +1021,7 @@ public class BpfNetMaps {
         try {
             final short config = enable ? DATA_SAVER_ENABLED : DATA_SAVER_DISABLED;
             sDataSaverEnabledMap.updateEntry(DATA_SAVER_ENABLED_KEY, new U8(config));
+            bumpRulesGeneration();
         } catch (ErrnoException e) {
             throw new ServiceSpecificException(e.errno, "Unable to set data saver: "
                     + Os.strerror(e.errno));
@@ -34,6 +34,7 @@ import android.os.Build;
 import android.os.ParcelFileDescriptor;
 import android.os.RemoteException;
 import android.os.ServiceSpecificException;
+import android.os.SystemClock;
 import android.system.ErrnoException;
 import android.util.Log;
 
@@ -44,6 +45,7 @@ import com.android.internal.util.IndentingPrintWriter;
 import com.android.net.module.util.BpfMap;
 import com.android.net.module.util.IBpfMap;
 import com.android.net.module.util.InterfaceParams;
+import com.android.net.module.util.Struct.S32;
 import com.android.net.module.util.TcUtils;
 import com.android.net.module.util.bpf.ClatEgress4Key;
 import com.android.net.module.util.bpf.ClatEgress4Value;
@@ -111,6 +113,7 @@ public class ClatCoordinator {
             "/sys/fs/bpf/netd_shared/map_netd_cookie_tag_map";
     private static final String CLAT_EGRESS4_MAP_PATH = makeMapPath("egress4");
     private static final String CLAT_INGRESS6_MAP_PATH = makeMapPath("ingress6");
+    private static final String CLAT_ERROR_MAP_PATH = makeMapPath("error");
 
     private static String makeMapPath(String which) {
         return "/sys/fs/bpf/net_shared/map_clatd_clat_" + which + "_map";
@@ -136,6 +139,11 @@ public class ClatCoordinator {
     private final IBpfMap<CookieTagMapKey, CookieTagMapValue> mCookieTagMap;
     @Nullable
     private ClatdTracker mClatdTracker = null;
+    // Memory that the running clatd keeps its counters in, see clatd/include/clatd_stats.h.
+    @Nullable
+    private ParcelFileDescriptor mClatdStats = null;
+    @Nullable
+    private StartLatency mLastStartLatency = null;
 
     /**
      * Dependencies of ClatCoordinator which makes ConnectivityService injection
@@ -233,8 +241,9 @@ public class ClatCoordinator {
          */
         public int startClatd(@NonNull FileDescriptor tunfd, @NonNull FileDescriptor readsock6,
                 @NonNull FileDescriptor writesock6, @NonNull String iface, @NonNull String pfx96,
-                @NonNull String v4, @NonNull String v6) throws IOException {
-            return native_startClatd(tunfd, readsock6, writesock6, iface, pfx96, v4, v6);
+                @NonNull String v4, @NonNull String v6, @Nullable FileDescriptor stats)
+                throws IOException {
+            return native_startClatd(tunfd, readsock6, writesock6, iface, pfx96, v4, v6, stats);
         }
 
         /**
@@ -275,6 +284,41 @@ public class ClatCoordinator {
             }
         }
 
+        /** Get error counter BPF map. */
+        @Nullable
+        public IBpfMap<S32, S32> getBpfErrorMap() {
+            try {
+                return new BpfMap<>(CLAT_ERROR_MAP_PATH,
+                        BpfMap.BPF_F_RDONLY, S32.class, S32.class);
+            } catch (ErrnoException e) {
+                Log.e(TAG, "Cannot create error map: " + e);
+                return null;
+            }
+        }
+
+        /** Get the names of the BPF error counters, indexed by counter. */
+        @NonNull
+        public String[] getBpfCounterNames() {
+            return native_getBpfCounterNames();
+        }
+
+        /** Create the shared memory for the clatd counters. */
+        public int createClatdStats() throws IOException {
+            return native_createClatdStats();
+        }
+
+        /** Read the clatd counters from their shared memory. */
+        @NonNull
+        public long[] getClatdCounters(@NonNull FileDescriptor stats) throws IOException {
+            return native_getClatdCounters(stats);
+        }
+
+        /** Get the names of the clatd counters, indexed by counter. */
+        @NonNull
+        public String[] getClatdCounterNames() {
+            return native_getClatdCounterNames();
+        }
+
         /** Get cookie tag map */
         @Nullable
         public IBpfMap<CookieTagMapKey, CookieTagMapValue> getBpfCookieTagMap() {
@@ -370,6 +414,30 @@ public class ClatCoordinator {
         }
     };
 
+    /**
+     * How long each phase of a clatStart() took, to track 464xlat bring-up latency on network
+     * switches.
+     */
+    @VisibleForTesting
+    static class StartLatency {
+        private final long mStartNs = SystemClock.elapsedRealtimeNanos();
+        private long mLastNs = mStartNs;
+        private final StringBuilder mPhases = new StringBuilder();
+
+        /** Records the time since the previous phase ended. */
+        void phaseDone(@NonNull String phase) {
+            final long now = SystemClock.elapsedRealtimeNanos();
+            if (mPhases.length() > 0) mPhases.append(", ");
+            mPhases.append(phase).append(": ").append((now - mLastNs) / 1000).append("us");
+            mLastNs = now;
+        }
+
+        @Override
+        public String toString() {
+            return (mLastNs - mStartNs) / 1000 + "us (" + mPhases + ")";
+        }
+    }
+
     @VisibleForTesting
     static int getFwmark(int netId) {
         // See union Fwmark in system/netd/include/Fwmark.h
@@ -520,6 +588,15 @@ public class ClatCoordinator {
         }
     }
 
+    private static void closeClatdStats(@Nullable ParcelFileDescriptor stats) {
+        if (stats == null) return;
+        try {
+            stats.close();
+        } catch (IOException e) {
+            Log.e(TAG, "Fail to close clatd counters " + e);
+        }
+    }
+
     private void maybeCleanUp(ParcelFileDescriptor tunFd, ParcelFileDescriptor readSock6,
             ParcelFileDescriptor writeSock6) {
         if (tunFd != null) {
@@ -600,6 +677,8 @@ public class ClatCoordinator {
             throw new IOException("Prefix must be 96 bits long: " + nat64Prefix);
         }
 
+        final StartLatency latency = new StartLatency();
+
         // [1] Pick an IPv4 address from 192.0.0.4, 192.0.0.5, 192.0.0.6 ..
         final String v4Str;
         try {
@@ -615,6 +694,8 @@ public class ClatCoordinator {
             throw new IOException("Invalid IPv4 address " + v4Str);
         }
 
+        latency.phaseDone("ipv4");
+
         // [2] Generate a checksum-neutral IID.
         final Integer fwmark = getFwmark(netId);
         final String pfx96Str = nat64Prefix.getAddress().getHostAddress();
@@ -633,6 +714,8 @@ public class ClatCoordinator {
             throw new IOException("Invalid IPv6 address " + v6Str);
         }
 
+        latency.phaseDone("ipv6");
+
         // [3] Open, configure and bring up the tun interface.
         // Create the v4-... tun interface.
 
@@ -696,6 +779,8 @@ public class ClatCoordinator {
                     + ifConfig.prefixLength + " failed on " + ifConfig.ifName + ": " + e);
         }
 
+        latency.phaseDone("tun");
+
         // [4] Open and configure local 464xlat read/write sockets.
         // Opens a packet socket to receive IPv6 packets in clatd.
         try {
@@ -756,17 +841,29 @@ public class ClatCoordinator {
             throw new IOException("configure packet socket failed: " + e);
         }
 
+        latency.phaseDone("sockets");
+
         // [5] Start clatd.
+        // The counters are only for dumpsys, clatd can run without them.
+        ParcelFileDescriptor stats = null;
+        try {
+            stats = mDeps.adoptFd(mDeps.createClatdStats());
+        } catch (IOException e) {
+            Log.e(TAG, "Create clatd counters failed: " + e);
+        }
+
         final int pid;
         try {
             pid = mDeps.startClatd(tunFd.getFileDescriptor(), readSock6.getFileDescriptor(),
-                    writeSock6.getFileDescriptor(), iface, pfx96Str, v4Str, v6Str);
+                    writeSock6.getFileDescriptor(), iface, pfx96Str, v4Str, v6Str,
+                    stats != null ? stats.getFileDescriptor() : null);
         } catch (IOException e) {
             try {
                 untagSocket(cookie);
             } catch (IOException e2) {
                 Log.e(TAG, "untagSocket cookie " + cookie + " failed: " + e2);
             }
+            closeClatdStats(stats);
             throw new IOException("Error start clatd on " + iface + ": " + e);
         } finally {
             // The file descriptors have been duplicated (dup2) to clatd in native_startClatd().
@@ -774,12 +871,19 @@ public class ClatCoordinator {
             maybeCleanUp(tunFd, readSock6, writeSock6);
         }
 
+        latency.phaseDone("spawn");
+
         // [6] Initialize and store clatd tracker object.
         mClatdTracker = new ClatdTracker(iface, ifIndex, tunIface, tunIfIndex, v4, v6, pfx96,
                 pid, cookie);
+        mClatdStats = stats;
 
         // [7] Start BPF
         maybeStartBpf(mClatdTracker);
+        latency.phaseDone("bpf");
+
+        Log.i(TAG, "clatd on " + iface + " started in " + latency);
+        mLastStartLatency = latency;
 
         return v6Str;
     }
@@ -832,9 +936,11 @@ public class ClatCoordinator {
         maybeStopBpf(mClatdTracker);
         mDeps.stopClatd(mClatdTracker.pid);
         untagSocket(mClatdTracker.cookie);
+        closeClatdStats(mClatdStats);
 
         Log.i(TAG, "clatd on " + mClatdTracker.iface + " stopped");
         mClatdTracker = null;
+        mClatdStats = null;
     }
 
     private void dumpBpfIngress(@NonNull IndentingPrintWriter pw) {
@@ -883,6 +989,51 @@ public class ClatCoordinator {
         }
     }
 
+    private void dumpBpfCounters(@NonNull IndentingPrintWriter pw) {
+        try (IBpfMap<S32, S32> map = mDeps.getBpfErrorMap()) {
+            if (map == null) {
+                pw.println("No BPF error counter map");
+                return;
+            }
+            if (map.isEmpty()) {
+                pw.println("<empty>");
+                return;
+            }
+            final String[] counterNames = mDeps.getBpfCounterNames();
+            pw.println("BPF ingress6 punt/drop counters:");
+            pw.increaseIndent();
+            map.forEach((k, v) -> {
+                final String counterName = k.val >= 0 && k.val < counterNames.length
+                        ? counterNames[k.val] : Integer.toString(k.val);
+                if (v.val > 0) pw.println(String.format("%s: %d", counterName, v.val));
+            });
+            pw.decreaseIndent();
+        } catch (ErrnoException | IOException e) {
+            pw.println("Error dumping BPF error counter map: " + e);
+        }
+    }
+
+    private void dumpClatdCounters(@NonNull IndentingPrintWriter pw) {
+        if (mClatdStats == null) {
+            pw.println("No clatd counters");
+            return;
+        }
+        try {
+            final long[] counters = mDeps.getClatdCounters(mClatdStats.getFileDescriptor());
+            final String[] counterNames = mDeps.getClatdCounterNames();
+            pw.println("clatd counters:");
+            pw.increaseIndent();
+            for (int i = 0; i < counters.length && i < counterNames.length; i++) {
+                if (counters[i] > 0) {
+                    pw.println(String.format("%s: %d", counterNames[i], counters[i]));
+                }
+            }
+            pw.decreaseIndent();
+        } catch (IOException e) {
+            pw.println("Error dumping clatd counters: " + e);
+        }
+    }
+
     /**
      * Dump the coordinator information.
      *
@@ -898,6 +1049,9 @@ public class ClatCoordinator {
             dumpBpfIngress(pw);
             dumpBpfEgress(pw);
             pw.decreaseIndent();
+            dumpBpfCounters(pw);
+            dumpClatdCounters(pw);
+            pw.println("Start latency: " + mLastStartLatency);
         } else {
             pw.println("<not started>");
         }
@@ -927,8 +1081,13 @@ public class ClatCoordinator {
     private static native void native_configurePacketSocket(FileDescriptor sock, String v6,
             int ifindex) throws IOException;
     private static native int native_startClatd(FileDescriptor tunfd, FileDescriptor readsock6,
-            FileDescriptor writesock6, String iface, String pfx96, String v4, String v6)
-            throws IOException;
+            FileDescriptor writesock6, String iface, String pfx96, String v4, String v6,
+            FileDescriptor stats) throws IOException;
     private static native void native_stopClatd(int pid) throws IOException;
+    private static native String[] native_getBpfCounterNames();
+    private static native int native_createClatdStats() throws IOException;
+    private static native long[] native_getClatdCounters(FileDescriptor stats)
+            throws IOException;
+    private static native String[] native_getClatdCounterNames();
     private static native long native_getSocketCookie(FileDescriptor sock) throws IOException;
 }
@@ -24,15 +24,11 @@ import android.os.Binder;
 import android.os.Process;
 import android.os.ServiceSpecificException;
 import android.system.ErrnoException;
-import android.util.Log;
 
 import com.android.internal.annotations.VisibleForTesting;
 import com.android.net.module.util.BpfBitmap;
-import com.android.net.module.util.CollectionUtils;
 import com.android.net.module.util.PermissionUtils;
 
-import java.util.ArrayList;
-
 /**
  * @hide
  */
@@ -111,6 +107,51 @@ public class ConnectivityNativeService extends ConnectivityNative.Stub {
         }
     }
 
+    @Override
+    public void blockPortRangeForBind(int firstPort, int lastPort) {
+        setPortRangeBlocked(firstPort, lastPort, true);
+    }
+
+    @Override
+    public void unblockPortRangeForBind(int firstPort, int lastPort) {
+        setPortRangeBlocked(firstPort, lastPort, false);
+    }
+
+    private void setPortRangeBlocked(int firstPort, int lastPort, boolean blocked) {
+        enforceBlockPortPermission();
+        ensureValidPortNumber(firstPort);
+        ensureValidPortNumber(lastPort);
+        if (lastPort < firstPort) {
+            throw new IllegalArgumentException("Invalid port range " + firstPort + "-" + lastPort);
+        }
+        try {
+            mBpfBlockedPortsMap.setRange(firstPort, lastPort, blocked);
+        } catch (ErrnoException e) {
+            throw new ServiceSpecificException(e.errno, "Could not update bitmap for (ports: "
+                    + firstPort + "-" + lastPort + "): " + e);
+        }
+    }
+
+    @Override
+    public void blockPortsForBind(int[] ports) {
+        setPortsBlocked(ports, true);
+    }
+
+    @Override
+    public void unblockPortsForBind(int[] ports) {
+        setPortsBlocked(ports, false);
+    }
+
+    private void setPortsBlocked(int[] ports, boolean blocked) {
+        enforceBlockPortPermission();
+        for (int port : ports) ensureValidPortNumber(port);
+        try {
+            mBpfBlockedPortsMap.set(ports, blocked);
+        } catch (ErrnoException e) {
+            throw new ServiceSpecificException(e.errno, "Could not update bitmap: " + e);
+        }
+    }
+
     @Override
     public void unblockAllPortsForBind() {
         enforceBlockPortPermission();
@@ -124,16 +165,11 @@ public class ConnectivityNativeService extends ConnectivityNative.Stub {
     @Override
     public int[] getPortsBlockedForBind() {
         enforceBlockPortPermission();
-
-        ArrayList<Integer> portMap = new ArrayList<Integer>();
-        for (int i = 0; i <= 65535; i++) {
-            try {
-                if (mBpfBlockedPortsMap.get(i)) portMap.add(i);
-            } catch (ErrnoException e) {
-                Log.e(TAG, "Failed to get index " + i, e);
-            }
+        try {
+            return mBpfBlockedPortsMap.getAllSet();
+        } catch (ErrnoException e) {
+            throw new ServiceSpecificException(e.errno, "Could not read bitmap: " + e);
         }
-        return CollectionUtils.toIntArray(portMap);
     }
 
     @Override
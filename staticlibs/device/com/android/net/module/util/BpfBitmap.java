@@ -22,6 +22,11 @@ import android.system.ErrnoException;
 import androidx.annotation.NonNull;
 import androidx.annotation.RequiresApi;
 
+import java.util.HashMap;
+import java.util.LinkedHashMap;
+import java.util.Map;
+import java.util.TreeMap;
+
  /**
  *
  * Generic bitmap class for use with BPF programs. Corresponds to a BpfMap
@@ -101,6 +106,93 @@ public class BpfBitmap {
         mBpfMap.updateEntry(key, new Struct.S64(val));
     }
 
+    /**
+     * Change all indices from first to last inclusive to set value.
+     *
+     * Only the 64-bit words overlapping the range are written, all in one batched map update.
+     * Of those, only the (at most two) words partially covered by the range are read first.
+     *
+     * @param first First position to change in bitmap.
+     * @param last Last position to change in bitmap.
+     * @param set Boolean indicating to set or unset the range.
+     */
+    public void setRange(int first, int last, boolean set) throws ErrnoException {
+        if (first < 0 || last < first) throw new IllegalArgumentException("Invalid range.");
+
+        final Map<Struct.S32, Struct.S64> updates = new LinkedHashMap<>();
+        for (int word = first >> 6; word <= last >> 6; word++) {
+            final int lo = Math.max(first, word << 6) & 63;
+            final int hi = Math.min(last, (word << 6) + 63) & 63;
+            final long mask = (-1L >>> (63 - hi)) & (-1L << lo);
+            final Struct.S32 key = new Struct.S32(word);
+            final long oldVal = (mask == -1L) ? 0 : getBpfMapValue(key);
+            updates.put(key, new Struct.S64(set ? (oldVal | mask) : (oldVal & ~mask)));
+        }
+        mBpfMap.updateEntries(updates);
+    }
+
+    /**
+     * Change all the specified indices in the bitmap to set value.
+     *
+     * The bitmap is read once, and the changed 64-bit words are written in one batched map
+     * update.
+     *
+     * @param indices Positions to change in bitmap, in any order.
+     * @param set Boolean indicating to set or unset indices.
+     */
+    public void set(@NonNull int[] indices, boolean set) throws ErrnoException {
+        for (int index : indices) {
+            if (index < 0) throw new IllegalArgumentException("Index out of bounds.");
+        }
+        if (indices.length == 0) return;
+
+        final Map<Integer, Long> words = readNonZeroWords();
+        final Map<Integer, Long> masks = new HashMap<>();
+        for (int index : indices) {
+            masks.merge(index >> 6, 1L << (index & 63), (x, y) -> x | y);
+        }
+        final Map<Struct.S32, Struct.S64> updates = new LinkedHashMap<>();
+        for (Map.Entry<Integer, Long> entry : masks.entrySet()) {
+            final long oldVal = words.getOrDefault(entry.getKey(), 0L);
+            final long mask = entry.getValue();
+            final long val = set ? (oldVal | mask) : (oldVal & ~mask);
+            if (val != oldVal) updates.put(new Struct.S32(entry.getKey()), new Struct.S64(val));
+        }
+        mBpfMap.updateEntries(updates);
+    }
+
+    /**
+     * Returns all set indices in ascending order.
+     *
+     * This reads the bitmap in one batched map dump, and expands each non-zero 64-bit word
+     * one set bit at a time, instead of reading the bitmap once per index.
+     */
+    @NonNull
+    public int[] getAllSet() throws ErrnoException {
+        final Map<Integer, Long> words = readNonZeroWords();
+        int count = 0;
+        for (long val : words.values()) count += Long.bitCount(val);
+
+        final int[] result = new int[count];
+        int n = 0;
+        for (Map.Entry<Integer, Long> entry : words.entrySet()) {
+            final int base = entry.getKey() << 6;
+            for (long val = entry.getValue(); val != 0; val &= val - 1) {
+                result[n++] = base + Long.numberOfTrailingZeros(val);
+            }
+        }
+        return result;
+    }
+
+    /** Returns all non-zero words of the bitmap, in ascending word order. */
+    private Map<Integer, Long> readNonZeroWords() throws ErrnoException {
+        final TreeMap<Integer, Long> words = new TreeMap<>();
+        mBpfMap.forEach((key, value) -> {
+            if (value.val != 0) words.put(key.val, value.val);
+        });
+        return words;
+    }
+
     /**
      * Clears the map. The map may already be empty.
      *
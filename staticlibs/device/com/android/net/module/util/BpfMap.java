@@ -29,9 +29,12 @@ import androidx.annotation.RequiresApi;
 
 import java.nio.ByteBuffer;
 import java.nio.ByteOrder;
+import java.util.Collection;
+import java.util.Map;
 import java.util.NoSuchElementException;
 import java.util.Objects;
 import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.atomic.AtomicReference;
 
 /**
  * BpfMap is a key -> value mapping structure that is designed to maintained the bpf map entries.
@@ -66,6 +69,11 @@ public class BpfMap<K extends Struct, V extends Struct> implements IBpfMap<K, V>
     private final int mKeySize;
     private final int mValueSize;
 
+    // 0 if not yet known, negative if the kernel cannot tell us (< 4.14).
+    private int mMaxEntries;
+    // Reused by dumpEntries(), taken while in use so that concurrent dumps don't share it.
+    private final AtomicReference<ByteBuffer> mDumpBuffer = new AtomicReference<>();
+
     private static ConcurrentHashMap<Pair<String, Integer>, ParcelFileDescriptor> sFdCache =
             new ConcurrentHashMap<>();
 
@@ -200,6 +208,113 @@ public class BpfMap<K extends Struct, V extends Struct> implements IBpfMap<K, V>
         return nativeDeleteMapEntry(mMapFd.getFd(), key.writeToBytes());
     }
 
+    /**
+     * Update existing or create new key -> value entries for all of the given entries,
+     * with a single JNI call (and, on 5.6+ kernels, a single syscall).
+     */
+    @Override
+    public void updateEntries(@NonNull Map<K, V> entries) throws ErrnoException {
+        final int count = entries.size();
+        if (count == 0) return;
+        final ByteBuffer keys = ByteBuffer.allocate(count * mKeySize);
+        final ByteBuffer values = ByteBuffer.allocate(count * mValueSize);
+        keys.order(ByteOrder.nativeOrder());
+        values.order(ByteOrder.nativeOrder());
+        for (Map.Entry<K, V> entry : entries.entrySet()) {
+            entry.getKey().writeToByteBuffer(keys);
+            entry.getValue().writeToByteBuffer(values);
+        }
+        nativeUpdateEntries(mMapFd.getFd(), keys.array(), mKeySize, values.array(), mValueSize,
+                count, BPF_ANY);
+    }
+
+    /**
+     * Remove all of the given keys from the eBpf map, ignoring keys which do not exist,
+     * with a single JNI call (and, on 5.6+ kernels, usually a single syscall).
+     * Return the number of entries deleted.
+     */
+    @Override
+    public int deleteEntries(@NonNull Collection<K> keys) throws ErrnoException {
+        final int count = keys.size();
+        if (count == 0) return 0;
+        final ByteBuffer rawKeys = ByteBuffer.allocate(count * mKeySize);
+        rawKeys.order(ByteOrder.nativeOrder());
+        for (K key : keys) key.writeToByteBuffer(rawKeys);
+        return nativeDeleteEntries(mMapFd.getFd(), rawKeys.array(), mKeySize, count);
+    }
+
+    private int getMaxEntries() {
+        // Racy, but harmless: all threads compute the same value.
+        if (mMaxEntries == 0) mMaxEntries = nativeGetMaxEntries(mMapFd.getFd());
+        return mMaxEntries;
+    }
+
+    private ByteBuffer takeDumpBuffer(int size) {
+        final ByteBuffer buffer = mDumpBuffer.getAndSet(null);
+        if (buffer != null && buffer.capacity() >= size) return buffer;
+        final ByteBuffer newBuffer = ByteBuffer.allocateDirect(size);
+        newBuffer.order(ByteOrder.nativeOrder());
+        return newBuffer;
+    }
+
+    /**
+     * Iterate through a snapshot of the map, taken with a single JNI call (and, on 5.6+
+     * kernels, usually a single syscall), instead of one JNI call and syscall per key and value.
+     * As with the default implementation, the BiConsumer may delete the passed-in entry.
+     */
+    @Override
+    public void forEach(ThrowingBiConsumer<K, V> action) throws ErrnoException {
+        final int capacity = getMaxEntries();
+        if (capacity <= 0) {
+            IBpfMap.super.forEach(action);
+            return;
+        }
+
+        final ByteBuffer buffer = takeDumpBuffer(capacity * (mKeySize + mValueSize));
+        try {
+            final int count = nativeDumpEntries(mMapFd.getFd(), mKeySize, mValueSize, capacity,
+                    buffer);
+            for (int i = 0; i < count; i++) {
+                buffer.position(i * mKeySize);
+                final K key = Struct.parse(mKeyClass, buffer);
+                buffer.position(capacity * mKeySize + i * mValueSize);
+                final V value = Struct.parse(mValueClass, buffer);
+                action.accept(key, value);
+            }
+        } finally {
+            buffer.clear();
+            mDumpBuffer.set(buffer);
+        }
+    }
+
+    /**
+     * Clears the map, with one JNI call to list the keys and one to delete them,
+     * (repeated if entries get added in the meantime).
+     */
+    @Override
+    public void clear() throws ErrnoException {
+        final int capacity = getMaxEntries();
+        if (capacity <= 0) {
+            IBpfMap.super.clear();
+            return;
+        }
+
+        final ByteBuffer buffer = takeDumpBuffer(capacity * (mKeySize + mValueSize));
+        try {
+            int count;
+            while ((count = nativeDumpEntries(mMapFd.getFd(), mKeySize, mValueSize, capacity,
+                    buffer)) > 0) {
+                final byte[] keys = new byte[count * mKeySize];
+                buffer.position(0);
+                buffer.get(keys);
+                nativeDeleteEntries(mMapFd.getFd(), keys, mKeySize, count);
+            }
+        } finally {
+            buffer.clear();
+            mDumpBuffer.set(buffer);
+        }
+    }
+
     private K getNextKeyInternal(@Nullable K key) throws ErrnoException {
         byte[] rawKey = new byte[mKeySize];
 
@@ -280,4 +395,20 @@ public class BpfMap<K extends Struct, V extends Struct> implements IBpfMap<K, V>
             throws ErrnoException;
 
     private static native void nativeSynchronizeKernelRCU() throws ErrnoException;
+
+    // Returns the map's max_entries, or -1 if this kernel cannot tell us.
+    private native int nativeGetMaxEntries(int fd);
+
+    // Copies up to 'capacity' entries into 'buffer' (which must be a direct buffer), keys back to
+    // back from offset 0 and values back to back from offset 'capacity * keySize'.  Returns the
+    // number of entries copied.
+    private native int nativeDumpEntries(int fd, int keySize, int valueSize, int capacity,
+            ByteBuffer buffer) throws ErrnoException;
+
+    // Deletes 'count' back to back keys, ignoring missing ones. Returns the number deleted.
+    private native int nativeDeleteEntries(int fd, byte[] keys, int keySize, int count)
+            throws ErrnoException;
+
+    private native void nativeUpdateEntries(int fd, byte[] keys, int keySize, byte[] values,
+            int valueSize, int count, int flags) throws ErrnoException;
 }
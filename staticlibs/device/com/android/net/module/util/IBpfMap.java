@@ -21,6 +21,8 @@ import androidx.annotation.NonNull;
 import androidx.annotation.Nullable;
 
 import java.io.IOException;
+import java.util.Collection;
+import java.util.Map;
 import java.util.NoSuchElementException;
 
 /**
@@ -50,6 +52,28 @@ public interface IBpfMap<K extends Struct, V extends Struct> extends AutoCloseab
     /** Remove existing key from eBpf map. Return true if something was deleted. */
     boolean deleteEntry(K key) throws ErrnoException;
 
+    /**
+     * Update existing or create new key -> value entries for all of the given entries.
+     * Stops at the first failure, in which case some of the entries may have been written.
+     */
+    default void updateEntries(@NonNull Map<K, V> entries) throws ErrnoException {
+        for (Map.Entry<K, V> entry : entries.entrySet()) {
+            updateEntry(entry.getKey(), entry.getValue());
+        }
+    }
+
+    /**
+     * Remove all of the given keys from the eBpf map, ignoring keys which do not exist.
+     * Return the number of entries deleted.
+     */
+    default int deleteEntries(@NonNull Collection<K> keys) throws ErrnoException {
+        int deleted = 0;
+        for (K key : keys) {
+            if (deleteEntry(key)) deleted++;
+        }
+        return deleted;
+    }
+
     /** Get the key after the passed-in key. */
     K getNextKey(@NonNull K key) throws ErrnoException;
 
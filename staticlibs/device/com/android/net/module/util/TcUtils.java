@@ -101,4 +101,107 @@ public class TcUtils {
      * @throws IOException
      */
     public static native void tcQdiscAddDevClsact(int ifIndex) throws IOException;
+
+    /**
+     * A netlink socket through which several tc operations can be sent at once.
+     *
+     * The operations are only queued up, until {@link #commit} sends all of them to the kernel
+     * in a single message and waits for all of their results. This is much cheaper than the
+     * equivalent static methods above, which each open their own socket.
+     *
+     * Instances are not thread-safe, and must be closed when no longer needed. Calling any
+     * method other than {@link #close} on a closed session throws IllegalStateException.
+     */
+    public static class Session implements AutoCloseable {
+        private long mPtr;
+
+        /**
+         * Opens the netlink socket.
+         *
+         * @throws IOException
+         */
+        public Session() throws IOException {
+            mPtr = sessionOpen();
+        }
+
+        /**
+         * Queue up the equivalent of {@link TcUtils#tcQdiscAddDevClsact}.
+         *
+         * @throws IOException if the request could not be built.
+         */
+        public void tcQdiscAddDevClsact(int ifIndex) throws IOException {
+            ensureOpen();
+            sessionQdiscAddDevClsact(mPtr, ifIndex);
+        }
+
+        /**
+         * Queue up the equivalent of {@link TcUtils#tcFilterAddDevBpf}.
+         *
+         * @throws IOException if the request could not be built, eg. the program does not exist.
+         */
+        public void tcFilterAddDevBpf(int ifIndex, boolean ingress, short prio, short proto,
+                String bpfProgPath) throws IOException {
+            ensureOpen();
+            sessionFilterAddDevBpf(mPtr, ifIndex, ingress, prio, proto, bpfProgPath);
+        }
+
+        /**
+         * Queue up the equivalent of {@link TcUtils#tcFilterAddDevIngressPolice}.
+         *
+         * @throws IOException if the request could not be built, eg. the program does not exist.
+         */
+        public void tcFilterAddDevIngressPolice(int ifIndex, short prio, short proto,
+                int rateInBytesPerSec, String bpfProgPath) throws IOException {
+            ensureOpen();
+            sessionFilterAddDevIngressPolice(mPtr, ifIndex, prio, proto, rateInBytesPerSec,
+                    bpfProgPath);
+        }
+
+        /**
+         * Queue up the equivalent of {@link TcUtils#tcFilterDelDev}.
+         *
+         * @throws IOException if the request could not be built.
+         */
+        public void tcFilterDelDev(int ifIndex, boolean ingress, short prio, short proto)
+                throws IOException {
+            ensureOpen();
+            sessionFilterDelDev(mPtr, ifIndex, ingress, prio, proto);
+        }
+
+        /**
+         * Sends all queued operations, and waits for their results.
+         *
+         * The kernel carries on with the next operation after one fails.
+         *
+         * @return one errno per queued operation, in order, with 0 meaning success.
+         */
+        public int[] commit() {
+            ensureOpen();
+            return sessionCommit(mPtr);
+        }
+
+        private void ensureOpen() {
+            // The JNI would dereference the null session.
+            if (mPtr == 0) throw new IllegalStateException("Session is closed");
+        }
+
+        @Override
+        public void close() {
+            if (mPtr != 0) {
+                sessionClose(mPtr);
+                mPtr = 0;
+            }
+        }
+    }
+
+    private static native long sessionOpen() throws IOException;
+    private static native void sessionClose(long ptr);
+    private static native void sessionQdiscAddDevClsact(long ptr, int ifIndex) throws IOException;
+    private static native void sessionFilterAddDevBpf(long ptr, int ifIndex, boolean ingress,
+            short prio, short proto, String bpfProgPath) throws IOException;
+    private static native void sessionFilterAddDevIngressPolice(long ptr, int ifIndex, short prio,
+            short proto, int rateInBytesPerSec, String bpfProgPath) throws IOException;
+    private static native void sessionFilterDelDev(long ptr, int ifIndex, boolean ingress,
+            short prio, short proto) throws IOException;
+    private static native int[] sessionCommit(long ptr);
 }
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/result-gmock.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "BpfSyscallWrappers.h"
+#include "bpf/BpfMmapArray.h"
+#include "bpf/KernelUtils.h"
+
+namespace android {
+namespace bpf {
+using ::android::base::testing::HasError;
+using ::android::base::testing::HasValue;
+using ::android::base::testing::WithCode;
+using base::unique_fd;
+
+constexpr uint32_t TEST_ARRAY_SIZE = 5;
+
+class BpfMmapArrayTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    if (!isAtLeastKernelVersion(4, 14, 0)) {
+      GTEST_SKIP() << "BPF_OBJ_GET_INFO_BY_FD not supported below 4.14";
+    }
+  }
+
+  // Writes and reads every entry of the array through both the wrapper and
+  // bpf() syscalls, to check that they see the same values.
+  template <typename Value>
+  void checkReadWrite(BpfMmapArray<Value>& array) {
+    for (uint32_t key = 0; key < TEST_ARRAY_SIZE; key++) {
+      const Value value = static_cast<Value>(0x0102030405060708ULL * (key + 1));
+      ASSERT_RESULT_OK(array.writeValue(key, value));
+      Value syscallValue;
+      ASSERT_EQ(0, findMapEntry(array.getMap(), &key, &syscallValue));
+      EXPECT_EQ(value, syscallValue);
+
+      const Value newValue = static_cast<Value>(~value);
+      ASSERT_EQ(0, writeToMapEntry(array.getMap(), &key, &newValue, BPF_ANY));
+      EXPECT_THAT(array.readValue(key), HasValue(newValue));
+    }
+    EXPECT_THAT(array.readValue(TEST_ARRAY_SIZE), HasError(WithCode(array.isMmapped() ? E2BIG
+                                                                                      : ENOENT)));
+  }
+};
+
+TEST_F(BpfMmapArrayTest, Mmapped) {
+  if (!isAtLeastKernelVersion(5, 5, 0)) {
+    GTEST_SKIP() << "BPF_F_MMAPABLE not supported below 5.5";
+  }
+
+  unique_fd fd(createMap(BPF_MAP_TYPE_ARRAY, sizeof(uint32_t), sizeof(uint16_t), TEST_ARRAY_SIZE,
+                         BPF_F_MMAPABLE));
+  ASSERT_TRUE(fd.ok()) << strerror(errno);
+  auto result = BpfMmapArray<uint16_t>::CreateFromFd(std::move(fd), /* writable */ true);
+  ASSERT_RESULT_OK(result);
+  EXPECT_TRUE(result.value()->isMmapped());
+  checkReadWrite(*result.value());
+}
+
+TEST_F(BpfMmapArrayTest, SyscallFallback) {
+  unique_fd fd(createMap(BPF_MAP_TYPE_ARRAY, sizeof(uint32_t), sizeof(uint64_t), TEST_ARRAY_SIZE,
+                         0));
+  ASSERT_TRUE(fd.ok()) << strerror(errno);
+  auto result = BpfMmapArray<uint64_t>::CreateFromFd(std::move(fd), /* writable */ true);
+  ASSERT_RESULT_OK(result);
+  EXPECT_FALSE(result.value()->isMmapped());
+  checkReadWrite(*result.value());
+}
+
+TEST_F(BpfMmapArrayTest, ReadOnly) {
+  unique_fd fd(createMap(BPF_MAP_TYPE_ARRAY, sizeof(uint32_t), sizeof(uint32_t), TEST_ARRAY_SIZE,
+                         isAtLeastKernelVersion(5, 5, 0) ? BPF_F_MMAPABLE : 0));
+  ASSERT_TRUE(fd.ok()) << strerror(errno);
+  const uint32_t key = 1, value = 42;
+  ASSERT_EQ(0, writeToMapEntry(fd, &key, &value, BPF_ANY));
+
+  auto result = BpfMmapArray<uint32_t>::CreateFromFd(std::move(fd), /* writable */ false);
+  ASSERT_RESULT_OK(result);
+  EXPECT_THAT(result.value()->readValue(key), HasValue(value));
+  EXPECT_THAT(result.value()->writeValue(key, 0), HasError(WithCode(EPERM)));
+}
+
+TEST_F(BpfMmapArrayTest, WrongMap) {
+  unique_fd hash(createMap(BPF_MAP_TYPE_HASH, sizeof(uint32_t), sizeof(uint32_t), TEST_ARRAY_SIZE,
+                           0));
+  ASSERT_TRUE(hash.ok()) << strerror(errno);
+  EXPECT_THAT(BpfMmapArray<uint32_t>::CreateFromFd(std::move(hash), false),
+              HasError(WithCode(EINVAL)));
+
+  unique_fd array(createMap(BPF_MAP_TYPE_ARRAY, sizeof(uint32_t), sizeof(uint64_t),
+                            TEST_ARRAY_SIZE, 0));
+  ASSERT_TRUE(array.ok()) << strerror(errno);
+  EXPECT_THAT(BpfMmapArray<uint32_t>::CreateFromFd(std::move(array), false),
+              HasError(WithCode(EINVAL)));
+}
+
+TEST_F(BpfMmapArrayTest, InvalidPath) {
+  EXPECT_THAT(BpfMmapArray<uint32_t>::Create("/sys/fs/bpf/bad_path"), HasError(WithCode(ENOENT)));
+}
+
+}  // namespace bpf
+}  // namespace android
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/result.h>
+#include <android-base/unique_fd.h>
+#include <linux/bpf.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "BpfSyscallWrappers.h"
+#include "bpf/KernelUtils.h"
+
+#include <memory>
+#include <type_traits>
+
+namespace android {
+namespace bpf {
+
+// This is a class wrapper for eBPF ARRAY maps, which reads and writes the
+// values through a userspace mapping of the map when it was created with
+// BPF_F_MMAPABLE (5.5+ kernels). A lookup is then a memory load instead of a
+// bpf() syscall, which matters for small, read-mostly maps like configuration
+// maps that are read on every socket or DNS operation.
+//
+// Maps created without BPF_F_MMAPABLE (and all maps on older kernels) cannot be
+// mapped, and are accessed with bpf() syscalls instead, with the same API.
+//
+// Each value is read and written with a single atomic access, so Value must be
+// trivially copyable and 1, 2, 4 or 8 bytes. Memory ordering is relaxed: eBPF
+// programs do not use barriers either, and a reader only ever sees a value that
+// was written as a whole, never which write came first. Note that the syscall
+// fallback gives no such guarantee for values written from eBPF, which can be
+// torn if they are not naturally aligned, but values of these sizes always are.
+//
+// This class is thread safe once created: the mapping is never changed.
+template <typename Value>
+class BpfMmapArray {
+ public:
+  static_assert(std::is_trivially_copyable_v<Value>);
+  static_assert(sizeof(Value) == 1 || sizeof(Value) == 2 || sizeof(Value) == 4 ||
+                sizeof(Value) == 8, "BpfMmapArray values must be atomically accessible");
+
+  ~BpfMmapArray() {
+    if (mValues) munmap(mValues, mMapSize);
+    mValues = nullptr;
+  }
+
+  // Delete copy constructor (class owns a raw mapping).
+  BpfMmapArray(const BpfMmapArray&) = delete;
+
+  // Creates a wrapper from a pinned path. The map must be an ARRAY map with
+  // uint32_t keys and Value values. If writable is false, the map is opened
+  // read-only and writeValue always fails.
+  static base::Result<std::unique_ptr<BpfMmapArray<Value>>> Create(const char* path,
+                                                                    bool writable = false);
+
+  // Creates a wrapper from a map fd, e.g. one returned by createMap().
+  static base::Result<std::unique_ptr<BpfMmapArray<Value>>> CreateFromFd(base::unique_fd fd,
+                                                                          bool writable);
+
+  // Reads the value at key, which must be less than the number of entries.
+  base::Result<Value> readValue(uint32_t key) const {
+    if (mValues) {
+      if (key >= mMaxEntries) {
+        errno = E2BIG;
+        return ErrnoErrorf("BpfMmapArray key {} out of range", key);
+      }
+      Value value;
+      __atomic_load(valuePtr(key), &value, __ATOMIC_RELAXED);
+      return value;
+    }
+    Value value;
+    if (findMapEntry(mMapFd, &key, &value)) {
+      return ErrnoErrorf("BpfMmapArray::readValue() failed");
+    }
+    return value;
+  }
+
+  // Writes the value at key, which must be less than the number of entries.
+  base::Result<void> writeValue(uint32_t key, const Value& value) {
+    if (!mWritable) {
+      errno = EPERM;
+      return ErrnoErrorf("BpfMmapArray::writeValue() on read-only map");
+    }
+    if (mValues) {
+      if (key >= mMaxEntries) {
+        errno = E2BIG;
+        return ErrnoErrorf("BpfMmapArray key {} out of range", key);
+      }
+      Value copy = value;
+      __atomic_store(valuePtr(key), &copy, __ATOMIC_RELAXED);
+      return {};
+    }
+    if (writeToMapEntry(mMapFd, &key, &value, BPF_ANY)) {
+      return ErrnoErrorf("BpfMmapArray::writeValue() failed");
+    }
+    return {};
+  }
+
+  // Whether values are accessed through the mapping rather than bpf() syscalls.
+  bool isMmapped() const { return mValues != nullptr; }
+
+  const base::unique_fd& getMap() const { return mMapFd; }
+
+ private:
+  BpfMmapArray(base::unique_fd fd, bool writable) : mMapFd(std::move(fd)), mWritable(writable) {}
+
+  base::Result<void> Init();
+
+  // ARRAY map values are 8-byte aligned, see bpf_array's elem_size.
+  static constexpr size_t kElemSize = (sizeof(Value) + 7) & ~size_t{7};
+
+  Value* valuePtr(uint32_t key) const {
+    return reinterpret_cast<Value*>(static_cast<char*>(mValues) + key * kElemSize);
+  }
+
+  base::unique_fd mMapFd;
+  const bool mWritable;
+  uint32_t mMaxEntries = 0;
+  size_t mMapSize = 0;
+  void* mValues = nullptr;
+};
+
+template <typename Value>
+inline base::Result<void> BpfMmapArray<Value>::Init() {
+  if (!mMapFd.ok()) return base::ErrnoError() << "invalid map fd";
+
+  // Without BPF_OBJ_GET_INFO_BY_FD the map can be neither checked nor mmapable.
+  if (!isAtLeastKernelVersion(4, 14, 0)) return {};
+
+  const int type = bpfGetFdMapType(mMapFd);
+  if (type != BPF_MAP_TYPE_ARRAY) {
+    errno = EINVAL;
+    return base::ErrnoError() << "bpf map has wrong type: want BPF_MAP_TYPE_ARRAY ("
+                              << BPF_MAP_TYPE_ARRAY << ") got " << type;
+  }
+  if (bpfGetFdKeySize(mMapFd) != sizeof(uint32_t) ||
+      bpfGetFdValueSize(mMapFd) != (int)sizeof(Value)) {
+    errno = EINVAL;
+    return base::ErrnoError() << "bpf map has wrong key or value size";
+  }
+  const int maxEntries = bpfGetFdMaxEntries(mMapFd);
+  if (maxEntries <= 0) {
+    return base::ErrnoError() << "failed to read max_entries from array";
+  }
+  const int flags = bpfGetFdMapFlags(mMapFd);
+  if (flags < 0) return base::ErrnoError() << "failed to read map_flags from array";
+  if (!(flags & BPF_F_MMAPABLE)) return {};
+
+  const size_t pageSize = getpagesize();
+  const size_t mapSize = ((size_t)maxEntries * kElemSize + pageSize - 1) & ~(pageSize - 1);
+  const int prot = mWritable ? PROT_READ | PROT_WRITE : PROT_READ;
+  void* ptr = mmap(nullptr, mapSize, prot, MAP_SHARED, mMapFd, 0);
+  if (ptr == MAP_FAILED) {
+    return base::ErrnoError() << "failed to mmap BPF_F_MMAPABLE array";
+  }
+  mValues = ptr;
+  mMapSize = mapSize;
+  mMaxEntries = maxEntries;
+  return {};
+}
+
+template <typename Value>
+inline base::Result<std::unique_ptr<BpfMmapArray<Value>>> BpfMmapArray<Value>::Create(
+    const char* path, bool writable) {
+  base::unique_fd fd(writable ? mapRetrieveRW(path) : mapRetrieveRO(path));
+  if (!fd.ok()) {
+    return base::ErrnoError() << "failed to retrieve array at " << path;
+  }
+  return CreateFromFd(std::move(fd), writable);
+}
+
+template <typename Value>
+inline base::Result<std::unique_ptr<BpfMmapArray<Value>>> BpfMmapArray<Value>::CreateFromFd(
+    base::unique_fd fd, bool writable) {
+  auto array = std::unique_ptr<BpfMmapArray>(new BpfMmapArray(std::move(fd), writable));
+  if (auto status = array->Init(); !status.ok()) return status.error();
+  return array;
+}
+
+}  // namespace bpf
+}  // namespace android
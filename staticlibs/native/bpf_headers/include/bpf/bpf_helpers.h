@@ -112,6 +112,7 @@ struct kver_uint { unsigned int kver; };
 #define KVER_4_14 KVER(4, 14, 0)
 #define KVER_4_19 KVER(4, 19, 0)
 #define KVER_5_4 KVER(5, 4, 0)
+#define KVER_5_5 KVER(5, 5, 0)
 #define KVER_5_8 KVER(5, 8, 0)
 #define KVER_5_9 KVER(5, 9, 0)
 #define KVER_5_15 KVER(5, 15, 0)
@@ -206,16 +207,20 @@ static void (*bpf_ringbuf_submit_unsafe)(const void* data, __u64 flags) = (void*
               (ignore_userdebug).ignore_on_userdebug),                                   \
         "bpfloader min version must be >= 0.33 in order to use ignored_on");
 
-#define DEFINE_BPF_MAP_BASE(the_map, TYPE, keysize, valuesize, num_entries, \
-                            usr, grp, md, selinux, pindir, share, minkver,  \
-                            maxkver, minloader, maxloader, ignore_eng,      \
-                            ignore_user, ignore_userdebug)                  \
+// Like DEFINE_BPF_MAP_BASE, with map creation flags, e.g. BPF_F_MMAPABLE.
+// The kernel refuses flags it does not know, so set minkver accordingly.
+#define DEFINE_BPF_MAP_BASE_FLAGS(the_map, TYPE, keysize, valuesize,      \
+                                  num_entries, flags, usr, grp, md,       \
+                                  selinux, pindir, share, minkver,        \
+                                  maxkver, minloader, maxloader,          \
+                                  ignore_eng, ignore_user,                \
+                                  ignore_userdebug)                       \
     const struct bpf_map_def SECTION("maps") the_map = {                    \
         .type = BPF_MAP_TYPE_##TYPE,                                        \
         .key_size = (keysize),                                              \
         .value_size = (valuesize),                                          \
         .max_entries = (num_entries),                                       \
-        .map_flags = 0,                                                     \
+        .map_flags = (flags),                                               \
         .uid = (usr),                                                       \
         .gid = (grp),                                                       \
         .mode = (md),                                                       \
@@ -232,6 +237,16 @@ static void (*bpf_ringbuf_submit_unsafe)(const void* data, __u64 flags) = (void*
     };                                                                      \
     BPF_ASSERT_LOADER_VERSION(minloader, ignore_eng, ignore_user, ignore_userdebug);
 
+#define DEFINE_BPF_MAP_BASE(the_map, TYPE, keysize, valuesize, num_entries, \
+                            usr, grp, md, selinux, pindir, share, minkver,  \
+                            maxkver, minloader, maxloader, ignore_eng,      \
+                            ignore_user, ignore_userdebug)                  \
+    DEFINE_BPF_MAP_BASE_FLAGS(the_map, TYPE, keysize, valuesize,            \
+                              num_entries, 0, usr, grp, md, selinux,        \
+                              pindir, share, minkver, maxkver, minloader,   \
+                              maxloader, ignore_eng, ignore_user,           \
+                              ignore_userdebug)
+
 // Type safe macro to declare a ring buffer and related output functions.
 // Compatibility:
 // * BPF ring buffers are only available kernels 5.8 and above. Any program
@@ -18,6 +18,10 @@
 #include <linux/pfkeyv2.h>
 #include <sys/socket.h>
 #include <jni.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
 #include <nativehelper/JNIHelp.h>
 #include <nativehelper/ScopedLocalRef.h>
 
@@ -119,6 +123,170 @@ static jboolean com_android_net_module_util_BpfMap_nativeFindMapEntry(JNIEnv *en
     return throwIfNotEnoent(env, "nativeFindMapEntry", ret, errno);
 }
 
+// Kernel internal, returned for map types which do not implement the batch operations.
+#ifndef ENOTSUPP
+#define ENOTSUPP 524
+#endif
+
+// Whether a failed BPF_MAP_*_BATCH command means the kernel (pre-5.6: EINVAL, as the command
+// is unknown) or the map type (ENOTSUPP) does not support it, and thus we should fall back to
+// doing one syscall per entry instead.
+static bool batchUnsupported(int err) {
+    return err == EINVAL || err == ENOTSUPP || err == EOPNOTSUPP;
+}
+
+static int mapBatch(bpf_cmd cmd, int fd, void* inBatch, void* outBatch, void* keys, void* values,
+                    uint32_t* count, uint64_t elemFlags) {
+    bpf_attr attr = {};
+    attr.batch.in_batch = bpf::ptr_to_u64(inBatch);
+    attr.batch.out_batch = bpf::ptr_to_u64(outBatch);
+    attr.batch.keys = bpf::ptr_to_u64(keys);
+    attr.batch.values = bpf::ptr_to_u64(values);
+    attr.batch.count = *count;
+    attr.batch.elem_flags = elemFlags;
+    attr.batch.map_fd = static_cast<uint32_t>(fd);
+    int ret = bpf::bpf(cmd, &attr);
+    // The kernel always reports how many elements it processed, even on failure.
+    *count = attr.batch.count;
+    return ret;
+}
+
+static jint com_android_net_module_util_BpfMap_nativeGetMaxEntries(JNIEnv *env, jclass clazz,
+        jint fd) {
+    // Fails with EINVAL on <4.14
+    return bpf::bpfGetFdMaxEntries(static_cast<int>(fd));
+}
+
+// Copies out all of the map's entries: keys are written back to back at the start of the
+// buffer, values are written back to back starting at offset 'capacity * keySize'.
+// Returns the number of entries copied, which is at most 'capacity'.
+static jint com_android_net_module_util_BpfMap_nativeDumpEntries(JNIEnv *env, jobject self,
+        jint fd, jint keySize, jint valueSize, jint capacity, jobject buffer) {
+    char* const buf = static_cast<char*>(env->GetDirectBufferAddress(buffer));
+    if (!buf || env->GetDirectBufferCapacity(buffer) < (jlong)capacity * (keySize + valueSize)) {
+        jniThrowErrnoException(env, "nativeDumpEntries", EINVAL);
+        return 0;
+    }
+    char* const keys = buf;
+    char* const values = buf + (size_t)capacity * keySize;
+
+    // The batch position cookie is a bucket index for hash maps, but a key for array maps.
+    std::vector<char> batch(std::max(keySize, 8));
+    uint32_t done = 0;
+    bool first = true;
+    while (done < (uint32_t)capacity) {
+        uint32_t count = capacity - done;
+        int ret = mapBatch(BPF_MAP_LOOKUP_BATCH, fd, first ? nullptr : batch.data(),
+                           batch.data(), keys + (size_t)done * keySize,
+                           values + (size_t)done * valueSize, &count, 0);
+        const int err = errno;
+        first = false;
+        done += count;
+        // ENOENT means we are at the end of the map.
+        if (!ret) continue;
+        if (err == ENOENT) return done;
+        if (done == 0 && batchUnsupported(err)) break;
+        jniThrowErrnoException(env, "nativeDumpEntries", err);
+        return 0;
+    }
+    if (done) return done;
+
+    // Fallback: walk the keys, and look each of them up.
+    std::vector<char> key(keySize);
+    for (int ret = bpf::getNextMapKey(fd, nullptr, key.data()); !ret && done < (uint32_t)capacity;
+         ret = bpf::getNextMapKey(fd, key.data(), key.data())) {
+        memcpy(keys + (size_t)done * keySize, key.data(), keySize);
+        // Skip entries deleted since we got their key.
+        if (!bpf::findMapEntry(fd, key.data(), values + (size_t)done * valueSize)) {
+            done++;
+        } else if (errno != ENOENT) {
+            jniThrowErrnoException(env, "nativeDumpEntries", errno);
+            return 0;
+        }
+    }
+    if (errno != ENOENT && done < (uint32_t)capacity) {
+        jniThrowErrnoException(env, "nativeDumpEntries", errno);
+        return 0;
+    }
+    return done;
+}
+
+// Deletes 'count' keys, given back to back. Keys which do not exist are skipped.
+// Returns the number of entries deleted.
+static jint com_android_net_module_util_BpfMap_nativeDeleteEntries(JNIEnv *env, jobject self,
+        jint fd, jbyteArray keys, jint keySize, jint count) {
+    ScopedByteArrayRO keysRO(env, keys);
+    if ((jlong)keysRO.size() < (jlong)keySize * count) {
+        jniThrowErrnoException(env, "nativeDeleteEntries", EINVAL);
+        return 0;
+    }
+    char* const k = const_cast<char*>(reinterpret_cast<const char*>(keysRO.get()));
+
+    uint32_t done = 0;
+    jint deleted = 0;
+    while (done < (uint32_t)count) {
+        uint32_t n = count - done;
+        int ret = mapBatch(BPF_MAP_DELETE_BATCH, fd, nullptr, nullptr, k + (size_t)done * keySize,
+                           nullptr, &n, 0);
+        const int err = errno;
+        done += n;
+        deleted += n;
+        if (!ret) break;
+        if (err == ENOENT) {
+            // The kernel stops at the first missing key, skip it and carry on with the rest.
+            done++;
+            continue;
+        }
+        if (batchUnsupported(err) && !n) break;
+        jniThrowErrnoException(env, "nativeDeleteEntries", err);
+        return deleted;
+    }
+
+    // Fallback for whatever the kernel did not handle.
+    for (; done < (uint32_t)count; done++) {
+        if (!bpf::deleteMapEntry(fd, k + (size_t)done * keySize)) {
+            deleted++;
+        } else if (errno != ENOENT) {
+            jniThrowErrnoException(env, "nativeDeleteEntries", errno);
+            return deleted;
+        }
+    }
+    return deleted;
+}
+
+// Writes 'count' entries, keys and values each given back to back, with the given BPF_* flags.
+static void com_android_net_module_util_BpfMap_nativeUpdateEntries(JNIEnv *env, jobject self,
+        jint fd, jbyteArray keys, jint keySize, jbyteArray values, jint valueSize, jint count,
+        jint flags) {
+    ScopedByteArrayRO keysRO(env, keys);
+    ScopedByteArrayRO valuesRO(env, values);
+    if ((jlong)keysRO.size() < (jlong)keySize * count ||
+        (jlong)valuesRO.size() < (jlong)valueSize * count) {
+        jniThrowErrnoException(env, "nativeUpdateEntries", EINVAL);
+        return;
+    }
+    char* const k = const_cast<char*>(reinterpret_cast<const char*>(keysRO.get()));
+    char* const v = const_cast<char*>(reinterpret_cast<const char*>(valuesRO.get()));
+
+    // Note: the batch command only accepts BPF_F_LOCK as elem_flags, so with BPF_NOEXIST or
+    // BPF_EXIST it fails with EINVAL (having done nothing) and we take the fallback path.
+    uint32_t done = count;
+    int ret = mapBatch(BPF_MAP_UPDATE_BATCH, fd, nullptr, nullptr, k, v, &done, flags);
+    if (!ret) return;
+    if (!batchUnsupported(errno) || done) {
+        jniThrowErrnoException(env, "nativeUpdateEntries", errno);
+        return;
+    }
+
+    for (done = 0; done < (uint32_t)count; done++) {
+        if (bpf::writeToMapEntry(fd, k + (size_t)done * keySize, v + (size_t)done * valueSize,
+                                 flags)) {
+            jniThrowErrnoException(env, "nativeUpdateEntries", errno);
+            return;
+        }
+    }
+}
+
 static void com_android_net_module_util_BpfMap_nativeSynchronizeKernelRCU(JNIEnv *env,
                                                                           jclass clazz) {
     const int pfSocket = socket(AF_KEY, SOCK_RAW | SOCK_CLOEXEC, PF_KEY_V2);
@@ -152,6 +320,14 @@ static const JNINativeMethod gMethods[] = {
         (void*) com_android_net_module_util_BpfMap_nativeFindMapEntry },
     { "nativeSynchronizeKernelRCU", "()V",
         (void*) com_android_net_module_util_BpfMap_nativeSynchronizeKernelRCU },
+    { "nativeGetMaxEntries", "(I)I",
+        (void*) com_android_net_module_util_BpfMap_nativeGetMaxEntries },
+    { "nativeDumpEntries", "(IIIILjava/nio/ByteBuffer;)I",
+        (void*) com_android_net_module_util_BpfMap_nativeDumpEntries },
+    { "nativeDeleteEntries", "(I[BII)I",
+        (void*) com_android_net_module_util_BpfMap_nativeDeleteEntries },
+    { "nativeUpdateEntries", "(I[BI[BIII)V",
+        (void*) com_android_net_module_util_BpfMap_nativeUpdateEntries },
 
 };
 
@@ -19,6 +19,8 @@
 #include <nativehelper/scoped_utf_chars.h>
 #include <tcutils/tcutils.h>
 
+#include <vector>
+
 namespace android {
 
 static void throwIOException(JNIEnv *env, const char *msg, int error) {
@@ -96,6 +98,98 @@ static void com_android_net_module_util_TcUtils_tcQdiscAddDevClsact(JNIEnv *env,
   }
 }
 
+static jlong com_android_net_module_util_TcUtils_sessionOpen(JNIEnv *env,
+                                                             jclass clazz) {
+  TcSession *session = new TcSession();
+  int error = session->open();
+  if (error) {
+    delete session;
+    throwIOException(
+        env, "com_android_net_module_util_TcUtils_sessionOpen error: ", -error);
+    return 0;
+  }
+  return reinterpret_cast<jlong>(session);
+}
+
+static void com_android_net_module_util_TcUtils_sessionClose(JNIEnv *env,
+                                                             jclass clazz,
+                                                             jlong ptr) {
+  delete reinterpret_cast<TcSession *>(ptr);
+}
+
+static void com_android_net_module_util_TcUtils_sessionQdiscAddDevClsact(
+    JNIEnv *env, jclass clazz, jlong ptr, jint ifIndex) {
+  TcSession *session = reinterpret_cast<TcSession *>(ptr);
+  int error = session->queueQdiscClsact(ifIndex, RTM_NEWQDISC,
+                                        NLM_F_EXCL | NLM_F_CREATE);
+  if (error) {
+    throwIOException(env,
+                     "com_android_net_module_util_TcUtils_"
+                     "sessionQdiscAddDevClsact error: ",
+                     -error);
+  }
+}
+
+static void com_android_net_module_util_TcUtils_sessionFilterAddDevBpf(
+    JNIEnv *env, jclass clazz, jlong ptr, jint ifIndex, jboolean ingress,
+    jshort prio, jshort proto, jstring bpfProgPath) {
+  TcSession *session = reinterpret_cast<TcSession *>(ptr);
+  ScopedUtfChars pathname(env, bpfProgPath);
+  int error = session->queueAddBpfFilter(ifIndex, ingress, prio, proto,
+                                         pathname.c_str());
+  if (error) {
+    throwIOException(env,
+                     "com_android_net_module_util_TcUtils_"
+                     "sessionFilterAddDevBpf error: ",
+                     -error);
+  }
+}
+
+static void com_android_net_module_util_TcUtils_sessionFilterAddDevIngressPolice(
+    JNIEnv *env, jclass clazz, jlong ptr, jint ifIndex, jshort prio,
+    jshort proto, jint rateInBytesPerSec, jstring bpfProgPath) {
+  TcSession *session = reinterpret_cast<TcSession *>(ptr);
+  ScopedUtfChars pathname(env, bpfProgPath);
+  int error = session->queueAddIngressPoliceFilter(
+      ifIndex, prio, proto, rateInBytesPerSec, pathname.c_str());
+  if (error) {
+    throwIOException(env,
+                     "com_android_net_module_util_TcUtils_"
+                     "sessionFilterAddDevIngressPolice error: ",
+                     -error);
+  }
+}
+
+static void com_android_net_module_util_TcUtils_sessionFilterDelDev(
+    JNIEnv *env, jclass clazz, jlong ptr, jint ifIndex, jboolean ingress,
+    jshort prio, jshort proto) {
+  TcSession *session = reinterpret_cast<TcSession *>(ptr);
+  int error = session->queueDeleteFilter(ifIndex, ingress, prio, proto);
+  if (error) {
+    throwIOException(env,
+                     "com_android_net_module_util_TcUtils_"
+                     "sessionFilterDelDev error: ",
+                     -error);
+  }
+}
+
+// Returns one errno (0 on success) per queued request.
+static jintArray com_android_net_module_util_TcUtils_sessionCommit(JNIEnv *env,
+                                                                  jclass clazz,
+                                                                  jlong ptr) {
+  TcSession *session = reinterpret_cast<TcSession *>(ptr);
+  std::vector<int> results;
+  session->commit(&results);
+  for (int &result : results) {
+    result = -result;
+  }
+  jintArray array = env->NewIntArray(results.size());
+  if (array) {
+    env->SetIntArrayRegion(array, 0, results.size(), results.data());
+  }
+  return array;
+}
+
 /*
  * JNI registration.
  */
@@ -111,6 +205,21 @@ static const JNINativeMethod gMethods[] = {
      (void *)com_android_net_module_util_TcUtils_tcFilterDelDev},
     {"tcQdiscAddDevClsact", "(I)V",
      (void *)com_android_net_module_util_TcUtils_tcQdiscAddDevClsact},
+    {"sessionOpen", "()J",
+     (void *)com_android_net_module_util_TcUtils_sessionOpen},
+    {"sessionClose", "(J)V",
+     (void *)com_android_net_module_util_TcUtils_sessionClose},
+    {"sessionQdiscAddDevClsact", "(JI)V",
+     (void *)com_android_net_module_util_TcUtils_sessionQdiscAddDevClsact},
+    {"sessionFilterAddDevBpf", "(JIZSSLjava/lang/String;)V",
+     (void *)com_android_net_module_util_TcUtils_sessionFilterAddDevBpf},
+    {"sessionFilterAddDevIngressPolice", "(JISSILjava/lang/String;)V",
+     (void *)
+         com_android_net_module_util_TcUtils_sessionFilterAddDevIngressPolice},
+    {"sessionFilterDelDev", "(JIZSS)V",
+     (void *)com_android_net_module_util_TcUtils_sessionFilterDelDev},
+    {"sessionCommit", "(J)[I",
+     (void *)com_android_net_module_util_TcUtils_sessionCommit},
 };
 
 int register_com_android_net_module_util_TcUtils(JNIEnv *env,
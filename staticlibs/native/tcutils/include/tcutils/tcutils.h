@@ -16,11 +16,72 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <linux/rtnetlink.h>
+#include <vector>
 
 namespace android {
 
+// A NETLINK_ROUTE socket which stays open across requests.
+//
+// Any number of qdisc/filter requests can be queued up, and are then all sent
+// to the kernel with a single sendmsg() by commit(), which then collects all of
+// their ACKs. This saves a socket setup and a round trip per request, which
+// adds up when configuring several interfaces (or several filters on one).
+//
+// Not thread-safe.
+class TcSession {
+public:
+  TcSession() = default;
+  ~TcSession();
+  TcSession(const TcSession &) = delete;
+  TcSession &operator=(const TcSession &) = delete;
+
+  // Opens the netlink socket, returns 0 or -errno.  Does nothing if already
+  // open.  commit() calls this itself, so calling it is only needed in order
+  // to find out about failures early.
+  int open();
+
+  // The following queue up a request, and return 0, or -errno (and queue
+  // nothing) if the request could not be built.  The arguments are the same
+  // as for the same named functions below.
+  int queueQdiscClsact(int ifIndex, uint16_t nlMsgType, uint16_t nlMsgFlags);
+  int queueAddBpfFilter(int ifIndex, bool ingress, uint16_t prio,
+                        uint16_t proto, const char *bpfProgPath);
+  int queueAddIngressPoliceFilter(int ifIndex, uint16_t prio, uint16_t proto,
+                                  unsigned rateInBytesPerSec,
+                                  const char *bpfProgPath);
+  int queueDeleteFilter(int ifIndex, bool ingress, uint16_t prio,
+                        uint16_t proto);
+
+  // Number of requests queued since the last commit().
+  size_t pending() const { return mOffsets.size(); }
+
+  // Sends all queued requests and waits for all of their ACKs, emptying the
+  // queue.  The kernel processes the requests in order, and carries on with
+  // the next one after a failure.
+  //
+  // If results is not null, it is set to one 0 or -errno per request, in the
+  // order they were queued in.  Returns 0 if every request succeeded, and
+  // otherwise the first error.
+  int commit(std::vector<int> *results = nullptr);
+
+private:
+  void append(const void *req, size_t len);
+  void clear();
+
+  int mFd = -1;
+  uint32_t mSeq = 0;
+  // All queued requests, back to back, as they will be sent.
+  std::vector<char> mBuf;
+  // Offset of each queued request in mBuf.
+  std::vector<size_t> mOffsets;
+  // bpf program fds referenced by queued requests, which must stay open until
+  // the requests have been sent.
+  std::vector<int> mBpfFds;
+};
+
 int isEthernet(const char *iface, bool &isEthernet);
 
 int doTcQdiscClsact(int ifIndex, uint16_t nlMsgType, uint16_t nlMsgFlags);
@@ -307,6 +307,10 @@ public:
 
   constexpr unsigned getRequestSize() const { return sizeof(Request); }
 
+  // Transfers ownership of the bpf program fd referenced by the request, which
+  // must stay open until the request has been sent.
+  int releaseBpfFd() { return std::exchange(mBpfFd, -1); }
+
 private:
   unsigned calculateXmitTime(unsigned size) {
     const uint32_t rate = mRequest.opt.acts.act1.opt.police.obj.rate.rate;
@@ -368,8 +372,11 @@ public:
 const sockaddr_nl KERNEL_NLADDR = {AF_NETLINK, 0, 0, 0};
 const uint16_t NETLINK_REQUEST_FLAGS = NLM_F_REQUEST | NLM_F_ACK;
 
-int sendAndProcessNetlinkResponse(const void *req, int len) {
-  // TODO: use unique_fd instead of ScopeGuard
+// Generous, the ACKs are capped by NETLINK_CAP_ACK, and thus only include the
+// failed request's headers, plus any NETLINK_EXT_ACK error message.
+constexpr size_t ACK_BUFFER_SIZE = 4096;
+
+int openNetlinkSocket() {
   int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
   if (fd == -1) {
     int error = errno;
@@ -408,55 +415,8 @@ int sendAndProcessNetlinkResponse(const void *req, int len) {
     return -error;
   }
 
-  int rv = send(fd, req, len, 0);
-
-  if (rv == -1) {
-    int error = errno;
-    ALOGE("send(fd, req, len, 0) failed: %d", error);
-    return -error;
-  }
-
-  if (rv != len) {
-    ALOGE("send(fd, req, len = %d, 0) returned invalid message size %d", len,
-             rv);
-    return -EMSGSIZE;
-  }
-
-  struct {
-    nlmsghdr h;
-    nlmsgerr e;
-    char buf[256];
-  } resp = {};
-
-  rv = recv(fd, &resp, sizeof(resp), MSG_TRUNC);
-
-  if (rv == -1) {
-    int error = errno;
-    ALOGE("recv() failed: %d", error);
-    return -error;
-  }
-
-  if (rv < (int)NLMSG_SPACE(sizeof(struct nlmsgerr))) {
-    ALOGE("recv() returned short packet: %d", rv);
-    return -EBADMSG;
-  }
-
-  if (resp.h.nlmsg_len != (unsigned)rv) {
-    ALOGE("recv() returned invalid header length: %d != %d",
-             resp.h.nlmsg_len, rv);
-    return -EBADMSG;
-  }
-
-  if (resp.h.nlmsg_type != NLMSG_ERROR) {
-    ALOGE("recv() did not return NLMSG_ERROR message: %d",
-             resp.h.nlmsg_type);
-    return -ENOMSG;
-  }
-
-  if (resp.e.error) {
-    ALOGE("NLMSG_ERROR message return error: %d", resp.e.error);
-  }
-  return resp.e.error; // returns 0 on success
+  scopeGuard.Disable();
+  return fd;
 }
 
 int hardwareAddressType(const char *interface) {
@@ -527,7 +487,8 @@ int isEthernet(const char *iface, bool &isEthernet) {
 // ADD:     nlMsgType=RTM_NEWQDISC nlMsgFlags=NLM_F_EXCL|NLM_F_CREATE
 // REPLACE: nlMsgType=RTM_NEWQDISC nlMsgFlags=NLM_F_CREATE|NLM_F_REPLACE
 // DEL:     nlMsgType=RTM_DELQDISC nlMsgFlags=0
-int doTcQdiscClsact(int ifIndex, uint16_t nlMsgType, uint16_t nlMsgFlags) {
+int TcSession::queueQdiscClsact(int ifIndex, uint16_t nlMsgType,
+                                uint16_t nlMsgFlags) {
   // This is the name of the qdisc we are attaching.
   // Some hoop jumping to make this compile time constant with known size,
   // so that the structure declaration is well defined at compile time.
@@ -569,19 +530,20 @@ int doTcQdiscClsact(int ifIndex, uint16_t nlMsgType, uint16_t nlMsgFlags) {
   };
 #undef CLSACT
 
-  return sendAndProcessNetlinkResponse(&req, sizeof(req));
+  append(&req, sizeof(req));
+  return 0;
 }
 
 // tc filter add dev .. in/egress prio 1 protocol ipv6/ip bpf object-pinned
 // /sys/fs/bpf/... direct-action
-int tcAddBpfFilter(int ifIndex, bool ingress, uint16_t prio, uint16_t proto,
-                   const char *bpfProgPath) {
+int TcSession::queueAddBpfFilter(int ifIndex, bool ingress, uint16_t prio,
+                                 uint16_t proto, const char *bpfProgPath) {
   const int bpfFd = bpf::retrieveProgram(bpfProgPath);
   if (bpfFd == -1) {
     ALOGE("retrieveProgram failed: %d", errno);
     return -errno;
   }
-  auto scopeGuard = base::make_scope_guard([bpfFd] { close(bpfFd); });
+  mBpfFds.push_back(bpfFd);
 
   struct {
     nlmsghdr n;
@@ -676,8 +638,8 @@ int tcAddBpfFilter(int ifIndex, bool ingress, uint16_t prio, uint16_t proto,
   snprintf(req.options.name.str, sizeof(req.options.name.str), "%s:[*fsobj]",
            basename(bpfProgPath));
 
-  int error = sendAndProcessNetlinkResponse(&req, sizeof(req));
-  return error;
+  append(&req, sizeof(req));
+  return 0;
 }
 
 // tc filter add dev .. ingress prio .. protocol .. matchall \
@@ -689,9 +651,10 @@ int tcAddBpfFilter(int ifIndex, bool ingress, uint16_t prio, uint16_t proto,
 // adding a second tc-police filter at a lower priority that rate limits traffic
 // at something like 0.8 times the global rate limit and ecn marks exceeding
 // packets inside a bpf program (but does not drop them).
-int tcAddIngressPoliceFilter(int ifIndex, uint16_t prio, uint16_t proto,
-                             unsigned rateInBytesPerSec,
-                             const char *bpfProgPath) {
+int TcSession::queueAddIngressPoliceFilter(int ifIndex, uint16_t prio,
+                                           uint16_t proto,
+                                           unsigned rateInBytesPerSec,
+                                           const char *bpfProgPath) {
   // TODO: this value needs to be validated.
   // TCP IW10 (initial congestion window) means servers will send 10 mtus worth
   // of data on initial connect.
@@ -707,12 +670,14 @@ int tcAddIngressPoliceFilter(int ifIndex, uint16_t prio, uint16_t proto,
   if (error) {
     return error;
   }
-  return sendAndProcessNetlinkResponse(filter.getRequest(),
-                                       filter.getRequestSize());
+  mBpfFds.push_back(filter.releaseBpfFd());
+  append(filter.getRequest(), filter.getRequestSize());
+  return 0;
 }
 
 // tc filter del dev .. in/egress prio .. protocol ..
-int tcDeleteFilter(int ifIndex, bool ingress, uint16_t prio, uint16_t proto) {
+int TcSession::queueDeleteFilter(int ifIndex, bool ingress, uint16_t prio,
+                                 uint16_t proto) {
   const struct {
     nlmsghdr n;
     tcmsg t;
@@ -736,7 +701,170 @@ int tcDeleteFilter(int ifIndex, bool ingress, uint16_t prio, uint16_t proto) {
           },
   };
 
-  return sendAndProcessNetlinkResponse(&req, sizeof(req));
+  append(&req, sizeof(req));
+  return 0;
+}
+
+TcSession::~TcSession() {
+  clear();
+  if (mFd != -1) {
+    close(mFd);
+  }
+}
+
+int TcSession::open() {
+  if (mFd != -1) {
+    return 0;
+  }
+  int fd = openNetlinkSocket();
+  if (fd < 0) {
+    return fd;
+  }
+  mFd = fd;
+  return 0;
+}
+
+void TcSession::append(const void *req, size_t len) {
+  const size_t offset = mBuf.size();
+  mBuf.resize(offset + NLMSG_ALIGN(len));
+  memcpy(&mBuf[offset], req, len);
+  mOffsets.push_back(offset);
+}
+
+void TcSession::clear() {
+  for (int fd : mBpfFds) {
+    close(fd);
+  }
+  mBpfFds.clear();
+  mOffsets.clear();
+  mBuf.clear();
+}
+
+int TcSession::commit(std::vector<int> *results) {
+  auto scopeGuard = base::make_scope_guard([this] { clear(); });
+  const size_t count = mOffsets.size();
+  // Any request we do not get an ACK for fails with the error that stopped us.
+  std::vector<int> errors(count, -EBADMSG);
+  if (results) {
+    results->clear();
+  }
+  if (!count) {
+    return 0;
+  }
+
+  int error = open();
+  if (error) {
+    errors.assign(count, error);
+  }
+
+  // Number the requests, so their ACKs can be matched up with them.
+  const uint32_t firstSeq = mSeq;
+  for (size_t i = 0; i < count; ++i) {
+    reinterpret_cast<nlmsghdr *>(&mBuf[mOffsets[i]])->nlmsg_seq = mSeq++;
+  }
+
+  ssize_t rv = error ? 0 : send(mFd, mBuf.data(), mBuf.size(), 0);
+  if (!error && rv == -1) {
+    error = -errno;
+    ALOGE("send(fd, req, len, 0) failed: %d", -error);
+    errors.assign(count, error);
+  } else if (!error && rv != (ssize_t)mBuf.size()) {
+    ALOGE("send(fd, req, len = %zu, 0) returned invalid message size %zd",
+          mBuf.size(), rv);
+    error = -EMSGSIZE;
+    errors.assign(count, error);
+  }
+
+  char buf[ACK_BUFFER_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+  for (size_t acked = 0; !error && acked < count;) {
+    rv = recv(mFd, buf, sizeof(buf), MSG_TRUNC);
+    if (rv == -1) {
+      error = -errno;
+      ALOGE("recv() failed: %d", -error);
+      break;
+    }
+    if (rv < (ssize_t)NLMSG_SPACE(sizeof(struct nlmsgerr)) ||
+        rv > (ssize_t)sizeof(buf)) {
+      ALOGE("recv() returned invalid packet size: %zd", rv);
+      error = -EBADMSG;
+      break;
+    }
+
+    int len = rv;
+    for (const nlmsghdr *h = reinterpret_cast<const nlmsghdr *>(buf);
+         NLMSG_OK(h, len); h = NLMSG_NEXT(h, len)) {
+      if (h->nlmsg_type != NLMSG_ERROR) {
+        ALOGE("recv() did not return NLMSG_ERROR message: %d",
+              h->nlmsg_type);
+        continue;
+      }
+      if (h->nlmsg_len < NLMSG_LENGTH(sizeof(struct nlmsgerr))) {
+        ALOGE("recv() returned short NLMSG_ERROR message: %d", h->nlmsg_len);
+        continue;
+      }
+      const uint32_t i = h->nlmsg_seq - firstSeq;
+      if (i >= count) {
+        ALOGE("recv() returned unexpected sequence number: %u",
+              h->nlmsg_seq);
+        continue;
+      }
+      const nlmsgerr *e = reinterpret_cast<const nlmsgerr *>(NLMSG_DATA(h));
+      if (e->error) {
+        ALOGE("NLMSG_ERROR message return error: %d", e->error);
+      }
+      errors[i] = e->error; // 0 on success
+      ++acked;
+    }
+  }
+
+  if (error && mFd != -1) {
+    // Re-open on next use, the kernel might still send the missing ACKs.
+    close(mFd);
+    mFd = -1;
+  }
+
+  int firstError = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (error && errors[i] == -EBADMSG) {
+      errors[i] = error;
+    }
+    if (!firstError) {
+      firstError = errors[i];
+    }
+  }
+  if (results) {
+    *results = std::move(errors);
+  }
+  return firstError;
+}
+
+int doTcQdiscClsact(int ifIndex, uint16_t nlMsgType, uint16_t nlMsgFlags) {
+  TcSession session;
+  int error = session.queueQdiscClsact(ifIndex, nlMsgType, nlMsgFlags);
+  return error ? error : session.commit();
+}
+
+int tcAddBpfFilter(int ifIndex, bool ingress, uint16_t prio, uint16_t proto,
+                   const char *bpfProgPath) {
+  TcSession session;
+  int error =
+      session.queueAddBpfFilter(ifIndex, ingress, prio, proto, bpfProgPath);
+  return error ? error : session.commit();
+}
+
+int tcAddIngressPoliceFilter(int ifIndex, uint16_t prio, uint16_t proto,
+                             unsigned rateInBytesPerSec,
+                             const char *bpfProgPath) {
+  TcSession session;
+  int error = session.queueAddIngressPoliceFilter(
+      ifIndex, prio, proto, rateInBytesPerSec, bpfProgPath);
+  return error ? error : session.commit();
+}
+
+int tcDeleteFilter(int ifIndex, bool ingress, uint16_t prio, uint16_t proto) {
+  TcSession session;
+  int error = session.queueDeleteFilter(ifIndex, ingress, prio, proto);
+  return error ? error : session.commit();
 }
 
 } // namespace android
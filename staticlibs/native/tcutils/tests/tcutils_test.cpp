@@ -78,16 +78,18 @@ TEST(LibTcUtilsTest, AttachReplaceDetachClsactLo) {
   EXPECT_EQ(-EINVAL, tcDeleteQdiscClsact(LOOPBACK_IFINDEX));
 }
 
+// Shared by the bpf filter tests.
+// TODO: this should likely be in the tethering module, where using netd.h would be ok
+static constexpr char bpfProgPath[] =
+    "/sys/fs/bpf/tethering/prog_offload_schedcls_tether_downstream6_ether";
+static constexpr uint16_t prio = 17;
+static constexpr uint16_t proto = ETH_P_ALL;
+
 TEST(LibTcUtilsTest, AddAndDeleteBpfFilter) {
-  // TODO: this should likely be in the tethering module, where using netd.h would be ok
-  static constexpr char bpfProgPath[] =
-      "/sys/fs/bpf/tethering/prog_offload_schedcls_tether_downstream6_ether";
   const int errNOENT = bpf::isAtLeastKernelVersion(4, 19, 0) ? ENOENT : EINVAL;
 
   // static test values
   static constexpr bool ingress = true;
-  static constexpr uint16_t prio = 17;
-  static constexpr uint16_t proto = ETH_P_ALL;
 
   // try to delete missing filter from missing qdisc
   EXPECT_EQ(-EINVAL, tcDeleteFilter(LOOPBACK_IFINDEX, ingress, prio, proto));
@@ -151,4 +153,46 @@ TEST(LibTcUtilsTest, AddAndDeleteIngressPoliceFilter) {
             tcDeleteFilter(LOOPBACK_IFINDEX, true /*ingress*/, prio, proto));
 }
 
+TEST(LibTcUtilsTest, SessionBatchesRequests) {
+  const int errNOENT = bpf::isAtLeastKernelVersion(4, 19, 0) ? ENOENT : EINVAL;
+
+  TcSession session;
+  ASSERT_EQ(0, session.open());
+
+  // nothing queued
+  std::vector<int> results = {1};
+  EXPECT_EQ(0, session.commit(&results));
+  EXPECT_TRUE(results.empty());
+
+  // a missing program fails to queue, and queues nothing
+  EXPECT_EQ(-ENOENT, session.queueAddBpfFilter(LOOPBACK_IFINDEX, true, prio,
+                                               proto, "/sys/fs/bpf/missing"));
+  EXPECT_EQ(0u, session.pending());
+
+  // add the clsact qdisc and filters on both sides
+  ASSERT_EQ(0, session.queueQdiscClsact(LOOPBACK_IFINDEX, RTM_NEWQDISC,
+                                        NLM_F_EXCL | NLM_F_CREATE));
+  ASSERT_EQ(0, session.queueAddBpfFilter(LOOPBACK_IFINDEX, true, prio, proto,
+                                         bpfProgPath));
+  ASSERT_EQ(0, session.queueAddBpfFilter(LOOPBACK_IFINDEX, false, prio, proto,
+                                         bpfProgPath));
+  EXPECT_EQ(3u, session.pending());
+  EXPECT_EQ(0, session.commit(&results));
+  EXPECT_EQ(std::vector<int>({0, 0, 0}), results);
+  EXPECT_EQ(0u, session.pending());
+
+  // a failure in the middle of a batch does not stop the following requests
+  ASSERT_EQ(0, session.queueDeleteFilter(LOOPBACK_IFINDEX, true, prio, proto));
+  ASSERT_EQ(0, session.queueDeleteFilter(LOOPBACK_IFINDEX, true, prio, proto));
+  ASSERT_EQ(0, session.queueDeleteFilter(LOOPBACK_IFINDEX, false, prio, proto));
+  EXPECT_EQ(-errNOENT, session.commit(&results));
+  EXPECT_EQ(std::vector<int>({0, -errNOENT, 0}), results);
+
+  // the session can keep being reused
+  ASSERT_EQ(0, session.queueQdiscClsact(LOOPBACK_IFINDEX, RTM_DELQDISC, 0));
+  EXPECT_EQ(0, session.commit());
+  ASSERT_EQ(0, session.queueQdiscClsact(LOOPBACK_IFINDEX, RTM_DELQDISC, 0));
+  EXPECT_EQ(-EINVAL, session.commit());
+}
+
 } // namespace android
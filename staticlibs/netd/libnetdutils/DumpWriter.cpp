@@ -16,13 +16,13 @@
 
 #include "netdutils/DumpWriter.h"
 
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <limits>
 
-#include <android-base/stringprintf.h>
-#include <utils/String8.h>
-
-using android::base::StringAppendV;
+#include <android-base/macros.h>
 
 namespace android {
 namespace netdutils {
@@ -34,7 +34,28 @@ const size_t kIndentStringLen = strlen(kIndentString);
 
 }  // namespace
 
-DumpWriter::DumpWriter(int fd) : mIndentLevel(0), mFd(fd) {}
+DumpWriter::DumpWriter(int fd) : DumpWriter(fd, Format::TEXT) {}
+
+DumpWriter::DumpWriter(int fd, Format format) : mIndentLevel(0), mFd(fd), mFormat(format) {
+    mBuffer.reserve(kBufferSize + kBufferSize / 4);
+    if (mFormat == Format::JSON) {
+        append("[");
+        mJsonElements.push_back(0);
+    }
+}
+
+DumpWriter::~DumpWriter() {
+    if (mFormat == Format::JSON) {
+        // Close any sections left open, and the top level array.
+        while (!mJsonElements.empty()) {
+            append("]");
+            mJsonElements.pop_back();
+            if (!mJsonElements.empty()) append("}");
+        }
+        append("\n");
+    }
+    flush();
+}
 
 void DumpWriter::incIndent() {
     if (mIndentLevel < std::numeric_limits<decltype(mIndentLevel)>::max()) {
@@ -49,23 +70,179 @@ void DumpWriter::decIndent() {
 }
 
 void DumpWriter::println(const std::string& line) {
-    if (!line.empty()) {
-        for (int i = 0; i < mIndentLevel; i++) {
-            ::write(mFd, kIndentString, kIndentStringLen);
-        }
-        ::write(mFd, line.c_str(), line.size());
-    }
-    ::write(mFd, "\n", 1);
+    appendLine(line);
 }
 
 // NOLINTNEXTLINE(cert-dcl50-cpp): Grandfathered C-style variadic function.
 void DumpWriter::println(const char* fmt, ...) {
-    std::string line;
+    // Most lines fit in this buffer, saving the temporary string.
+    char stackLine[256];
+    std::string heapLine;
     va_list ap;
     va_start(ap, fmt);
-    StringAppendV(&line, fmt, ap);
+    const int len = vsnprintf(stackLine, sizeof(stackLine), fmt, ap);
     va_end(ap);
-    println(line);
+    if (len < 0) return;
+    if (static_cast<size_t>(len) >= sizeof(stackLine)) {
+        heapLine.resize(len);
+        va_start(ap, fmt);
+        vsnprintf(heapLine.data(), len + 1, fmt, ap);
+        va_end(ap);
+    }
+    appendLine(heapLine.empty() ? std::string_view(stackLine, len) : heapLine);
+}
+
+void DumpWriter::beginSection(std::string_view name) {
+    if (mFormat == Format::JSON) {
+        beginJsonElement();
+        append("{");
+        appendJsonString(name);
+        append(":[");
+        mJsonElements.push_back(0);
+    } else {
+        appendIndent();
+        append(name);
+        append(":\n");
+        incIndent();
+    }
+}
+
+void DumpWriter::endSection() {
+    if (mFormat == Format::JSON) {
+        // Never close the top level array, which only the destructor does.
+        if (mJsonElements.size() <= 1) return;
+        append("]}");
+        mJsonElements.pop_back();
+    } else {
+        decIndent();
+    }
+    maybeFlush();
+}
+
+DumpWriter::Row DumpWriter::row() {
+    return Row(*this);
+}
+
+void DumpWriter::flush() {
+    const char* data = mBuffer.data();
+    size_t remaining = mBuffer.size();
+    while (remaining > 0 && !mWriteFailed) {
+        const ssize_t written = TEMP_FAILURE_RETRY(::write(mFd, data, remaining));
+        if (written <= 0) {
+            // The reader went away. Keep the caller's dump loop going, but stop writing.
+            mWriteFailed = true;
+            break;
+        }
+        data += written;
+        remaining -= written;
+    }
+    mBuffer.clear();
+}
+
+void DumpWriter::appendLine(std::string_view line) {
+    if (mFormat == Format::JSON) {
+        beginJsonElement();
+        appendJsonString(line);
+    } else {
+        if (!line.empty()) {
+            appendIndent();
+            append(line);
+        }
+        append("\n");
+    }
+    maybeFlush();
+}
+
+void DumpWriter::append(std::string_view s) {
+    mBuffer.append(s);
+}
+
+void DumpWriter::appendIndent() {
+    for (int i = 0; i < mIndentLevel; i++) {
+        mBuffer.append(kIndentString, kIndentStringLen);
+    }
+}
+
+void DumpWriter::appendJsonString(std::string_view s) {
+    static const char kHex[] = "0123456789abcdef";
+    mBuffer.push_back('"');
+    for (const char c : s) {
+        switch (c) {
+            case '"':
+                append("\\\"");
+                break;
+            case '\\':
+                append("\\\\");
+                break;
+            case '\n':
+                append("\\n");
+                break;
+            case '\t':
+                append("\\t");
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    append("\\u00");
+                    mBuffer.push_back(kHex[c >> 4]);
+                    mBuffer.push_back(kHex[c & 0xf]);
+                } else {
+                    mBuffer.push_back(c);
+                }
+        }
+    }
+    mBuffer.push_back('"');
+}
+
+void DumpWriter::beginJsonElement() {
+    // One element per line, so that large dumps can also be read with line based tools.
+    append(mJsonElements.back()++ ? ",\n" : "\n");
+}
+
+DumpWriter::Row::Row(DumpWriter& dw) : mDw(dw) {
+    if (mDw.mFormat == Format::JSON) {
+        mDw.beginJsonElement();
+        mDw.append("{");
+    } else {
+        mDw.appendIndent();
+    }
+}
+
+DumpWriter::Row::~Row() {
+    mDw.append(mDw.mFormat == Format::JSON ? "}" : "\n");
+    mDw.maybeFlush();
+}
+
+void DumpWriter::Row::key(std::string_view key) {
+    if (mDw.mFormat == Format::JSON) {
+        if (!mFirst) mDw.append(",");
+        mDw.appendJsonString(key);
+        mDw.append(":");
+    } else {
+        if (!mFirst) mDw.append(" ");
+        mDw.append(key);
+        mDw.append(": ");
+    }
+    mFirst = false;
+}
+
+DumpWriter::Row& DumpWriter::Row::field(std::string_view k, std::string_view value) {
+    key(k);
+    if (mDw.mFormat == Format::JSON) {
+        mDw.appendJsonString(value);
+    } else {
+        mDw.append(value);
+    }
+    return *this;
+}
+
+DumpWriter::Row& DumpWriter::Row::field(std::string_view k, bool value) {
+    return number(k, value ? "true" : "false");
+}
+
+DumpWriter::Row& DumpWriter::Row::number(std::string_view k, std::string_view digits) {
+    key(k);
+    mDw.append(digits);
+    return *this;
 }
 
 }  // namespace netdutils
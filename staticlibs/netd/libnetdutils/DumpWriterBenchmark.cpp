@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Dumping a 10k entry stats map to /dev/null: flushing after every line (which is how
+// DumpWriter used to behave), buffered println(), and buffered rows in both formats.
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+
+#include "netdutils/DumpWriter.h"
+
+namespace android {
+namespace netdutils {
+namespace {
+
+constexpr int kEntries = 10000;
+
+void BM_PrintlnUnbuffered(benchmark::State& state) {
+    android::base::unique_fd fd(open("/dev/null", O_WRONLY | O_CLOEXEC));
+    for (auto _ : state) {
+        DumpWriter dw(fd);
+        ScopedIndent indent(dw);
+        for (int i = 0; i < kEntries; i++) {
+            dw.println("uid: %d iface: %s rxBytes: %d txBytes: %d", i, "wlan0", i * 3, i * 5);
+            dw.flush();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kEntries);
+}
+
+void BM_Println(benchmark::State& state) {
+    android::base::unique_fd fd(open("/dev/null", O_WRONLY | O_CLOEXEC));
+    for (auto _ : state) {
+        DumpWriter dw(fd);
+        ScopedIndent indent(dw);
+        for (int i = 0; i < kEntries; i++) {
+            dw.println("uid: %d iface: %s rxBytes: %d txBytes: %d", i, "wlan0", i * 3, i * 5);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kEntries);
+}
+
+void BM_Rows(benchmark::State& state, DumpWriter::Format format) {
+    android::base::unique_fd fd(open("/dev/null", O_WRONLY | O_CLOEXEC));
+    for (auto _ : state) {
+        DumpWriter dw(fd, format);
+        ScopedSection section(dw, "stats");
+        for (int i = 0; i < kEntries; i++) {
+            dw.row().field("uid", i).field("iface", "wlan0").field("rxBytes", i * 3).field(
+                    "txBytes", i * 5);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kEntries);
+}
+
+BENCHMARK(BM_PrintlnUnbuffered);
+BENCHMARK(BM_Println);
+BENCHMARK_CAPTURE(BM_Rows, text, DumpWriter::Format::TEXT);
+BENCHMARK_CAPTURE(BM_Rows, json, DumpWriter::Format::JSON);
+
+}  // namespace
+}  // namespace netdutils
+}  // namespace android
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "netdutils/DumpWriter.h"
+
+namespace android {
+namespace netdutils {
+
+namespace {
+
+std::string contents(const TemporaryFile& file) {
+    std::string s;
+    EXPECT_TRUE(android::base::ReadFileToString(file.path, &s));
+    return s;
+}
+
+void writeTable(DumpWriter& dw) {
+    dw.println("header %d", 1);
+    ScopedSection section(dw, "stats");
+    dw.row().field("uid", 1000).field("iface", "wlan0").field("rxBytes", UINT64_MAX);
+    dw.row().field("uid", -1).field("tagged", true);
+    {
+        ScopedSection nested(dw, "empty");
+    }
+    dw.println("say \"hi\"\t\\");
+}
+
+}  // namespace
+
+TEST(DumpWriterTest, Text) {
+    TemporaryFile file;
+    {
+        DumpWriter dw(file.fd);
+        writeTable(dw);
+        dw.blankline();
+        dw.println(std::string(1000, 'x'));
+    }
+    EXPECT_EQ("header 1\n"
+              "stats:\n"
+              "  uid: 1000 iface: wlan0 rxBytes: 18446744073709551615\n"
+              "  uid: -1 tagged: true\n"
+              "  empty:\n"
+              "  say \"hi\"\t\\\n"
+              "\n" + std::string(1000, 'x') + "\n",
+              contents(file));
+}
+
+TEST(DumpWriterTest, Json) {
+    TemporaryFile file;
+    {
+        DumpWriter dw(file.fd, DumpWriter::Format::JSON);
+        writeTable(dw);
+        // Left open, closed by the destructor.
+        dw.beginSection("open");
+        dw.row().field("control", std::string_view("\x01", 1));
+    }
+    EXPECT_EQ("[\n"
+              "\"header 1\",\n"
+              "{\"stats\":[\n"
+              "{\"uid\":1000,\"iface\":\"wlan0\",\"rxBytes\":18446744073709551615},\n"
+              "{\"uid\":-1,\"tagged\":true},\n"
+              "{\"empty\":[]},\n"
+              "\"say \\\"hi\\\"\\t\\\\\"]},\n"
+              "{\"open\":[\n"
+              "{\"control\":\"\\u0001\"}]}]\n",
+              contents(file));
+}
+
+TEST(DumpWriterTest, BuffersWrites) {
+    TemporaryFile file;
+    DumpWriter dw(file.fd);
+    for (int i = 0; i < 100; i++) dw.println("line %d", i);
+    // Nothing is written until the buffer fills up or is flushed.
+    EXPECT_EQ("", contents(file));
+    dw.flush();
+    EXPECT_EQ(std::string::npos, contents(file).find("line 100"));
+    EXPECT_NE(std::string::npos, contents(file).find("line 99\n"));
+
+    // Large dumps are written out as they go, without needing a flush.
+    for (int i = 0; i < 100000; i++) dw.println("line %d", i);
+    EXPECT_LT(512 * 1024U, contents(file).size());
+}
+
+TEST(DumpWriterTest, ClosedReader) {
+    // As when the dumpsys client is killed mid-dump.
+    sighandler_t oldHandler = signal(SIGPIPE, SIG_IGN);
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    close(fds[0]);
+    {
+        DumpWriter dw(fds[1]);
+        for (int i = 0; i < 100000; i++) dw.println("line %d", i);
+    }
+    close(fds[1]);
+    signal(SIGPIPE, oldHandler);
+}
+
+}  // namespace netdutils
+}  // namespace android
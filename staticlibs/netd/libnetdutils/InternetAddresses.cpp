@@ -16,10 +16,12 @@
 
 #include "netdutils/InternetAddresses.h"
 
+#include <charconv>
 #include <string>
 
 #include <android-base/stringprintf.h>
 #include <arpa/inet.h>
+#include <net/if.h>
 #include <netdb.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -30,38 +32,244 @@ using base::StringPrintf;
 
 namespace netdutils {
 
-std::string IPAddress::toString() const noexcept {
-    char repr[INET6_ADDRSTRLEN] = "\0";
+namespace {
+
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Strict dotted quad, as inet_pton(AF_INET): four decimal octets, no leading zeros.
+bool parseIPv4(std::string_view s, uint8_t out[IPV4_ADDR_LEN]) {
+    size_t i = 0;
+    for (int octet = 0; octet < IPV4_ADDR_LEN; octet++) {
+        if (octet > 0) {
+            if (i >= s.size() || s[i] != '.') return false;
+            i++;
+        }
+        const size_t start = i;
+        unsigned value = 0;
+        while (i < s.size() && isDigit(s[i]) && i - start < 3) {
+            value = value * 10 + (s[i] - '0');
+            i++;
+        }
+        const size_t digits = i - start;
+        if (digits == 0 || value > 255 || (digits > 1 && s[start] == '0')) return false;
+        out[octet] = static_cast<uint8_t>(value);
+    }
+    return i == s.size();
+}
+
+// RFC 4291 section 2.2 text forms, as inet_pton(AF_INET6).
+bool parseIPv6(std::string_view s, in6_addr* out) {
+    uint16_t words[8] = {};
+    int count = 0;
+    int gap = -1;  // index in words at which "::" was seen
+    size_t i = 0;
+
+    if (s.size() >= 2 && s[0] == ':' && s[1] == ':') {
+        gap = 0;
+        i = 2;
+    } else if (!s.empty() && s[0] == ':') {
+        return false;
+    }
+
+    while (i < s.size()) {
+        const size_t start = i;
+        unsigned value = 0;
+        int digit;
+        while (i < s.size() && i - start < 5 && (digit = hexValue(s[i])) >= 0) {
+            value = (value << 4) | digit;
+            i++;
+        }
+        if (i < s.size() && s[i] == '.') {
+            // Embedded IPv4 address, which must end the string.
+            uint8_t v4[IPV4_ADDR_LEN];
+            if (count > 6 || !parseIPv4(s.substr(start), v4)) return false;
+            words[count++] = (v4[0] << 8) | v4[1];
+            words[count++] = (v4[2] << 8) | v4[3];
+            i = s.size();
+            break;
+        }
+        if (i == start || i - start > 4 || count == 8) return false;
+        words[count++] = value;
+        if (i == s.size()) break;
+        if (s[i] != ':') return false;
+        i++;
+        if (i < s.size() && s[i] == ':') {
+            if (gap >= 0) return false;
+            gap = count;
+            i++;
+        } else if (i == s.size()) {
+            return false;
+        }
+    }
+
+    if (gap < 0) {
+        if (count != 8) return false;
+    } else {
+        // "::" stands for at least one group of zeros.
+        if (count > 7) return false;
+        const int tail = count - gap;
+        std::copy_backward(words + gap, words + count, words + 8);
+        std::fill(words + gap, words + 8 - tail, 0);
+    }
+    for (int w = 0; w < 8; w++) {
+        out->s6_addr[2 * w] = words[w] >> 8;
+        out->s6_addr[2 * w + 1] = words[w] & 0xff;
+    }
+    return true;
+}
+
+// The zone after '%': a decimal number, or an interface name for link-local addresses.
+bool parseScope(std::string_view s, const in6_addr& addr, uint32_t* scope) {
+    if (s.empty()) return false;
+    if (isDigit(s[0])) {
+        const auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), *scope);
+        return ec == std::errc() && ptr == s.data() + s.size();
+    }
+    if (!usesScopedIds(addr) || s.size() >= IF_NAMESIZE) return false;
+    char name[IF_NAMESIZE];
+    memcpy(name, s.data(), s.size());
+    name[s.size()] = '\0';
+    *scope = if_nametoindex(name);
+    return *scope != 0;
+}
+
+char* appendString(char* first, char* last, std::string_view str) {
+    if (first == nullptr || last - first < static_cast<ptrdiff_t>(str.size())) return nullptr;
+    memcpy(first, str.data(), str.size());
+    return first + str.size();
+}
+
+char* appendUint(char* first, char* last, uint32_t value) {
+    if (first == nullptr) return nullptr;
+    const auto [ptr, ec] = std::to_chars(first, last, value);
+    return ec == std::errc() ? ptr : nullptr;
+}
+
+char* formatIPv4(char* first, char* last, const uint8_t addr[IPV4_ADDR_LEN]) {
+    for (int octet = 0; octet < IPV4_ADDR_LEN; octet++) {
+        if (octet > 0) first = appendString(first, last, ".");
+        first = appendUint(first, last, addr[octet]);
+    }
+    return first;
+}
 
+// Same output as inet_ntop(AF_INET6): the longest run of two or more zero
+// groups (the first, on ties) is compressed, and IPv4-compatible and -mapped
+// addresses end in dotted quad.
+char* formatIPv6(char* first, char* last, const in6_addr& addr) {
+    uint16_t words[8];
+    for (int w = 0; w < 8; w++) {
+        words[w] = (addr.s6_addr[2 * w] << 8) | addr.s6_addr[2 * w + 1];
+    }
+    int bestBase = -1, bestLen = 0;
+    for (int w = 0; w < 8;) {
+        if (words[w] != 0) {
+            w++;
+            continue;
+        }
+        int end = w;
+        while (end < 8 && words[end] == 0) end++;
+        if (end - w > bestLen) {
+            bestBase = w;
+            bestLen = end - w;
+        }
+        w = end;
+    }
+    if (bestLen < 2) bestBase = -1;
+
+    for (int w = 0; w < 8; w++) {
+        if (bestBase >= 0 && w >= bestBase && w < bestBase + bestLen) {
+            if (w == bestBase) first = appendString(first, last, ":");
+            continue;
+        }
+        if (w != 0) first = appendString(first, last, ":");
+        if (w == 6 && bestBase == 0 && (bestLen == 6 || (bestLen == 5 && words[5] == 0xffff))) {
+            return formatIPv4(first, last, &addr.s6_addr[12]);
+        }
+        char hex[4];
+        int n = 0;
+        for (int shift = 12; shift >= 0; shift -= 4) {
+            const int digit = (words[w] >> shift) & 0xf;
+            if (n > 0 || digit != 0 || shift == 0) hex[n++] = kHexDigits[digit];
+        }
+        first = appendString(first, last, std::string_view(hex, n));
+    }
+    if (bestBase >= 0 && bestBase + bestLen == 8) first = appendString(first, last, ":");
+    return first;
+}
+
+}  // namespace
+
+char* IPAddress::toChars(char* first, char* last) const noexcept {
     switch (mData.family) {
         case AF_UNSPEC:
-            return "<unspecified>";
+            return appendString(first, last, "<unspecified>");
         case AF_INET: {
-            const in_addr v4 = mData.ip.v4;
-            inet_ntop(AF_INET, &v4, repr, sizeof(repr));
-            break;
+            uint8_t v4[IPV4_ADDR_LEN];
+            memcpy(v4, &mData.ip.v4, sizeof(v4));
+            return formatIPv4(first, last, v4);
         }
         case AF_INET6: {
             const in6_addr v6 = mData.ip.v6;
-            inet_ntop(AF_INET6, &v6, repr, sizeof(repr));
-            break;
+            first = formatIPv6(first, last, v6);
+            if (mData.scope_id > 0) {
+                first = appendUint(appendString(first, last, "%"), last, mData.scope_id);
+            }
+            return first;
         }
         default:
-            return "<unknown_family>";
+            return appendString(first, last, "<unknown_family>");
     }
+}
 
-    if (mData.family == AF_INET6 && mData.scope_id > 0) {
-        return StringPrintf("%s%%%u", repr, mData.scope_id);
+std::string IPAddress::toString() const noexcept {
+    char repr[kMaxStringLength];
+    const char* end = toChars(repr, repr + sizeof(repr));
+    return std::string(repr, end ? end - repr : 0);
+}
+
+bool IPAddress::parse(std::string_view repr, IPAddress* ip) {
+    const size_t percent = repr.find('%');
+    const std::string_view addr = repr.substr(0, percent);
+
+    if (addr.find(':') == std::string_view::npos) {
+        in_addr v4;
+        if (percent != std::string_view::npos ||
+            !parseIPv4(addr, reinterpret_cast<uint8_t*>(&v4))) {
+            return false;
+        }
+        if (ip) *ip = IPAddress(v4);
+        return true;
     }
 
-    return repr;
+    in6_addr v6;
+    if (!parseIPv6(addr, &v6)) return false;
+    uint32_t scope = 0;
+    if (percent != std::string_view::npos && !parseScope(repr.substr(percent + 1), v6, &scope)) {
+        return false;
+    }
+    if (ip) *ip = IPAddress(v6, scope);
+    return true;
 }
 
 bool IPAddress::forString(const std::string& repr, IPAddress* ip) {
+    if (parse(repr, ip)) return true;
+
     const addrinfo hints = {
             .ai_flags = AI_NUMERICHOST | AI_NUMERICSERV,
     };
-    addrinfo* res;
+    addrinfo* res = nullptr;
     const int ret = getaddrinfo(repr.c_str(), nullptr, &hints, &res);
     ScopedAddrinfo res_cleanup(res);
     if (ret != 0) {
@@ -125,20 +333,24 @@ bool IPPrefix::isUninitialized() const noexcept {
     return mData == empty;
 }
 
-bool IPPrefix::forString(const std::string& repr, IPPrefix* prefix) {
-    size_t index = repr.find('/');
-    if (index == std::string::npos) return false;
+namespace {
+
+template <typename ParseAddressFn>
+bool parsePrefix(std::string_view repr, IPPrefix* prefix, ParseAddressFn parseAddress) {
+    const size_t index = repr.find('/');
+    if (index == std::string_view::npos) return false;
 
     // Parse the IP address.
     IPAddress ip;
-    if (!IPAddress::forString(repr.substr(0, index), &ip)) return false;
+    if (!parseAddress(repr.substr(0, index), &ip)) return false;
 
     // Parse the prefix length. Can't use base::ParseUint because it accepts non-base 10 input.
-    const char* prefixString = repr.c_str() + index + 1;
-    if (!isdigit(*prefixString)) return false;
-    char* endptr;
-    unsigned long prefixlen = strtoul(prefixString, &endptr, 10);
-    if (*endptr != '\0') return false;
+    const std::string_view prefixString = repr.substr(index + 1);
+    if (prefixString.empty() || !isDigit(prefixString[0])) return false;
+    unsigned prefixlen;
+    const char* end = prefixString.data() + prefixString.size();
+    const auto [ptr, ec] = std::from_chars(prefixString.data(), end, prefixlen);
+    if (ec != std::errc() || ptr != end) return false;
 
     uint8_t maxlen = (ip.family() == AF_INET) ? 32 : 128;
     if (prefixlen > maxlen) return false;
@@ -147,8 +359,28 @@ bool IPPrefix::forString(const std::string& repr, IPPrefix* prefix) {
     return true;
 }
 
+}  // namespace
+
+bool IPPrefix::forString(const std::string& repr, IPPrefix* prefix) {
+    return parsePrefix(repr, prefix, [](std::string_view addr, IPAddress* ip) {
+        return IPAddress::forString(std::string(addr), ip);
+    });
+}
+
+bool IPPrefix::parse(std::string_view repr, IPPrefix* prefix) {
+    return parsePrefix(repr, prefix, IPAddress::parse);
+}
+
+char* IPPrefix::toChars(char* first, char* last) const noexcept {
+    first = ip().toChars(first, last);
+    first = appendString(first, last, "/");
+    return appendUint(first, last, mData.cidrlen);
+}
+
 std::string IPPrefix::toString() const noexcept {
-    return StringPrintf("%s/%d", ip().toString().c_str(), mData.cidrlen);
+    char repr[kMaxStringLength];
+    const char* end = toChars(repr, repr + sizeof(repr));
+    return std::string(repr, end ? end - repr : 0);
 }
 
 std::string IPSockAddr::toString() const noexcept {
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Parses, formats and matches a list of a few thousand mixed IPv4 / IPv6 addresses with the
+// non-allocating IPAddress / IPPrefix routines, and with the getaddrinfo(), inet_ntop() and
+// temporary IPPrefix based code they replaced (reproduced here as the *Legacy variants).
+
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "netdutils/InternetAddresses.h"
+
+namespace android {
+namespace netdutils {
+namespace {
+
+constexpr int kAddresses = 4096;
+
+const std::vector<std::string>& addressStrings() {
+    static const std::vector<std::string> sAddrs = [] {
+        std::vector<std::string> addrs;
+        for (int i = 0; i < kAddresses; i++) {
+            char buf[INET6_ADDRSTRLEN];
+            if (i % 2) {
+                const in_addr v4 = {.s_addr = htonl(0xc0a80000U + i * 7919U)};
+                inet_ntop(AF_INET, &v4, buf, sizeof(buf));
+            } else {
+                in6_addr v6 = {};
+                v6.s6_addr[0] = 0x20;
+                v6.s6_addr[1] = 0x01;
+                v6.s6_addr[2] = 0x0d;
+                v6.s6_addr[3] = 0xb8;
+                for (int b = 8; b < 16; b++) v6.s6_addr[b] = (i * (b + 13)) & 0xff;
+                inet_ntop(AF_INET6, &v6, buf, sizeof(buf));
+            }
+            addrs.push_back(buf);
+        }
+        return addrs;
+    }();
+    return sAddrs;
+}
+
+const std::vector<IPAddress>& addresses() {
+    static const std::vector<IPAddress> sAddrs = [] {
+        std::vector<IPAddress> addrs;
+        for (const std::string& s : addressStrings()) addrs.push_back(IPAddress::forString(s));
+        return addrs;
+    }();
+    return sAddrs;
+}
+
+bool forStringLegacy(const std::string& repr, IPAddress* ip) {
+    const addrinfo hints = {.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV};
+    addrinfo* res = nullptr;
+    if (getaddrinfo(repr.c_str(), nullptr, &hints, &res) != 0) return false;
+    ScopedAddrinfo cleanup(res);
+    switch (res->ai_family) {
+        case AF_INET:
+            *ip = IPAddress(reinterpret_cast<sockaddr_in*>(res->ai_addr)->sin_addr);
+            return true;
+        case AF_INET6: {
+            const auto* sin6 = reinterpret_cast<sockaddr_in6*>(res->ai_addr);
+            *ip = IPAddress(sin6->sin6_addr, sin6->sin6_scope_id);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string toStringLegacy(const IPAddress& ip) {
+    char repr[INET6_ADDRSTRLEN] = "";
+    sockaddr_storage ss = IPSockAddr(ip);
+    if (ip.family() == AF_INET) {
+        inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(&ss)->sin_addr, repr, sizeof(repr));
+    } else {
+        inet_ntop(AF_INET6, &reinterpret_cast<sockaddr_in6*>(&ss)->sin6_addr, repr, sizeof(repr));
+    }
+    return repr;
+}
+
+void setCounters(benchmark::State& state) {
+    state.SetItemsProcessed(state.iterations() * kAddresses);
+}
+
+void BM_ParseLegacy(benchmark::State& state) {
+    const auto& strs = addressStrings();
+    for (auto _ : state) {
+        for (const std::string& s : strs) {
+            IPAddress ip;
+            benchmark::DoNotOptimize(forStringLegacy(s, &ip));
+        }
+    }
+    setCounters(state);
+}
+BENCHMARK(BM_ParseLegacy);
+
+void BM_Parse(benchmark::State& state) {
+    const auto& strs = addressStrings();
+    for (auto _ : state) {
+        for (const std::string& s : strs) {
+            IPAddress ip;
+            benchmark::DoNotOptimize(IPAddress::parse(s, &ip));
+        }
+    }
+    setCounters(state);
+}
+BENCHMARK(BM_Parse);
+
+void BM_ToStringLegacy(benchmark::State& state) {
+    const auto& addrs = addresses();
+    for (auto _ : state) {
+        for (const IPAddress& ip : addrs) benchmark::DoNotOptimize(toStringLegacy(ip));
+    }
+    setCounters(state);
+}
+BENCHMARK(BM_ToStringLegacy);
+
+void BM_ToString(benchmark::State& state) {
+    const auto& addrs = addresses();
+    for (auto _ : state) {
+        for (const IPAddress& ip : addrs) benchmark::DoNotOptimize(ip.toString());
+    }
+    setCounters(state);
+}
+BENCHMARK(BM_ToString);
+
+void BM_ToChars(benchmark::State& state) {
+    const auto& addrs = addresses();
+    char buf[IPAddress::kMaxStringLength];
+    for (auto _ : state) {
+        for (const IPAddress& ip : addrs) {
+            benchmark::DoNotOptimize(ip.toChars(buf, buf + sizeof(buf)));
+        }
+    }
+    setCounters(state);
+}
+BENCHMARK(BM_ToChars);
+
+const std::vector<IPPrefix>& prefixes() {
+    static const std::vector<IPPrefix> sPrefixes = {
+            IPPrefix::forString("192.168.0.0/18"),
+            IPPrefix::forString("2001:db8::/64"),
+            IPPrefix::forString("2001:db8:0:0:8000::/65"),
+    };
+    return sPrefixes;
+}
+
+void BM_ContainsLegacy(benchmark::State& state) {
+    const auto& addrs = addresses();
+    for (auto _ : state) {
+        int matches = 0;
+        for (const IPPrefix& prefix : prefixes()) {
+            for (const IPAddress& ip : addrs) {
+                matches += IPPrefix(ip, prefix.length()).ip() == prefix.ip();
+            }
+        }
+        benchmark::DoNotOptimize(matches);
+    }
+    state.SetItemsProcessed(state.iterations() * kAddresses * prefixes().size());
+}
+BENCHMARK(BM_ContainsLegacy);
+
+void BM_Contains(benchmark::State& state) {
+    const auto& addrs = addresses();
+    for (auto _ : state) {
+        int matches = 0;
+        for (const IPPrefix& prefix : prefixes()) {
+            for (const IPAddress& ip : addrs) matches += prefix.contains(ip);
+        }
+        benchmark::DoNotOptimize(matches);
+    }
+    state.SetItemsProcessed(state.iterations() * kAddresses * prefixes().size());
+}
+BENCHMARK(BM_Contains);
+
+}  // namespace
+}  // namespace netdutils
+}  // namespace android
@@ -18,8 +18,11 @@
 #include <limits>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include <arpa/inet.h>
+
 #include <android-base/macros.h>
 #include <fmt/format.h>
 #include <gtest/gtest.h>
@@ -172,6 +175,86 @@ TEST(IPAddressTest, forString) {
     EXPECT_EQ(IPAddress(FE80_1, 1), IPAddress::forString("fe80::1%lo"));
 }
 
+TEST(IPAddressTest, parse) {
+    IPAddress ip;
+    EXPECT_TRUE(IPAddress::parse("192.0.2.1", &ip));
+    EXPECT_EQ(IPAddress::forString("192.0.2.1"), ip);
+    EXPECT_TRUE(IPAddress::parse("fe80::1%22", &ip));
+    EXPECT_EQ(IPAddress(FE80_1, 22), ip);
+    EXPECT_TRUE(IPAddress::parse("::ffff:192.0.2.1", &ip));
+    EXPECT_EQ("::ffff:192.0.2.1", ip.toString());
+
+    // Not NUL terminated.
+    const std::string_view repr("2001:db8::1/64");
+    EXPECT_TRUE(IPAddress::parse(repr.substr(0, repr.find('/')), &ip));
+    EXPECT_EQ(IPAddress::forString("2001:db8::1"), ip);
+
+    for (const char* bad : {"", ":", ":::", "1::2::3", "1:2:3:4:5:6:7:8:9", "1:2:3:4:5:6:7::8",
+                            "12345::", "::1:", ":1::", "1.2.3", "1.2.3.4.5", "256.0.0.1",
+                            "1.2.3.4%1", "::1.2.3", "1:2:3:4:5:6:7:1.2.3.4", "fe80::1%",
+                            "fe80::1%4294967296", "not_an_ip"}) {
+        SCOPED_TRACE(bad);
+        EXPECT_FALSE(IPAddress::parse(bad, &ip));
+    }
+
+    // Legacy forms only forString() accepts.
+    EXPECT_FALSE(IPAddress::parse("127.1", &ip));
+    EXPECT_EQ(IPAddress(IPV4_LOOPBACK), IPAddress::forString("127.1"));
+}
+
+TEST(IPAddressTest, parseAndFormatMatchLibc) {
+    // Zero runs in various positions exercise the "::" placement rules.
+    std::vector<in6_addr> addrs;
+    for (unsigned mask = 0; mask < 256; mask++) {
+        in6_addr v6 = {};
+        for (int w = 0; w < 8; w++) {
+            if (mask & (1 << w)) {
+                v6.s6_addr[2 * w] = (w * 37) & 0xff;
+                v6.s6_addr[2 * w + 1] = 0x10 + w;
+            }
+        }
+        addrs.push_back(v6);
+        v6.s6_addr[10] = v6.s6_addr[11] = 0xff;
+        addrs.push_back(v6);
+    }
+    for (const in6_addr& v6 : addrs) {
+        char expected[INET6_ADDRSTRLEN];
+        ASSERT_NE(nullptr, inet_ntop(AF_INET6, &v6, expected, sizeof(expected)));
+        SCOPED_TRACE(expected);
+        EXPECT_EQ(expected, IPAddress(v6).toString());
+
+        IPAddress parsed;
+        ASSERT_TRUE(IPAddress::parse(expected, &parsed));
+        EXPECT_EQ(IPAddress(v6), parsed);
+    }
+
+    for (uint32_t v4addr : {0U, 1U, 0x7f000001U, 0xc0000201U, 0x0a00ff00U, ~0U}) {
+        const in_addr v4 = {.s_addr = htonl(v4addr)};
+        char expected[INET_ADDRSTRLEN];
+        ASSERT_NE(nullptr, inet_ntop(AF_INET, &v4, expected, sizeof(expected)));
+        EXPECT_EQ(expected, IPAddress(v4).toString());
+        EXPECT_EQ(IPAddress(v4), IPAddress::forString(expected));
+    }
+}
+
+TEST(IPAddressTest, toChars) {
+    const IPAddress ip(FE80_1, 4294967295U);
+    char buf[IPAddress::kMaxStringLength];
+    const char* end = ip.toChars(buf, buf + sizeof(buf));
+    ASSERT_NE(nullptr, end);
+    EXPECT_EQ("fe80::1%4294967295", std::string(buf, end - buf));
+
+    // Too small for the scope.
+    EXPECT_EQ(nullptr, ip.toChars(buf, buf + 8));
+    EXPECT_EQ(nullptr, ip.toChars(buf, buf));
+
+    const IPPrefix prefix = IPPrefix::forString("2001:db8::/32");
+    char pbuf[IPPrefix::kMaxStringLength];
+    end = prefix.toChars(pbuf, pbuf + sizeof(pbuf));
+    ASSERT_NE(nullptr, end);
+    EXPECT_EQ("2001:db8::/32", std::string(pbuf, end - pbuf));
+}
+
 TEST(IPPrefixTest, forString) {
     IPPrefix prefix;
 
@@ -209,6 +292,20 @@ TEST(IPPrefixTest, forString) {
               IPPrefix::forString("2001:db8:1:2:3:4:5:6/126").toString());
 }
 
+TEST(IPPrefixTest, parse) {
+    IPPrefix prefix;
+    for (const char* bad : {"", "invalid", "192.0.2.0", "2001:db8::/", "2001:db8::/32z",
+                            "2001:db8::/0x20", "2001:db8::/ 32", "2001:db8::/+32",
+                            "192.0.2.0/33", "2001:db8::/129", "192.0.2.0/-1"}) {
+        SCOPED_TRACE(bad);
+        EXPECT_FALSE(IPPrefix::parse(bad, &prefix));
+    }
+    EXPECT_TRUE(IPPrefix::parse("192.0.2.131/25", &prefix));
+    EXPECT_EQ(IPPrefix::forString("192.0.2.128/25"), prefix);
+    EXPECT_TRUE(IPPrefix::parse("fe80::1%3/64", &prefix));
+    EXPECT_EQ(IPPrefix(IPAddress(FE80_1, 3), 64), prefix);
+}
+
 TEST(IPPrefixTest, IPv4Truncation) {
     const auto prefixStr = [](int length) -> std::string {
         return IPPrefix(IPAddress(IPV4_ONES), length).toString();
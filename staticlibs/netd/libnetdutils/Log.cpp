@@ -17,6 +17,7 @@
 #include "netdutils/Log.h"
 #include "netdutils/Slice.h"
 
+#include <algorithm>
 #include <chrono>
 #include <ctime>
 #include <iomanip>
@@ -27,6 +28,7 @@
 #include <log/log.h>
 
 using ::android::base::Join;
+using ::android::base::StringAppendF;
 using ::android::base::StringPrintf;
 
 namespace android {
@@ -34,13 +36,17 @@ namespace netdutils {
 
 namespace {
 
-std::string makeTimestampedEntry(const std::string& entry) {
+int64_t toNs(std::chrono::system_clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+std::string makeTimestampedEntry(const std::string& entry,
+                                 std::chrono::system_clock::time_point now) {
     using ::std::chrono::duration_cast;
     using ::std::chrono::milliseconds;
     using ::std::chrono::system_clock;
 
     std::stringstream tsEntry;
-    const auto now = system_clock::now();
     const auto time_sec = system_clock::to_time_t(now);
     tsEntry << std::put_time(std::localtime(&time_sec), "%m-%d %H:%M:%S.") << std::setw(3)
             << std::setfill('0')
@@ -50,8 +56,152 @@ std::string makeTimestampedEntry(const std::string& entry) {
     return tsEntry.str();
 }
 
+size_t roundUpToPowerOf2(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
 }  // namespace
 
+LogRing::LogRing(size_t capacity)
+    : mMask(roundUpToPowerOf2(std::max<size_t>(capacity, 1)) - 1),
+      mSlots(std::make_unique<Slot[]>(mMask + 1)) {}
+
+void LogRing::write(const Record& r) {
+    const uint64_t n = mNext.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = mSlots[n & mMask];
+
+    // Claim the slot, unless it is still being written (by a writer which has
+    // been lapped), or has already been claimed by a later record.
+    uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+    do {
+        if ((seq & 1) || seq > 2 * n) {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    } while (!slot.seq.compare_exchange_weak(seq, 2 * n + 1, std::memory_order_acquire,
+                                             std::memory_order_relaxed));
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint64_t words[WORDS] = {};
+    memcpy(words, &r, sizeof(r));
+    for (size_t i = 0; i < WORDS; i++) slot.words[i].store(words[i], std::memory_order_relaxed);
+
+    slot.seq.store(2 * n + 2, std::memory_order_release);
+}
+
+void LogRing::forEachRecord(const std::function<void(const Record&)>& fn) const {
+    const uint64_t end = mNext.load(std::memory_order_acquire);
+    const uint64_t capacity = mMask + 1;
+    const uint64_t begin = end > capacity ? end - capacity : 0;
+
+    for (uint64_t n = begin; n < end; n++) {
+        const Slot& slot = mSlots[n & mMask];
+        if (slot.seq.load(std::memory_order_acquire) != 2 * n + 2) continue;
+
+        uint64_t words[WORDS];
+        for (size_t i = 0; i < WORDS; i++) words[i] = slot.words[i].load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != 2 * n + 2) continue;
+
+        Record r;
+        memcpy(&r, words, sizeof(r));
+        fn(r);
+    }
+}
+
+std::string LogRing::Record::format() const {
+    std::string result;
+    size_t argIdx = 0;
+
+    for (const char* p = fmt; *p; p++) {
+        if (*p != '%') {
+            result += *p;
+            continue;
+        }
+        if (p[1] == '%') {
+            result += '%';
+            p++;
+            continue;
+        }
+
+        // Collect the flags, width and precision, drop any length modifier,
+        // and then format the argument as the widest type of its kind.
+        const char* const start = p;
+        std::string spec = "%";
+        const char* q = p + 1;
+        while (*q && strchr("-+ #0123456789.", *q)) spec += *q++;
+        while (*q && strchr("hljztqL", *q)) q++;
+        const char conversion = *q;
+        if (!conversion) break;
+        p = q;
+
+        if (argIdx >= numArgs) {
+            result += "<missing>";
+            continue;
+        }
+        const ArgType type = types[argIdx];
+        const uint64_t arg = args[argIdx++];
+        double d;
+        memcpy(&d, &arg, sizeof(d));
+        const char* str = type == ArgType::STRING && arg < MAX_STRING_BYTES ? strings + arg : "";
+
+        switch (conversion) {
+            case 'd':
+            case 'i':
+                if (type == ArgType::DOUBLE) {
+                    StringAppendF(&result, (spec + "lld").c_str(), static_cast<long long>(d));
+                } else {
+                    StringAppendF(&result, (spec + "lld").c_str(), static_cast<long long>(arg));
+                }
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+                StringAppendF(&result, (spec + "ll" + conversion).c_str(),
+                              static_cast<unsigned long long>(arg));
+                break;
+            case 'c':
+                StringAppendF(&result, (spec + "c").c_str(), static_cast<int>(arg));
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                if (type == ArgType::INT) d = static_cast<int64_t>(arg);
+                if (type == ArgType::UINT) d = arg;
+                StringAppendF(&result, (spec + conversion).c_str(), d);
+                break;
+            case 's':
+                if (type == ArgType::STRING) {
+                    StringAppendF(&result, (spec + "s").c_str(), str);
+                } else if (type == ArgType::INT) {
+                    StringAppendF(&result, "%lld", static_cast<long long>(arg));
+                } else if (type == ArgType::UINT) {
+                    StringAppendF(&result, "%llu", static_cast<unsigned long long>(arg));
+                } else {
+                    StringAppendF(&result, "%g", d);
+                }
+                break;
+            case 'p':
+                StringAppendF(&result, "0x%llx", static_cast<unsigned long long>(arg));
+                break;
+            default:
+                // Unsupported conversion (eg. %n), print it as is.
+                result.append(start, q + 1);
+                break;
+        }
+    }
+    return result;
+}
+
 std::string LogEntry::toString() const {
     std::vector<std::string> text;
 
@@ -180,16 +330,40 @@ Log::~Log() {
     info(LogEntry().function(__FUNCTION__));
 }
 
+LogRing* Log::initRing() {
+    std::call_once(mRingOnce, [this] {
+        mRingStorage = std::make_unique<LogRing>(mMaxEntries);
+        mRing.store(mRingStorage.get(), std::memory_order_release);
+    });
+    return mRingStorage.get();
+}
+
 void Log::forEachEntry(const std::function<void(const std::string&)>& perEntryFn) const {
     // We make a (potentially expensive) copy of the log buffer (including
     // all strings), in case the |perEntryFn| takes its sweet time.
-    std::deque<std::string> entries;
+    std::vector<Entry> entries;
     {
         std::shared_lock<std::shared_mutex> guard(mLock);
         entries.assign(mEntries.cbegin(), mEntries.cend());
     }
 
-    for (const std::string& entry : entries) perEntryFn(entry);
+    // The binary records only get formatted now, and are then merged in.
+    const LogRing* ring = mRing.load(std::memory_order_acquire);
+    if (ring != nullptr) {
+        const size_t numTextEntries = entries.size();
+        ring->forEachRecord([&entries](const LogRing::Record& r) {
+            const std::chrono::system_clock::time_point t{
+                    std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                            std::chrono::nanoseconds(r.timestampNs))};
+            entries.push_back({r.timestampNs, makeTimestampedEntry(r.format(), t)});
+        });
+        std::inplace_merge(entries.begin(), entries.begin() + numTextEntries, entries.end(),
+                           [](const Entry& a, const Entry& b) {
+                               return a.timestampNs < b.timestampNs;
+                           });
+    }
+
+    for (const Entry& entry : entries) perEntryFn(entry.text);
 }
 
 void Log::record(Log::Level lvl, const std::string& entry) {
@@ -207,8 +381,9 @@ void Log::record(Log::Level lvl, const std::string& entry) {
             break;
     }
 
+    const auto now = std::chrono::system_clock::now();
     std::lock_guard guard(mLock);
-    mEntries.push_back(makeTimestampedEntry(entry));
+    mEntries.push_back({toNs(now), makeTimestampedEntry(entry, now)});
     while (mEntries.size() > mMaxEntries) mEntries.pop_front();
 }
 
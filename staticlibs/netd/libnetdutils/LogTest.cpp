@@ -16,6 +16,11 @@
 
 #include <gtest/gtest.h>
 
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "netdutils/Log.h"
 
 android::netdutils::LogEntry globalFunctionName() {
@@ -139,5 +144,88 @@ TEST(LogEntryTest, PrintArgumentPack) {
     EXPECT_EQ("testFunc(hello, 42, false)", entry.toString());
 }
 
+namespace {
+
+std::vector<std::string> getEntries(const Log& log) {
+    std::vector<std::string> entries;
+    // Strip the "MM-DD HH:MM:SS.mmm " timestamp.
+    log.forEachEntry([&entries](const std::string& entry) { entries.push_back(entry.substr(19)); });
+    return entries;
+}
+
+template <typename... Args>
+std::string formatRecord(const char* fmt, const Args&... args) {
+    LogRing ring(1);
+    ring.record(fmt, args...);
+    std::string result;
+    ring.forEachRecord([&result](const LogRing::Record& r) { result = r.format(); });
+    return result;
+}
+
+}  // namespace
+
+TEST(LogRingTest, FormatTypes) {
+    EXPECT_EQ("no args", formatRecord("no args"));
+    EXPECT_EQ("-1 4294967295 ff 100%", formatRecord("%d %u %x 100%%", -1, 0xffffffffU, 255));
+    EXPECT_EQ("-1000 18446744073709551615", formatRecord("%lld %lu", -1000LL, UINT64_MAX));
+    EXPECT_EQ("[   42] [0x2a] [A]", formatRecord("[%5d] [%#x] [%c]", 42, 42, 'A'));
+    EXPECT_EQ("1.50 true", formatRecord("%.2f %s", 1.5, "true"));
+    EXPECT_EQ("wlan0 rmnet0", formatRecord("%s %s", std::string("wlan0"), "rmnet0"));
+    EXPECT_EQ("(null)", formatRecord("%s", static_cast<const char*>(nullptr)));
+    EXPECT_EQ("1 <missing>", formatRecord("%d %d", 1));
+}
+
+TEST(LogRingTest, TruncatesStrings) {
+    const std::string longString(2 * LogRing::MAX_STRING_BYTES, 'x');
+    const std::string result = formatRecord("%s|%s|%s", "abc", longString, "def");
+    EXPECT_EQ("abc|" + std::string(LogRing::MAX_STRING_BYTES - 5, 'x') + "|", result);
+}
+
+TEST(LogRingTest, KeepsMostRecent) {
+    LogRing ring(3);  // rounded up to 4
+    for (int i = 0; i < 10; i++) ring.record("%d", i);
+
+    std::vector<std::string> records;
+    ring.forEachRecord([&records](const LogRing::Record& r) { records.push_back(r.format()); });
+    EXPECT_EQ(std::vector<std::string>({"6", "7", "8", "9"}), records);
+    EXPECT_EQ(0U, ring.dropped());
+}
+
+TEST(LogRingTest, ConcurrentWriters) {
+    constexpr int kThreads = 4;
+    constexpr int kRecordsPerThread = 10000;
+    LogRing ring(64);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&ring, t] {
+            for (int i = 0; i < kRecordsPerThread; i++) ring.record("%d %d %s", t, i, "x");
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    size_t count = 0;
+    ring.forEachRecord([&count](const LogRing::Record& r) {
+        int t, i;
+        char x;
+        // Every record read back must be intact.
+        EXPECT_EQ(3, sscanf(r.format().c_str(), "%d %d %c", &t, &i, &x));
+        EXPECT_EQ('x', x);
+        count++;
+    });
+    EXPECT_LE(count, 64U);
+    EXPECT_GE(count + ring.dropped(), 1U);
+}
+
+TEST(LogTest, MergesFastEntries) {
+    Log log("LogTest", 4);
+    log.log("first");
+    log.logFast("second %d", 2);
+    log.log("third");
+    log.logFast("fourth %s", "4");
+    EXPECT_EQ(std::vector<std::string>({"first", "second 2", "third", "fourth 4"}),
+              getEntries(log));
+}
+
 }  // namespace netdutils
 }  // namespace android
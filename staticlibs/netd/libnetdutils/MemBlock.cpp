@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "netdutils/MemBlock.h"
+
+#include <cstring>
+
+namespace android {
+namespace netdutils {
+
+PooledMemBlock& PooledMemBlock::operator=(PooledMemBlock&& other) noexcept {
+    if (this != &other) {
+        reset();
+        std::swap(mPool, other.mPool);
+        std::swap(mData, other.mData);
+        std::swap(mLen, other.mLen);
+        std::swap(mSizeClass, other.mSizeClass);
+    }
+    return *this;
+}
+
+void PooledMemBlock::reset() {
+    if (mData != nullptr) {
+        mPool->release(mData, mSizeClass);
+    }
+    mPool = nullptr;
+    mData = nullptr;
+    mLen = 0;
+    mSizeClass = 0;
+}
+
+MemBlockPool::MemBlockPool(size_t maxCachedPerClass) : mMaxCachedPerClass(maxCachedPerClass) {}
+
+MemBlockPool::~MemBlockPool() {
+    trim();
+}
+
+size_t MemBlockPool::sizeClassOf(size_t len) {
+    if (len > kMaxBlockSize) return kUnpooled;
+    size_t sizeClass = 0;
+    while (classSize(sizeClass) < len) sizeClass++;
+    return sizeClass;
+}
+
+PooledMemBlock MemBlockPool::acquire(size_t len, Init init) {
+    if (len == 0) return PooledMemBlock();
+
+    const size_t sizeClass = sizeClassOf(len);
+    uint8_t* data = nullptr;
+    {
+        std::lock_guard guard(mMutex);
+        if (sizeClass != kUnpooled && !mFree[sizeClass].empty()) {
+            data = mFree[sizeClass].back();
+            mFree[sizeClass].pop_back();
+            mStats.cachedBytes -= classSize(sizeClass);
+            mStats.reuses++;
+        } else {
+            mStats.allocations++;
+        }
+    }
+    if (data == nullptr) {
+        data = new uint8_t[sizeClass == kUnpooled ? len : classSize(sizeClass)];
+    }
+    if (init == Init::ZERO) memset(data, 0, len);
+    return PooledMemBlock(this, data, len, sizeClass);
+}
+
+void MemBlockPool::release(uint8_t* data, size_t sizeClass) {
+    {
+        std::lock_guard guard(mMutex);
+        if (sizeClass != kUnpooled && mFree[sizeClass].size() < mMaxCachedPerClass) {
+            mFree[sizeClass].push_back(data);
+            mStats.cachedBytes += classSize(sizeClass);
+            return;
+        }
+        mStats.frees++;
+    }
+    delete[] data;
+}
+
+MemBlockPool::Stats MemBlockPool::getStats() const {
+    std::lock_guard guard(mMutex);
+    return mStats;
+}
+
+void MemBlockPool::trim() {
+    std::array<std::vector<uint8_t*>, kNumClasses> freed;
+    {
+        std::lock_guard guard(mMutex);
+        freed.swap(mFree);
+        mStats.cachedBytes = 0;
+    }
+    for (const auto& list : freed) {
+        for (uint8_t* data : list) delete[] data;
+    }
+}
+
+}  // namespace netdutils
+}  // namespace android
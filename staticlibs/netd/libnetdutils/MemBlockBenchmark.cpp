@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Cost of getting a fresh I/O buffer per packet / netlink datagram: a new zeroed MemBlock,
+// a new uninitialized MemBlock, and a recycled PooledMemBlock with and without zero-fill.
+//
+// Every iteration writes the first and last byte, as a recv() would.
+
+#include <benchmark/benchmark.h>
+
+#include "netdutils/MemBlock.h"
+
+namespace android {
+namespace netdutils {
+namespace {
+
+void touch(const Slice s) {
+    s.base()[0] = 1;
+    s.base()[s.size() - 1] = 1;
+    benchmark::DoNotOptimize(s.base());
+    benchmark::ClobberMemory();
+}
+
+void setCounters(benchmark::State& state, uint64_t allocations) {
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+    state.counters["allocations"] = allocations;
+    state.counters["allocations_per_iteration"] =
+            static_cast<double>(allocations) / state.iterations();
+}
+
+void BM_MemBlock(benchmark::State& state) {
+    const size_t len = state.range(0);
+    for (auto _ : state) {
+        MemBlock block(len);
+        touch(block);
+    }
+    setCounters(state, state.iterations());
+}
+
+void BM_MemBlockUninitialized(benchmark::State& state) {
+    const size_t len = state.range(0);
+    for (auto _ : state) {
+        MemBlock block = MemBlock::uninitialized(len);
+        touch(block);
+    }
+    setCounters(state, state.iterations());
+}
+
+void pooled(benchmark::State& state, MemBlockPool& pool, MemBlockPool::Init init) {
+    const size_t len = state.range(0);
+    const uint64_t before = pool.getStats().allocations;
+    for (auto _ : state) {
+        PooledMemBlock block = pool.acquire(len, init);
+        touch(block);
+    }
+    setCounters(state, pool.getStats().allocations - before);
+}
+
+void pooled(benchmark::State& state, MemBlockPool::Init init) {
+    MemBlockPool pool;
+    pooled(state, pool, init);
+}
+
+void BM_PooledMemBlock(benchmark::State& state) {
+    pooled(state, MemBlockPool::Init::ZERO);
+}
+
+void BM_PooledMemBlockUninitialized(benchmark::State& state) {
+    pooled(state, MemBlockPool::Init::NONE);
+}
+
+// All threads share one pool, as the users of a process wide pool would.
+void BM_SharedPooledMemBlock(benchmark::State& state) {
+    static MemBlockPool sPool;
+    pooled(state, sPool, MemBlockPool::Init::NONE);
+}
+
+// A DNS packet, a netlink datagram, and a 64 KiB GRO'd receive.
+#define MEMBLOCK_SIZES ->ArgName("bytes")->Arg(512)->Arg(8192)->Arg(65536)
+
+BENCHMARK(BM_MemBlock) MEMBLOCK_SIZES;
+BENCHMARK(BM_MemBlockUninitialized) MEMBLOCK_SIZES;
+BENCHMARK(BM_PooledMemBlock) MEMBLOCK_SIZES;
+BENCHMARK(BM_PooledMemBlockUninitialized) MEMBLOCK_SIZES;
+BENCHMARK(BM_SharedPooledMemBlock) MEMBLOCK_SIZES->Threads(1)->Threads(4);
+
+}  // namespace
+}  // namespace netdutils
+}  // namespace android
@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <utility>
 
 #include <gtest/gtest.h>
@@ -142,5 +143,83 @@ TEST(MemBlockTest, ImplicitCastToSlice) {
     ASSERT_NO_FATAL_FAILURE(checkHelloMello(dataCopy, dataSlice));
 }
 
+TEST(MemBlockTest, Uninitialized) {
+    MemBlock block = MemBlock::uninitialized(DNS_PACKET_SIZE);
+    EXPECT_EQ(DNS_PACKET_SIZE, block.get().size());
+    EXPECT_NE(nullptr, block.get().base());
+    EXPECT_EQ(nullptr, MemBlock::uninitialized(0).get().base());
+}
+
+TEST(MemBlockPoolTest, RecyclesBuffers) {
+    MemBlockPool pool;
+    uint8_t* first;
+    {
+        PooledMemBlock block = pool.acquire(DNS_PACKET_SIZE);
+        EXPECT_EQ(DNS_PACKET_SIZE, block.get().size());
+        first = block.get().base();
+    }
+    EXPECT_EQ(1U, pool.getStats().allocations);
+    EXPECT_EQ(DNS_PACKET_SIZE, pool.getStats().cachedBytes);
+
+    // Same size class, so the same memory comes back.
+    for (int i = 0; i < 10; i++) {
+        PooledMemBlock block = pool.acquire(DNS_PACKET_SIZE - 10);
+        EXPECT_EQ(first, block.get().base());
+    }
+    const MemBlockPool::Stats stats = pool.getStats();
+    EXPECT_EQ(1U, stats.allocations);
+    EXPECT_EQ(10U, stats.reuses);
+    EXPECT_EQ(0U, stats.frees);
+}
+
+TEST(MemBlockPoolTest, ZeroFill) {
+    MemBlockPool pool;
+    {
+        PooledMemBlock block = pool.acquire(DNS_PACKET_SIZE);
+        memset(block.get().base(), ARBITRARY_VALUE, DNS_PACKET_SIZE);
+    }
+    {
+        PooledMemBlock block = pool.acquire(DNS_PACKET_SIZE, MemBlockPool::Init::NONE);
+        EXPECT_EQ(ARBITRARY_VALUE, block.get().base()[DNS_PACKET_SIZE - 1]);
+    }
+    PooledMemBlock block = pool.acquire(DNS_PACKET_SIZE);
+    ASSERT_NO_FATAL_FAILURE(checkAllZeros(block));
+}
+
+TEST(MemBlockPoolTest, BoundedCache) {
+    MemBlockPool pool(2);
+    {
+        PooledMemBlock a = pool.acquire(100);
+        PooledMemBlock b = pool.acquire(100);
+        PooledMemBlock c = pool.acquire(100);
+        PooledMemBlock huge = pool.acquire(MemBlockPool::kMaxBlockSize + 1);
+        EXPECT_EQ(MemBlockPool::kMaxBlockSize + 1, huge.get().size());
+    }
+    MemBlockPool::Stats stats = pool.getStats();
+    EXPECT_EQ(4U, stats.allocations);
+    // One of a, b, c does not fit in the cache and neither does the unpooled block.
+    EXPECT_EQ(2U, stats.frees);
+    EXPECT_EQ(256U, stats.cachedBytes);
+
+    pool.trim();
+    EXPECT_EQ(0U, pool.getStats().cachedBytes);
+}
+
+TEST(MemBlockPoolTest, MoveAndReset) {
+    MemBlockPool pool;
+    PooledMemBlock empty = pool.acquire(0);
+    EXPECT_TRUE(empty.get().empty());
+
+    PooledMemBlock block = pool.acquire(DNS_PACKET_SIZE);
+    uint8_t* data = block.get().base();
+    PooledMemBlock moved = std::move(block);
+    EXPECT_EQ(data, moved.get().base());
+    EXPECT_EQ(0U, pool.getStats().cachedBytes);
+
+    moved.reset();
+    EXPECT_TRUE(moved.get().empty());
+    EXPECT_EQ(DNS_PACKET_SIZE, pool.getStats().cachedBytes);
+}
+
 }  // namespace netdutils
 }  // namespace android
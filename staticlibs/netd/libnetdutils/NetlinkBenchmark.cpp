@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares parsing a large RTM_GETLINK / RTM_GETNEIGH dump with the std::function based
+// forEachNetlink{Message,Attribute}() against the in-place NetlinkMessage iterators.
+//
+// The dumps are synthesized so that results are comparable across devices.
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <linux/neighbour.h>
+#include <linux/rtnetlink.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <benchmark/benchmark.h>
+
+#include "netdutils/Netlink.h"
+
+namespace android {
+namespace netdutils {
+namespace {
+
+constexpr int kMessages = 1000;
+
+class DumpBuilder {
+  public:
+    template <typename FamilyT>
+    void beginMessage(const FamilyT& family) {
+        mStart = mBuf.size();
+        mBuf.resize(mStart + NLMSG_HDRLEN);
+        append(&family, sizeof(family));
+    }
+
+    void attr(uint16_t type, const void* data, size_t len) {
+        const nlattr hdr = {.nla_len = static_cast<uint16_t>(NLA_HDRLEN + len), .nla_type = type};
+        append(&hdr, sizeof(hdr));
+        append(data, len);
+    }
+
+    template <typename T>
+    void attr(uint16_t type, const T& value) {
+        attr(type, &value, sizeof(value));
+    }
+
+    void endMessage(uint16_t type) {
+        const nlmsghdr hdr = {.nlmsg_len = static_cast<uint32_t>(mBuf.size() - mStart),
+                              .nlmsg_type = type,
+                              .nlmsg_flags = NLM_F_MULTI};
+        memcpy(&mBuf[mStart], &hdr, sizeof(hdr));
+    }
+
+    const Slice slice() { return Slice(mBuf.data(), mBuf.size()); }
+
+  private:
+    void append(const void* data, size_t len) {
+        const auto* p = reinterpret_cast<const uint8_t*>(data);
+        mBuf.insert(mBuf.end(), p, p + len);
+        mBuf.resize(NLMSG_ALIGN(mBuf.size()));
+    }
+
+    std::vector<uint8_t> mBuf;
+    size_t mStart = 0;
+};
+
+std::vector<uint8_t> gLinkDump;
+std::vector<uint8_t> gNeighDump;
+
+const Slice linkDump() {
+    if (gLinkDump.empty()) {
+        DumpBuilder b;
+        for (int i = 0; i < kMessages; i++) {
+            b.beginMessage(ifinfomsg{.ifi_family = AF_UNSPEC, .ifi_index = i + 1});
+            const std::string name = "rmnet_data" + std::to_string(i);
+            b.attr(IFLA_IFNAME, name.c_str(), name.size() + 1);
+            b.attr(IFLA_TXQLEN, uint32_t{1000});
+            b.attr(IFLA_OPERSTATE, uint8_t{6});
+            b.attr(IFLA_MTU, uint32_t{1500});
+            b.attr(IFLA_GROUP, uint32_t{0});
+            b.attr(IFLA_ADDRESS, std::array<uint8_t, 6>{0x02, 0, 0, 0, 0, uint8_t(i)});
+            b.attr(IFLA_BROADCAST, std::array<uint8_t, 6>{0xff, 0xff, 0xff, 0xff, 0xff, 0xff});
+            b.attr(IFLA_STATS64, rtnl_link_stats64{});
+            b.endMessage(RTM_NEWLINK);
+        }
+        b.beginMessage(uint32_t{0});
+        b.endMessage(NLMSG_DONE);
+        gLinkDump.assign(b.slice().base(), b.slice().limit());
+    }
+    return Slice(gLinkDump.data(), gLinkDump.size());
+}
+
+const Slice neighDump() {
+    if (gNeighDump.empty()) {
+        DumpBuilder b;
+        for (int i = 0; i < kMessages; i++) {
+            b.beginMessage(ndmsg{.ndm_family = AF_INET6, .ndm_ifindex = 3,
+                                 .ndm_state = NUD_REACHABLE});
+            std::array<uint8_t, 16> dst = {0xfe, 0x80};
+            dst[14] = i >> 8;
+            dst[15] = i & 0xff;
+            b.attr(NDA_DST, dst);
+            b.attr(NDA_LLADDR, std::array<uint8_t, 6>{0x02, 0, 0, 0, uint8_t(i >> 8), uint8_t(i)});
+            b.attr(NDA_PROBES, uint32_t{1});
+            b.attr(NDA_CACHEINFO, nda_cacheinfo{});
+            b.endMessage(RTM_NEWNEIGH);
+        }
+        b.beginMessage(uint32_t{0});
+        b.endMessage(NLMSG_DONE);
+        gNeighDump.assign(b.slice().base(), b.slice().limit());
+    }
+    return Slice(gNeighDump.data(), gNeighDump.size());
+}
+
+// Sums the MTUs and ifname lengths, which touches every attribute header.
+void BM_LinkDumpForEach(benchmark::State& state) {
+    const Slice dump = linkDump();
+    for (auto _ : state) {
+        uint64_t sum = 0;
+        forEachNetlinkMessage(dump, [&sum](const nlmsghdr& hdr, const Slice msg) {
+            if (hdr.nlmsg_type != RTM_NEWLINK) return;
+            forEachNetlinkAttribute(drop(msg, NLMSG_ALIGN(sizeof(ifinfomsg))),
+                                    [&sum](const nlattr& attr, const Slice payload) {
+                                        if (attr.nla_type == IFLA_MTU) {
+                                            uint32_t mtu = 0;
+                                            extract(payload, mtu);
+                                            sum += mtu;
+                                        } else if (attr.nla_type == IFLA_IFNAME) {
+                                            sum += strnlen(reinterpret_cast<char*>(
+                                                                   payload.base()),
+                                                           payload.size());
+                                        }
+                                    });
+        });
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() * dump.size());
+    state.SetItemsProcessed(state.iterations() * kMessages);
+}
+BENCHMARK(BM_LinkDumpForEach);
+
+void BM_LinkDumpIterator(benchmark::State& state) {
+    const Slice dump = linkDump();
+    for (auto _ : state) {
+        uint64_t sum = 0;
+        for (const NetlinkMessage msg : netlinkMessages(dump)) {
+            if (msg.type() != RTM_NEWLINK) continue;
+            for (const NetlinkAttribute attr : msg.attributes<ifinfomsg>()) {
+                if (attr.type() == IFLA_MTU) {
+                    sum += attr.value<uint32_t>().value_or(0);
+                } else if (attr.type() == IFLA_IFNAME) {
+                    sum += attr.string().size();
+                }
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() * dump.size());
+    state.SetItemsProcessed(state.iterations() * kMessages);
+}
+BENCHMARK(BM_LinkDumpIterator);
+
+// Sums the last byte of every neighbour's NDA_DST.
+void BM_NeighDumpForEach(benchmark::State& state) {
+    const Slice dump = neighDump();
+    for (auto _ : state) {
+        uint64_t sum = 0;
+        forEachNetlinkMessage(dump, [&sum](const nlmsghdr& hdr, const Slice msg) {
+            if (hdr.nlmsg_type != RTM_NEWNEIGH) return;
+            forEachNetlinkAttribute(drop(msg, NLMSG_ALIGN(sizeof(ndmsg))),
+                                    [&sum](const nlattr& attr, const Slice payload) {
+                                        if (attr.nla_type != NDA_DST) return;
+                                        in6_addr dst = {};
+                                        extract(payload, dst);
+                                        sum += dst.s6_addr[15];
+                                    });
+        });
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() * dump.size());
+    state.SetItemsProcessed(state.iterations() * kMessages);
+}
+BENCHMARK(BM_NeighDumpForEach);
+
+void BM_NeighDumpIterator(benchmark::State& state) {
+    const Slice dump = neighDump();
+    for (auto _ : state) {
+        uint64_t sum = 0;
+        for (const NetlinkMessage msg : netlinkMessages(dump)) {
+            if (msg.type() != RTM_NEWNEIGH) continue;
+            for (const NetlinkAttribute attr : msg.attributes<ndmsg>()) {
+                if (attr.type() != NDA_DST) continue;
+                sum += attr.value<in6_addr>().value_or(in6_addr{}).s6_addr[15];
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() * dump.size());
+    state.SetItemsProcessed(state.iterations() * kMessages);
+}
+BENCHMARK(BM_NeighDumpIterator);
+
+}  // namespace
+}  // namespace netdutils
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <linux/rtnetlink.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include <gtest/gtest.h>
+
+#include "netdutils/NetlinkListener.h"
+#include "netdutils/Status.h"
+
+namespace android {
+namespace netdutils {
+namespace {
+
+constexpr int kDumps = 20;
+
+// Issues RTM_GETLINK dumps one at a time (the kernel refuses concurrent dumps on one
+// socket) and counts the replies.
+void dumpLinks(const NetlinkListener::Options& options) {
+    UniqueFd sock(socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_ROUTE));
+    UniqueFd event(eventfd(0, EFD_CLOEXEC));
+    ASSERT_TRUE(isWellFormed(sock));
+    ASSERT_TRUE(isWellFormed(event));
+    NetlinkListener listener(std::move(event), std::move(sock), "nltest", options);
+
+    std::atomic<int> links = 0;
+    std::atomic<int> done = 0;
+    EXPECT_OK(listener.subscribe(RTM_NEWLINK, [&](const nlmsghdr&, const Slice) { links++; }));
+    EXPECT_OK(listener.subscribe(NLMSG_DONE, [&](const nlmsghdr&, const Slice) { done++; }));
+
+    for (int i = 0; i < kDumps; i++) {
+        struct {
+            nlmsghdr hdr;
+            ifinfomsg ifi;
+        } req = {};
+        req.hdr.nlmsg_len = sizeof(req);
+        req.hdr.nlmsg_type = RTM_GETLINK;
+        req.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        req.hdr.nlmsg_seq = i + 1;
+        req.ifi.ifi_family = AF_UNSPEC;
+        ASSERT_OK(listener.send(makeSlice(req)));
+        for (int wait = 0; done <= i && wait < 1000; wait++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        ASSERT_EQ(i + 1, done);
+    }
+
+    // Every dump contains at least the loopback interface.
+    EXPECT_LE(kDumps, links);
+    EXPECT_OK(listener.unsubscribe(RTM_NEWLINK));
+
+    const NetlinkListener::Stats stats = listener.getStats();
+    EXPECT_EQ(static_cast<uint64_t>(links + done), stats.messages);
+    EXPECT_LE(static_cast<uint64_t>(kDumps), stats.datagrams);
+    EXPECT_LE(stats.recvCalls, stats.datagrams);
+    EXPECT_LT(0U, stats.bytes);
+    EXPECT_EQ(0U, stats.overruns);
+    EXPECT_EQ(0U, stats.truncated);
+}
+
+}  // namespace
+
+TEST(NetlinkListener, dispatchOneAtATime) {
+    dumpLinks(NetlinkListener::defaultOptions());
+}
+
+TEST(NetlinkListener, dispatchBatched) {
+    dumpLinks(NetlinkListener::highThroughputOptions());
+}
+
+}  // namespace netdutils
+}  // namespace android
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <linux/rtnetlink.h>
+#include <sys/socket.h>
+
+#include <gtest/gtest.h>
+
+#include "netdutils/Netlink.h"
+
+namespace android {
+namespace netdutils {
+namespace {
+
+void appendAttr(std::vector<uint8_t>& buf, uint16_t type, const void* data, size_t len) {
+    const nlattr hdr = {.nla_len = static_cast<uint16_t>(NLA_HDRLEN + len), .nla_type = type};
+    const auto* p = reinterpret_cast<const uint8_t*>(&hdr);
+    buf.insert(buf.end(), p, p + sizeof(hdr));
+    p = reinterpret_cast<const uint8_t*>(data);
+    buf.insert(buf.end(), p, p + len);
+    buf.resize(NLA_ALIGN(buf.size()));
+}
+
+// An RTM_NEWLINK message with an ifname, an MTU and a nested IFLA_LINKINFO.
+std::vector<uint8_t> makeLink(int ifindex, const std::string& name, uint32_t mtu) {
+    std::vector<uint8_t> buf(NLMSG_HDRLEN + NLMSG_ALIGN(sizeof(ifinfomsg)));
+    const ifinfomsg ifi = {.ifi_family = AF_UNSPEC, .ifi_index = ifindex};
+    memcpy(&buf[NLMSG_HDRLEN], &ifi, sizeof(ifi));
+    appendAttr(buf, IFLA_IFNAME, name.c_str(), name.size() + 1);
+    appendAttr(buf, IFLA_MTU, &mtu, sizeof(mtu));
+    std::vector<uint8_t> nested;
+    appendAttr(nested, IFLA_INFO_KIND, "dummy", 6);
+    appendAttr(buf, IFLA_LINKINFO | NLA_F_NESTED, nested.data(), nested.size());
+
+    const nlmsghdr hdr = {.nlmsg_len = static_cast<uint32_t>(buf.size()),
+                          .nlmsg_type = RTM_NEWLINK};
+    memcpy(buf.data(), &hdr, sizeof(hdr));
+    return buf;
+}
+
+}  // namespace
+
+TEST(Netlink, iterateMessagesAndAttributes) {
+    std::vector<uint8_t> dump = makeLink(1, "lo", 65536);
+    const std::vector<uint8_t> second = makeLink(7, "wlan0", 1500);
+    dump.insert(dump.end(), second.begin(), second.end());
+
+    std::vector<std::string> names;
+    std::vector<uint32_t> mtus;
+    std::vector<int> indexes;
+    for (const NetlinkMessage msg : netlinkMessages(Slice(dump.data(), dump.size()))) {
+        EXPECT_EQ(RTM_NEWLINK, msg.type());
+        indexes.push_back(msg.family<ifinfomsg>().value().ifi_index);
+        for (const NetlinkAttribute attr : msg.attributes<ifinfomsg>()) {
+            switch (attr.type()) {
+                case IFLA_IFNAME:
+                    names.emplace_back(attr.string());
+                    break;
+                case IFLA_MTU:
+                    mtus.push_back(attr.value<uint32_t>().value());
+                    break;
+                case IFLA_LINKINFO: {
+                    EXPECT_TRUE(attr.isNested());
+                    const auto kind = findNetlinkAttribute(attr.payload(), IFLA_INFO_KIND);
+                    ASSERT_TRUE(kind.has_value());
+                    EXPECT_EQ("dummy", kind->string());
+                    break;
+                }
+            }
+        }
+    }
+    EXPECT_EQ((std::vector<int>{1, 7}), indexes);
+    EXPECT_EQ((std::vector<std::string>{"lo", "wlan0"}), names);
+    EXPECT_EQ((std::vector<uint32_t>{65536, 1500}), mtus);
+}
+
+TEST(Netlink, truncatedInput) {
+    // A final message cut short is clipped to the buffer, and trailing bytes too short to
+    // hold a header are ignored.
+    const std::vector<uint8_t> first = makeLink(1, "lo", 65536);
+    const std::vector<uint8_t> second = makeLink(7, "wlan0", 1500);
+    std::vector<uint8_t> dump = first;
+    dump.insert(dump.end(), second.begin(), second.end() - 8);
+    const Slice buf(dump.data(), dump.size());
+
+    std::vector<std::pair<uint32_t, size_t>> msgs;
+    forEachNetlinkMessage(buf, [&](const nlmsghdr& hdr, const Slice payload) {
+        msgs.emplace_back(hdr.nlmsg_len, payload.size());
+    });
+    const std::vector<std::pair<uint32_t, size_t>> expected = {
+            {first.size(), first.size() - NLMSG_HDRLEN},
+            {second.size(), second.size() - 8 - NLMSG_HDRLEN},
+    };
+    EXPECT_EQ(expected, msgs);
+
+    std::vector<uint8_t> tail(sizeof(nlattr) - 1);
+    EXPECT_TRUE(netlinkAttributes(Slice(tail.data(), tail.size())).empty());
+    EXPECT_TRUE(netlinkMessages(Slice()).empty());
+}
+
+TEST(Netlink, shortValues) {
+    std::vector<uint8_t> buf;
+    const uint16_t small = 3;
+    appendAttr(buf, IFLA_MTU, &small, sizeof(small));
+    const auto attr = findNetlinkAttribute(Slice(buf.data(), buf.size()), IFLA_MTU);
+    ASSERT_TRUE(attr.has_value());
+    EXPECT_FALSE(attr->value<uint32_t>().has_value());
+    EXPECT_EQ(small, attr->value<uint16_t>().value());
+    EXPECT_FALSE(findNetlinkAttribute(Slice(buf.data(), buf.size()), IFLA_IFNAME).has_value());
+}
+
+}  // namespace netdutils
+}  // namespace android
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "netdutils/InternetAddresses.h"
+#include "netdutils/PrefixTable.h"
+
+namespace android {
+namespace netdutils {
+
+namespace {
+
+IPPrefix prefix(const std::string& s) {
+    IPPrefix p;
+    EXPECT_TRUE(IPPrefix::forString(s, &p)) << s;
+    return p;
+}
+
+IPAddress addr(const std::string& s) {
+    IPAddress ip;
+    EXPECT_TRUE(IPAddress::forString(s, &ip)) << s;
+    return ip;
+}
+
+// Reference longest prefix match, by linear scan.
+const int* slowLookup(const std::map<IPPrefix, int>& prefixes, const IPAddress& ip) {
+    const int* best = nullptr;
+    int bestLength = -1;
+    for (const auto& [p, value] : prefixes) {
+        if (p.contains(ip) && p.length() > bestLength) {
+            best = &value;
+            bestLength = p.length();
+        }
+    }
+    return best;
+}
+
+IPAddress randomAddress(std::mt19937& rng, bool v6) {
+    if (!v6) {
+        return IPAddress(in_addr{.s_addr = static_cast<in_addr_t>(rng())});
+    }
+    in6_addr v6addr;
+    for (int i = 0; i < 16; i++) v6addr.s6_addr[i] = rng();
+    // Keep the top bits shared, so that prefixes nest.
+    v6addr.s6_addr[0] = 0x20;
+    v6addr.s6_addr[1] = 0x01;
+    return IPAddress(v6addr);
+}
+
+}  // namespace
+
+TEST(PrefixTableTest, LongestMatchWins) {
+    PrefixTable<int> table;
+    EXPECT_TRUE(table.insert(prefix("0.0.0.0/0"), 0));
+    EXPECT_TRUE(table.insert(prefix("10.0.0.0/8"), 8));
+    EXPECT_TRUE(table.insert(prefix("10.1.0.0/16"), 16));
+    EXPECT_TRUE(table.insert(prefix("10.1.2.3/32"), 32));
+    EXPECT_TRUE(table.insert(prefix("2001:db8::/32"), 632));
+    EXPECT_TRUE(table.insert(prefix("2001:db8:1::/48"), 648));
+    EXPECT_EQ(6U, table.size());
+
+    EXPECT_EQ(0, *table.lookup(addr("192.0.2.1")));
+    EXPECT_EQ(8, *table.lookup(addr("10.2.0.1")));
+    EXPECT_EQ(16, *table.lookup(addr("10.1.2.4")));
+    EXPECT_EQ(32, *table.lookup(addr("10.1.2.3")));
+    EXPECT_EQ(632, *table.lookup(addr("2001:db8:2::1")));
+    EXPECT_EQ(648, *table.lookup(addr("2001:db8:1::1")));
+    EXPECT_EQ(648, *table.lookup(addr("2001:db8:1::1%3")));
+    EXPECT_EQ(nullptr, table.lookup(addr("2002::1")));
+    EXPECT_EQ(nullptr, table.lookup(IPAddress()));
+
+    // Replacing a value keeps the prefix.
+    EXPECT_TRUE(table.insert(prefix("10.1.0.0/16"), 17));
+    EXPECT_EQ(17, *table.lookup(addr("10.1.2.4")));
+    EXPECT_EQ(6U, table.size());
+
+    // Removal falls back to the next longest prefix.
+    EXPECT_TRUE(table.remove(prefix("10.1.0.0/16")));
+    EXPECT_FALSE(table.remove(prefix("10.1.0.0/16")));
+    EXPECT_EQ(8, *table.lookup(addr("10.1.2.4")));
+    EXPECT_EQ(32, *table.lookup(addr("10.1.2.3")));
+    EXPECT_TRUE(table.remove(prefix("10.0.0.0/8")));
+    EXPECT_EQ(0, *table.lookup(addr("10.1.2.4")));
+    EXPECT_TRUE(table.remove(prefix("0.0.0.0/0")));
+    EXPECT_EQ(nullptr, table.lookup(addr("10.1.2.4")));
+    EXPECT_EQ(32, *table.lookup(addr("10.1.2.3")));
+}
+
+TEST(PrefixTableTest, MatchesLinearScan) {
+    std::mt19937 rng(42);
+    PrefixTable<int> table;
+    std::map<IPPrefix, int> reference;
+
+    for (int round = 0; round < 2000; round++) {
+        const bool v6 = rng() & 1;
+        const int length = v6 ? 16 + rng() % 113 : rng() % 33;
+        const IPPrefix p(randomAddress(rng, v6), length);
+        if (reference.count(p) && (rng() & 1)) {
+            EXPECT_TRUE(table.remove(p));
+            reference.erase(p);
+        } else {
+            EXPECT_TRUE(table.insert(p, round));
+            reference[p] = round;
+        }
+    }
+    ASSERT_EQ(reference.size(), table.size());
+    table.publish();
+    const auto snapshot = table.snapshot();
+
+    std::vector<IPAddress> addrs;
+    for (const auto& [p, value] : reference) {
+        // Each prefix's own address, and a random one of the same family.
+        addrs.push_back(p.ip());
+        addrs.push_back(randomAddress(rng, p.family() == AF_INET6));
+    }
+    std::vector<const int*> batch(addrs.size());
+    snapshot->lookup(addrs.data(), addrs.size(), batch.data());
+    for (size_t i = 0; i < addrs.size(); i++) {
+        const int* expected = slowLookup(reference, addrs[i]);
+        const int* actual = table.lookup(addrs[i]);
+        const int* fromSnapshot = snapshot->lookup(addrs[i]);
+        if (expected == nullptr) {
+            EXPECT_EQ(nullptr, actual) << addrs[i];
+            EXPECT_EQ(nullptr, fromSnapshot) << addrs[i];
+            EXPECT_EQ(nullptr, batch[i]) << addrs[i];
+        } else {
+            ASSERT_NE(nullptr, actual) << addrs[i];
+            ASSERT_NE(nullptr, fromSnapshot) << addrs[i];
+            ASSERT_NE(nullptr, batch[i]) << addrs[i];
+            EXPECT_EQ(*expected, *actual) << addrs[i];
+            EXPECT_EQ(*expected, *fromSnapshot) << addrs[i];
+            EXPECT_EQ(*expected, *batch[i]) << addrs[i];
+        }
+    }
+
+    for (const auto& [p, value] : reference) EXPECT_TRUE(table.remove(p));
+    EXPECT_EQ(0U, table.size());
+    for (const IPAddress& ip : addrs) EXPECT_EQ(nullptr, table.lookup(ip));
+}
+
+TEST(PrefixTableTest, SnapshotsAreImmutable) {
+    PrefixTable<std::string> table;
+    EXPECT_EQ(0U, table.snapshot()->size());
+    EXPECT_EQ(nullptr, table.snapshot()->lookup(addr("192.0.2.1")));
+
+    table.insert(prefix("192.0.2.0/24"), "old");
+    table.publish();
+    const auto before = table.snapshot();
+    table.insert(prefix("192.0.2.0/24"), "new");
+    table.insert(prefix("198.51.100.0/24"), "other");
+    EXPECT_EQ("old", *before->lookup(addr("192.0.2.1")));
+    EXPECT_EQ(nullptr, before->lookup(addr("198.51.100.1")));
+
+    table.publish();
+    EXPECT_EQ("new", *table.snapshot()->lookup(addr("192.0.2.1")));
+    EXPECT_EQ("old", *before->lookup(addr("192.0.2.1")));
+}
+
+TEST(PrefixTableTest, ConcurrentReaders) {
+    PrefixTable<int> table;
+    table.insert(prefix("0.0.0.0/0"), 0);
+    table.publish();
+    std::atomic<bool> done = false;
+    std::thread reader([&] {
+        const IPAddress ip = addr("10.1.2.3");
+        while (!done) {
+            const int* value = table.snapshot()->lookup(ip);
+            ASSERT_NE(nullptr, value);
+        }
+    });
+    for (int i = 1; i < 500; i++) {
+        table.insert(IPPrefix(addr("10.1.2.3"), i % 33), i);
+        table.publish();
+    }
+    done = true;
+    reader.join();
+}
+
+TEST(PrefixTableTest, BpfLpmEntries) {
+    PrefixTable<int> table;
+    table.insert(prefix("192.0.2.128/25"), 1);
+    table.insert(prefix("2001:db8::/32"), 2);
+
+    int count4 = 0;
+    table.forEachBpfLpmEntry4([&](const BpfLpmKey4& key, int value) {
+        EXPECT_EQ(25U, key.prefixlen);
+        const uint8_t expected[] = {192, 0, 2, 128};
+        EXPECT_EQ(0, memcmp(expected, key.data, sizeof(expected)));
+        EXPECT_EQ(1, value);
+        count4++;
+    });
+    EXPECT_EQ(1, count4);
+
+    int count6 = 0;
+    table.forEachBpfLpmEntry6([&](const BpfLpmKey6& key, int value) {
+        EXPECT_EQ(32U, key.prefixlen);
+        EXPECT_EQ(0x20, key.data[0]);
+        EXPECT_EQ(0xb8, key.data[3]);
+        EXPECT_EQ(2, value);
+        count6++;
+    });
+    EXPECT_EQ(1, count6);
+    EXPECT_EQ(20U, sizeof(BpfLpmKey6));
+}
+
+}  // namespace netdutils
+}  // namespace android
@@ -17,14 +17,40 @@
 #ifndef NETDUTILS_DUMPWRITER_H_
 #define NETDUTILS_DUMPWRITER_H_
 
+#include <charconv>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 
 namespace android {
 namespace netdutils {
 
+// Writes dumpsys output to a file descriptor.
+//
+// Output is buffered and written in large chunks, when the buffer fills up,
+// on flush(), and on destruction.
+//
+// Besides free-form lines, output can be structured into named sections of
+// rows of key/value fields, for large tables such as BPF map contents. In
+// TEXT format these print as "name:" followed by one indented
+// "key: value key: value" line per row. In JSON format the whole dump is one
+// JSON array, whose elements are strings (println() lines), objects (rows),
+// and single-key objects mapping a section name to an array of the same.
 class DumpWriter {
   public:
+    enum class Format { TEXT, JSON };
+
+    class Row;
+
     DumpWriter(int fd);
+    DumpWriter(int fd, Format format);
+    DumpWriter(const DumpWriter&) = delete;
+    DumpWriter& operator=(const DumpWriter&) = delete;
+    ~DumpWriter();
+
+    Format format() const { return mFormat; }
 
     void incIndent();
     void decIndent();
@@ -40,9 +66,64 @@ class DumpWriter {
     void println(const char* fmt, ...) __attribute__((__format__(__printf__, 2, 3)));
     void blankline() { println(""); }
 
+    void beginSection(std::string_view name);
+    void endSection();
+
+    // Returns a row of the current section, which is complete when the
+    // returned object is destroyed. No other output may be written meanwhile.
+    Row row();
+
+    // Writes out everything buffered so far.
+    void flush();
+
   private:
+    static constexpr size_t kBufferSize = 64 * 1024;
+
+    void appendLine(std::string_view line);
+    void append(std::string_view s);
+    void appendIndent();
+    void appendJsonString(std::string_view s);
+    void beginJsonElement();
+    void maybeFlush() {
+        if (mBuffer.size() >= kBufferSize) flush();
+    }
+
     uint8_t mIndentLevel;
     int mFd;
+    const Format mFormat;
+    std::string mBuffer;
+    // JSON element count of each open array, innermost last.
+    std::vector<size_t> mJsonElements;
+    bool mWriteFailed = false;
+};
+
+class DumpWriter::Row {
+  public:
+    Row(const Row&) = delete;
+    Row& operator=(const Row&) = delete;
+    ~Row();
+
+    Row& field(std::string_view key, std::string_view value);
+    Row& field(std::string_view key, const char* value) {
+        return field(key, std::string_view(value));
+    }
+    Row& field(std::string_view key, bool value);
+    template <typename T, std::enable_if_t<std::is_integral_v<T>, bool> = true>
+    Row& field(std::string_view key, T value) {
+        char digits[24];
+        const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        return number(key, std::string_view(digits, result.ptr - digits));
+    }
+
+  private:
+    friend class DumpWriter;
+    explicit Row(DumpWriter& dw);
+
+    void key(std::string_view key);
+    Row& number(std::string_view key, std::string_view digits);
+
+    DumpWriter& mDw;
+    bool mFirst = true;
 };
 
 class ScopedIndent {
@@ -62,6 +143,17 @@ class ScopedIndent {
     DumpWriter& mDw;
 };
 
+class ScopedSection {
+  public:
+    ScopedSection(DumpWriter& dw, std::string_view name) : mDw(dw) { mDw.beginSection(name); }
+    ~ScopedSection() { mDw.endSection(); }
+    ScopedSection(const ScopedSection&) = delete;
+    ScopedSection& operator=(const ScopedSection&) = delete;
+
+  private:
+    DumpWriter& mDw;
+};
+
 }  // namespace netdutils
 }  // namespace android
 
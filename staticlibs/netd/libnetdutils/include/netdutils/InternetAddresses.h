@@ -23,6 +23,7 @@
 #include <limits>
 #include <memory>
 #include <string>
+#include <string_view>
 
 #include "netdutils/NetworkConstants.h"
 
@@ -103,6 +104,32 @@ static_assert(AF_INET <= std::numeric_limits<uint8_t>::max(), "AF_INET value too
 static_assert(AF_INET6 <= std::numeric_limits<uint8_t>::max(), "AF_INET6 value too large");
 static_assert(sizeof(compact_ipdata) == 24U, "compact_ipdata unexpectedly large");
 
+// Whether the first |length| bits of the addresses in |prefix| and |addr|
+// match, i.e. whether |prefix| truncated to |length| contains |addr|.
+// Scope IDs must match too.
+inline bool prefixMatches(const compact_ipdata& prefix, const compact_ipdata& addr, int length) {
+    if (prefix.family != addr.family || prefix.scope_id != addr.scope_id) return false;
+    switch (prefix.family) {
+        case AF_INET: {
+            if (length <= 0) return true;
+            const uint32_t mask = (length >= 32) ? ~0U : ~(~0U >> length);
+            return ((ntohl(prefix.ip.v4.s_addr) ^ ntohl(addr.ip.v4.s_addr)) & mask) == 0;
+        }
+        case AF_INET6: {
+            if (length <= 0) return true;
+            if (length > IPV6_ADDR_BITS) length = IPV6_ADDR_BITS;
+            const uint8_t* a = prefix.ip.v6.s6_addr;
+            const uint8_t* b = addr.ip.v6.s6_addr;
+            const int bytes = length / 8;
+            if (std::memcmp(a, b, bytes) != 0) return false;
+            if (length % 8 == 0) return true;
+            const uint8_t mask = 0xff << (8 - length % 8);
+            return ((a[bytes] ^ b[bytes]) & mask) == 0;
+        }
+    }
+    return true;
+}
+
 }  // namespace internal_
 
 struct AddrinfoDeleter {
@@ -124,7 +151,15 @@ class IPSockAddr;
 
 class IPAddress {
   public:
+    // Longest toChars() output, e.g. "ffff:ffff:ffff:ffff:ffff:ffff:255.255.255.255%4294967295".
+    static constexpr size_t kMaxStringLength = INET6_ADDRSTRLEN - 1 + 11;
+
     static bool forString(const std::string& repr, IPAddress* ip);
+    // Like forString() but parses directly into ip without allocating. The
+    // legacy inet_aton() forms of IPv4 ("127.1", "0x7f.0.0.1", "010.0.0.1")
+    // and interface name scopes on other than link-local addresses are not
+    // accepted. forString() falls back to getaddrinfo() for those.
+    static bool parse(std::string_view repr, IPAddress* ip);
     static IPAddress forString(const std::string& repr) {
         IPAddress ip;
         if (!forString(repr, &ip)) return IPAddress();
@@ -157,6 +192,9 @@ class IPAddress {
     constexpr uint32_t scope_id() const noexcept { return mData.scope_id; }
 
     std::string toString() const noexcept;
+    // Write the same text as toString() to [first, last), without a NUL
+    // terminator. Returns the end of the text, or nullptr if it didn't fit.
+    char* toChars(char* first, char* last) const noexcept;
 
     friend std::ostream& operator<<(std::ostream& os, const IPAddress& ip) {
         os << ip.toString();
@@ -196,7 +234,12 @@ class IPAddress {
 
 class IPPrefix {
   public:
+    // Longest toChars() output.
+    static constexpr size_t kMaxStringLength = IPAddress::kMaxStringLength + 4;
+
     static bool forString(const std::string& repr, IPPrefix* prefix);
+    // Non-allocating forString(), with the same limitations as IPAddress::parse().
+    static bool parse(std::string_view repr, IPPrefix* prefix);
     static IPPrefix forString(const std::string& repr) {
         IPPrefix prefix;
         if (!forString(repr, &prefix)) return IPPrefix();
@@ -222,15 +265,18 @@ class IPPrefix {
     in_addr addr4() const noexcept { return mData.ip.v4; }
     in6_addr addr6() const noexcept { return mData.ip.v6; }
     constexpr int length() const noexcept { return mData.cidrlen; }
-    bool contains(const IPPrefix& other) {
-        return length() <= other.length() && IPPrefix(other.ip(), length()).ip() == ip();
+    bool contains(const IPPrefix& other) const noexcept {
+        return length() <= other.length() &&
+               internal_::prefixMatches(mData, other.mData, length());
     }
-    bool contains(const IPAddress& other) {
-        return IPPrefix(other, length()).ip() == ip();
+    bool contains(const IPAddress& other) const noexcept {
+        return internal_::prefixMatches(mData, other.mData, length());
     }
 
     bool isUninitialized() const noexcept;
     std::string toString() const noexcept;
+    // See IPAddress::toChars().
+    char* toChars(char* first, char* last) const noexcept;
 
     friend std::ostream& operator<<(std::ostream& os, const IPPrefix& prefix) {
         os << prefix.toString();
@@ -17,11 +17,17 @@
 #ifndef NETUTILS_LOG_H
 #define NETUTILS_LOG_H
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstring>
 #include <deque>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <shared_mutex>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 
@@ -107,6 +113,117 @@ class LogEntry {
     std::string mDuration{};
 };
 
+// A fixed capacity ring of binary log records, which multiple threads may
+// record into concurrently without locking or allocating.
+//
+// Each record only holds a timestamp, a pointer to its printf-style format
+// string, and its raw arguments: it is only formatted when read back. When
+// the ring is full the oldest records are overwritten.
+class LogRing {
+  public:
+    static constexpr size_t MAX_ARGS = 4;
+    // Total space for the (NUL terminated) string arguments of one record,
+    // longer strings are truncated.
+    static constexpr size_t MAX_STRING_BYTES = 32;
+
+    enum class ArgType : uint8_t {
+        INT,
+        UINT,
+        DOUBLE,
+        STRING,  // the argument holds an offset into Record::strings
+    };
+
+    struct Record {
+        int64_t timestampNs;  // since the system_clock epoch
+        const char* fmt;
+        uint8_t numArgs;
+        ArgType types[MAX_ARGS];
+        uint64_t args[MAX_ARGS];
+        char strings[MAX_STRING_BYTES];
+
+        // Formats the record as printf() would, without the timestamp.
+        std::string format() const;
+    };
+
+    // The capacity is rounded up to a power of 2.
+    explicit LogRing(size_t capacity);
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+
+    template <typename... Args>
+    void record(const char* fmt, const Args&... args) {
+        static_assert(sizeof...(Args) <= MAX_ARGS, "too many arguments");
+        Record r{};
+        r.timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::system_clock::now().time_since_epoch())
+                                .count();
+        r.fmt = fmt;
+        size_t stringBytes = 0;
+        (void)std::initializer_list<int>{(addArg(r, stringBytes, args), 0)...};
+        (void)stringBytes;
+        write(r);
+    }
+
+    // Calls fn for every record still in the ring, oldest first. Records being
+    // overwritten while this runs are skipped.
+    void forEachRecord(const std::function<void(const Record&)>& fn) const;
+
+    // Number of records dropped because another thread was still writing the
+    // same slot, which only happens if the ring wraps around during a write.
+    uint64_t dropped() const { return mDropped.load(std::memory_order_relaxed); }
+
+  private:
+    static constexpr size_t WORDS = (sizeof(Record) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    // A seqlock protected copy of a Record. seq is 2 * n + 1 while the n-th
+    // record is being written into the slot, and 2 * n + 2 once it is done.
+    struct Slot {
+        std::atomic<uint64_t> seq{0};
+        std::atomic<uint64_t> words[WORDS];
+    };
+
+    template <typename T>
+    static void addArg(Record& r, size_t& stringBytes, const T& val) {
+        const uint8_t i = r.numArgs++;
+        if constexpr (std::is_same_v<T, bool>) {
+            r.types[i] = ArgType::UINT;
+            r.args[i] = val;
+        } else if constexpr (std::is_enum_v<T>) {
+            const auto v = static_cast<std::underlying_type_t<T>>(val);
+            r.types[i] = std::is_signed_v<decltype(v)> ? ArgType::INT : ArgType::UINT;
+            r.args[i] = static_cast<uint64_t>(v);
+        } else if constexpr (std::is_integral_v<T>) {
+            r.types[i] = std::is_signed_v<T> ? ArgType::INT : ArgType::UINT;
+            r.args[i] = static_cast<uint64_t>(val);
+        } else if constexpr (std::is_floating_point_v<T>) {
+            const double d = val;
+            r.types[i] = ArgType::DOUBLE;
+            memcpy(&r.args[i], &d, sizeof(d));
+        } else {
+            std::string_view str;
+            if constexpr (std::is_pointer_v<T>) {
+                str = val ? val : "(null)";
+            } else {
+                str = val;
+            }
+            const size_t len = std::min(str.size(), MAX_STRING_BYTES - 1 - stringBytes);
+            r.types[i] = ArgType::STRING;
+            r.args[i] = stringBytes;
+            memcpy(r.strings + stringBytes, str.data(), len);
+            r.strings[stringBytes + len] = '\0';
+            // Only leave room for further strings if there is any.
+            stringBytes = std::min(stringBytes + len + 1, MAX_STRING_BYTES - 1);
+        }
+    }
+
+    void write(const Record& r);
+
+    const size_t mMask;
+    std::unique_ptr<Slot[]> mSlots;
+    std::atomic<uint64_t> mNext{0};
+    std::atomic<uint64_t> mDropped{0};
+};
+
 class Log {
   public:
     Log() = delete;
@@ -120,6 +237,21 @@ class Log {
 
     LogEntry newEntry() const { return LogEntry(); }
 
+    // Record a log entry in internal storage only, without allocating or
+    // taking any locks, for use on hot paths: only the arguments are stored,
+    // and the entry is only formatted when read back by forEachEntry().
+    //
+    // fmt must be a string literal (as only a pointer to it is stored), and
+    // there can be up to LogRing::MAX_ARGS integer, floating point or string
+    // arguments. Strings are copied, but truncated to LogRing::MAX_STRING_BYTES
+    // in total.
+    template <typename... Args>
+    void logFast(const char* fmt, const Args&... args) {
+        LogRing* ring = mRing.load(std::memory_order_acquire);
+        if (ring == nullptr) ring = initRing();
+        ring->record(fmt, args...);
+    }
+
     // Record a log entry in internal storage only.
     void log(const std::string& entry) { record(Level::LOG, entry); }
     template <size_t n>
@@ -180,9 +312,9 @@ class Log {
         error(result);
     }
 
-    // Iterates over every entry in the log in chronological order. Operates
-    // on a copy of the log entries, and so perEntryFn may itself call one of
-    // the logging functions if needed.
+    // Iterates over every entry in the log (including the ones from logFast())
+    // in chronological order. Operates on a copy of the log entries, and so
+    // perEntryFn may itself call one of the logging functions if needed.
     void forEachEntry(const std::function<void(const std::string&)>& perEntryFn) const;
 
   private:
@@ -202,8 +334,20 @@ class Log {
 
     void record(Level lvl, const std::string& entry);
 
+    struct Entry {
+        int64_t timestampNs;  // since the system_clock epoch
+        std::string text;     // including the formatted timestamp
+    };
+
     mutable std::shared_mutex mLock;
-    std::deque<const std::string> mEntries;  // GUARDED_BY(mLock), when supported
+    std::deque<Entry> mEntries;  // GUARDED_BY(mLock), when supported
+
+    LogRing* initRing();
+
+    // Only allocated on first use of logFast().
+    std::once_flag mRingOnce;
+    std::unique_ptr<LogRing> mRingStorage;
+    std::atomic<LogRing*> mRing{nullptr};
 };
 
 }  // namespace netdutils
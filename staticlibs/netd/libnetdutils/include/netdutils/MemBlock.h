@@ -17,7 +17,13 @@
 #ifndef NETUTILS_MEMBLOCK_H
 #define NETUTILS_MEMBLOCK_H
 
+#include <array>
 #include <memory>
+#include <mutex>
+#include <vector>
+
+#include <android-base/thread_annotations.h>
+
 #include "netdutils/Slice.h"
 
 namespace android {
@@ -36,10 +42,14 @@ class MemBlock {
             : mData((len > 0U) ? new uint8_t[len]{} : nullptr),
               mLen(len) {}
     // Allocate memory of size src.size() and copy src into this MemBlock.
-    explicit MemBlock(Slice src) : MemBlock(src.size()) {
+    explicit MemBlock(Slice src) : MemBlock(src.size(), Uninitialized{}) {
         copy(get(), src);
     }
 
+    // Allocate len bytes without zeroing them, for buffers that are about to
+    // be overwritten anyway (e.g. by recv()).
+    static MemBlock uninitialized(size_t len) { return MemBlock(len, Uninitialized{}); }
+
     // No copy construction or assignment.
     MemBlock(const MemBlock&) = delete;
     MemBlock& operator=(const MemBlock&) = delete;
@@ -57,10 +67,110 @@ class MemBlock {
     operator const Slice() const noexcept { return get(); }
 
   private:
+    struct Uninitialized {};
+    MemBlock(size_t len, Uninitialized)
+            : mData((len > 0U) ? new uint8_t[len] : nullptr), mLen(len) {}
+
     std::unique_ptr<uint8_t[]> mData;
     size_t mLen;
 };
 
+class MemBlockPool;
+
+// A MemBlock whose memory comes from, and on destruction goes back to, a
+// MemBlockPool. Must not outlive the pool.
+//
+// Like MemBlock, no thread-safety guarantees for a single instance.
+class PooledMemBlock {
+  public:
+    PooledMemBlock() = default;
+    ~PooledMemBlock() { reset(); }
+
+    PooledMemBlock(const PooledMemBlock&) = delete;
+    PooledMemBlock& operator=(const PooledMemBlock&) = delete;
+
+    PooledMemBlock(PooledMemBlock&& other) noexcept { *this = std::move(other); }
+    PooledMemBlock& operator=(PooledMemBlock&& other) noexcept;
+
+    Slice get() const noexcept { return Slice(mData, mLen); }
+
+    // NOLINTNEXTLINE(google-explicit-constructor)
+    operator const Slice() const noexcept { return get(); }
+
+    // Return the memory to the pool now; this becomes empty.
+    void reset();
+
+  private:
+    friend class MemBlockPool;
+    PooledMemBlock(MemBlockPool* pool, uint8_t* data, size_t len, size_t sizeClass)
+        : mPool(pool), mData(data), mLen(len), mSizeClass(sizeClass) {}
+
+    MemBlockPool* mPool = nullptr;
+    uint8_t* mData = nullptr;
+    size_t mLen = 0;
+    size_t mSizeClass = 0;
+};
+
+// Recycles buffers for recurring packet and netlink I/O instead of
+// allocating (and zeroing) a new MemBlock every time.
+//
+// Requests are rounded up to a power of two size class between
+// kMinBlockSize and kMaxBlockSize, and each class caches up to
+// maxCachedPerClass released buffers. Larger requests are allocated
+// and freed directly.
+//
+// Threadsafe.
+class MemBlockPool {
+  public:
+    enum class Init { ZERO, NONE };
+
+    static constexpr size_t kMinBlockSize = 64;
+    static constexpr size_t kMaxBlockSize = 64 * 1024;
+
+    struct Stats {
+        // Buffers obtained from the system allocator.
+        uint64_t allocations;
+        // Buffers handed out from the cache.
+        uint64_t reuses;
+        // Buffers freed on release because their class cache was full.
+        uint64_t frees;
+        // Bytes currently held in the caches.
+        size_t cachedBytes;
+    };
+
+    explicit MemBlockPool(size_t maxCachedPerClass = 16);
+    ~MemBlockPool();
+
+    MemBlockPool(const MemBlockPool&) = delete;
+    MemBlockPool& operator=(const MemBlockPool&) = delete;
+
+    // Return a buffer of exactly len bytes (the Slice size), zeroed unless
+    // init is Init::NONE. A recycled buffer holds whatever its last user
+    // left in it.
+    PooledMemBlock acquire(size_t len, Init init = Init::ZERO);
+
+    Stats getStats() const EXCLUDES(mMutex);
+
+    // Free all cached buffers.
+    void trim() EXCLUDES(mMutex);
+
+  private:
+    friend class PooledMemBlock;
+
+    static constexpr size_t kNumClasses = 11;  // 64 B .. 64 KiB
+    static constexpr size_t kUnpooled = kNumClasses;
+
+    static size_t sizeClassOf(size_t len);
+    static size_t classSize(size_t sizeClass) { return kMinBlockSize << sizeClass; }
+
+    void release(uint8_t* data, size_t sizeClass) EXCLUDES(mMutex);
+
+    const size_t mMaxCachedPerClass;
+    mutable std::mutex mMutex;
+    std::array<std::vector<uint8_t*>, kNumClasses> mFree GUARDED_BY(mMutex);
+    Stats mStats GUARDED_BY(mMutex) = {};
+};
+
 }  // namespace netdutils
 }  // namespace android
 
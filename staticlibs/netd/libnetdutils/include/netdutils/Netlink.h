@@ -17,10 +17,15 @@
 #ifndef NETUTILS_NETLINK_H
 #define NETUTILS_NETLINK_H
 
+#include <cstring>
 #include <functional>
+#include <iterator>
+#include <optional>
 #include <ostream>
+#include <string_view>
 #include <linux/netlink.h>
 
+#include "netdutils/Math.h"
 #include "netdutils/Slice.h"
 
 namespace android {
@@ -42,6 +47,217 @@ void forEachNetlinkMessage(const Slice buf,
 void forEachNetlinkAttribute(const Slice buf,
                              const std::function<void(const nlattr&, const Slice)>& onAttr);
 
+// Zero-copy alternatives to the above, usable with range-for:
+//
+//   for (const NetlinkMessage msg : netlinkMessages(buf)) {
+//       if (msg.type() != RTM_NEWLINK) continue;
+//       for (const NetlinkAttribute attr : msg.attributes<ifinfomsg>()) {
+//           if (attr.type() == IFLA_MTU) mtu = attr.value<uint32_t>().value_or(0);
+//       }
+//   }
+//
+// Nothing is allocated and no payload is copied: messages and attributes
+// are views into buf, and headers and values are only loaded (with memcpy,
+// since netlink gives no alignment guarantee beyond 4 bytes) when asked for.
+// Framing is identical to forEachNetlink{Message,Attribute}(): a length
+// shorter than the header is treated as the header size, and a length past
+// the end of buf is clipped to it.
+
+// Load a T from the start of s, or nullopt if s is too short.
+template <typename T>
+inline std::optional<T> loadFromSlice(const Slice s) {
+    static_assert(std::is_trivially_copyable_v<T>, "value must be trivially copyable");
+    if (s.size() < sizeof(T)) return std::nullopt;
+    T value;
+    memcpy(&value, s.base(), sizeof(T));
+    return value;
+}
+
+// Total length, header included, of an element whose header claims hdrLen
+// and of which avail bytes are present in the buffer.
+template <typename HdrT>
+inline constexpr size_t netlinkElementLength(size_t hdrLen, size_t avail) {
+    return std::min(std::max(hdrLen, sizeof(HdrT)), avail);
+}
+
+// Offset of the element following one whose header claims hdrLen.
+template <typename HdrT>
+inline constexpr size_t netlinkElementStride(size_t hdrLen, size_t avail) {
+    return std::min(align(std::max(hdrLen, sizeof(HdrT)), 2), avail);
+}
+
+// Type of the length field, which is the first member of both nlmsghdr and nlattr.
+template <typename HdrT>
+struct NetlinkLengthField;
+
+template <>
+struct NetlinkLengthField<nlmsghdr> {
+    using type = decltype(nlmsghdr::nlmsg_len);
+};
+
+template <>
+struct NetlinkLengthField<nlattr> {
+    using type = decltype(nlattr::nla_len);
+};
+
+// Forward iterator over the netlink messages (HdrT = nlmsghdr) or
+// attributes (HdrT = nlattr) packed in a buffer. ElemT is constructed from
+// a Slice covering one element, header included.
+template <typename HdrT, typename ElemT>
+class NetlinkIterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = ElemT;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = ElemT;
+
+    NetlinkIterator() = default;
+    NetlinkIterator(uint8_t* pos, uint8_t* limit) : mPos(pos), mLimit(limit) { settle(); }
+
+    ElemT operator*() const {
+        return ElemT(Slice(mPos, netlinkElementLength<HdrT>(headerLength(), remaining())));
+    }
+
+    NetlinkIterator& operator++() {
+        mPos += netlinkElementStride<HdrT>(headerLength(), remaining());
+        settle();
+        return *this;
+    }
+
+    NetlinkIterator operator++(int) {
+        NetlinkIterator prev = *this;
+        ++*this;
+        return prev;
+    }
+
+    bool operator==(const NetlinkIterator& other) const { return mPos == other.mPos; }
+    bool operator!=(const NetlinkIterator& other) const { return mPos != other.mPos; }
+
+  private:
+    size_t remaining() const { return mLimit - mPos; }
+
+    size_t headerLength() const {
+        typename NetlinkLengthField<HdrT>::type len;
+        memcpy(&len, mPos, sizeof(len));
+        return len;
+    }
+
+    // Trailing bytes too short to hold a header are not an element.
+    void settle() {
+        if (remaining() < sizeof(HdrT)) mPos = mLimit;
+    }
+
+    uint8_t* mPos = nullptr;
+    uint8_t* mLimit = nullptr;
+};
+
+template <typename HdrT, typename ElemT>
+class NetlinkRange {
+  public:
+    using iterator = NetlinkIterator<HdrT, ElemT>;
+
+    NetlinkRange() = default;
+    explicit NetlinkRange(const Slice buf) : mBuf(buf) {}
+
+    iterator begin() const { return iterator(mBuf.base(), mBuf.limit()); }
+    iterator end() const { return iterator(mBuf.limit(), mBuf.limit()); }
+    bool empty() const { return begin() == end(); }
+
+  private:
+    Slice mBuf;
+};
+
+// One netlink attribute, viewed in place.
+class NetlinkAttribute {
+  public:
+    // attr covers the attribute header and payload.
+    explicit NetlinkAttribute(const Slice attr) : mAttr(attr) {}
+
+    nlattr header() const { return loadFromSlice<nlattr>(mAttr).value_or(nlattr{}); }
+
+    // Attribute type without the NLA_F_NESTED and NLA_F_NET_BYTEORDER flags.
+    uint16_t type() const { return header().nla_type & NLA_TYPE_MASK; }
+
+    bool isNested() const { return header().nla_type & NLA_F_NESTED; }
+
+    const Slice payload() const { return drop(mAttr, sizeof(nlattr)); }
+
+    // The payload as a T, or nullopt if the payload is too short.
+    template <typename T>
+    std::optional<T> value() const {
+        return loadFromSlice<T>(payload());
+    }
+
+    // The payload up to its first NUL, for NLA_STRING / NLA_NUL_STRING.
+    std::string_view string() const {
+        const Slice p = payload();
+        const char* str = reinterpret_cast<const char*>(p.base());
+        return std::string_view(str, strnlen(str, p.size()));
+    }
+
+    // The attributes nested in this one.
+    NetlinkRange<nlattr, NetlinkAttribute> attributes() const {
+        return NetlinkRange<nlattr, NetlinkAttribute>(payload());
+    }
+
+  private:
+    Slice mAttr;
+};
+
+using NetlinkAttributeRange = NetlinkRange<nlattr, NetlinkAttribute>;
+
+// One netlink message, viewed in place.
+class NetlinkMessage {
+  public:
+    // msg covers the message header and payload.
+    explicit NetlinkMessage(const Slice msg) : mMsg(msg) {}
+
+    nlmsghdr header() const { return loadFromSlice<nlmsghdr>(mMsg).value_or(nlmsghdr{}); }
+
+    uint16_t type() const { return header().nlmsg_type; }
+
+    const Slice payload() const { return drop(mMsg, sizeof(nlmsghdr)); }
+
+    // The family specific header (e.g. ifinfomsg, ndmsg) at the start of
+    // the payload, or nullopt if the payload is too short.
+    template <typename FamilyT>
+    std::optional<FamilyT> family() const {
+        return loadFromSlice<FamilyT>(payload());
+    }
+
+    // The attributes following a family specific header of familyLen bytes.
+    NetlinkAttributeRange attributes(size_t familyLen) const {
+        return NetlinkAttributeRange(drop(payload(), align(familyLen, 2)));
+    }
+
+    template <typename FamilyT>
+    NetlinkAttributeRange attributes() const {
+        return attributes(sizeof(FamilyT));
+    }
+
+  private:
+    Slice mMsg;
+};
+
+using NetlinkMessageRange = NetlinkRange<nlmsghdr, NetlinkMessage>;
+
+inline NetlinkMessageRange netlinkMessages(const Slice buf) {
+    return NetlinkMessageRange(buf);
+}
+
+inline NetlinkAttributeRange netlinkAttributes(const Slice buf) {
+    return NetlinkAttributeRange(buf);
+}
+
+// Return the first attribute of the given type in buf, or nullopt.
+inline std::optional<NetlinkAttribute> findNetlinkAttribute(const Slice buf, uint16_t type) {
+    for (const NetlinkAttribute attr : netlinkAttributes(buf)) {
+        if (attr.type() == type) return attr;
+    }
+    return std::nullopt;
+}
+
 }  // namespace netdutils
 }  // namespace android
 
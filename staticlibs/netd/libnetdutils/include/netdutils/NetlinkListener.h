@@ -17,12 +17,18 @@
 #ifndef NETLINK_LISTENER_H
 #define NETLINK_LISTENER_H
 
+#include <atomic>
 #include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
+
+#include <sys/socket.h>
 
 #include <android-base/thread_annotations.h>
+#include <netdutils/DumpWriter.h>
 #include <netdutils/Netlink.h>
 #include <netdutils/Slice.h>
 #include <netdutils/Status.h>
@@ -73,10 +79,51 @@ class NetlinkListenerInterface {
 // Note that NetlinkListener is capable of processing multiple batched
 // netlink messages in a single system call. This is useful to
 // netfilter extensions that allow batching of events like NFLOG.
+//
+// Listeners on busy multicast groups (sock_diag, conntrack) should be
+// constructed with highThroughputOptions(), which grows the socket
+// receive buffer and drains several datagrams per recvmmsg() call.
+//
+// Dispatch does not take any lock: the worker reads an immutable
+// snapshot of the dispatch table, which subscribe() and unsubscribe()
+// replace. Both still guarantee that once they return no message is
+// delivered to the old table.
 class NetlinkListener : public NetlinkListenerInterface {
   public:
+    struct Options {
+        // SO_RCVBUF(FORCE) to apply to the socket, 0 to keep what it has.
+        int rcvbufBytes;
+        // Maximum datagrams received per system call. 1 uses recvfrom().
+        unsigned batchSize;
+        // Receive buffer size per datagram.
+        size_t bufferBytes;
+        // Maximum recvmmsg() calls per wakeup before checking for shutdown.
+        unsigned maxDrainCalls;
+        // Set NETLINK_NO_ENOBUFS. The kernel then silently drops messages
+        // on overrun instead of reporting ENOBUFS, so only use this where
+        // drops are ok and nothing is resynchronized on overrun.
+        bool noEnobufs;
+    };
+
+    struct Stats {
+        uint64_t messages;
+        uint64_t bytes;
+        uint64_t datagrams;
+        uint64_t recvCalls;
+        uint64_t overruns;
+        uint64_t truncated;
+    };
+
+    // One datagram per system call, socket left as passed in.
+    static Options defaultOptions();
+    // 4 MiB receive buffer, up to 32 datagrams per system call.
+    static Options highThroughputOptions();
+
     NetlinkListener(netdutils::UniqueFd event, netdutils::UniqueFd sock, const std::string& name);
 
+    NetlinkListener(netdutils::UniqueFd event, netdutils::UniqueFd sock, const std::string& name,
+                    const Options& options);
+
     ~NetlinkListener() override;
 
     netdutils::Status send(const netdutils::Slice msg) override;
@@ -87,16 +134,43 @@ class NetlinkListener : public NetlinkListenerInterface {
 
     void registerSkErrorHandler(const SkErrorHandler& handler) override;
 
+    // Threadsafe, may be called while messages are being received.
+    Stats getStats() const;
+
+    void dump(DumpWriter& dw) const;
+
   private:
+    using DispatchMap = std::map<uint16_t, DispatchFn>;
+
+    void configureSocket();
+    // Publishes a new dispatch table and waits until the worker is no
+    // longer using the previous one.
+    void publish(std::unique_ptr<const DispatchMap> map) REQUIRES(mMutex);
+    void dispatch(const DispatchMap& map, const netdutils::Slice datagram);
+    void onRecvError(int err);
+    void receiveOne(std::vector<char>& rxbuf);
+    void receiveBatch(std::vector<char>& rxbuf, std::vector<mmsghdr>& msgs,
+                      std::vector<iovec>& iovs);
     netdutils::Status run();
 
     const netdutils::UniqueFd mEvent;
     const netdutils::UniqueFd mSock;
     const std::string mThreadName;
+    const Options mOptions;
     std::mutex mMutex;
-    std::map<uint16_t, DispatchFn> mDispatchMap GUARDED_BY(mMutex);
+    std::unique_ptr<const DispatchMap> mDispatchMap GUARDED_BY(mMutex);
+    std::atomic<const DispatchMap*> mDispatchSnapshot{nullptr};
+    // Odd while the worker is dispatching from a snapshot.
+    std::atomic<uint64_t> mDispatchSeq{0};
     std::thread mWorker;
     SkErrorHandler mErrorHandler;
+
+    std::atomic<uint64_t> mMessages{0};
+    std::atomic<uint64_t> mBytes{0};
+    std::atomic<uint64_t> mDatagrams{0};
+    std::atomic<uint64_t> mRecvCalls{0};
+    std::atomic<uint64_t> mOverruns{0};
+    std::atomic<uint64_t> mTruncated{0};
 };
 
 }  // namespace netdutils
@@ -0,0 +1,464 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <android-base/thread_annotations.h>
+
+#include "netdutils/InternetAddresses.h"
+
+namespace android {
+namespace netdutils {
+
+namespace internal_ {
+
+// Multibit trie over IPv4 or IPv6 addresses, 4 bits (one 64 byte cache
+// line of 16 slots) per level, with leaf pushing: each slot holds either a
+// child node, or the result for every address below it. A lookup is thus
+// one dependent load per nibble until the first leaf, and never backtracks.
+//
+// Results are opaque non-zero uint32_t's below kChild; kNoMatch is 0.
+// Each leaf also remembers the length of the prefix that set it, which is
+// what makes incremental insert and remove possible.
+class LpmTrie {
+  public:
+    static constexpr uint32_t kNoMatch = 0;
+    static constexpr uint32_t kChild = 0x80000000U;
+
+    struct Node {
+        uint32_t slots[16];
+    };
+    static_assert(sizeof(Node) == 64, "Node should be one cache line");
+
+    LpmTrie() : mNodes(1), mOwners(1) {}
+
+    static int nibble(const uint8_t* addr, int n) {
+        return (n & 1) ? (addr[n / 2] & 0xf) : (addr[n / 2] >> 4);
+    }
+
+    // Map addr/len to result, overriding shorter prefixes but not longer ones.
+    void insert(const uint8_t* addr, int len, uint32_t result) {
+        const uint8_t owner = len + 1;
+        set(addr, len, [result, owner](uint32_t& slot, uint8_t& slotOwner) {
+            if (slotOwner <= owner) {
+                slot = result;
+                slotOwner = owner;
+            }
+        });
+    }
+
+    // Unmap addr/len, whose addresses then go to fallback, the result of the
+    // longest remaining prefix covering addr/len, of length fallbackLen
+    // (-1 and kNoMatch if there is none).
+    void remove(const uint8_t* addr, int len, uint32_t fallback, int fallbackLen) {
+        const uint8_t owner = len + 1;
+        const uint8_t fallbackOwner = fallbackLen + 1;
+        set(addr, len, [=](uint32_t& slot, uint8_t& slotOwner) {
+            if (slotOwner == owner) {
+                slot = fallback;
+                slotOwner = fallbackOwner;
+            }
+        });
+    }
+
+    uint32_t lookup(const uint8_t* addr) const {
+        const Node* nodes = mNodes.data();
+        uint32_t slot = nodes[0].slots[nibble(addr, 0)];
+        for (int n = 1; slot & kChild; n++) {
+            slot = nodes[slot & ~kChild].slots[nibble(addr, n)];
+        }
+        return slot;
+    }
+
+    const std::vector<Node>& nodes() const { return mNodes; }
+
+    size_t memoryBytes() const {
+        return mNodes.capacity() * sizeof(Node) + mOwners.capacity() * sizeof(mOwners[0]);
+    }
+
+  private:
+    using Owners = std::array<uint8_t, 16>;
+
+    uint32_t allocNode(uint32_t fill, uint8_t owner) {
+        uint32_t index;
+        if (!mFreeNodes.empty()) {
+            index = mFreeNodes.back();
+            mFreeNodes.pop_back();
+        } else {
+            index = mNodes.size();
+            mNodes.emplace_back();
+            mOwners.emplace_back();
+        }
+        std::fill(std::begin(mNodes[index].slots), std::end(mNodes[index].slots), fill);
+        mOwners[index].fill(owner);
+        return index;
+    }
+
+    // Fold a child whose slots are all the same leaf back into its parent slot.
+    void collapse(uint32_t node, int i) {
+        const uint32_t slot = mNodes[node].slots[i];
+        if (!(slot & kChild)) return;
+        const uint32_t child = slot & ~kChild;
+        const Node& c = mNodes[child];
+        const Owners& o = mOwners[child];
+        if (c.slots[0] & kChild) return;
+        for (int j = 1; j < 16; j++) {
+            if (c.slots[j] != c.slots[0] || o[j] != o[0]) return;
+        }
+        mNodes[node].slots[i] = c.slots[0];
+        mOwners[node][i] = o[0];
+        mFreeNodes.push_back(child);
+    }
+
+    // Apply fn to every leaf at or below slot i of node.
+    template <typename Fn>
+    void apply(uint32_t node, int i, const Fn& fn) {
+        const uint32_t slot = mNodes[node].slots[i];
+        if (slot & kChild) {
+            for (int j = 0; j < 16; j++) apply(slot & ~kChild, j, fn);
+            collapse(node, i);
+        } else {
+            fn(mNodes[node].slots[i], mOwners[node][i]);
+        }
+    }
+
+    // Apply fn to every leaf covered by addr/len, creating nodes down to the
+    // level at which the prefix ends, and collapsing any made redundant.
+    template <typename Fn>
+    void set(const uint8_t* addr, int len, const Fn& fn) {
+        std::array<std::pair<uint32_t, int>, 32> path;
+        int depth = 0;
+        uint32_t node = 0;
+        int bits = 0;
+        while (len > bits + 4) {
+            const int i = nibble(addr, bits / 4);
+            uint32_t slot = mNodes[node].slots[i];
+            if (!(slot & kChild)) {
+                const uint32_t child = allocNode(slot, mOwners[node][i]);
+                slot = mNodes[node].slots[i] = child | kChild;
+            }
+            path[depth++] = {node, i};
+            node = slot & ~kChild;
+            bits += 4;
+        }
+        const int span = 1 << (4 - (len - bits));
+        const int first = (len > bits) ? nibble(addr, bits / 4) & ~(span - 1) : 0;
+        for (int i = first; i < first + span; i++) apply(node, i, fn);
+        while (depth > 0) {
+            const auto [parent, i] = path[--depth];
+            collapse(parent, i);
+        }
+    }
+
+    std::vector<Node> mNodes;
+    std::vector<Owners> mOwners;
+    std::vector<uint32_t> mFreeNodes;
+};
+
+}  // namespace internal_
+
+// Prefix lengths and addresses laid out as the kernel's struct
+// bpf_lpm_trie_key, for populating BPF_MAP_TYPE_LPM_TRIE maps.
+template <size_t N>
+struct BpfLpmKey {
+    uint32_t prefixlen;
+    uint8_t data[N];
+} __attribute__((packed));
+
+using BpfLpmKey4 = BpfLpmKey<IPV4_ADDR_LEN>;
+using BpfLpmKey6 = BpfLpmKey<IPV6_ADDR_LEN>;
+
+// Longest prefix match table from IPv4 and IPv6 prefixes to Values.
+//
+// The table itself has a single writer: insert(), remove() and lookup()
+// must not be called concurrently. Readers on other threads instead call
+// snapshot() and look up in the immutable copy last made by publish(),
+// which they can keep using for as long as they like.
+//
+// Scope IDs are ignored.
+template <typename Value>
+class PrefixTable {
+  public:
+    class Snapshot {
+      public:
+        const Value* lookup(const IPAddress& addr) const {
+            return result(trieFor(addr.family()), addr);
+        }
+
+        // Look up count addresses at once, interleaving the trie walks so
+        // that their cache misses overlap.
+        void lookup(const IPAddress* addrs, size_t count, const Value** results) const {
+            constexpr size_t kGroup = 8;
+            for (size_t base = 0; base < count; base += kGroup) {
+                const size_t n = std::min(kGroup, count - base);
+                uint8_t bytes[kGroup][IPV6_ADDR_LEN];
+                const internal_::LpmTrie::Node* nodes[kGroup];
+                uint32_t slots[kGroup];
+                size_t pending = 0;
+                for (size_t k = 0; k < n; k++) {
+                    const IPAddress& addr = addrs[base + k];
+                    const auto* trie = trieFor(addr.family());
+                    slots[k] = internal_::LpmTrie::kNoMatch;
+                    if (trie == nullptr) continue;
+                    addressBytes(addr, bytes[k]);
+                    nodes[k] = trie->data();
+                    slots[k] = nodes[k][0].slots[internal_::LpmTrie::nibble(bytes[k], 0)];
+                    pending++;
+                }
+                for (int nib = 1; pending > 0; nib++) {
+                    pending = 0;
+                    for (size_t k = 0; k < n; k++) {
+                        if (!(slots[k] & internal_::LpmTrie::kChild)) continue;
+                        const auto& node = nodes[k][slots[k] & ~internal_::LpmTrie::kChild];
+                        slots[k] = node.slots[internal_::LpmTrie::nibble(bytes[k], nib)];
+                        pending++;
+                    }
+                }
+                for (size_t k = 0; k < n; k++) {
+                    results[base + k] = valueFor(slots[k]);
+                }
+            }
+        }
+
+        size_t size() const { return mSize; }
+
+      private:
+        friend class PrefixTable;
+
+        using Nodes = std::vector<internal_::LpmTrie::Node>;
+
+        const Nodes* trieFor(sa_family_t family) const {
+            switch (family) {
+                case AF_INET:
+                    return &mV4;
+                case AF_INET6:
+                    return &mV6;
+            }
+            return nullptr;
+        }
+
+        const Value* valueFor(uint32_t result) const {
+            return result == internal_::LpmTrie::kNoMatch ? nullptr : &mValues[result - 1];
+        }
+
+        const Value* result(const Nodes* nodes, const IPAddress& addr) const {
+            if (nodes == nullptr) return nullptr;
+            uint8_t bytes[IPV6_ADDR_LEN];
+            addressBytes(addr, bytes);
+            uint32_t slot = (*nodes)[0].slots[internal_::LpmTrie::nibble(bytes, 0)];
+            for (int n = 1; slot & internal_::LpmTrie::kChild; n++) {
+                slot = (*nodes)[slot & ~internal_::LpmTrie::kChild]
+                               .slots[internal_::LpmTrie::nibble(bytes, n)];
+            }
+            return valueFor(slot);
+        }
+
+        Nodes mV4;
+        Nodes mV6;
+        std::vector<Value> mValues;
+        size_t mSize = 0;
+    };
+
+    PrefixTable() = default;
+    PrefixTable(const PrefixTable&) = delete;
+    PrefixTable& operator=(const PrefixTable&) = delete;
+
+    // Map prefix to value, replacing any previous value. Returns false if
+    // prefix is not IPv4 or IPv6.
+    bool insert(const IPPrefix& prefix, const Value& value) {
+        internal_::LpmTrie* trie = trieFor(prefix.family());
+        if (trie == nullptr) return false;
+        const IPPrefix key = normalize(prefix);
+        auto it = mPrefixes.find(key);
+        uint32_t index;
+        if (it != mPrefixes.end()) {
+            index = it->second;
+            mValues[index] = value;
+            return true;
+        }
+        if (!mFreeValues.empty()) {
+            index = mFreeValues.back();
+            mFreeValues.pop_back();
+            mValues[index] = value;
+        } else {
+            index = mValues.size();
+            mValues.push_back(value);
+        }
+        mPrefixes.emplace(key, index);
+        uint8_t bytes[IPV6_ADDR_LEN];
+        prefixBytes(key, bytes);
+        trie->insert(bytes, key.length(), index + 1);
+        return true;
+    }
+
+    // Returns false if prefix was not in the table.
+    bool remove(const IPPrefix& prefix) {
+        internal_::LpmTrie* trie = trieFor(prefix.family());
+        if (trie == nullptr) return false;
+        const IPPrefix key = normalize(prefix);
+        auto it = mPrefixes.find(key);
+        if (it == mPrefixes.end()) return false;
+        const uint32_t index = it->second;
+        mPrefixes.erase(it);
+        mValues[index] = Value();
+        mFreeValues.push_back(index);
+
+        // The addresses go back to the longest remaining prefix covering them.
+        uint32_t fallback = internal_::LpmTrie::kNoMatch;
+        int fallbackLen = -1;
+        for (int len = key.length() - 1; len >= 0; len--) {
+            auto covering = mPrefixes.find(IPPrefix(key.ip(), len));
+            if (covering != mPrefixes.end()) {
+                fallback = covering->second + 1;
+                fallbackLen = len;
+                break;
+            }
+        }
+        uint8_t bytes[IPV6_ADDR_LEN];
+        prefixBytes(key, bytes);
+        trie->remove(bytes, key.length(), fallback, fallbackLen);
+        return true;
+    }
+
+    const Value* lookup(const IPAddress& addr) const {
+        const internal_::LpmTrie* trie = trieFor(addr.family());
+        if (trie == nullptr) return nullptr;
+        uint8_t bytes[IPV6_ADDR_LEN];
+        addressBytes(addr, bytes);
+        const uint32_t result = trie->lookup(bytes);
+        return result == internal_::LpmTrie::kNoMatch ? nullptr : &mValues[result - 1];
+    }
+
+    size_t size() const { return mPrefixes.size(); }
+
+    size_t memoryBytes() const { return mV4.memoryBytes() + mV6.memoryBytes(); }
+
+    // Make the current contents visible to snapshot(). This copies the
+    // tables, so batch updates before publishing.
+    void publish() EXCLUDES(mSnapshotMutex) {
+        auto snapshot = std::make_shared<Snapshot>();
+        snapshot->mV4 = mV4.nodes();
+        snapshot->mV6 = mV6.nodes();
+        snapshot->mValues = mValues;
+        snapshot->mSize = mPrefixes.size();
+        std::lock_guard guard(mSnapshotMutex);
+        mSnapshot = std::move(snapshot);
+    }
+
+    // Threadsafe. Empty until the first publish().
+    std::shared_ptr<const Snapshot> snapshot() const EXCLUDES(mSnapshotMutex) {
+        std::lock_guard guard(mSnapshotMutex);
+        return mSnapshot ? mSnapshot : kEmptySnapshot();
+    }
+
+    // Call fn(const BpfLpmKey4&, const Value&) / fn(const BpfLpmKey6&, const Value&)
+    // for every IPv4 / IPv6 prefix, in order.
+    template <typename Fn>
+    void forEachBpfLpmEntry4(const Fn& fn) const {
+        forEachBpfLpmEntry<BpfLpmKey4>(AF_INET, fn);
+    }
+
+    template <typename Fn>
+    void forEachBpfLpmEntry6(const Fn& fn) const {
+        forEachBpfLpmEntry<BpfLpmKey6>(AF_INET6, fn);
+    }
+
+  private:
+    static const std::shared_ptr<const Snapshot>& kEmptySnapshot() {
+        static const auto* sEmpty = new std::shared_ptr<const Snapshot>(
+                std::make_shared<Snapshot>(makeEmptySnapshot()));
+        return *sEmpty;
+    }
+
+    static Snapshot makeEmptySnapshot() {
+        Snapshot empty;
+        empty.mV4.resize(1);
+        empty.mV6.resize(1);
+        return empty;
+    }
+
+    static void addressBytes(const IPAddress& addr, uint8_t bytes[IPV6_ADDR_LEN]) {
+        const IPPrefix p(addr);
+        if (addr.family() == AF_INET) {
+            const in_addr v4 = p.addr4();
+            memcpy(bytes, &v4, IPV4_ADDR_LEN);
+        } else {
+            const in6_addr v6 = p.addr6();
+            memcpy(bytes, &v6, IPV6_ADDR_LEN);
+        }
+    }
+
+    static void prefixBytes(const IPPrefix& prefix, uint8_t bytes[IPV6_ADDR_LEN]) {
+        addressBytes(prefix.ip(), bytes);
+    }
+
+    // Drop the scope ID, which would otherwise make otherwise identical prefixes distinct.
+    static IPPrefix normalize(const IPPrefix& prefix) {
+        if (prefix.family() == AF_INET6) {
+            return IPPrefix(IPAddress(prefix.addr6()), prefix.length());
+        }
+        return prefix;
+    }
+
+    internal_::LpmTrie* trieFor(sa_family_t family) {
+        switch (family) {
+            case AF_INET:
+                return &mV4;
+            case AF_INET6:
+                return &mV6;
+        }
+        return nullptr;
+    }
+
+    const internal_::LpmTrie* trieFor(sa_family_t family) const {
+        return const_cast<PrefixTable*>(this)->trieFor(family);
+    }
+
+    template <typename Key, typename Fn>
+    void forEachBpfLpmEntry(sa_family_t family, const Fn& fn) const {
+        for (const auto& [prefix, index] : mPrefixes) {
+            if (prefix.family() != family) continue;
+            Key key = {.prefixlen = static_cast<uint32_t>(prefix.length())};
+            uint8_t bytes[IPV6_ADDR_LEN];
+            prefixBytes(prefix, bytes);
+            memcpy(key.data, bytes, sizeof(key.data));
+            fn(key, mValues[index]);
+        }
+    }
+
+    internal_::LpmTrie mV4;
+    internal_::LpmTrie mV6;
+    // Authoritative contents, for remove() and BPF export. Values are
+    // indexed by the trie results (minus one).
+    std::map<IPPrefix, uint32_t> mPrefixes;
+    std::vector<Value> mValues;
+    std::vector<uint32_t> mFreeValues;
+
+    mutable std::mutex mSnapshotMutex;
+    std::shared_ptr<const Snapshot> mSnapshot GUARDED_BY(mSnapshotMutex);
+};
+
+}  // namespace netdutils
+}  // namespace android
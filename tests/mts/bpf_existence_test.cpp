@@ -87,6 +87,7 @@ static const set<string> MAINLINE_FOR_S_5_10_PLUS = {
 static const set<string> MAINLINE_FOR_T_PLUS = {
     SHARED "map_block_blocked_ports_map",
     SHARED "map_clatd_clat_egress4_map",
+    SHARED "map_clatd_clat_error_map",
     SHARED "map_clatd_clat_ingress6_map",
     SHARED "map_dscpPolicy_ipv4_dscp_policies_map",
     SHARED "map_dscpPolicy_ipv6_dscp_policies_map",
@@ -101,7 +102,9 @@ static const set<string> MAINLINE_FOR_T_PLUS = {
     NETD "map_netd_stats_map_A",
     NETD "map_netd_stats_map_B",
     NETD "map_netd_uid_counterset_map",
+    NETD "map_netd_uid_owner_array_map",
     NETD "map_netd_uid_owner_map",
+    NETD "map_netd_uid_permission_array_map",
     NETD "map_netd_uid_permission_map",
     SHARED "prog_clatd_schedcls_egress4_clat_rawip",
     SHARED "prog_clatd_schedcls_ingress6_clat_ether",
@@ -126,6 +129,11 @@ static const set<string> MAINLINE_FOR_T_4_19_PLUS = {
     NETD_RO "prog_block_bind6_block_port",
 };
 
+// Provided by *current* mainline module for T+ devices with 5.5+ kernels
+static const set<string> MAINLINE_FOR_T_5_5_PLUS = {
+    NETD "map_netd_rules_generation_map",
+};
+
 // Provided by *current* mainline module for T+ devices with 5.15+ kernels
 static const set<string> MAINLINE_FOR_T_5_15_PLUS = {
     SHARED "prog_dscpPolicy_schedcls_set_dscp_ether",
@@ -179,6 +187,7 @@ TEST_F(BpfExistenceTest, TestPrograms) {
     DO_EXPECT(IsAtLeastT(), MAINLINE_FOR_T_PLUS);
     DO_EXPECT(IsAtLeastT() && isAtLeastKernelVersion(4, 14, 0), MAINLINE_FOR_T_4_14_PLUS);
     DO_EXPECT(IsAtLeastT() && isAtLeastKernelVersion(4, 19, 0), MAINLINE_FOR_T_4_19_PLUS);
+    DO_EXPECT(IsAtLeastT() && isAtLeastKernelVersion(5, 5, 0), MAINLINE_FOR_T_5_5_PLUS);
     DO_EXPECT(IsAtLeastT() && isAtLeastKernelVersion(5, 15, 0), MAINLINE_FOR_T_5_15_PLUS);
 
     // U requires Linux Kernel 4.14+, but nothing (as yet) added or removed in U.
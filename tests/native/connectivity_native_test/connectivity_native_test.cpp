@@ -22,6 +22,9 @@
 #include <gtest/gtest.h>
 #include <netinet/in.h>
 
+#include <iterator>
+#include <vector>
+
 #include "bpf/BpfUtils.h"
 
 typedef int (*GetPortsBlockedForBind)(in_port_t*, size_t*);
@@ -32,6 +35,12 @@ typedef int (*UnblockPortForBind)(in_port_t);
 UnblockPortForBind unblockPortForBind;
 typedef int (*UnblockAllPortsForBind)();
 UnblockAllPortsForBind unblockAllPortsForBind;
+typedef int (*SetPortRangeForBind)(in_port_t, in_port_t);
+SetPortRangeForBind blockPortRangeForBind;
+SetPortRangeForBind unblockPortRangeForBind;
+typedef int (*SetPortsForBind)(const in_port_t*, size_t);
+SetPortsForBind blockPortsForBind;
+SetPortsForBind unblockPortsForBind;
 
 class ConnectivityNativeBinderTest : public ::testing::Test {
   public:
@@ -68,6 +77,16 @@ class ConnectivityNativeBinderTest : public ::testing::Test {
         unblockAllPortsForBind = reinterpret_cast<UnblockAllPortsForBind>(
                 dlsym(nativeLib, "AConnectivityNative_unblockAllPortsForBind"));
         ASSERT_NE(nullptr, unblockAllPortsForBind);
+        // Range and batch calls only exist in newer module versions; tests using them skip
+        // themselves if these are null.
+        blockPortRangeForBind = reinterpret_cast<SetPortRangeForBind>(
+                dlsym(nativeLib, "AConnectivityNative_blockPortRangeForBind"));
+        unblockPortRangeForBind = reinterpret_cast<SetPortRangeForBind>(
+                dlsym(nativeLib, "AConnectivityNative_unblockPortRangeForBind"));
+        blockPortsForBind = reinterpret_cast<SetPortsForBind>(
+                dlsym(nativeLib, "AConnectivityNative_blockPortsForBind"));
+        unblockPortsForBind = reinterpret_cast<SetPortsForBind>(
+                dlsym(nativeLib, "AConnectivityNative_unblockPortsForBind"));
 
         // If there are already ports being blocked on device unblockAllPortsForBind() store
         // the currently blocked ports and add them back at the end of the test. Do this for
@@ -261,6 +280,57 @@ TEST_F(ConnectivityNativeBinderTest, UnblockAllPorts) {
     // If mActualBlockedPorts is not empty, ports will be added back in teardown.
 }
 
+TEST_F(ConnectivityNativeBinderTest, BlockPortRange) {
+    if (!blockPortRangeForBind) GTEST_SKIP() << "Range API not available.";
+    int err = unblockAllPortsForBind();
+    EXPECT_EQ(err, 0);
+
+    // Spans four words of the bitmap, the middle two entirely.
+    err = blockPortRangeForBind(5100, 5250);
+    EXPECT_EQ(err, 0);
+    err = unblockPortRangeForBind(5120, 5239);
+    EXPECT_EQ(err, 0);
+    EXPECT_EQ(EINVAL, blockPortRangeForBind(5250, 5100));
+
+    size_t count = 65535;
+    std::vector<in_port_t> ports(count);
+    err = getPortsBlockedForBind(ports.data(), &count);
+    EXPECT_EQ(err, 0);
+    ASSERT_EQ(31U, count);
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(i < 20 ? 5100 + i : 5240 + (i - 20), ports[i]);
+    }
+
+    err = unblockAllPortsForBind();
+    EXPECT_EQ(err, 0);
+}
+
+TEST_F(ConnectivityNativeBinderTest, BlockPortsBatch) {
+    if (!blockPortsForBind) GTEST_SKIP() << "Batch API not available.";
+    int err = unblockAllPortsForBind();
+    EXPECT_EQ(err, 0);
+
+    const in_port_t blockedPorts[] = {65000, 1, 5555, 100, 63, 64, 5555};
+    err = blockPortsForBind(blockedPorts, std::size(blockedPorts));
+    EXPECT_EQ(err, 0);
+    const in_port_t unblockedPorts[] = {100, 64};
+    err = unblockPortsForBind(unblockedPorts, std::size(unblockedPorts));
+    EXPECT_EQ(err, 0);
+
+    size_t count = 8;
+    in_port_t ports[8];
+    err = getPortsBlockedForBind(ports, &count);
+    EXPECT_EQ(err, 0);
+    ASSERT_EQ(4U, count);
+    EXPECT_EQ(1, ports[0]);
+    EXPECT_EQ(63, ports[1]);
+    EXPECT_EQ(5555, ports[2]);
+    EXPECT_EQ(65000, ports[3]);
+
+    err = unblockAllPortsForBind();
+    EXPECT_EQ(err, 0);
+}
+
 TEST_F(ConnectivityNativeBinderTest, CheckPermission) {
     int curUid = getuid();
     EXPECT_EQ(0, seteuid(FIRST_APPLICATION_UID + 2000)) << "seteuid failed: " << strerror(errno);
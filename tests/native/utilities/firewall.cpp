@@ -19,6 +19,7 @@
 
 #include <android-base/result.h>
 #include <gtest/gtest.h>
+#include <time.h>
 
 Firewall::Firewall() {
     std::lock_guard guard(mMutex);
@@ -33,6 +34,43 @@ Firewall::Firewall() {
     // DNS resolver tests statically link to this class. But when running MTS, the test infra
     // installs only DNS resolver module without installing tethering module together.
     mDataSaverEnabledMap.init(DATA_SAVER_ENABLED_MAP_PATH);
+
+    // Likewise, and it also only exists on 5.5+ kernels.
+    mRulesGenerationMap.init(RULES_GENERATION_MAP_PATH);
+
+    // Likewise.
+    mUidOwnerArrayMap.init(UID_OWNER_ARRAY_MAP_PATH);
+}
+
+// Same as BpfNetMaps#updateUidOwnerEntry: uids that fit in the array map are only looked up there
+// by the eBPF programs, so it must be written too, but only once the HASH map write succeeded.
+Result<void> Firewall::writeUidOwnerLocked(uint32_t uid, const UidOwnerValue& value) {
+    auto res = mUidOwnerMap.writeValue(uid, value, BPF_ANY);
+    if (!res.ok()) return res;
+    if (uid < UID_ARRAY_MAP_SIZE && mUidOwnerArrayMap.isValid()) {
+        return mUidOwnerArrayMap.writeValue(uid, value, BPF_EXIST);
+    }
+    return {};
+}
+
+Result<void> Firewall::deleteUidOwnerLocked(uint32_t uid) {
+    auto res = mUidOwnerMap.deleteValue(uid);
+    if (!res.ok()) return res;
+    if (uid < UID_ARRAY_MAP_SIZE && mUidOwnerArrayMap.isValid()) {
+        return mUidOwnerArrayMap.writeValue(uid, {}, BPF_EXIST);
+    }
+    return {};
+}
+
+// Same as BpfNetMaps#bumpRulesGeneration, so that DnsBpfHelper does not keep using what it cached
+// before the change.
+void Firewall::bumpRulesGenerationLocked() {
+    if (!mRulesGenerationMap.isValid()) return;
+
+    timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    const uint64_t generation = now.tv_sec * 1000000000ULL + now.tv_nsec;
+    EXPECT_RESULT_OK(mRulesGenerationMap.writeValue(RULES_GENERATION_KEY, generation, BPF_EXIST));
 }
 
 Firewall* Firewall::getInstance() {
@@ -53,6 +91,7 @@ Result<void> Firewall::toggleStandbyMatch(bool enable) {
     auto res = mConfigurationMap.writeValue(key, newConfiguration, BPF_EXIST);
     if (!res.ok()) return Errorf("Failed to toggle STANDBY_MATCH: {}", res.error().message());
 
+    bumpRulesGenerationLocked();
     return {};
 }
 
@@ -73,16 +112,17 @@ Result<void> Firewall::addRule(uint32_t uid, UidOwnerMatchType match, uint32_t i
                 .iif = iif ? iif : oldMatch.value().iif,
                 .rule = oldMatch.value().rule | match,
         };
-        auto res = mUidOwnerMap.writeValue(uid, newMatch, BPF_ANY);
+        auto res = writeUidOwnerLocked(uid, newMatch);
         if (!res.ok()) return Errorf("Failed to update rule: {}", res.error().message());
     } else {
         UidOwnerValue newMatch = {
                 .iif = iif,
                 .rule = match,
         };
-        auto res = mUidOwnerMap.writeValue(uid, newMatch, BPF_ANY);
+        auto res = writeUidOwnerLocked(uid, newMatch);
         if (!res.ok()) return Errorf("Failed to add rule: {}", res.error().message());
     }
+    bumpRulesGenerationLocked();
     return {};
 }
 
@@ -96,12 +136,13 @@ Result<void> Firewall::removeRule(uint32_t uid, UidOwnerMatchType match) {
             .rule = oldMatch.value().rule & ~match,
     };
     if (newMatch.rule == 0) {
-        auto res = mUidOwnerMap.deleteValue(uid);
+        auto res = deleteUidOwnerLocked(uid);
         if (!res.ok()) return Errorf("Failed to remove rule: {}", res.error().message());
     } else {
-        auto res = mUidOwnerMap.writeValue(uid, newMatch, BPF_ANY);
+        auto res = writeUidOwnerLocked(uid, newMatch);
         if (!res.ok()) return Errorf("Failed to update rule: {}", res.error().message());
     }
+    bumpRulesGenerationLocked();
     return {};
 }
 
@@ -147,5 +188,6 @@ Result<void> Firewall::setDataSaver(bool enabled) {
     auto res = mDataSaverEnabledMap.writeValue(DATA_SAVER_ENABLED_KEY, enabled, BPF_EXIST);
     if (!res.ok()) return Errorf("Failed to set data saver: {}", res.error().message());
 
+    bumpRulesGenerationLocked();
     return {};
 }
@@ -36,8 +36,14 @@ class Firewall {
     Result<bool> getDataSaverSetting();
     Result<void> setDataSaver(bool enabled);
   private:
+    void bumpRulesGenerationLocked() REQUIRES(mMutex);
+    Result<void> writeUidOwnerLocked(uint32_t uid, const UidOwnerValue& value) REQUIRES(mMutex);
+    Result<void> deleteUidOwnerLocked(uint32_t uid) REQUIRES(mMutex);
+
     BpfMap<uint32_t, uint32_t> mConfigurationMap GUARDED_BY(mMutex);
     BpfMap<uint32_t, UidOwnerValue> mUidOwnerMap GUARDED_BY(mMutex);
+    BpfMap<uint32_t, UidOwnerValue> mUidOwnerArrayMap GUARDED_BY(mMutex);
     BpfMap<uint32_t, bool> mDataSaverEnabledMap GUARDED_BY(mMutex);
+    BpfMap<uint32_t, uint64_t> mRulesGenerationMap GUARDED_BY(mMutex);
     std::mutex mMutex;
 };
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.net.module.util;
+
+import static android.system.OsConstants.ETH_P_IP;
+
+import static com.android.testutils.MiscAsserts.assertThrows;
+
+import android.os.Build;
+
+import androidx.test.filters.SmallTest;
+
+import com.android.testutils.DevSdkIgnoreRule;
+import com.android.testutils.DevSdkIgnoreRunner;
+
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+// Lives here rather than in the staticlibs tests, since it needs the TcUtils JNI.
+@RunWith(DevSdkIgnoreRunner.class)
+@SmallTest
+@DevSdkIgnoreRule.IgnoreUpTo(Build.VERSION_CODES.R)
+public class TcUtilsTest {
+    private static final int IFINDEX = 1000;
+    private static final short PRIO = 1;
+    private static final String PROG_PATH = "/sys/fs/bpf/tethering/prog_test";
+
+    @Test
+    public void testSessionThrowsAfterClose() throws Exception {
+        final TcUtils.Session session = new TcUtils.Session();
+        session.close();
+        // Closing again is a no-op.
+        session.close();
+
+        assertThrows(IllegalStateException.class, () -> session.tcQdiscAddDevClsact(IFINDEX));
+        assertThrows(IllegalStateException.class, () -> session.tcFilterAddDevBpf(IFINDEX,
+                true /* ingress */, PRIO, (short) ETH_P_IP, PROG_PATH));
+        assertThrows(IllegalStateException.class, () -> session.tcFilterAddDevIngressPolice(
+                IFINDEX, PRIO, (short) ETH_P_IP, 1000 /* rateInBytesPerSec */, PROG_PATH));
+        assertThrows(IllegalStateException.class, () -> session.tcFilterDelDev(IFINDEX,
+                false /* ingress */, PRIO, (short) ETH_P_IP));
+        assertThrows(IllegalStateException.class, () -> session.commit());
+    }
+}
@@ -32,9 +32,12 @@ import static android.net.BpfNetMapsConstants.OEM_DENY_1_MATCH;
 import static android.net.BpfNetMapsConstants.OEM_DENY_2_MATCH;
 import static android.net.BpfNetMapsConstants.OEM_DENY_3_MATCH;
 import static android.net.BpfNetMapsConstants.PENALTY_BOX_MATCH;
+import static android.net.BpfNetMapsConstants.PERMISSION_ARRAY_ENTRY;
 import static android.net.BpfNetMapsConstants.POWERSAVE_MATCH;
 import static android.net.BpfNetMapsConstants.RESTRICTED_MATCH;
+import static android.net.BpfNetMapsConstants.RULES_GENERATION_KEY;
 import static android.net.BpfNetMapsConstants.STANDBY_MATCH;
+import static android.net.BpfNetMapsConstants.UID_ARRAY_MAP_SIZE;
 import static android.net.BpfNetMapsConstants.UID_RULES_CONFIGURATION_KEY;
 import static android.net.ConnectivityManager.FIREWALL_CHAIN_DOZABLE;
 import static android.net.ConnectivityManager.FIREWALL_CHAIN_LOW_POWER_STANDBY;
@@ -50,6 +53,7 @@ import static android.net.INetd.PERMISSION_INTERNET;
 import static android.net.INetd.PERMISSION_NONE;
 import static android.net.INetd.PERMISSION_UNINSTALLED;
 import static android.net.INetd.PERMISSION_UPDATE_DEVICE_STATS;
+import static android.system.OsConstants.E2BIG;
 import static android.system.OsConstants.EINVAL;
 import static android.system.OsConstants.EPERM;
 
@@ -57,6 +61,7 @@ import static com.android.server.ConnectivityStatsLog.NETWORK_BPF_MAP_INFO;
 
 import static org.junit.Assert.assertEquals;
 import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertNotEquals;
 import static org.junit.Assert.assertNull;
 import static org.junit.Assert.assertThrows;
 import static org.junit.Assert.assertTrue;
@@ -75,6 +80,7 @@ import android.net.InetAddresses;
 import android.net.UidOwnerValue;
 import android.os.Build;
 import android.os.ServiceSpecificException;
+import android.os.UserHandle;
 import android.system.ErrnoException;
 import android.util.ArraySet;
 import android.util.IndentingPrintWriter;
@@ -84,6 +90,7 @@ import androidx.test.filters.SmallTest;
 import com.android.modules.utils.build.SdkLevel;
 import com.android.net.module.util.IBpfMap;
 import com.android.net.module.util.Struct.S32;
+import com.android.net.module.util.Struct.S64;
 import com.android.net.module.util.Struct.U32;
 import com.android.net.module.util.Struct.U8;
 import com.android.net.module.util.bpf.CookieTagMapKey;
@@ -149,11 +156,15 @@ public final class BpfNetMapsTest {
     private final IBpfMap<S32, UidOwnerValue> mUidOwnerMap =
             new TestBpfMap<>(S32.class, UidOwnerValue.class);
     private final IBpfMap<S32, U8> mUidPermissionMap = new TestBpfMap<>(S32.class, U8.class);
+    private final IBpfMap<S32, UidOwnerValue> mUidOwnerArrayMap =
+            new TestBpfMap<>(S32.class, UidOwnerValue.class);
+    private final IBpfMap<S32, U8> mUidPermissionArrayMap = new TestBpfMap<>(S32.class, U8.class);
     private final IBpfMap<CookieTagMapKey, CookieTagMapValue> mCookieTagMap =
             spy(new TestBpfMap<>(CookieTagMapKey.class, CookieTagMapValue.class));
     private final IBpfMap<S32, U8> mDataSaverEnabledMap = new TestBpfMap<>(S32.class, U8.class);
     private final IBpfMap<IngressDiscardKey, IngressDiscardValue> mIngressDiscardMap =
             new TestBpfMap<>(IngressDiscardKey.class, IngressDiscardValue.class);
+    private final IBpfMap<S32, S64> mRulesGenerationMap = new TestBpfMap<>(S32.class, S64.class);
 
     @Before
     public void setUp() throws Exception {
@@ -167,10 +178,14 @@ public final class BpfNetMapsTest {
                 CURRENT_STATS_MAP_CONFIGURATION_KEY, new U32(STATS_SELECT_MAP_A));
         BpfNetMaps.setUidOwnerMapForTest(mUidOwnerMap);
         BpfNetMaps.setUidPermissionMapForTest(mUidPermissionMap);
+        BpfNetMaps.setUidOwnerArrayMapForTest(mUidOwnerArrayMap);
+        BpfNetMaps.setUidPermissionArrayMapForTest(mUidPermissionArrayMap);
         BpfNetMaps.setCookieTagMapForTest(mCookieTagMap);
         BpfNetMaps.setDataSaverEnabledMapForTest(mDataSaverEnabledMap);
         mDataSaverEnabledMap.updateEntry(DATA_SAVER_ENABLED_KEY, new U8(DATA_SAVER_DISABLED));
         BpfNetMaps.setIngressDiscardMapForTest(mIngressDiscardMap);
+        BpfNetMaps.setRulesGenerationMapForTest(mRulesGenerationMap);
+        mRulesGenerationMap.updateEntry(RULES_GENERATION_KEY, new S64(0));
         mBpfNetMaps = new BpfNetMaps(mContext, mNetd, mDeps);
     }
 
@@ -1234,6 +1249,84 @@ public final class BpfNetMapsTest {
         }
     }
 
+    private long getRulesGeneration() throws Exception {
+        return mRulesGenerationMap.getValue(RULES_GENERATION_KEY).val;
+    }
+
+    @Test
+    @IgnoreUpTo(Build.VERSION_CODES.S_V2)
+    public void testRulesGenerationChangesOnRuleWrites() throws Exception {
+        long generation = getRulesGeneration();
+
+        mBpfNetMaps.setDataSaverEnabled(true);
+        assertNotEquals(generation, getRulesGeneration());
+        generation = getRulesGeneration();
+
+        mBpfNetMaps.setChildChain(FIREWALL_CHAIN_DOZABLE, true /* enable */);
+        assertNotEquals(generation, getRulesGeneration());
+        generation = getRulesGeneration();
+
+        mBpfNetMaps.addNaughtyApp(TEST_UID);
+        assertNotEquals(generation, getRulesGeneration());
+        generation = getRulesGeneration();
+
+        mBpfNetMaps.removeNaughtyApp(TEST_UID);
+        assertNotEquals(generation, getRulesGeneration());
+    }
+
+    @Test
+    @IgnoreUpTo(Build.VERSION_CODES.S_V2)
+    public void testUidOwnerArrayMapMirrorsUidOwnerMap() throws Exception {
+        final int secondaryUserUid = 10 * UserHandle.PER_USER_RANGE + TEST_UID;
+        assertTrue(TEST_UID < UID_ARRAY_MAP_SIZE);
+        mBpfNetMaps.addNaughtyApp(TEST_UID);
+        mBpfNetMaps.addNaughtyApp(secondaryUserUid);
+        assertEquals(PENALTY_BOX_MATCH, mUidOwnerArrayMap.getValue(new S32(TEST_UID)).rule);
+        assertFalse(mUidOwnerArrayMap.containsKey(new S32(secondaryUserUid)));
+        checkUidOwnerValue(secondaryUserUid, NO_IIF, PENALTY_BOX_MATCH);
+
+        // The eBPF programs see an all zero array entry the same as a missing uid owner map entry.
+        mBpfNetMaps.removeNaughtyApp(TEST_UID);
+        assertFalse(mUidOwnerMap.containsKey(new S32(TEST_UID)));
+        final UidOwnerValue value = mUidOwnerArrayMap.getValue(new S32(TEST_UID));
+        assertEquals(0, value.iif);
+        assertEquals(0, value.rule);
+    }
+
+    @Test
+    @IgnoreUpTo(Build.VERSION_CODES.S_V2)
+    public void testUidOwnerArrayMapNotWrittenIfUidOwnerMapWriteFails() throws Exception {
+        final IBpfMap<S32, UidOwnerValue> uidOwnerMap =
+                spy(new TestBpfMap<>(S32.class, UidOwnerValue.class));
+        BpfNetMaps.setUidOwnerMapForTest(uidOwnerMap);
+        doThrow(new ErrnoException("", E2BIG)).when(uidOwnerMap).updateEntry(any(), any());
+
+        final ServiceSpecificException e = assertThrows(ServiceSpecificException.class,
+                () -> mBpfNetMaps.addNaughtyApp(TEST_UID));
+        assertEquals(E2BIG, e.errorCode);
+        assertFalse(uidOwnerMap.containsKey(new S32(TEST_UID)));
+        assertFalse(mUidOwnerArrayMap.containsKey(new S32(TEST_UID)));
+    }
+
+    @Test
+    @IgnoreUpTo(Build.VERSION_CODES.S_V2)
+    public void testUidPermissionArrayMapMirrorsUidPermissionMap() throws Exception {
+        final int appId0 = TEST_UIDS[0];
+        final int appId1 = TEST_UIDS[1];
+        mBpfNetMaps.setNetPermForUids(PERMISSION_NONE, new int[]{appId0});
+        mBpfNetMaps.setNetPermForUids(PERMISSION_UPDATE_DEVICE_STATS, new int[]{appId1});
+        assertEquals(PERMISSION_ARRAY_ENTRY,
+                mUidPermissionArrayMap.getValue(new S32(appId0)).val);
+        assertEquals(PERMISSION_UPDATE_DEVICE_STATS | PERMISSION_ARRAY_ENTRY,
+                mUidPermissionArrayMap.getValue(new S32(appId1)).val);
+
+        // Back to the default INTERNET permission, which is an unwritten (all zero) array entry.
+        mBpfNetMaps.setNetPermForUids(PERMISSION_INTERNET, TEST_UIDS);
+        assertEquals(0, mUidPermissionArrayMap.getValue(new S32(appId0)).val);
+        assertEquals(0, mUidPermissionArrayMap.getValue(new S32(appId1)).val);
+        assertTrue(mUidPermissionMap.isEmpty());
+    }
+
     @Test
     @IgnoreUpTo(Build.VERSION_CODES.S_V2)
     public void testSetIngressDiscardRule_V4address() throws Exception {
@@ -33,6 +33,7 @@ import static com.android.testutils.MiscAsserts.assertThrows;
 import static org.junit.Assert.assertEquals;
 import static org.junit.Assert.assertNotNull;
 import static org.junit.Assert.assertNull;
+import static org.junit.Assert.assertTrue;
 import static org.junit.Assert.fail;
 import static org.mockito.Mockito.argThat;
 import static org.mockito.Mockito.clearInvocations;
@@ -43,6 +44,7 @@ import static org.mockito.Mockito.spy;
 import static org.mockito.Mockito.verify;
 
 import android.annotation.NonNull;
+import android.annotation.Nullable;
 import android.net.INetd;
 import android.net.InetAddresses;
 import android.net.IpPrefix;
@@ -53,6 +55,7 @@ import androidx.test.filters.SmallTest;
 
 import com.android.internal.util.IndentingPrintWriter;
 import com.android.net.module.util.IBpfMap;
+import com.android.net.module.util.Struct.S32;
 import com.android.net.module.util.bpf.ClatEgress4Key;
 import com.android.net.module.util.bpf.ClatEgress4Value;
 import com.android.net.module.util.bpf.ClatIngress6Key;
@@ -110,6 +113,7 @@ public class ClatCoordinatorTest {
     private static final int TUN_FD = 534;
     private static final int RAW_SOCK_FD = 535;
     private static final int PACKET_SOCK_FD = 536;
+    private static final int STATS_FD = 537;
     private static final long RAW_SOCK_COOKIE = 27149;
     private static final ParcelFileDescriptor TUN_PFD = spy(new ParcelFileDescriptor(
             new FileDescriptor()));
@@ -117,6 +121,8 @@ public class ClatCoordinatorTest {
             new FileDescriptor()));
     private static final ParcelFileDescriptor PACKET_SOCK_PFD = spy(new ParcelFileDescriptor(
             new FileDescriptor()));
+    private static final ParcelFileDescriptor STATS_PFD = spy(new ParcelFileDescriptor(
+            new FileDescriptor()));
 
     private static final String EGRESS_PROG_PATH =
             "/sys/fs/bpf/net_shared/prog_clatd_schedcls_egress4_clat_rawip";
@@ -140,6 +146,7 @@ public class ClatCoordinatorTest {
             spy(new TestBpfMap<>(ClatEgress4Key.class, ClatEgress4Value.class));
     private final TestBpfMap<CookieTagMapKey, CookieTagMapValue> mCookieTagMap =
             spy(new TestBpfMap<>(CookieTagMapKey.class, CookieTagMapValue.class));
+    private final TestBpfMap<S32, S32> mErrorMap = new TestBpfMap<>(S32.class, S32.class);
 
     @Mock private INetd mNetd;
     @Spy private TestDependencies mDeps = new TestDependencies();
@@ -170,6 +177,8 @@ public class ClatCoordinatorTest {
                     return RAW_SOCK_PFD;
                 case PACKET_SOCK_FD:
                     return PACKET_SOCK_PFD;
+                case STATS_FD:
+                    return STATS_PFD;
                 default:
                     fail("unsupported arg: " + fd);
                     return null;
@@ -294,18 +303,20 @@ public class ClatCoordinatorTest {
         @Override
         public int startClatd(@NonNull FileDescriptor tunfd, @NonNull FileDescriptor readsock6,
                 @NonNull FileDescriptor writesock6, @NonNull String iface, @NonNull String pfx96,
-                @NonNull String v4, @NonNull String v6) throws IOException {
+                @NonNull String v4, @NonNull String v6, @Nullable FileDescriptor stats)
+                throws IOException {
             if (Objects.equals(TUN_PFD.getFileDescriptor(), tunfd)
                     && Objects.equals(PACKET_SOCK_PFD.getFileDescriptor(), readsock6)
                     && Objects.equals(RAW_SOCK_PFD.getFileDescriptor(), writesock6)
                     && BASE_IFACE.equals(iface)
                     && NAT64_PREFIX_STRING.equals(pfx96)
                     && XLAT_LOCAL_IPV4ADDR_STRING.equals(v4)
-                    && XLAT_LOCAL_IPV6ADDR_STRING.equals(v6)) {
+                    && XLAT_LOCAL_IPV6ADDR_STRING.equals(v6)
+                    && Objects.equals(STATS_PFD.getFileDescriptor(), stats)) {
                 return CLATD_PID;
             }
             fail("unsupported args: " + tunfd + ", " + readsock6 + ", " + writesock6 + ", "
-                    + ", " + iface + ", " + v4 + ", " + v6);
+                    + ", " + iface + ", " + v4 + ", " + v6 + ", " + stats);
             return -1;
         }
 
@@ -344,6 +355,40 @@ public class ClatCoordinatorTest {
             return mCookieTagMap;
         }
 
+        /** Get error counter BPF map. */
+        @Override
+        public IBpfMap<S32, S32> getBpfErrorMap() {
+            return mErrorMap;
+        }
+
+        /** Get the names of the BPF error counters, indexed by counter. */
+        @Override
+        public String[] getBpfCounterNames() {
+            return new String[] {"FRAG_UNSUPPORTED_KVER", "SHORT_FRAG_HEADER"};
+        }
+
+        /** Create the shared memory for the clatd counters. */
+        @Override
+        public int createClatdStats() throws IOException {
+            return STATS_FD;
+        }
+
+        /** Read the clatd counters from their shared memory. */
+        @Override
+        public long[] getClatdCounters(@NonNull FileDescriptor stats) throws IOException {
+            if (Objects.equals(STATS_PFD.getFileDescriptor(), stats)) {
+                return new long[] {0, 0, 3};
+            }
+            fail("unsupported arg: " + stats);
+            return null;
+        }
+
+        /** Get the names of the clatd counters, indexed by counter. */
+        @Override
+        public String[] getClatdCounterNames() {
+            return new String[] {"PACKETS_4_TO_6", "BYTES_4_TO_6", "PACKETS_6_TO_4"};
+        }
+
         /** Checks if the network interface uses an ethernet L2 header. */
         public boolean isEthernet(String iface) throws IOException {
             if (BASE_IFACE.equals(iface)) return true;
@@ -399,7 +444,7 @@ public class ClatCoordinatorTest {
     public void testStartStopClatd() throws Exception {
         final ClatCoordinator coordinator = makeClatCoordinator();
         final InOrder inOrder = inOrder(mNetd, mDeps, mIngressMap, mEgressMap, mCookieTagMap);
-        clearInvocations(mNetd, mDeps, mIngressMap, mEgressMap, mCookieTagMap);
+        clearInvocations(mNetd, mDeps, mIngressMap, mEgressMap, mCookieTagMap, STATS_PFD);
 
         // [1] Start clatd.
         final String addr6For464xlat = coordinator.clatStart(BASE_IFACE, NETID, NAT64_IP_PREFIX);
@@ -450,12 +495,15 @@ public class ClatCoordinatorTest {
                 eq(XLAT_LOCAL_IPV6ADDR_STRING), eq(BASE_IFINDEX));
 
         // Start clatd.
+        inOrder.verify(mDeps).createClatdStats();
+        inOrder.verify(mDeps).adoptFd(eq(STATS_FD));
         inOrder.verify(mDeps).startClatd(
                 argThat(fd -> Objects.equals(TUN_PFD.getFileDescriptor(), fd)),
                 argThat(fd -> Objects.equals(PACKET_SOCK_PFD.getFileDescriptor(), fd)),
                 argThat(fd -> Objects.equals(RAW_SOCK_PFD.getFileDescriptor(), fd)),
                 eq(BASE_IFACE), eq(NAT64_PREFIX_STRING),
-                eq(XLAT_LOCAL_IPV4ADDR_STRING), eq(XLAT_LOCAL_IPV6ADDR_STRING));
+                eq(XLAT_LOCAL_IPV4ADDR_STRING), eq(XLAT_LOCAL_IPV6ADDR_STRING),
+                argThat(fd -> Objects.equals(STATS_PFD.getFileDescriptor(), fd)));
         inOrder.verify(mEgressMap).insertEntry(eq(EGRESS_KEY), eq(EGRESS_VALUE));
         inOrder.verify(mIngressMap).insertEntry(eq(INGRESS_KEY), eq(INGRESS_VALUE));
         inOrder.verify(mDeps).tcQdiscAddDevClsact(eq(STACKED_IFINDEX));
@@ -480,6 +528,7 @@ public class ClatCoordinatorTest {
         inOrder.verify(mIngressMap).deleteEntry(eq(INGRESS_KEY));
         inOrder.verify(mDeps).stopClatd(eq(CLATD_PID));
         inOrder.verify(mCookieTagMap).deleteEntry(eq(COOKIE_TAG_KEY));
+        verify(STATS_PFD).close();
         assertNull(coordinator.getClatdTrackerForTesting());
         inOrder.verifyNoMoreInteractions();
 
@@ -514,14 +563,17 @@ public class ClatCoordinatorTest {
         assertEquals(1500, ClatCoordinator.adjustMtu(CLAT_MAX_MTU + 1 /* over maximum mtu */));
     }
 
-    private void verifyDump(final ClatCoordinator coordinator, boolean clatStarted) {
+    private void verifyDump(final ClatCoordinator coordinator, boolean clatStarted)
+            throws Exception {
+        mErrorMap.insertOrReplaceEntry(new S32(0), new S32(0));
+        mErrorMap.insertOrReplaceEntry(new S32(1), new S32(7));
         final StringWriter stringWriter = new StringWriter();
         final IndentingPrintWriter ipw = new IndentingPrintWriter(stringWriter, " ");
         coordinator.dump(ipw);
 
         final String[] dumpStrings = stringWriter.toString().split("\n");
         if (clatStarted) {
-            assertEquals(6, dumpStrings.length);
+            assertEquals(11, dumpStrings.length);
             assertEquals("CLAT tracker: iface: test0 (1000), v4iface: v4-test0 (1001), "
                     + "v4: /192.0.0.46, v6: /2001:db8:0:b11::464, pfx96: /64:ff9b::, "
                     + "pid: 10483, cookie: 27149", dumpStrings[0].trim());
@@ -534,6 +586,12 @@ public class ClatCoordinatorTest {
                     dumpStrings[4].trim());
             assertEquals("1001 /192.0.0.46 -> /2001:db8:0:b11::464 /64:ff9b::/96 1000 ether",
                     dumpStrings[5].trim());
+            assertEquals("BPF ingress6 punt/drop counters:", dumpStrings[6].trim());
+            assertEquals("SHORT_FRAG_HEADER: 7", dumpStrings[7].trim());
+            assertEquals("clatd counters:", dumpStrings[8].trim());
+            assertEquals("PACKETS_6_TO_4: 3", dumpStrings[9].trim());
+            assertTrue(dumpStrings[10].trim().matches("Start latency: \\d+us \\(ipv4: \\d+us, "
+                    + "ipv6: \\d+us, tun: \\d+us, sockets: \\d+us, spawn: \\d+us, bpf: \\d+us\\)"));
         } else {
             assertEquals(1, dumpStrings.length);
             assertEquals("<not started>", dumpStrings[0].trim());
@@ -704,8 +762,8 @@ public class ClatCoordinatorTest {
             @Override
             public int startClatd(@NonNull FileDescriptor tunfd, @NonNull FileDescriptor readsock6,
                     @NonNull FileDescriptor writesock6, @NonNull String iface,
-                    @NonNull String pfx96, @NonNull String v4, @NonNull String v6)
-                    throws IOException {
+                    @NonNull String pfx96, @NonNull String v4, @NonNull String v6,
+                    @Nullable FileDescriptor stats) throws IOException {
                 throw new IOException();
             }
         }